@@ -1,80 +1,165 @@
-
 #ifndef _CIRCULAR_BUFFER_H_INCLUDED_
 #define _CIRCULAR_BUFFER_H_INCLUDED_
 
-#include <iostream>
-
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
-
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Lock-free single-producer single-consumer ring buffer.
+ * @details
+ * The capacity is rounded up to a power of two, and the head and tail
+ * are free running counters masked on access. The head is only written
+ * by the producer thread, the tail only by the consumer thread; items
+ * are published by the release store of the head.
+ *
+ * The buffer is used either as a bounded queue (\ref push fails when the
+ * buffer is full), or as a log of the most recent items (\ref put
+ * overwrites the oldest item). In the second mode the consumer may race
+ * with the producer overwriting the item being read: the overwrites are
+ * announced before the slot is written, and \ref pop and \ref snapshot
+ * discard the items overwritten while they were read. Logged items must
+ * be trivially copyable for this reason.
+ */
 template <class T>
 class circular_buffer
 {
 public:
     circular_buffer(size_t size)
-        : _head(0), _tail(0), _size(size),
-          _buf(std::unique_ptr<T[]>(new T[size]))
+        : _mask(capacity_for(size) - 1),
+          _buf(std::unique_ptr<T[]>(new T[_mask + 1]))
     {}
 
     ~circular_buffer() {}
 
-    void reset(void) {
-        _head = _tail = 0;
+    size_t capacity(void) const {
+        return _mask + 1;
+    }
+
+    /** Number of buffered items, exact from the consumer thread only. */
+    size_t length(void) const {
+        size_t head = _head.load(std::memory_order_acquire);
+        return head - oldest(head);
     }
 
-    bool empty(void) {
-        return _head == _tail;
+    bool empty(void) const {
+        return length() == 0;
     }
 
-    bool full(void) {
-        return (_head + 1) % _size == _tail;
+    bool full(void) const {
+        return length() == capacity();
     }
 
-    size_t length(void) const {
-        return ((_head + _size) - _tail) % _size;
+    /** Producer: append an item, overwriting the oldest if full. */
+    void put(T const &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        _write.store(head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _buf[head & _mask] = item;
+        _head.store(head + 1, std::memory_order_release);
     }
 
-    void put(T item)
+    /**
+     * @brief Producer: append an item, return false if the buffer is full.
+     *  The item is left untouched in this case.
+     */
+    template <class U>
+    bool push(U &&item)
     {
-        _buf[_head] = item;
-        _head = (_head + 1) % _size;
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) > _mask)
+            return false;
 
-        if (_head == _tail)
-            _tail = (_tail + 1) % _size;
+        _buf[head & _mask] = std::forward<U>(item);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
     }
 
+    /** Consumer: remove the oldest item, return false if empty. */
+    bool pop(T *item)
+    {
+        for (;;) {
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t tail = oldest(head);
+            if (tail == head)
+                return false;
+
+            *item = std::move(_buf[tail & _mask]);
+            if (!overwritten(tail)) {
+                _tail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    /** Consumer: remove the oldest item, T() if empty. */
     T get(void)
     {
-        if (empty())
-            return T();
+        T item = T();
+        pop(&item);
+        return item;
+    }
 
-        T ret = _buf[_tail];
-        _tail = (_tail + 1) % _size;
-        return ret;
+    /** Consumer: discard the buffered items. */
+    void reset(void) {
+        _tail.store(_head.load(std::memory_order_acquire),
+                    std::memory_order_release);
     }
 
-    T peek_front(size_t at) const
+    /**
+     * @brief Consumer: copy the \p count most recent items, oldest first,
+     *  without removing them.
+     */
+    std::vector<T> snapshot(size_t count = SIZE_MAX) const
     {
-        if (at >= length())
-            throw std::out_of_range("peek out of bound access");
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t start = head - std::min(count, head - oldest(head));
+        std::vector<T> items;
+        items.reserve(head - start);
+        for (size_t index = start; index < head; index++)
+            items.push_back(_buf[index & _mask]);
+
+        // Drop the items overwritten during the copy.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        size_t write = _write.load(std::memory_order_relaxed);
+        if (write > start + capacity())
+            items.erase(items.begin(), items.begin() +
+                std::min(write - start - capacity(), items.size()));
+        return items;
+    }
 
-        size_t offset = (_head + _size - at - 1) % _size;
-        return _buf[offset];
+private:
+    static size_t capacity_for(size_t size) {
+        size_t capacity = 1;
+        while (capacity < size)
+            capacity <<= 1;
+        return capacity;
     }
 
-    T peek_back(size_t at) const
-    {
-        if (at >= length())
-            throw std::out_of_range("peek out of bound access");
+    /// Index of the oldest buffered item, the tail unless overwritten.
+    size_t oldest(size_t head) const {
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return head - tail > _mask ? head - _mask - 1 : tail;
+    }
 
-        size_t offset = (_tail + at) % _size;
-        return _buf[offset];
+    /// Whether the item \p index read from the buffer was overwritten.
+    bool overwritten(size_t index) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _write.load(std::memory_order_relaxed) > index + capacity();
     }
 
-private:
-    size_t _head = 0;
-    size_t _tail = 0;
-    size_t _size;
+    /// Producer side: the head publishes the items, the write counter
+    /// announces the overwrites of \ref put.
+    alignas(64) std::atomic<size_t> _head{0};
+    std::atomic<size_t> _write{0};
+    /// Consumer side.
+    alignas(64) std::atomic<size_t> _tail{0};
+    size_t _mask;
     std::unique_ptr<T[]> _buf;
 };
 
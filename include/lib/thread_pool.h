@@ -0,0 +1,151 @@
+
+#ifndef _THREAD_POOL_H_INCLUDED_
+#define _THREAD_POOL_H_INCLUDED_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Work-stealing thread pool.
+ * @details
+ * Each worker owns a task queue. Submitted tasks are distributed round
+ * robin over the queues; a worker runs the tasks of its own queue most
+ * recently queued first, and when it runs out steals the oldest task of
+ * another queue. Long tasks therefore do not hold back the tasks queued
+ * behind them while other workers are idle.
+ */
+class thread_pool
+{
+public:
+    typedef std::function<void()> task;
+
+    /** Create a pool of \p size workers, or one per host thread if 0. */
+    thread_pool(unsigned size = 0)
+        : _next(0), _queued(0), _pending(0), _stopped(false)
+    {
+        if (size == 0) {
+            size = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        for (unsigned nr = 0; nr < size; nr++) {
+            _queues.emplace_back(new queue());
+        }
+        for (unsigned nr = 0; nr < size; nr++) {
+            _threads.emplace_back(&thread_pool::worker, this, nr);
+        }
+    }
+
+    /** Wait for the submitted tasks to complete and stop the workers. */
+    ~thread_pool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _wakeup.notify_all();
+        for (std::thread &thread : _threads) {
+            thread.join();
+        }
+    }
+
+    unsigned size(void) const {
+        return _queues.size();
+    }
+
+    void submit(task task) {
+        unsigned index;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            index = _next++ % _queues.size();
+        }
+        queue &queue = *_queues[index];
+        {
+            // The task is queued before it is counted, so that a
+            // worker claiming it always finds it.
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queued++;
+            _pending++;
+        }
+        _wakeup.notify_one();
+    }
+
+    /** Wait until all the submitted tasks have completed. */
+    void wait(void) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this] { return _pending == 0; });
+    }
+
+private:
+    struct queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    /** Take a task from the queue of the worker \p self, or steal one. */
+    bool take(unsigned self, task *task) {
+        for (unsigned nr = 0; nr < _queues.size(); nr++) {
+            queue &queue = *_queues[(self + nr) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (nr == 0) {
+                *task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                *task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void worker(unsigned self) {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wakeup.wait(lock, [this] { return _queued > 0 || _stopped; });
+                if (_queued == 0) {
+                    return;
+                }
+                // Claim a task: another worker may take the one that
+                // woke this worker up, but a queued task remains.
+                _queued--;
+            }
+
+            task task;
+            while (!take(self, &task)) {
+                std::this_thread::yield();
+            }
+            task();
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_pending == 0) {
+                _idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<queue>> _queues;
+    std::vector<std::thread> _threads;
+    unsigned _next;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _idle;
+    size_t _queued;     /**< Tasks not yet claimed by a worker */
+    size_t _pending;    /**< Tasks not yet completed */
+    bool _stopped;
+};
+
+#endif /* _THREAD_POOL_H_INCLUDED_ */
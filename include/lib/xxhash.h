@@ -0,0 +1,150 @@
+
+#ifndef _XXHASH_H_INCLUDED_
+#define _XXHASH_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Streaming implementation of the XXH64 non-cryptographic hash.
+ * @details
+ * The output is bit-identical to the reference implementation
+ * (`xxhsum -H1`), which lets hashes logged by the emulator be checked
+ * against dumps processed with external tools. Input is consumed in
+ * 32 byte stripes over four independent lanes, which the compiler
+ * schedules in parallel; throughput is close to memory bandwidth.
+ */
+class xxh64
+{
+public:
+    xxh64(uint64_t seed = 0) { reset(seed); }
+    ~xxh64() {}
+
+    void reset(uint64_t seed = 0) {
+        _lane[0] = seed + prime1 + prime2;
+        _lane[1] = seed + prime2;
+        _lane[2] = seed;
+        _lane[3] = seed - prime1;
+        _seed = seed;
+        _total_len = 0;
+        _buf_len = 0;
+    }
+
+    void update(void const *input, size_t len) {
+        uint8_t const *p = (uint8_t const *)input;
+        uint8_t const *end = p + len;
+        _total_len += len;
+
+        if (_buf_len + len < 32) {
+            memcpy(_buf + _buf_len, p, len);
+            _buf_len += len;
+            return;
+        }
+        if (_buf_len > 0) {
+            size_t fill = 32 - _buf_len;
+            memcpy(_buf + _buf_len, p, fill);
+            stripe(_buf);
+            p += fill;
+            _buf_len = 0;
+        }
+        while (p + 32 <= end) {
+            stripe(p);
+            p += 32;
+        }
+        if (p < end) {
+            _buf_len = end - p;
+            memcpy(_buf, p, _buf_len);
+        }
+    }
+
+    uint64_t digest(void) const {
+        uint64_t h;
+        if (_total_len >= 32) {
+            h = rotl(_lane[0], 1) + rotl(_lane[1], 7) +
+                rotl(_lane[2], 12) + rotl(_lane[3], 18);
+            h = merge(h, _lane[0]);
+            h = merge(h, _lane[1]);
+            h = merge(h, _lane[2]);
+            h = merge(h, _lane[3]);
+        } else {
+            h = _seed + prime5;
+        }
+        h += _total_len;
+
+        uint8_t const *p = _buf;
+        size_t len = _buf_len;
+        for (; len >= 8; p += 8, len -= 8) {
+            h ^= round(0, load_u64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if (len >= 4) {
+            h ^= (uint64_t)load_u32(p) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4; len -= 4;
+        }
+        for (; len > 0; p++, len--) {
+            h ^= (uint64_t)*p * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33; h *= prime2;
+        h ^= h >> 29; h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    /** One-shot hash of a contiguous buffer. */
+    static uint64_t hash(void const *input, size_t len, uint64_t seed = 0) {
+        xxh64 state(seed);
+        state.update(input, len);
+        return state.digest();
+    }
+
+private:
+    static constexpr uint64_t prime1 = UINT64_C(0x9E3779B185EBCA87);
+    static constexpr uint64_t prime2 = UINT64_C(0xC2B2AE3D27D4EB4F);
+    static constexpr uint64_t prime3 = UINT64_C(0x165667B19E3779F9);
+    static constexpr uint64_t prime4 = UINT64_C(0x85EBCA77C2B2AE63);
+    static constexpr uint64_t prime5 = UINT64_C(0x27D4EB2F165667C5);
+
+    uint64_t _lane[4];
+    uint64_t _seed;
+    uint64_t _total_len;
+    uint8_t _buf[32];
+    size_t _buf_len;
+
+    static inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // The machine is little endian, as is the hash input
+    // stream definition: plain unaligned loads are correct.
+    static inline uint64_t load_u64(uint8_t const *p) {
+        uint64_t v; memcpy(&v, p, sizeof(v)); return v;
+    }
+
+    static inline uint32_t load_u32(uint8_t const *p) {
+        uint32_t v; memcpy(&v, p, sizeof(v)); return v;
+    }
+
+    static inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = rotl(acc, 31);
+        return acc * prime1;
+    }
+
+    static inline uint64_t merge(uint64_t acc, uint64_t lane) {
+        acc ^= round(0, lane);
+        return acc * prime1 + prime4;
+    }
+
+    inline void stripe(uint8_t const *p) {
+        _lane[0] = round(_lane[0], load_u64(p + 0));
+        _lane[1] = round(_lane[1], load_u64(p + 8));
+        _lane[2] = round(_lane[2], load_u64(p + 16));
+        _lane[3] = round(_lane[3], load_u64(p + 24));
+    }
+};
+
+#endif /* _XXHASH_H_INCLUDED_ */
@@ -0,0 +1,68 @@
+
+#ifndef _BOOT_H_INCLUDED_
+#define _BOOT_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Fast boot and side-loading of PS-X EXE executables.
+ * @details
+ * The BIOS is run until its kernel is initialised and it jumps to the
+ * shell entry point (SHELL_ENTRY). When fast boot is enabled, the jump
+ * is intercepted: the boot executable named in SYSTEM.CNF is located in
+ * the ISO9660 file system of the disc, loaded into RAM, and executed in
+ * place of the shell (logo, intro and license check). A side-loaded
+ * executable replaces the disc executable.
+ *
+ * The machine state at the shell entry point depends only on the BIOS
+ * image. It can be cached in a snapshot named after the SHA-256 of the
+ * BIOS, and restored on reset to skip the kernel initialisation.
+ */
+namespace psx::boot {
+
+/// Address of the BIOS shell, entered once the kernel is initialised.
+#define SHELL_ENTRY         UINT32_C(0x80030000)
+
+/** Enable or disable fast boot from the disc. */
+void set_fast_boot(bool enable);
+
+/**
+ * @brief Side-load the executable \p path at the shell entry point.
+ * @return 0 on success, -1 if the file cannot be read or is not a
+ *  PS-X EXE executable.
+ */
+int set_exe(std::string const &path);
+
+/**
+ * @brief Cache the post-init BIOS snapshot in the directory \p dir.
+ *  The snapshot is saved on the first jump to SHELL_ENTRY, and restored
+ *  on later machine resets.
+ */
+void set_snapshot_cache(std::string const &dir);
+
+/** Return true if the next jump to SHELL_ENTRY must be intercepted. */
+bool enabled(void);
+
+/**
+ * @brief Re-arm the shell entry hook, on machine reset. Restores the
+ *  cached BIOS snapshot if one exists.
+ */
+void reset(void);
+
+/**
+ * @brief Shell entry hook, called from the interpreter on the jump to
+ *  SHELL_ENTRY. Loads the boot executable and updates pc, gp, sp and fp.
+ *  The machine is left untouched if no executable can be loaded,
+ *  and the BIOS shell runs as usual.
+ */
+void shell_entry(void);
+
+/** Per-machine boot configuration, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::boot */
+
+#endif /* _BOOT_H_INCLUDED_ */
@@ -2,12 +2,59 @@
 #ifndef _DEBUGGER_H_INCLUDED_
 #define _DEBUGGER_H_INCLUDED_
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <fmt/format.h>
 #include <fmt/color.h>
 
 #include <lib/circular_buffer.h>
 
+/*
+ * Most verbose log level compiled in: 0 none, 1 error, 2 warn, 3 info,
+ * 4 debug. Logs above the level of their label are removed at compile
+ * time; LOG_LEVEL_<label> overrides LOG_LEVEL for one label.
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 4
+#endif
+#ifndef LOG_LEVEL_CPU
+#define LOG_LEVEL_CPU LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_COP0
+#define LOG_LEVEL_COP0 LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_COP2
+#define LOG_LEVEL_COP2 LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MC
+#define LOG_LEVEL_MC LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_JC
+#define LOG_LEVEL_JC LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_IC
+#define LOG_LEVEL_IC LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_Timer
+#define LOG_LEVEL_Timer LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_DMA
+#define LOG_LEVEL_DMA LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_CDROM
+#define LOG_LEVEL_CDROM LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_GPU
+#define LOG_LEVEL_GPU LOG_LEVEL
+#endif
+
 class Debugger {
 public:
     Debugger();
@@ -41,6 +88,8 @@ public:
     /** Type of execution trace entries. */
     typedef std::pair<uint32_t, uint32_t> TraceEntry;
 
+    /** Most recent instructions of the attached machine, logged by the
+     * interpreter thread and read by the GUI thread. */
     circular_buffer<TraceEntry> cpu_trace;
     std::string config_file;
 
@@ -157,6 +206,20 @@ extern Debugger debugger;
 extern char const *LabelName[Debugger::Label::LabelCount];
 extern fmt::text_style VerbosityStyle[5];
 
+/** Most verbose level compiled in, per label. */
+static constexpr Debugger::Verbosity MaxVerbosity[Debugger::LabelCount] = {
+    (Debugger::Verbosity)LOG_LEVEL_CPU,
+    (Debugger::Verbosity)LOG_LEVEL_COP0,
+    (Debugger::Verbosity)LOG_LEVEL_COP2,
+    (Debugger::Verbosity)LOG_LEVEL_MC,
+    (Debugger::Verbosity)LOG_LEVEL_JC,
+    (Debugger::Verbosity)LOG_LEVEL_IC,
+    (Debugger::Verbosity)LOG_LEVEL_Timer,
+    (Debugger::Verbosity)LOG_LEVEL_DMA,
+    (Debugger::Verbosity)LOG_LEVEL_CDROM,
+    (Debugger::Verbosity)LOG_LEVEL_GPU,
+};
+
 template <Debugger::Verbosity verb>
 static void vlog(Debugger::Label label, const char* format, fmt::format_args args) {
     if (debugger.verbosity[label] >= verb) {
@@ -166,24 +229,142 @@ static void vlog(Debugger::Label label, const char* format, fmt::format_args arg
     }
 }
 
+/**
+ * @brief Log message captured by the asynchronous logger.
+ * @details
+ * The arguments are copied raw into the payload: strings as a u16 length
+ * followed by the characters, other arguments as their object
+ * representation. Messages are formatted by the logger thread with
+ * \p decode, instantiated for the argument types of the call site.
+ */
+#define LOG_PAYLOAD_SIZE    96
+
+struct log_record {
+    uint64_t timestamp;
+    char const *format;
+    std::string (*decode)(char const *format, uint8_t const *payload);
+    Debugger::Label label;
+    Debugger::Verbosity verbosity;
+    uint8_t payload[LOG_PAYLOAD_SIZE];
+};
+
+/** Set while the asynchronous logger is running. */
+extern std::atomic_bool logger_running;
+
+/**
+ * @brief Start the asynchronous logger: enabled logs are queued to a
+ *  background thread instead of being printed by the calling thread.
+ *  Logs with arguments that cannot be captured are still printed
+ *  synchronously.
+ */
+void start_logger(void);
+
+/** Print the queued logs and stop the asynchronous logger. */
+void stop_logger(void);
+
+/** Queue a log record from the calling thread. */
+void post(log_record const &record);
+
+template <typename T>
+constexpr bool log_string = std::is_convertible<T, std::string_view>::value;
+
+template <typename T>
+constexpr bool log_capturable = log_string<T> || std::is_trivially_copyable<T>::value;
+
+template <typename T>
+using log_stored = std::conditional_t<log_string<T>, std::string_view, T>;
+
+template <typename T>
+static size_t log_size(T const &arg) {
+    if constexpr (log_string<T>) {
+        return 2 + std::min<size_t>(std::string_view(arg).size(), UINT16_MAX);
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <typename T>
+static void log_store(uint8_t *&ptr, T const &arg) {
+    if constexpr (log_string<T>) {
+        std::string_view str(arg);
+        uint16_t len = std::min<size_t>(str.size(), UINT16_MAX);
+        memcpy(ptr, &len, 2);
+        memcpy(ptr + 2, str.data(), len);
+        ptr += 2 + len;
+    } else {
+        memcpy(ptr, &arg, sizeof(T));
+        ptr += sizeof(T);
+    }
+}
+
+template <typename T>
+static log_stored<T> log_load(uint8_t const *&ptr) {
+    if constexpr (log_string<T>) {
+        uint16_t len;
+        memcpy(&len, ptr, 2);
+        ptr += 2 + len;
+        return std::string_view((char const *)ptr - len, len);
+    } else {
+        alignas(T) uint8_t value[sizeof(T)];
+        memcpy(value, ptr, sizeof(T));
+        ptr += sizeof(T);
+        return *(T *)value;
+    }
+}
+
+template <typename... Args>
+static std::string log_decode(char const *format, uint8_t const *payload) {
+    // The braced initializer loads the arguments in order.
+    std::tuple<log_stored<Args>...> values{ log_load<Args>(payload)... };
+    return std::apply([format](auto const &... values) {
+        return fmt::vformat(format, fmt::make_format_args(values...));
+    }, values);
+}
+
+template <Debugger::Verbosity verb, typename... Args>
+static void log(Debugger::Label label, const char* format, const Args & ... args) {
+    // Constant folded for the constant labels of the call sites.
+    if (verb > MaxVerbosity[label] || debugger.verbosity[label] < verb) {
+        return;
+    }
+    if constexpr ((log_capturable<std::decay_t<Args>> && ...)) {
+        if (logger_running.load(std::memory_order_relaxed) &&
+            (size_t(0) + ... + log_size<std::decay_t<Args>>(args)) <=
+                LOG_PAYLOAD_SIZE) {
+            log_record record;
+            record.timestamp = std::chrono::steady_clock::now()
+                .time_since_epoch().count();
+            record.format = format;
+            record.decode = log_decode<std::decay_t<Args>...>;
+            record.label = label;
+            record.verbosity = verb;
+            uint8_t *ptr = record.payload;
+            (log_store<std::decay_t<Args>>(ptr, args), ...);
+            post(record);
+            return;
+        }
+    }
+    vlog<verb>(label, format, fmt::make_format_args(args...));
+}
+
 template <typename... Args>
 static void debug(Debugger::Label label, const char* format, const Args & ... args) {
-    vlog<Debugger::Verbosity::Debug>(label, format, fmt::make_format_args(args...));
+    log<Debugger::Verbosity::Debug>(label, format, args...);
 }
 
 template <typename... Args>
 static void info(Debugger::Label label, const char* format, const Args & ... args) {
-    vlog<Debugger::Verbosity::Info>(label, format, fmt::make_format_args(args...));
+    log<Debugger::Verbosity::Info>(label, format, args...);
 }
 
 template <typename... Args>
 static void warn(Debugger::Label label, const char* format, const Args & ... args) {
-    vlog<Debugger::Verbosity::Warn>(label, format, fmt::make_format_args(args...));
+    log<Debugger::Verbosity::Warn>(label, format, args...);
 }
 
 template <typename... Args>
 static void error(Debugger::Label label, const char* format, const Args & ... args) {
-    vlog<Debugger::Verbosity::Error>(label, format, fmt::make_format_args(args...));
+    log<Debugger::Verbosity::Error>(label, format, args...);
 }
 
 /* Called for undefined behaviour, can be configured to hard fail the
@@ -0,0 +1,147 @@
+
+#ifndef _DISC_H_INCLUDED_
+#define _DISC_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Sector level access to the disc image.
+ * @details
+ * Three image formats are supported:
+ *  - flat images: a single data track, raw (2352 byte sectors)
+ *    or cooked (2048 byte sectors);
+ *  - CUE sheets referencing one or more BIN files, with data and
+ *    audio tracks, pregaps and indexes;
+ *  - compressed containers, see below.
+ *
+ * Sectors are addressed by LBA, where LBA 0 is the absolute position
+ * 00:02:00, i.e. the first sector after the track 1 pregap.
+ *
+ * Sectors are served from an LRU sector cache. A background thread reads
+ * ahead of the position last requested by the drive (Setloc, seeks and
+ * sequential reads) and keeps a window of upcoming sectors in the cache,
+ * so that the emulation thread only waits on image I/O on a cold miss:
+ * a sector requested before the prefetcher could load it.
+ *
+ * The compressed container stores every sector of the disc in raw
+ * format, grouped in hunks of N sectors compressed independently with
+ * zlib. All fields are little endian:
+ *
+ *      header:
+ *          u32 magic           "PSXZ"
+ *          u32 version         1
+ *          u32 hunk_sectors    N
+ *          u32 sector_count
+ *          u32 track_count
+ *      track (track_count entries):
+ *          u8  number
+ *          u8  audio
+ *          u16 reserved
+ *          u32 first           first sector, including the pregap
+ *          u32 start           index 01
+ *          u32 end             one past the last sector
+ *      hunk index:
+ *          u64 offset[hunk_count + 1]
+ *                              hunk i is stored in [offset[i], offset[i+1])
+ *
+ * Random access decompresses a single hunk, and the last few
+ * decompressed hunks are kept in a small cache.
+ */
+namespace psx::disc {
+
+/// Size of a raw sector, including the sync pattern, header, subheader
+/// and error correction codes.
+#define RAW_SECTOR_SIZE     2352
+/// Size of the user data in a Mode2 Form1 sector.
+#define DATA_SECTOR_SIZE    2048
+
+#define DISC_MAGIC          UINT32_C(0x5a585350)
+#define DISC_VERSION        UINT32_C(1)
+
+struct stats {
+    uint64_t reads;         ///< Sectors requested by the drive.
+    uint64_t hits;          ///< Requests served from the cache.
+    uint64_t cold_misses;   ///< Requests that waited for image I/O.
+    uint64_t prefetched;    ///< Sectors loaded by the prefetch thread.
+};
+
+struct track_info {
+    unsigned number;
+    bool audio;
+    uint32_t first;         ///< First sector, including the pregap.
+    uint32_t start;         ///< Index 01.
+    uint32_t end;           ///< One past the last sector.
+};
+
+/**
+ * @brief Open the disc image \p path. The format is selected from the
+ *  file extension (.cue) or contents (compressed container magic).
+ *  The prefetch thread is stopped, see \ref close.
+ * @return 0 on success, -1 if the image or one of the files it
+ *  references cannot be opened or parsed.
+ */
+int open(std::string const &path);
+
+/** Stop the prefetch thread and release the disc image. The caller
+ * restarts the prefetch thread with \ref start. */
+void close(void);
+
+/**
+ * @brief Write the loaded disc to \p path as a compressed container,
+ *  with hunks of \p hunk_sectors sectors.
+ * @return 0 on success, -1 on error.
+ */
+int compress(std::string const &path, unsigned hunk_sectors);
+
+/**
+ * @brief Start the prefetch thread.
+ * @param window  Number of sectors read ahead of the drive position.
+ *  The cache holds at least four windows.
+ */
+void start(unsigned window);
+
+/** Stop the prefetch thread and release the sector cache. */
+void stop(void);
+
+/** Number of sectors in the loaded image, 0 if no disc is loaded. */
+uint32_t sector_count(void);
+
+/**
+ * @brief Return the sector data of the loaded image, if it is stored
+ *  in a single uncompressed file (flat image, or CUE sheet referencing
+ *  a single file). The mapping is owned by the disc module.
+ * @return false if the image has several files or is compressed.
+ */
+bool raw_image(uint8_t const **data, size_t *size);
+
+/** Number of tracks in the loaded image. */
+unsigned track_count(void);
+
+/** Return the description of the track \p number (starting from 1). */
+bool get_track(unsigned number, struct track_info *info);
+
+/** Return the description of the track containing the sector \p lba. */
+bool find_track(uint32_t lba, struct track_info *info);
+
+/**
+ * @brief Copy the sector at \p lba into \p sector in raw format.
+ *  The sync pattern, header and subheader are synthesized for cooked
+ *  sectors, pregap sectors missing from the image are zeroed.
+ * @return false if \p lba is past the end of the disc.
+ */
+bool read_sector(uint32_t lba, uint8_t *sector);
+
+/** Move the read-ahead window to start at \p lba. */
+void prefetch(uint32_t lba);
+
+struct stats stats(void);
+
+/** Per-machine disc image and sector cache, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::disc */
+
+#endif /* _DISC_H_INCLUDED_ */
@@ -0,0 +1,66 @@
+
+#ifndef _FRAMEHASH_H_INCLUDED_
+#define _FRAMEHASH_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Per-frame hashing of the machine output.
+ * @details
+ * When enabled, the visible display rectangle (and optionally the full
+ * VRAM and RAM contents) is hashed with XXH64 at the start of each vertical
+ * blank, and the result appended to a binary log. Comparing logs
+ * from two runs identifies the first diverging frame without storing
+ * any image.
+ *
+ * Log layout, all fields little endian:
+ *
+ *      header:
+ *          u32 magic       "PSXH"
+ *          u32 version     1
+ *          u32 flags       bit 0: VRAM hash present
+ *                          bit 1: RAM hash present
+ *      record:
+ *          u32 frame       value of state->gpu.frame
+ *          u64 cycles      value of state->cycles
+ *          u64 display     hash of the display area
+ *          u64 vram        (if flags.0) hash of the full VRAM
+ *          u64 ram         (if flags.1) hash of the full RAM
+ */
+namespace psx::framehash {
+
+#define FRAMEHASH_MAGIC         UINT32_C(0x48585350)
+#define FRAMEHASH_VERSION       UINT32_C(1)
+#define FRAMEHASH_VRAM          (UINT32_C(1) << 0)
+#define FRAMEHASH_RAM           (UINT32_C(1) << 1)
+
+/**
+ * @brief Start logging frame hashes to the file \p path.
+ * @param hash_vram  Also hash the full VRAM contents.
+ * @param hash_ram   Also hash the full RAM contents.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int open(std::string const &path, bool hash_vram, bool hash_ram);
+
+/** Flush and close the current log, if any. */
+void close(void);
+
+/** Hash of the current display area. The display configuration
+ * (origin, size, color depth) is part of the hashed input. Returns 0 when
+ * the display is disabled. */
+uint64_t display_hash(void);
+
+/** Vertical blank hook, called from the emulation thread.
+ * Returns immediately when no log is open, or when the machine is
+ * re-executed by the reverse debugger. */
+void vblank_event(void);
+
+/** Per-machine frame hash log, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::framehash */
+
+#endif /* _FRAMEHASH_H_INCLUDED_ */
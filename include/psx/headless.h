@@ -0,0 +1,37 @@
+
+#ifndef _HEADLESS_H_INCLUDED_
+#define _HEADLESS_H_INCLUDED_
+
+#include <functional>
+
+namespace psx {
+
+/**
+ * @brief Run the machine without user interface.
+ * The interpreter is started immediately and runs unthrottled until
+ * the vertical blank of the frame \p max_frames, or until it halts.
+ * @param max_frames    Frame budget; 0 runs until the interpreter halts.
+ * @return 0 if the frame budget was reached, 1 if the interpreter
+ *  halted before.
+ */
+int start_headless(unsigned long max_frames);
+
+/**
+ * @brief Boot the machine once, then fork it into child processes.
+ * The machine runs until the vertical blank of the frame \p fork_frame;
+ * the process is then forked \p nr_children times, all the children
+ * start from this exact machine state. The children share the machine
+ * memory copy-on-write, and each runs until the vertical blank of the
+ * frame \p max_frames, or until it halts.
+ * @param setup_child   Called in each child with its index, before
+ *  the machine is resumed; restarts the disc prefetch thread and
+ *  selects the per-child outputs.
+ * @return 0 if all the children reached the frame budget, 1 otherwise.
+ */
+int start_headless_fork(unsigned long fork_frame, unsigned nr_children,
+                        unsigned long max_frames,
+                        std::function<void(unsigned)> setup_child);
+
+}; /* namespace psx */
+
+#endif /* _HEADLESS_H_INCLUDED_ */
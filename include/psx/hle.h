@@ -0,0 +1,62 @@
+
+#ifndef _HLE_H_INCLUDED_
+#define _HLE_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief High-level emulation of BIOS kernel calls.
+ * @details
+ * Kernel functions are called by jumping to 0xA0, 0xB0 or 0xC0 with the
+ * function number in t1. When HLE is enabled, the jump is intercepted
+ * and the hot, side-effect-simple functions (string and memory helpers,
+ * rand, TTY output) are executed natively: the result is written to v0,
+ * the machine jumps back to ra, and an approximate cycle cost is charged.
+ *
+ * Calls without a native implementation, calls listed in the LLE fallback
+ * list, calls whose kernel table entry was patched to point outside the
+ * kernel, and calls with arguments outside of RAM run the BIOS code as usual.
+ * In particular, the event, file, heap and exception functions always
+ * run the BIOS code, as they update kernel structures.
+ */
+namespace psx::hle {
+
+/** Enable or disable interception of the BIOS kernel calls. */
+void set_enabled(bool enable);
+
+/**
+ * @brief Set the LLE fallback list.
+ * @param list  Comma separated list of kernel calls which must run the
+ *  BIOS code, written as vector:function, e.g. "A0:2A,B0:3D".
+ * @return 0 on success, -1 if the list is malformed.
+ */
+int set_lle(std::string const &list);
+
+/** Return true if BIOS kernel calls are intercepted. */
+bool enabled(void);
+
+/** Clear the HLE state (TTY line), on machine reset. */
+void reset(void);
+
+/** Discard the pending TTY line, after the machine state is restored
+ * from a snapshot or rewind capture. */
+void restore(void);
+
+/**
+ * @brief Kernel call hook, called from the interpreter on the jump to
+ *  the address \p vector.
+ * @return true if the call was executed natively, in which case
+ *  state->jump_address is set to the return address. Return false if the
+ *  call must be executed by the BIOS.
+ */
+bool call(uint32_t vector);
+
+/** Per-machine HLE configuration, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::hle */
+
+#endif /* _HLE_H_INCLUDED_ */
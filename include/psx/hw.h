@@ -2,7 +2,9 @@
 #ifndef _HW_H_INCLUDED_
 #define _HW_H_INCLUDED_
 
+#include <cstddef>
 #include <cstdint>
+#include <string>
 #include <lib/types.h>
 
 namespace psx::hw {
@@ -16,6 +18,7 @@ void read_joy_mode(uint32_t *val);
 void write_joy_mode(uint16_t val);
 void read_joy_baud(uint32_t *val);
 void write_joy_baud(uint16_t val);
+void joy_ack_event();
 
 #define I_STAT_SPU      (UINT32_C(1) << 9)
 #define I_STAT_SIO      (UINT32_C(1) << 8)
@@ -38,6 +41,9 @@ void write_i_mask(uint32_t val);
 void read_timer_value(int timer, uint32_t *val);
 void write_timer_value(int timer, uint16_t val);
 void write_timer_mode(int timer, uint16_t val);
+void timer0_event();
+void timer1_event();
+void timer2_event();
 void write_timer_target(int timer, uint16_t val);
 
 void read_dx_madr(int channel, uint32_t *val);
@@ -45,6 +51,7 @@ void write_dx_madr(int channel, uint32_t val);
 void write_dx_bcr(int channel, uint32_t val);
 void read_dx_chcr(int channel, uint32_t *val);
 void write_d2_chcr(uint32_t val);
+void write_d3_chcr(uint32_t val);
 void write_d6_chcr(uint32_t val);
 void write_dx_chcr(int channel, uint32_t val);
 void read_dpcr(uint32_t *val);
@@ -52,13 +59,31 @@ void write_dpcr(uint32_t val);
 void read_dicr(uint32_t *val);
 void write_dicr(uint32_t val);
 
+/// Speed multiplier value selecting instant seeks and sector reads.
+#define CDROM_SPEED_INSTANT     0
+
+/// Select the CD-ROM drive speed multiplier: 1 for accurate timings,
+/// 2, 4, 8 for accelerated timings, or CDROM_SPEED_INSTANT.
+void set_cdrom_speed(unsigned speed);
+/// Return the ISO9660 volume identifier of the loaded disc,
+/// or the empty string.
+std::string read_cdrom_volume_id(void);
+
 void read_cdrom_index(uint32_t *val);
 void write_cdrom_index(uint8_t val);
 void read_cdrom_reg01(uint32_t *val);
 void write_cdrom_reg01(uint8_t val);
 void read_cdrom_reg03(uint32_t *val);
 void write_cdrom_reg03(uint8_t val);
+void read_cdrom_reg02(uint32_t *val);
+void read_cdrom_reg02_u16(uint32_t *val);
 void write_cdrom_reg02(uint8_t val);
+void cdrom_sector_event();
+void cdrom_second_response_event();
+void cdrom_queued_interrupt_event();
+/// Pop up to \p len bytes from the CD-ROM data fifo into \p buffer;
+/// missing bytes are zeroed. Returns the number of bytes copied.
+size_t read_cdrom_data(uint8_t *buffer, size_t len);
 
 void read_gpuread(uint32_t *val);
 void read_gpustat(uint32_t *val);
@@ -0,0 +1,117 @@
+
+#ifndef _INPUT_H_INCLUDED_
+#define _INPUT_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Controller input, with recording and deterministic replay.
+ * @details
+ * The digital pad in port 1 is polled by the guest through the joypad
+ * serial interface; each poll latches the pad buttons. Pad input is the
+ * only nondeterministic source of the machine: the execution is
+ * otherwise a function of the BIOS, the disc and the boot options.
+ * Recording the button state at every poll, stamped with the cycle
+ * counter, is therefore sufficient to replay a session exactly.
+ *
+ * The button changes are also kept in memory since the machine reset:
+ * polls re-executed after a rewind read the buttons of the original
+ * polls, so that the re-execution is exact. This holds for replayed
+ * polls as well, the replayed log is read only once.
+ *
+ * Recordings start at the machine reset. Log layout, all fields little
+ * endian:
+ *
+ *      header:
+ *          u32 magic       "PSXI"
+ *          u32 version     1
+ *          u64 bios        XXH64 hash of the BIOS image
+ *      record:
+ *          varint          (cycle delta << 2) | type, where the cycle
+ *                          delta is counted from the previous record,
+ *                          or from cycle 0 for the first record
+ *          type 0: pad poll, buttons unchanged
+ *          type 1: pad poll, followed by
+ *              u16 buttons
+ *          type 2: end of the recording, followed by
+ *              u32 frame       value of state->gpu.frame
+ *              u64 display     display hash, see framehash::display_hash()
+ *
+ * Varints are LEB128 encoded. A session of one poll per frame records
+ * about four bytes per frame.
+ */
+namespace psx::input {
+
+#define INPUT_MAGIC             UINT32_C(0x49585350)
+#define INPUT_VERSION           UINT32_C(1)
+
+/// Digital pad buttons, 1 when pressed.
+#define PAD_SELECT              (UINT16_C(1) << 0)
+#define PAD_START               (UINT16_C(1) << 3)
+#define PAD_UP                  (UINT16_C(1) << 4)
+#define PAD_RIGHT               (UINT16_C(1) << 5)
+#define PAD_DOWN                (UINT16_C(1) << 6)
+#define PAD_LEFT                (UINT16_C(1) << 7)
+#define PAD_L2                  (UINT16_C(1) << 8)
+#define PAD_R2                  (UINT16_C(1) << 9)
+#define PAD_L1                  (UINT16_C(1) << 10)
+#define PAD_R1                  (UINT16_C(1) << 11)
+#define PAD_TRIANGLE            (UINT16_C(1) << 12)
+#define PAD_CIRCLE              (UINT16_C(1) << 13)
+#define PAD_CROSS               (UINT16_C(1) << 14)
+#define PAD_SQUARE              (UINT16_C(1) << 15)
+
+/**
+ * @brief Press or release the pad buttons \p buttons.
+ *  Called from the frontend threads; ignored while replaying.
+ */
+void set_pad_buttons(uint16_t buttons, bool pressed);
+
+/**
+ * @brief Latch the pad buttons for a poll, called from the emulation
+ *  thread. The buttons are recorded, or read from the replayed log.
+ */
+uint16_t poll_pad(void);
+
+/**
+ * @brief Record the pad input to the file \p path.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int record(std::string const &path);
+
+/**
+ * @brief Replay the pad input from the file \p path. The machine halts
+ *  at the end of the recording, where the frame counter and display
+ *  hash are compared with the recorded ones.
+ * @return 0 on success, -1 if the file is missing or invalid.
+ */
+int replay(std::string const &path);
+
+/** Terminate the recording with the current frame and display hash,
+ * and close the log. */
+void close(void);
+
+/** Reset hook, called after the machine state is reset. */
+void reset(void);
+
+/** Event marking the end of the replayed recording. */
+void replay_end_event(void);
+
+struct replay_stats {
+    bool complete;          /**< The end of the recording was reached */
+    bool matched;           /**< No divergence, final frame and hash match */
+    uint64_t polls;
+    uint64_t divergences;   /**< Polls at unexpected cycles */
+};
+
+struct replay_stats replay_stats(void);
+
+/** Per-machine input state, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::input */
+
+#endif /* _INPUT_H_INCLUDED_ */
@@ -0,0 +1,65 @@
+
+#ifndef _MMIO_H_INCLUDED_
+#define _MMIO_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Access counters of the I/O registers.
+ * @details
+ * Every CPU load and store dispatched to the I/O ports and expansion
+ * region 2 (0x1f801000-0x1f802fff) is counted, keyed by physical address,
+ * width and direction. The counts are published per frame at the start
+ * of the vertical blank. The accesses and frames re-executed by the
+ * reverse debugger are not counted.
+ *
+ * Each counter also tracks the program counter issuing most of its
+ * accesses, with a majority vote: a register polled from a loop reports
+ * the address of the polling instruction, and the share of the accesses
+ * it issued.
+ */
+namespace psx::mmio {
+
+#define MMIO_BASE           UINT32_C(0x1f801000)
+#define MMIO_SIZE           UINT32_C(0x2000)
+
+/// Access counts of an I/O register, for one width and direction.
+struct register_stats {
+    uint32_t addr;          /**< Physical address */
+    unsigned bytes;         /**< Access width, 1, 2 or 4 */
+    bool store;             /**< Store counter if true, load otherwise */
+    uint64_t total;         /**< Accesses since the machine was created */
+    uint32_t frame;         /**< Accesses during the last frame */
+    uint32_t pc;            /**< Address of the most frequent accessor */
+    uint32_t pc_frame;      /**< Accesses from pc during the last frame */
+    uint64_t pc_total;      /**< Accesses from pc since it was elected */
+};
+
+/** Count an access to the I/O register \p addr, issued from the current
+ * CPU instruction. */
+void count(uint32_t addr, unsigned bytes, bool store);
+
+/** Vertical blank hook: publish the per-frame counts. */
+void end_frame(void);
+
+/** Return the counters published at the last vertical blank, in address
+ * order. Safe to call from the GUI thread. */
+std::vector<register_stats> stats(void);
+
+/** Return the name of the I/O register at \p addr, or NULL if unknown.
+ * Some registers are named differently for loads and stores. */
+char const *register_name(uint32_t addr, bool store);
+
+/** Print the \p count registers with the most accesses per frame to
+ * stdout. */
+void print_report(size_t count);
+
+/** Per-machine counters, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::mmio */
+
+#endif /* _MMIO_H_INCLUDED_ */
@@ -0,0 +1,88 @@
+
+#ifndef _PROFILER_H_INCLUDED_
+#define _PROFILER_H_INCLUDED_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Sampling profiler for guest code.
+ * @details
+ * When enabled, the interpreter maintains a shadow call stack from the
+ * JAL and JALR instructions (calls) and `jr ra` (returns), and the
+ * current stack is sampled every `interval` cycles. Each sample is
+ * weighted with the emulated cycles and host time elapsed since the
+ * previous sample, and aggregated per function (identified by its entry
+ * address) and per call stack.
+ *
+ * The call stacks can be exported as folded stacks, one line per stack:
+ *
+ *      fn_80010000;fn_80012340;fn_80015a00 1234
+ *
+ * with frames from the outermost call and the emulated cycle count,
+ * ready for flamegraph.pl.
+ *
+ * When disabled, the cost is a relaxed atomic load per branch.
+ */
+namespace psx::profiler {
+
+/// Profiling counters of a single guest function.
+struct function_stats {
+    uint32_t address;       /**< Function entry address, 0 if unknown */
+    uint64_t self_cycles;   /**< Cycles sampled with the function on top */
+    uint64_t total_cycles;  /**< Cycles sampled with the function on stack */
+    uint64_t self_host_ns;  /**< Host time sampled with the function on top */
+};
+
+extern std::atomic_bool active;
+
+/** Return true if the profiler is enabled. */
+static inline bool enabled(void) {
+    return active.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Enable or disable the profiler. Accumulated samples are kept,
+ *  the shadow call stack restarts empty. Safe to call from signal
+ *  handlers.
+ */
+void set_enabled(bool enable);
+
+/** Set the sampling interval in cycles. */
+void set_interval(unsigned long cycles);
+
+/** Discard the accumulated samples. */
+void clear(void);
+
+/**
+ * Interpreter hooks, called only when the profiler is enabled.
+ * @{
+ */
+/** Record a call to \p target, returning to \p return_address. */
+void call(uint32_t target, uint32_t return_address);
+/** Record a return to \p target. */
+void ret(uint32_t target);
+/** Take a sample if the sampling interval has elapsed. */
+void tick(void);
+/** @} */
+
+/** Return the \p count functions with the highest self cycles. */
+std::vector<function_stats> top(size_t count);
+
+/** Return the total number of cycles sampled. */
+uint64_t sampled_cycles(void);
+
+/**
+ * @brief Write the sampled call stacks as folded stacks to \p path.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+int write_folded(std::string const &path);
+
+/** Print the flat report of the \p count hottest functions to stdout. */
+void print_report(size_t count);
+
+}; /* namespace psx::profiler */
+
+#endif /* _PROFILER_H_INCLUDED_ */
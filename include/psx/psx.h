@@ -2,8 +2,14 @@
 #ifndef _PSX_H_INCLUDED_
 #define _PSX_H_INCLUDED_
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <psx/memory.h>
 
 namespace psx {
@@ -241,6 +247,35 @@ struct cdrom_registers {
     unsigned response_fifo_index;
 
     uint8_t stat;
+    uint8_t mode;
+    uint8_t filter_file;
+    uint8_t filter_channel;
+
+    /// Target position set by Setloc, consumed by the next
+    /// read or seek command.
+    uint32_t setloc_lba;
+    bool setloc_pending;
+    /// Current position of the drive head.
+    uint32_t lba;
+
+    /// Command waiting for its second response (INT2).
+    uint8_t second_response_command;
+
+    /// Interrupt held back until the host acknowledges the
+    /// interrupt currently pending in interrupt_flag.
+    uint8_t queued_interrupt;
+    uint8_t queued_response[16];
+    unsigned queued_response_length;
+
+    /// Last sector read from the disc, in raw 2352 byte format.
+    uint8_t sector[2352];
+    bool sector_valid;
+
+    /// Data fifo, loaded from the sector buffer when the host
+    /// sets the BFRD bit of the request register.
+    uint8_t data_fifo[2352];
+    unsigned data_fifo_length;
+    unsigned data_fifo_index;
 };
 
 struct gpu_registers {
@@ -368,6 +403,9 @@ struct hw_registers {
     uint16_t joy_mode;
     uint16_t joy_ctrl;
     uint16_t joy_baud;
+    uint8_t joy_rx_data;
+    uint8_t joy_pad_step;       /**< Position in the pad transfer */
+    uint16_t joy_pad_buttons;   /**< Buttons latched for the transfer */
     uint32_t sio_stat;
     uint16_t sio_mode;
     uint16_t sio_ctrl;
@@ -428,6 +466,12 @@ struct event {
         : timeout(timeout), callback(callback), next(next) {};
 };
 
+/// Granularity of the dirty page tracking of RAM and VRAM.
+#define STATE_PAGE_SHIFT    12
+#define STATE_PAGE_SIZE     (1u << STATE_PAGE_SHIFT)
+#define RAM_PAGES           (0x200000 >> STATE_PAGE_SHIFT)
+#define VRAM_PAGES          (0x100000 >> STATE_PAGE_SHIFT)
+
 struct state {
     struct cpu_registers cpu;
     struct cp0_registers cp0;
@@ -438,10 +482,14 @@ struct state {
     struct gp0_registers gp0;
 
     uint8_t ram[0x200000];
-    uint8_t bios[0x80000];
+    /// BIOS image, shared read-only with the other machines
+    /// that loaded the same image.
+    uint8_t const *bios;
     uint8_t dram[0x400];
     uint8_t vram[0x100000];
-    uint8_t *cd_rom;
+    /// Sector data of the disc image, mapped read-only by the disc
+    /// module; NULL for compressed and multi-file images.
+    uint8_t const *cd_rom;
     size_t cd_rom_size;
 
     uint64_t cycles;
@@ -452,11 +500,38 @@ struct state {
     bool delay_slot;
     psx::memory::Bus *bus;
 
+    /// Pages of RAM and VRAM written since the last rewind capture,
+    /// one bit per page. Every writer of the memories marks the pages
+    /// it modifies; marking more pages than written is harmless.
+    uint64_t ram_dirty[RAM_PAGES / 64];
+    uint64_t vram_dirty[VRAM_PAGES / 64];
+
+    void mark_ram_dirty(uint32_t addr) {
+        uint32_t page = (addr >> STATE_PAGE_SHIFT) & (RAM_PAGES - 1);
+        ram_dirty[page / 64] |= UINT64_C(1) << (page % 64);
+    }
+    void mark_ram_dirty(uint32_t addr, size_t len) {
+        uint32_t last = (addr + len - 1) >> STATE_PAGE_SHIFT;
+        for (uint32_t page = addr >> STATE_PAGE_SHIFT;
+             len > 0 && page <= last; page++) {
+            mark_ram_dirty(page << STATE_PAGE_SHIFT);
+        }
+    }
+    void mark_vram_dirty(uint32_t offset) {
+        uint32_t page = (offset >> STATE_PAGE_SHIFT) & (VRAM_PAGES - 1);
+        vram_dirty[page / 64] |= UINT64_C(1) << (page % 64);
+    }
+    void mark_all_dirty(void) {
+        memset(ram_dirty, 0xff, sizeof(ram_dirty));
+        memset(vram_dirty, 0xff, sizeof(vram_dirty));
+    }
+
     state();
     ~state();
 
     int load_bios(std::istream &bios_contents);
-    int load_cd_rom(std::istream &cd_rom_contents);
+    int load_cd_rom(std::string const &cd_rom_path);
+    void unload_cd_rom(void);
     void reset();
 
     void handle_event();
@@ -467,10 +542,139 @@ struct state {
 private:
     /** Mutex to control access to concurrent resources. */
     std::mutex _mutex;
+    /** Owning reference to the BIOS image. */
+    std::shared_ptr<uint8_t const> _bios_image;
 };
 
-/** Machine state. */
-extern state state;
+#define BIOS_SIZE           0x80000
+
+namespace disc { struct context; };
+namespace boot { struct context; };
+namespace hle { struct context; };
+namespace framehash { struct context; };
+namespace rewind { struct context; };
+namespace input { struct context; };
+namespace trace { struct context; };
+namespace mmio { struct context; };
+
+/**
+ * @brief Emulated machine.
+ * @details
+ * A machine owns its state, event queue, bus, interpreter thread and the
+ * context of the emulator modules (disc, boot, HLE, frame hashes, rewind,
+ * input, trace, I/O counters).
+ * Several machines can run independently in the same process; read-only
+ * resources (BIOS image, disc image mappings) are shared between them.
+ *
+ * The emulator functions operate on the machine bound to the calling
+ * thread, see \ref Machine::bind. The interpreter thread of a machine,
+ * and the helper threads it starts, are bound to it.
+ */
+class Machine
+{
+public:
+    Machine();
+    ~Machine();
+
+    /** Bind the machine to the calling thread. */
+    void bind(void);
+
+    void start(void);
+    void stop(void);
+    void halt(std::string reason);
+    bool halted(void);
+    std::string halted_reason(void);
+    void step(void);
+    void resume(void);
+
+    /**
+     * @brief Run the interpreter on the calling thread until the cycle
+     *  counter reaches \p cycles, or until the machine halts. The cycle
+     *  counter is checked at branch instructions.
+     *  Used by frontends that drive machines from their own threads;
+     *  the interpreter thread must not be started.
+     * @return true if the cycle counter reached \p cycles, false if the
+     *  machine halted.
+     */
+    bool run(uint64_t cycles);
+
+    /**
+     * @brief Re-execute the machine on the calling thread until the cycle
+     *  counter reaches \p cycles, with the debugger detached. The counter
+     *  is checked at every instruction, and events are handled at branch
+     *  instructions as in the interpreter loop, so that the execution
+     *  is identical to an uninterrupted run. The re-execution stops if
+     *  the machine halts, the halt reason is reported and replaces the
+     *  current one. The machine must be halted, and remains halted.
+     * @return true if the cycle counter reached \p cycles, false if the
+     *  machine halted during the re-execution.
+     */
+    bool fast_forward(uint64_t cycles);
+
+    /** Re-execute exactly one instruction, see \ref fast_forward. */
+    bool step_instruction(void);
+
+    /** Set during \ref fast_forward and \ref step_instruction. */
+    bool reexecuting(void) const {
+        return _reexec_halted != NULL;
+    }
+
+    /// Machine state; the module globals psx::state refers to it
+    /// on the bound threads.
+    std::unique_ptr<struct state> state;
+
+    /// Module contexts.
+    std::shared_ptr<disc::context> disc;
+    std::shared_ptr<boot::context> boot;
+    std::shared_ptr<hle::context> hle;
+    std::shared_ptr<framehash::context> framehash;
+    std::shared_ptr<rewind::context> rewind;
+    std::shared_ptr<input::context> input;
+    std::shared_ptr<trace::context> trace;
+    std::shared_ptr<mmio::context> mmio;
+    /// CD-ROM drive speed multiplier, see hw::set_cdrom_speed().
+    unsigned cdrom_speed;
+    /// The machine halts at the vertical blank of this frame, 0 if
+    /// unlimited. Checked on the emulation thread, so that runs with the
+    /// same budget stop at the same point.
+    unsigned long frame_budget;
+    /// Set when the machine halted on the frame budget.
+    bool frame_budget_reached;
+
+    /// Set when the machine is inspected from the debugger: enables the
+    /// CPU trace and breakpoints, which are shared process wide.
+    bool debugger_attached;
+    /// Set when the execution trace is streamed, see trace::open().
+    bool tracing;
+
+private:
+    void interpreter_routine(void);
+    bool reexec_halted(std::atomic_bool const &halted);
+
+    std::thread            *_interpreter_thread;
+    std::mutex              _interpreter_mutex;
+    std::condition_variable _interpreter_semaphore;
+    std::atomic_bool        _interpreter_halted;
+    std::atomic_bool        _interpreter_stopped;
+    std::string             _interpreter_halted_reason;
+    /// Halt flag of the re-execution in progress, see fast_forward().
+    std::atomic_bool       *_reexec_halted;
+};
+
+/** Machine bound to the calling thread. */
+extern thread_local Machine *current_machine;
+
+static inline Machine *machine(void) {
+    return current_machine;
+}
+
+/** State of the machine bound to the calling thread. */
+extern thread_local struct state *state;
+
+/*
+ * The following functions operate on the machine bound to the calling
+ * thread.
+ */
 
 /**
  * @brief Start the interpreter and recompiler in separate threads.
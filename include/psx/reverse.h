@@ -0,0 +1,50 @@
+
+#ifndef _REVERSE_H_INCLUDED_
+#define _REVERSE_H_INCLUDED_
+
+#include <cstdint>
+
+/**
+ * @brief Reverse execution for the debugger.
+ * @details
+ * The machine is moved back to an earlier cycle by restoring the most
+ * recent rewind capture taken before it (see \ref psx::rewind), and
+ * re-executing from the capture with the debugger detached
+ * (\ref Machine::fast_forward). The re-execution is exact: pad polls read
+ * the buttons of the original polls, see \ref psx::input. With a capture
+ * every frame, any target is reached in at most one frame of
+ * re-execution.
+ *
+ * Searches (reverse continue, last write) re-execute the capture
+ * intervals one instruction at a time, most recent interval first, and
+ * stop at the first interval holding a match, or after a fixed number
+ * of intervals. Captures more recent than the final position are
+ * discarded, and taken again as the machine runs forward.
+ *
+ * All the functions require the machine to be halted, and return -1 if
+ * the rewind buffer holds no capture early enough; the machine is left
+ * at its current cycle in this case. They also return -1 if the machine
+ * halts during the re-execution, and the machine is left where it
+ * halted.
+ */
+namespace psx::reverse {
+
+/** Move the machine back to the cycle \p cycles. */
+int seek(uint64_t cycles);
+
+/** Move the machine back by one instruction. */
+int step_back(void);
+
+/** Move the machine back to the most recent breakpoint hit. */
+int reverse_continue(void);
+
+/**
+ * @brief Move the machine back to the most recent CPU store to the
+ *  physical address \p addr, stopping after the store instruction.
+ *  Stores are matched if they overlap the addressed byte.
+ */
+int reverse_to_write(uint32_t addr);
+
+}; /* namespace psx::reverse */
+
+#endif /* _REVERSE_H_INCLUDED_ */
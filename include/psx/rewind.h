@@ -0,0 +1,85 @@
+
+#ifndef _REWIND_H_INCLUDED_
+#define _REWIND_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief In-memory rewind buffer.
+ * @details
+ * When enabled, the machine is captured every few frames at the start of
+ * the vertical blank. The emulation thread only copies the register files
+ * and the RAM and VRAM pages written since the previous capture (see
+ * \ref state::ram_dirty); a background thread encodes each page as the
+ * XOR delta against its previous contents, run length encoded, and
+ * appends the capture to a ring of fixed memory budget. The oldest
+ * captures are dropped when the budget is exceeded.
+ *
+ * The background thread keeps a copy of RAM and VRAM at the most recent
+ * capture; earlier captures are reconstructed by undoing the deltas of
+ * the captures that follow them, so stepping back K captures costs K
+ * delta decodes over the modified pages only.
+ *
+ * No capture is taken while the machine is re-executed by the reverse
+ * debugger.
+ */
+namespace psx::rewind {
+
+/**
+ * @brief Start capturing the machine every \p interval frames,
+ *  keeping at most \p budget bytes of captures.
+ *  The current captures are discarded.
+ */
+void start(unsigned interval, size_t budget);
+
+/** Stop capturing and discard the captures. */
+void stop(void);
+
+/**
+ * @brief Restore the machine to the \p count th capture taken before
+ *  the current cycle, discarding the more recent captures.
+ *  The machine must be halted.
+ * @return 0 on success, -1 if there are fewer than \p count captures.
+ */
+int step_back(unsigned count);
+
+/**
+ * @brief Restore the machine to the most recent capture taken at or
+ *  before the cycle \p cycles, discarding the more recent captures.
+ *  The machine must be halted.
+ * @return 0 on success, -1 if there is no such capture.
+ */
+int restore(uint64_t cycles);
+
+/**
+ * @brief Load the most recent capture taken at or before the cycle
+ *  \p cycles, keeping the more recent captures. Successive calls with
+ *  decreasing cycles decode each capture once. The machine must be
+ *  halted, and moved with \ref restore before it is resumed.
+ * @return 0 on success, -1 if there is no such capture.
+ */
+int peek(uint64_t cycles);
+
+struct stats {
+    size_t captures;        /**< Number of captures in the ring */
+    size_t bytes;           /**< Memory used by the captures */
+    uint32_t oldest_frame;
+    uint32_t newest_frame;
+    uint64_t skipped;       /**< Captures delayed by a busy encoder */
+};
+
+struct stats stats(void);
+
+/** Vertical blank hook, called from the emulation thread.
+ * Returns immediately when capturing is disabled. */
+void vblank_event(void);
+
+/** Per-machine rewind buffer, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::rewind */
+
+#endif /* _REWIND_H_INCLUDED_ */
@@ -0,0 +1,73 @@
+
+#ifndef _SNAPSHOT_H_INCLUDED_
+#define _SNAPSHOT_H_INCLUDED_
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Snapshots (save states) of the full machine state.
+ * @details
+ * A snapshot holds the register files, memories, the cycle counter and
+ * the pending events. Event callbacks are recorded by stable event ID,
+ * so snapshots remain valid across builds as long as the layout of the
+ * register files is unchanged; the size of every chunk is checked on
+ * restore. The BIOS image is not part of the snapshot.
+ *
+ * Snapshot layout, all fields little endian:
+ *
+ *      header:
+ *          u32 magic       "PSXS"
+ *          u32 version     2
+ *          u32 nr_chunks
+ *          u32 reserved
+ *      chunk directory (nr_chunks entries):
+ *          u32 id          four character code, e.g. "VRAM"
+ *          u32 reserved
+ *          u64 offset      from the start of the file
+ *          u64 size
+ *      chunk data
+ *
+ * Register chunks (CPU, CP0, CP2, HW, CDRM, GPU, GP0) are raw copies of
+ * the register structures. The memory chunks RAM and VRAM are placed at
+ * page aligned offsets, so that they can be mapped or copied directly;
+ * SPAD holds the scratchpad. MISC holds the u64 cycle counter, followed
+ * by the u32 cpu state, jump address and delay slot flag. EVTS holds the
+ * pending events as (u32 event ID, u32 reserved, u64 timeout) entries.
+ * Chunks with unknown IDs are ignored.
+ */
+namespace psx::snapshot {
+
+#define SNAPSHOT_MAGIC          UINT32_C(0x53585350)
+#define SNAPSHOT_VERSION        UINT32_C(2)
+#define SNAPSHOT_PAGE_SIZE      4096
+
+/**
+ * @brief Capture the current machine state, and queue the snapshot
+ *  to be written to \p path from a background thread. The file is
+ *  written to a temporary name first and renamed, so that concurrent
+ *  readers never observe a partial snapshot.
+ * @return 0 on success, -1 if the state cannot be captured.
+ */
+int save(std::string const &path);
+
+/**
+ * @brief Wait until the queued snapshots are written.
+ *  Must be called before exiting, the queued snapshots are lost otherwise.
+ * @return 0 on success, -1 if a snapshot could not be written
+ *  since the last call.
+ */
+int flush(void);
+
+/**
+ * @brief Restore the machine state from \p path. The register chunks
+ *  are read and validated first, the memory chunks are then read in
+ *  place into the machine state.
+ * @return 0 on success, -1 if the file is missing or invalid; the machine
+ *  state is left untouched in this case.
+ */
+int restore(std::string const &path);
+
+}; /* namespace psx::snapshot */
+
+#endif /* _SNAPSHOT_H_INCLUDED_ */
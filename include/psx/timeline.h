@@ -0,0 +1,81 @@
+
+#ifndef _TIMELINE_H_INCLUDED_
+#define _TIMELINE_H_INCLUDED_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Timeline of the emulator activity, in Chrome trace format.
+ * @details
+ * Spans and instant events are recorded by each emulator thread into its
+ * own lock-free single producer, single consumer buffer. A background
+ * thread drains the buffers periodically and writes the events to a
+ * Chrome trace JSON file, which can be opened in chrome://tracing or
+ * ui.perfetto.dev. Events are dropped if a buffer fills up faster than
+ * it is drained.
+ *
+ * Event names and categories must be string literals, or strings that
+ * remain valid until the timeline is closed.
+ */
+namespace psx::timeline {
+
+extern std::atomic_bool active;
+
+/** Return true if timeline events are recorded. */
+static inline bool enabled(void) {
+    return active.load(std::memory_order_relaxed);
+}
+
+/** Return the current timeline time stamp, in nanoseconds. */
+uint64_t timestamp(void);
+
+/**
+ * @brief Start recording events to the file \p path.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int open(std::string const &path);
+
+/** Stop recording, write the pending events and close the file. */
+void close(void);
+
+/** Name the calling thread in the timeline. */
+void set_thread_name(char const *name);
+
+/**
+ * @brief Record a complete span of the calling thread.
+ * @param arg_name  Name of the argument \p arg, or NULL if none.
+ */
+void complete(char const *category, char const *name, uint64_t start,
+              uint64_t end, char const *arg_name = NULL, uint64_t arg = 0);
+
+/** Record an instant event of the calling thread. */
+void instant(char const *category, char const *name,
+             char const *arg_name = NULL, uint64_t arg = 0);
+
+/** Scoped span, recorded when the scope is left. */
+class span
+{
+public:
+    span(char const *category, char const *name,
+         char const *arg_name = NULL, uint64_t arg = 0)
+        : _start(enabled() ? timestamp() : 0), _category(category),
+          _name(name), _arg_name(arg_name), _arg(arg) {}
+    ~span() {
+        if (_start != 0 && enabled()) {
+            complete(_category, _name, _start, timestamp(), _arg_name, _arg);
+        }
+    }
+
+private:
+    uint64_t _start;
+    char const *_category;
+    char const *_name;
+    char const *_arg_name;
+    uint64_t _arg;
+};
+
+}; /* namespace psx::timeline */
+
+#endif /* _TIMELINE_H_INCLUDED_ */
@@ -0,0 +1,116 @@
+
+#ifndef _TIMING_H_INCLUDED_
+#define _TIMING_H_INCLUDED_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Host time instrumentation of the emulator subsystems.
+ * @details
+ * Scoped timers are placed around the host hot paths. Timers nest:
+ * the time spent in a nested scope is charged to the inner subsystem
+ * only, so that the per-subsystem times add up to the instrumented host
+ * time. Time stamps are read with rdtsc where available.
+ *
+ * The accumulated times are closed at the start of each vertical blank
+ * and recorded per emulated frame. The timers are always compiled in;
+ * when disabled, the cost of a scope is a relaxed atomic load.
+ */
+namespace psx::timing {
+
+enum subsystem {
+    CPU,            /**< Interpreter, excluding the nested subsystems */
+    GP0,            /**< GP0 and GP1 command processing */
+    Rasterizer,     /**< Polygon, line and rectangle rendering */
+    Display,        /**< Conversion of the display area to RGB */
+    DMA,            /**< DMA transfers */
+    Events,         /**< Scheduled event dispatch */
+    GUI,            /**< GUI rendering */
+    SubsystemCount,
+};
+
+/// Host time spent in each subsystem during an emulated frame.
+struct frame_record {
+    uint32_t frame;
+    uint64_t ns[SubsystemCount];
+};
+
+extern std::atomic_bool active;
+
+/** Return true if the timers are enabled. */
+static inline bool enabled(void) {
+    return active.load(std::memory_order_relaxed);
+}
+
+/** Return the current time stamp, in host ticks. */
+static inline uint64_t timestamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Open and close a scope of the current thread.
+ *  Unlike timing::scope, these are not gated: they can be used to set
+ *  the base subsystem of a thread, charged when no other scope is open.
+ */
+void enter(subsystem subsystem);
+void leave(void);
+
+/** Scoped timer, charges the enclosed host time to a subsystem. */
+class scope
+{
+public:
+    scope(subsystem subsystem) : _active(enabled()) {
+        if (_active) enter(subsystem);
+    }
+    ~scope() {
+        if (_active) leave();
+    }
+
+private:
+    bool _active;
+};
+
+/** Enable or disable the timers. */
+void set_enabled(bool enable);
+
+/** Return the name of the subsystem \p subsystem. */
+char const *subsystem_name(unsigned subsystem);
+
+/**
+ * @brief Close the timing record of the frame \p frame.
+ *  Called from the interpreter thread at the start of vertical blank.
+ */
+void end_frame(uint32_t frame);
+
+/** Return the records of the most recent frames, oldest first. */
+std::vector<frame_record> history(void);
+
+/**
+ * @brief Log the frame records to the file \p path, as JSON if the file
+ *  name ends with .json, as CSV otherwise.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int open_log(std::string const &path);
+
+/** Complete and close the frame record log. */
+void close_log(void);
+
+/** Print the average per-frame host time of each subsystem to stdout. */
+void print_report(void);
+
+}; /* namespace psx::timing */
+
+#endif /* _TIMING_H_INCLUDED_ */
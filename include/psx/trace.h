@@ -0,0 +1,100 @@
+
+#ifndef _TRACE_H_INCLUDED_
+#define _TRACE_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Execution trace streamed to disk.
+ * @details
+ * When enabled, every instruction executed by the interpreter is encoded
+ * into a block buffer of the machine; full blocks are handed over to a
+ * background thread which appends them to the trace file. The emulation
+ * thread waits for the writer if too many blocks are pending, the trace
+ * is never truncated. Requires a build with ENABLE_TRACE.
+ *
+ * Trace layout, all fields little endian:
+ *
+ *      header:
+ *          u32 magic       "PSXT"
+ *          u32 version     1
+ *          u32 flags       bit 0: register values present
+ *          u32 reserved
+ *      block:
+ *          u32 size        size of the records, in bytes
+ *          u32 count       number of records
+ *          u64 cycles      cycle counter of the instruction preceding
+ *                          the block
+ *          u32 pc          address of the instruction preceding the block
+ *          u32 flags       bit 0: the block does not follow the previous
+ *                          block, see below
+ *      record:
+ *          varint          (zigzag(pc - previous pc - 4) << 2) |
+ *                          (cycles flag << 1) | instruction flag
+ *          varint          (if cycles flag) cycle delta from the previous
+ *                          instruction, 1 otherwise
+ *          u32 instr       (if instruction flag) instruction word, omitted
+ *                          if equal to the last instruction executed at the
+ *                          same address within the block, see
+ *                          TRACE_CACHE_SIZE
+ *          u8 register     (if flags.0) general purpose register written
+ *                          by the instruction, 0 if none
+ *          u32 value       (if register != 0) value written
+ *
+ * Varints are LEB128 encoded. The block headers double as the trace
+ * index: blocks are decoded independently, and can be located by cycle
+ * or address from the headers alone. Sequential instructions executed
+ * in a loop take one byte each.
+ *
+ * Instructions re-executed by the reverse debugger are not recorded.
+ * When the machine is moved to another point of its execution
+ * (snapshot or rewind restore, reverse execution), the trace continues
+ * with a new block starting at the new position, flagged with
+ * TRACE_BLOCK_RESYNC. The cycles of the block headers only increase
+ * within the segments delimited by the flagged blocks.
+ */
+namespace psx::trace {
+
+#define TRACE_MAGIC             UINT32_C(0x54585350)
+#define TRACE_VERSION           UINT32_C(1)
+#define TRACE_REGISTERS         UINT32_C(1)
+#define TRACE_BLOCK_RESYNC      UINT32_C(1)
+
+#define TRACE_HEADER_SIZE       16
+#define TRACE_BLOCK_HEADER_SIZE 24
+
+/// Instruction cache used to elide instruction words: direct mapped,
+/// indexed by word address, cleared at the start of every block.
+#define TRACE_CACHE_SIZE        1024
+
+/**
+ * @brief Start streaming the execution trace of the current machine
+ *  to the file \p path.
+ * @param registers  Include the register values written by the
+ *  instructions.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int open(std::string const &path, bool registers);
+
+/** Write the pending blocks and close the trace. */
+void close(void);
+
+/** Record the instruction \p instr executed at the address \p pc. */
+void record(uint32_t pc, uint32_t instr);
+
+/**
+ * @brief Start a new block at the current position of the machine,
+ *  called after the machine state is restored. Does nothing if the
+ *  trace is not open.
+ */
+void resync(void);
+
+/** Per-machine trace, owned by \ref psx::Machine. */
+struct context;
+std::shared_ptr<context> create_context(void);
+
+}; /* namespace psx::trace */
+
+#endif /* _TRACE_H_INCLUDED_ */
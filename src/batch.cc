@@ -0,0 +1,375 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cxxopts.hpp>
+#include <fmt/format.h>
+#include <toml++/toml.h>
+
+#include <lib/thread_pool.h>
+#include <psx/boot.h>
+#include <psx/debugger.h>
+#include <psx/framehash.h>
+#include <psx/hle.h>
+#include <psx/hw.h>
+#include <psx/input.h>
+#include <psx/psx.h>
+
+/**
+ * @file
+ * @brief Batch runner: runs the jobs of a manifest on a pool of machines
+ *  and reports one JSON line per job.
+ * @details
+ * The manifest is a TOML file, with an optional [defaults] table and an
+ * array of [[jobs]] tables:
+ *
+ *      [defaults]
+ *      bios = "scph1001.bin"
+ *      frames = 600            # frame budget
+ *      timeout = 60.0          # wall clock limit, in seconds
+ *      max_cycles = 0          # cycle limit, 0 for none
+ *      cd_speed = "instant"    # 1x, 2x, 4x, 8x or instant
+ *      fast_boot = true
+ *      hle_bios = false
+ *
+ *      [[jobs]]
+ *      name = "ridge-racer"
+ *      disc = "discs/ridge-racer.cue"
+ *      hash = "5d3c0a1b2e4f6789"   # expected display hash at the last frame
+ *      frame_hash = "logs/ridge-racer.psxh"
+ *
+ * Jobs may also side-load an executable with `exe`, and replay the pad
+ * input recorded with --record with `input`; replays run until the end
+ * of the recording, and pass if the replay matches it, so the frame
+ * budget is optional for them. Relative paths are
+ * resolved from the manifest directory. Each job runs on its own
+ * machine, driven from a pool worker; machines loading the same BIOS
+ * share the image.
+ */
+
+/// CPU clock rate, for the effective speed of the jobs.
+static const double cpu_clock_rate = 33868800.0;
+
+/// Number of cycles run between two checks of the job limits,
+/// approximately a tenth of a frame.
+static const uint64_t run_slice = 56448;
+
+struct job {
+    std::string bios;
+    std::string disc;
+    std::string exe;
+    std::string input;
+    std::string frame_hash;
+    std::string hash;
+    unsigned long frames;
+    double timeout;
+    uint64_t max_cycles;
+    unsigned cd_speed;
+    bool fast_boot;
+    bool hle_bios;
+};
+
+struct result {
+    std::string status;     ///< pass, fail, timeout or error
+    std::string reason;
+    unsigned long frames;
+    uint64_t cycles;
+    double host_seconds;
+    std::string hash;
+};
+
+static bool parse_cd_speed(std::string const &value, unsigned *speed) {
+    if (value == "1x")           *speed = 1;
+    else if (value == "2x")      *speed = 2;
+    else if (value == "4x")      *speed = 4;
+    else if (value == "8x")      *speed = 8;
+    else if (value == "instant") *speed = CDROM_SPEED_INSTANT;
+    else return false;
+    return true;
+}
+
+static std::string resolve_path(std::string const &dir, std::string path) {
+    if (path.empty() || path[0] == '/' || dir.empty()) {
+        return path;
+    }
+    return dir + path;
+}
+
+/**
+ * @brief Read the job \p table, with the defaults \p defaults.
+ * @return false if a field is invalid, with the error in \p error.
+ */
+static bool parse_job(toml::table const &table, toml::table const &defaults,
+                      std::string const &dir, struct job *job,
+                      std::string *error) {
+    auto field = [&](char const *key) {
+        toml::node const *node = table.get(key);
+        return node != NULL ? node : defaults.get(key);
+    };
+    auto string_field = [&](char const *key) {
+        toml::node const *node = field(key);
+        return node != NULL ? node->value_or(std::string()) : std::string();
+    };
+    auto int_field = [&](char const *key, int64_t def) {
+        toml::node const *node = field(key);
+        return node != NULL ? node->value_or(def) : def;
+    };
+    auto bool_field = [&](char const *key) {
+        toml::node const *node = field(key);
+        return node != NULL && node->value_or(false);
+    };
+
+    job->bios = resolve_path(dir, string_field("bios"));
+    job->disc = resolve_path(dir, string_field("disc"));
+    job->exe = resolve_path(dir, string_field("exe"));
+    job->input = resolve_path(dir, string_field("input"));
+    job->frame_hash = resolve_path(dir, string_field("frame_hash"));
+    job->hash = string_field("hash");
+    job->frames = int_field("frames", 0);
+    job->max_cycles = int_field("max_cycles", 0);
+    job->fast_boot = bool_field("fast_boot");
+    job->hle_bios = bool_field("hle_bios");
+
+    toml::node const *timeout = field("timeout");
+    job->timeout = timeout != NULL ? timeout->value<double>().value_or(0) : 0;
+
+    std::string cd_speed = string_field("cd_speed");
+    job->cd_speed = 1;
+    if (!cd_speed.empty() && !parse_cd_speed(cd_speed, &job->cd_speed)) {
+        *error = fmt::format("invalid CD-ROM speed '{}'", cd_speed);
+        return false;
+    }
+    if (job->bios.empty()) {
+        *error = "BIOS unspecified";
+        return false;
+    }
+    if (job->disc.empty() && job->exe.empty()) {
+        *error = "disc and executable unspecified";
+        return false;
+    }
+    if (job->frames == 0 && job->input.empty()) {
+        *error = "frame budget unspecified";
+        return false;
+    }
+    return true;
+}
+
+static struct result run_job(struct job const &job) {
+    struct result result = {};
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&] {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    };
+    auto error = [&](std::string reason) {
+        result.status = "error";
+        result.reason = reason;
+        result.host_seconds = elapsed();
+        return result;
+    };
+
+    psx::Machine machine;
+    machine.bind();
+
+    std::ifstream bios_contents(job.bios, std::ios::binary);
+    if (!bios_contents.good() || psx::state->load_bios(bios_contents) != 0) {
+        return error(fmt::format("cannot load BIOS '{}'", job.bios));
+    }
+    if (!job.disc.empty() && psx::state->load_cd_rom(job.disc) != 0) {
+        return error(fmt::format("cannot load disc '{}'", job.disc));
+    }
+    if (!job.exe.empty() && psx::boot::set_exe(job.exe) != 0) {
+        return error(fmt::format("cannot load executable '{}'", job.exe));
+    }
+    if (!job.frame_hash.empty() &&
+        psx::framehash::open(job.frame_hash, false, false) != 0) {
+        return error(fmt::format("cannot create frame hash log '{}'",
+            job.frame_hash));
+    }
+    psx::boot::set_fast_boot(job.fast_boot);
+    psx::hle::set_enabled(job.hle_bios);
+    psx::hw::set_cdrom_speed(job.cd_speed);
+    if (!job.input.empty() && psx::input::replay(job.input) != 0) {
+        return error(fmt::format("cannot load input log '{}'", job.input));
+    }
+    psx::state->reset();
+
+    result.status = "pass";
+    while (job.frames == 0 || psx::state->gpu.frame < job.frames) {
+        if (job.max_cycles != 0 && psx::state->cycles >= job.max_cycles) {
+            result.status = "timeout";
+            result.reason = "cycle limit reached";
+            break;
+        }
+        if (job.timeout > 0 && elapsed() >= job.timeout) {
+            result.status = "timeout";
+            result.reason = "wall clock limit reached";
+            break;
+        }
+        uint64_t target = psx::state->cycles + run_slice;
+        if (job.max_cycles != 0) {
+            target = std::min(target, job.max_cycles);
+        }
+        if (!machine.run(target)) {
+            if (!psx::input::replay_stats().matched) {
+                result.status = "fail";
+                result.reason = machine.halted_reason();
+            }
+            break;
+        }
+    }
+
+    result.frames = psx::state->gpu.frame;
+    result.cycles = psx::state->cycles;
+    result.hash = fmt::format("{:016x}", psx::framehash::display_hash());
+    if (result.status == "pass" && !job.hash.empty() &&
+        job.hash != result.hash) {
+        result.status = "fail";
+        result.reason = fmt::format("display hash mismatch, expected {}",
+            job.hash);
+    }
+
+    psx::framehash::close();
+    psx::input::close();
+    result.host_seconds = elapsed();
+    return result;
+}
+
+static std::string json_string(std::string const &str) {
+    std::string out = "\"";
+    for (char c : str) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                out += fmt::format("\\u{:04x}", c);
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+static void write_result(FILE *out, std::string const &name,
+                         struct result const &result) {
+    double emulated_seconds = result.cycles / cpu_clock_rate;
+    fmt::print(out,
+        "{{\"job\": {}, \"status\": \"{}\", \"reason\": {}, "
+        "\"frames\": {}, \"cycles\": {}, \"host_seconds\": {:.3f}, "
+        "\"speed\": {:.2f}, \"hash\": \"{}\"}}\n",
+        json_string(name), result.status, json_string(result.reason),
+        result.frames, result.cycles, result.host_seconds,
+        result.host_seconds > 0 ? emulated_seconds / result.host_seconds : 0.0,
+        result.hash);
+    fflush(out);
+}
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options options("ps1-batch", "Run PS1 emulation jobs in parallel");
+    options.add_options()
+        ("manifest",    "Job manifest (TOML)", cxxopts::value<std::string>())
+        ("j,jobs",      "Number of worker threads, 0 for one per host thread", cxxopts::value<unsigned>()->default_value("0"))
+        ("o,output",    "Write the job results to a file instead of stdout", cxxopts::value<std::string>())
+        ("verbose",     "Print the emulator logs")
+        ("h,help",      "Print usage");
+    options.parse_positional({"manifest"});
+    options.positional_help("MANIFEST");
+
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help") || result.count("manifest") == 0) {
+        std::cout << options.help() << std::endl;
+        exit(result.count("help") ? 0 : 1);
+    }
+
+    std::string manifest_file = result["manifest"].as<std::string>();
+    size_t slash = manifest_file.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" :
+        manifest_file.substr(0, slash + 1);
+
+    toml::table manifest;
+    try {
+        manifest = toml::parse_file(manifest_file);
+    } catch (const toml::parse_error &err) {
+        fmt::print("Cannot parse manifest '{}': {}\n",
+            manifest_file, err.description());
+        exit(1);
+    }
+
+    toml::table defaults;
+    if (toml::table const *table = manifest["defaults"].as_table()) {
+        defaults = *table;
+    }
+    toml::array const *jobs = manifest["jobs"].as_array();
+    if (jobs == NULL || jobs->empty()) {
+        fmt::print("No jobs in manifest '{}'\n", manifest_file);
+        exit(1);
+    }
+
+    FILE *out = stdout;
+    if (result.count("output")) {
+        std::string output_file = result["output"].as<std::string>();
+        out = fopen(output_file.c_str(), "w");
+        if (out == NULL) {
+            fmt::print("Cannot create output '{}'\n", output_file);
+            exit(1);
+        }
+    }
+
+    // Logs are interleaved between jobs, and mixed with the results
+    // when printed to stdout.
+    if (result.count("verbose") == 0) {
+        for (int label = 0; label < Debugger::LabelCount; label++) {
+            debugger::debugger.verbosity[label] = Debugger::None;
+        }
+    }
+
+    std::mutex out_mutex;
+    unsigned failed = 0;
+    {
+        thread_pool pool(result["jobs"].as<unsigned>());
+        for (size_t nr = 0; nr < jobs->size(); nr++) {
+            toml::table const *table = jobs->get(nr)->as_table();
+            std::string name = table == NULL ? "" :
+                (*table)["name"].value_or(std::string());
+            if (name.empty()) {
+                name = fmt::format("job{}", nr);
+            }
+
+            pool.submit([&, table, name] {
+                struct job job;
+                struct result result = {};
+                std::string error;
+                if (table == NULL) {
+                    result.status = "error";
+                    result.reason = "job is not a table";
+                } else if (!parse_job(*table, defaults, dir, &job, &error)) {
+                    result.status = "error";
+                    result.reason = error;
+                } else {
+                    result = run_job(job);
+                }
+
+                std::lock_guard<std::mutex> lock(out_mutex);
+                write_result(out, name, result);
+                failed += result.status != "pass";
+            });
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return failed == 0 ? 0 : 1;
+}
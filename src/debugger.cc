@@ -1,6 +1,12 @@
 
+#include <algorithm>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <toml++/toml.h>
 
 #include <psx/debugger.h>
@@ -155,3 +161,133 @@ bool Debugger::check_watchpoint(uint64_t start_addr, uint64_t end_addr,
     }
     return false;
 }
+
+/* Asynchronous logger */
+
+/// Records queued per thread before the thread waits for the logger.
+#define LOG_QUEUE_SIZE      16384
+
+namespace debugger {
+
+std::atomic_bool logger_running;
+
+/// Log queue of a thread, kept by the logger until drained once the
+/// thread has exited.
+struct log_queue {
+    circular_buffer<log_record> records;
+
+    log_queue() : records(LOG_QUEUE_SIZE) {}
+};
+
+static std::mutex logger_mutex;
+static std::condition_variable logger_semaphore;
+static std::thread *logger_thread;
+static bool logger_stopped;
+static std::vector<std::shared_ptr<log_queue>> log_queues;
+static thread_local std::shared_ptr<log_queue> thread_log_queue;
+
+/// Print the queued records of all threads, in time stamp order.
+/// Called with the logger mutex held.
+static void drain_log_queues(std::vector<log_record> &records) {
+    records.clear();
+    for (auto it = log_queues.begin(); it != log_queues.end();) {
+        log_queue &queue = **it;
+        log_record record;
+        while (queue.records.pop(&record)) {
+            records.push_back(record);
+        }
+        // Only the logger holds the queues of exited threads.
+        if (it->use_count() == 1) {
+            it = log_queues.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    std::stable_sort(records.begin(), records.end(),
+        [](log_record const &lhs, log_record const &rhs) {
+            return lhs.timestamp < rhs.timestamp; });
+    for (log_record const &record : records) {
+        fmt::print(fmt::fg(debugger.color[record.label]), "{:>7} | ",
+            LabelName[record.label]);
+        fmt::print(::stdout, VerbosityStyle[record.verbosity], "{}",
+            record.decode(record.format, record.payload));
+        fmt::print("\n");
+    }
+}
+
+void post(log_record const &record) {
+    if (!thread_log_queue) {
+        thread_log_queue = std::make_shared<log_queue>();
+        std::lock_guard<std::mutex> lock(logger_mutex);
+        log_queues.push_back(thread_log_queue);
+    }
+    // Logs are not dropped: a thread outpacing the logger waits for it.
+    bool queued;
+    while (!(queued = thread_log_queue->records.push(record)) &&
+           logger_running.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+    }
+
+    // The logger may have stopped after its final drain: the records
+    // left in the queues are printed by the calling thread.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!logger_running.load(std::memory_order_relaxed)) {
+        std::vector<log_record> records;
+        std::lock_guard<std::mutex> lock(logger_mutex);
+        drain_log_queues(records);
+        if (!queued) {
+            thread_log_queue->records.push(record);
+            drain_log_queues(records);
+        }
+    }
+}
+
+static void logger_routine(void) {
+    std::vector<log_record> records;
+    std::unique_lock<std::mutex> lock(logger_mutex);
+    for (;;) {
+        drain_log_queues(records);
+        if (logger_stopped) {
+            return;
+        }
+        // The producers do not signal the logger, the queues are
+        // polled.
+        logger_semaphore.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void start_logger(void) {
+    if (logger_thread != NULL) {
+        return;
+    }
+    logger_stopped = false;
+    logger_thread = new std::thread(logger_routine);
+    logger_running = true;
+}
+
+void stop_logger(void) {
+    if (logger_thread == NULL) {
+        return;
+    }
+    logger_running = false;
+    {
+        std::lock_guard<std::mutex> lock(logger_mutex);
+        logger_stopped = true;
+    }
+    logger_semaphore.notify_one();
+    logger_thread->join();
+    delete logger_thread;
+    logger_thread = NULL;
+
+    // Records pushed by the threads that checked logger_running just
+    // before it was cleared.
+    std::vector<log_record> records;
+    {
+        std::lock_guard<std::mutex> lock(logger_mutex);
+        drain_log_queues(records);
+    }
+    fflush(stdout);
+}
+
+}; /* namespace debugger */
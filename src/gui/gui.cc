@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
 #include <cstdio>
@@ -17,7 +18,16 @@
 
 #include <psx/psx.h>
 #include <psx/debugger.h>
+#include <psx/disc.h>
 #include <psx/gui.h>
+#include <psx/input.h>
+#include <psx/mmio.h>
+#include <psx/profiler.h>
+#include <psx/reverse.h>
+#include <psx/rewind.h>
+#include <psx/snapshot.h>
+#include <psx/timeline.h>
+#include <psx/timing.h>
 #include <assembly/registers.h>
 #include <graphics.h>
 
@@ -89,6 +99,122 @@ static void ShowRegister(char const *name, T value, Register<T> &reg) {
     reg.Show(value);
 }
 
+/// Stacked per-frame breakdown of the host time per subsystem.
+static void ShowTiming(void) {
+    static ImU32 const colors[psx::timing::SubsystemCount] = {
+        IM_COL32(0x4e, 0x79, 0xa7, 0xff),
+        IM_COL32(0xf2, 0x8e, 0x2b, 0xff),
+        IM_COL32(0xe1, 0x57, 0x59, 0xff),
+        IM_COL32(0x76, 0xb7, 0xb2, 0xff),
+        IM_COL32(0x59, 0xa1, 0x4f, 0xff),
+        IM_COL32(0xed, 0xc9, 0x48, 0xff),
+        IM_COL32(0xb0, 0x7a, 0xa1, 0xff),
+    };
+
+    bool timingEnabled = psx::timing::enabled();
+    if (ImGui::Checkbox("Subsystem timing", &timingEnabled)) {
+        psx::timing::set_enabled(timingEnabled);
+    }
+    std::vector<psx::timing::frame_record> history = psx::timing::history();
+    if (history.empty()) {
+        return;
+    }
+
+    // Scale on the slowest frame, at least one 60Hz frame.
+    double maxNanoseconds = 1e9 / 60;
+    double averageNanoseconds[psx::timing::SubsystemCount] = { 0 };
+    for (psx::timing::frame_record const &record : history) {
+        double frameNanoseconds = 0;
+        for (unsigned nr = 0; nr < psx::timing::SubsystemCount; nr++) {
+            frameNanoseconds += record.ns[nr];
+            averageNanoseconds[nr] += record.ns[nr] / history.size();
+        }
+        maxNanoseconds = std::max(maxNanoseconds, frameNanoseconds);
+    }
+
+    float plotWidth = ImGui::GetContentRegionAvail().x;
+    float plotHeight = 80.0f;
+    float barWidth = plotWidth / 300;
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    for (size_t frame = 0; frame < history.size(); frame++) {
+        float x = pos.x + frame * barWidth;
+        float y = pos.y + plotHeight;
+        for (unsigned nr = 0; nr < psx::timing::SubsystemCount; nr++) {
+            float height = history[frame].ns[nr] * plotHeight / maxNanoseconds;
+            drawList->AddRectFilled(ImVec2(x, y - height),
+                ImVec2(x + barWidth, y), colors[nr]);
+            y -= height;
+        }
+    }
+    ImGui::Dummy(ImVec2(plotWidth, plotHeight));
+
+    for (unsigned nr = 0; nr < psx::timing::SubsystemCount; nr++) {
+        ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(colors[nr]),
+            "%-12s %8.3f ms", psx::timing::subsystem_name(nr),
+            averageNanoseconds[nr] / 1e6);
+    }
+}
+
+static void ShowRegisterAccesses(void) {
+    std::vector<psx::mmio::register_stats> stats = psx::mmio::stats();
+    ImGui::Text("I/O register accesses, last frame");
+    ImGuiTableFlags flags = ImGuiTableFlags_Sortable |
+        ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg |
+        ImGuiTableFlags_Borders;
+    if (!ImGui::BeginTable("mmio", 6, flags, ImVec2(0, 200))) {
+        return;
+    }
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("register", ImGuiTableColumnFlags_NoSort);
+    ImGui::TableSetupColumn("address");
+    ImGui::TableSetupColumn("access", ImGuiTableColumnFlags_NoSort);
+    ImGui::TableSetupColumn("per frame",
+        ImGuiTableColumnFlags_DefaultSort |
+        ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("total",
+        ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("pc", ImGuiTableColumnFlags_NoSort);
+    ImGui::TableHeadersRow();
+
+    // The counters are refreshed every frame, and sorted every time.
+    ImGuiTableSortSpecs const *sortSpecs = ImGui::TableGetSortSpecs();
+    if (sortSpecs != NULL && sortSpecs->SpecsCount > 0) {
+        ImGuiTableColumnSortSpecs const &spec = sortSpecs->Specs[0];
+        bool ascending = spec.SortDirection == ImGuiSortDirection_Ascending;
+        auto key = [&spec](psx::mmio::register_stats const &reg) {
+            return spec.ColumnIndex == 1 ? (uint64_t)reg.addr :
+                   spec.ColumnIndex == 3 ? (uint64_t)reg.frame : reg.total;
+        };
+        std::stable_sort(stats.begin(), stats.end(),
+            [&](psx::mmio::register_stats const &lhs,
+                psx::mmio::register_stats const &rhs) {
+                return ascending ? key(lhs) < key(rhs) : key(lhs) > key(rhs);
+            });
+    }
+
+    for (psx::mmio::register_stats const &reg : stats) {
+        char const *name = psx::mmio::register_name(reg.addr, reg.store);
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", name ? name : "");
+        ImGui::TableNextColumn();
+        ImGui::Text("%08" PRIx32, reg.addr);
+        ImGui::TableNextColumn();
+        ImGui::Text("%s%u", reg.store ? "w" : "r", reg.bytes * 8);
+        ImGui::TableNextColumn();
+        ImGui::Text("%" PRIu32, reg.frame);
+        ImGui::TableNextColumn();
+        ImGui::Text("%" PRIu64, reg.total);
+        ImGui::TableNextColumn();
+        if (reg.frame > 0) {
+            ImGui::Text("%08" PRIx32 " %5.1f%%", reg.pc,
+                100.0 * reg.pc_frame / reg.frame);
+        }
+    }
+    ImGui::EndTable();
+}
+
 static void ShowAnalytics(void) {
     // CPU freq is 33.87 MHz
     static float timeRatio[5 * 60] = { 0 };
@@ -101,7 +227,7 @@ static void ShowAnalytics(void) {
 
     auto updateTime = std::chrono::steady_clock::now();;
     std::chrono::duration<double> diffTime = updateTime - startTime;
-    unsigned long updateCycles = psx::state.cycles;
+    unsigned long updateCycles = psx::state->cycles;
 
     float elapsedMilliseconds = diffTime.count() * 1000.0;
     float machineMilliseconds = (updateCycles - startCycles) / 33870.0;
@@ -117,25 +243,64 @@ static void ShowAnalytics(void) {
 
     ImGui::PlotLines("", timeRatio, plotLength, plotOffset,
         "time ratio", 0.0f, 100.0f, plotDimensions);
+
+    struct psx::disc::stats discStats = psx::disc::stats();
+    ImGui::Text("disc reads       %" PRIu64 "\n", discStats.reads);
+    ImGui::Text("disc cache hits  %" PRIu64 "\n", discStats.hits);
+    ImGui::Text("disc cold misses %" PRIu64 "\n", discStats.cold_misses);
+    ImGui::Text("disc prefetched  %" PRIu64 "\n", discStats.prefetched);
+
+    ImGui::Separator();
+    ShowTiming();
+
+    ImGui::Separator();
+    ShowRegisterAccesses();
+
+    ImGui::Separator();
+    bool profilerEnabled = psx::profiler::enabled();
+    if (ImGui::Checkbox("Profiler", &profilerEnabled)) {
+        psx::profiler::set_enabled(profilerEnabled);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+        psx::profiler::clear();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save folded stacks")) {
+        psx::profiler::write_folded("profile.folded");
+    }
+
+    uint64_t sampledCycles = psx::profiler::sampled_cycles();
+    if (sampledCycles == 0) {
+        return;
+    }
+    ImGui::Text("%-10.10s %7s %7s %10s", "function", "self%", "total%", "host ms");
+    for (psx::profiler::function_stats const &stats : psx::profiler::top(20)) {
+        ImGui::Text("%08" PRIx32 "   %6.2f%% %6.2f%% %10.3f",
+            stats.address,
+            100.0 * stats.self_cycles / sampledCycles,
+            100.0 * stats.total_cycles / sampledCycles,
+            stats.self_host_ns / 1e6);
+    }
 }
 
 static void ShowCpuRegisters(void) {
-    ImGui::Text("pc       %08" PRIx32 "\n", psx::state.cpu.pc);
+    ImGui::Text("pc       %08" PRIx32 "\n", psx::state->cpu.pc);
     for (unsigned int i = 0; i < 32; i+=2) {
         ImGui::Text("%-8.8s %08" PRIx32 "  %-8.8s %08" PRIx32 "\n",
-            assembly::cpu::getRegisterName(i), psx::state.cpu.gpr[i],
-            assembly::cpu::getRegisterName(i + 1), psx::state.cpu.gpr[i + 1]);
+            assembly::cpu::getRegisterName(i), psx::state->cpu.gpr[i],
+            assembly::cpu::getRegisterName(i + 1), psx::state->cpu.gpr[i + 1]);
     }
 }
 
 static void ShowCp0Registers(void) {
     #define PrintReg(fmt, name) \
         ImGui::Text("%-8.8s %08" fmt "\n", \
-            #name, psx::state.cp0.name)
+            #name, psx::state->cp0.name)
     #define Print2Regs(fmt0, name0, fmt1, name1) \
         ImGui::Text("%-8.8s %08" fmt0 "  %-8.8s %08" fmt1 "\n", \
-            #name0, psx::state.cp0.name0, \
-            #name1, psx::state.cp0.name1)
+            #name0, psx::state->cp0.name0, \
+            #name1, psx::state->cp0.name1)
 
     PrintReg(PRIx32, prid);
     Print2Regs(PRIx32, bpc,      PRIx32, bda);
@@ -153,45 +318,45 @@ static void ShowCp2Registers(void) {
 
 static void ShowMemoryControlRegisters(void) {
     ImGui::Text("expansion_1_base_addr      %08" PRIx32 "\n",
-        psx::state.hw.expansion_1_base_addr);
+        psx::state->hw.expansion_1_base_addr);
     ImGui::Text("expansion_2_base_addr      %08" PRIx32 "\n",
-        psx::state.hw.expansion_2_base_addr);
+        psx::state->hw.expansion_2_base_addr);
     ImGui::Text("expansion_1_delay_size     %08" PRIx32 "\n",
-        psx::state.hw.expansion_1_delay_size);
+        psx::state->hw.expansion_1_delay_size);
     ImGui::Text("expansion_3_delay_size     %08" PRIx32 "\n",
-        psx::state.hw.expansion_3_delay_size);
+        psx::state->hw.expansion_3_delay_size);
     ImGui::Text("bios_rom_delay_size        %08" PRIx32 "\n",
-        psx::state.hw.bios_rom_delay_size);
+        psx::state->hw.bios_rom_delay_size);
     ImGui::Text("spu_delay                  %08" PRIx32 "\n",
-        psx::state.hw.spu_delay);
+        psx::state->hw.spu_delay);
     ImGui::Text("cdrom_delay                %08" PRIx32 "\n",
-        psx::state.hw.cdrom_delay);
+        psx::state->hw.cdrom_delay);
     ImGui::Text("expansion_2_delay_size     %08" PRIx32 "\n",
-        psx::state.hw.expansion_2_delay_size);
+        psx::state->hw.expansion_2_delay_size);
     ImGui::Text("common_delay               %08" PRIx32 "\n",
-        psx::state.hw.common_delay);
+        psx::state->hw.common_delay);
     ImGui::Text("ram_size                   %08" PRIx32 "\n",
-        psx::state.hw.ram_size);
+        psx::state->hw.ram_size);
     ImGui::Text("cache_control              %08" PRIx32 "\n",
-        psx::state.hw.cache_control);
+        psx::state->hw.cache_control);
 }
 
 static void ShowJoyControlRegisters(void) {
     ImGui::Text("joy_stat                   %04" PRIx16 "\n",
-        psx::state.hw.joy_stat);
+        psx::state->hw.joy_stat);
     ImGui::Text("joy_mode                   %04" PRIx16 "\n",
-        psx::state.hw.joy_mode);
+        psx::state->hw.joy_mode);
     ImGui::Text("joy_ctrl                   %04" PRIx16 "\n",
-        psx::state.hw.joy_ctrl);
+        psx::state->hw.joy_ctrl);
     ImGui::Text("joy_baud                   %04" PRIx16 "\n",
-        psx::state.hw.joy_baud);
+        psx::state->hw.joy_baud);
 }
 
 static void ShowInterruptControlRegisters(void) {
     ImGui::Text("i_stat                     %04" PRIx16 "\n",
-        psx::state.hw.i_stat);
+        psx::state->hw.i_stat);
     ImGui::Text("i_mask                     %04" PRIx16 "\n",
-        psx::state.hw.i_mask);
+        psx::state->hw.i_mask);
 }
 
 static void ShowTimerRegisters(void) {
@@ -210,149 +375,161 @@ static void ShowTimerRegisters(void) {
     };
 
     ShowRegister<uint16_t>("tim0_value",
-        psx::state.hw.timer[0].counter.read(psx::state.cycles));
+        psx::state->hw.timer[0].counter.read(psx::state->cycles));
     ShowRegister("tim0_target",
-        psx::state.hw.timer[0].target);
+        psx::state->hw.timer[0].target);
     ShowRegister("tim0_mode",
-        psx::state.hw.timer[0].mode,
+        psx::state->hw.timer[0].mode,
         mode_register);
 
     ShowRegister<uint16_t>("tim1_value",
-        psx::state.hw.timer[1].counter.read(psx::state.cycles));
+        psx::state->hw.timer[1].counter.read(psx::state->cycles));
     ShowRegister("tim1_target",
-        psx::state.hw.timer[1].target);
+        psx::state->hw.timer[1].target);
     ShowRegister("tim1_mode",
-        psx::state.hw.timer[1].mode,
+        psx::state->hw.timer[1].mode,
         mode_register);
 
     ShowRegister<uint16_t>("tim2_value",
-        psx::state.hw.timer[2].counter.read(psx::state.cycles));
+        psx::state->hw.timer[2].counter.read(psx::state->cycles));
     ShowRegister("tim2_target",
-        psx::state.hw.timer[2].target);
+        psx::state->hw.timer[2].target);
     ShowRegister("tim2_mode",
-        psx::state.hw.timer[2].mode,
+        psx::state->hw.timer[2].mode,
         mode_register);
 }
 
 static void ShowDMARegisters(void) {
     ImGui::Text("dpcr                       %08" PRIx32 "\n",
-        psx::state.hw.dpcr);
+        psx::state->hw.dpcr);
     ImGui::Text("dicr                       %08" PRIx32 "\n",
-        psx::state.hw.dicr);
+        psx::state->hw.dicr);
 }
 
 static void ShowCDROMRegisters(void) {
     ImGui::Text("index                      %02" PRIx8 "\n",
-        psx::state.cdrom.index);
+        psx::state->cdrom.index);
     ImGui::Text("command                    %02" PRIx8 "\n",
-        psx::state.cdrom.command);
+        psx::state->cdrom.command);
     ImGui::Text("request                    %02" PRIx8 "\n",
-        psx::state.cdrom.request);
+        psx::state->cdrom.request);
 
     ImGui::Text("interrupt_enable           %02" PRIx8 "\n",
-        psx::state.cdrom.interrupt_enable);
+        psx::state->cdrom.interrupt_enable);
     ImGui::Text("interrupt_flag             %02" PRIx8 "\n",
-        psx::state.cdrom.interrupt_flag);
+        psx::state->cdrom.interrupt_flag);
+    ImGui::Text("stat                       %02" PRIx8 "\n",
+        psx::state->cdrom.stat);
+    ImGui::Text("mode                       %02" PRIx8 "\n",
+        psx::state->cdrom.mode);
+    ImGui::Text("lba                        %" PRIu32 "\n",
+        psx::state->cdrom.lba);
+    ImGui::Text("setloc_lba                 %" PRIu32 "%s\n",
+        psx::state->cdrom.setloc_lba,
+        psx::state->cdrom.setloc_pending ? " (pending)" : "");
+    ImGui::Text("data fifo                  %u / %u\n",
+        psx::state->cdrom.data_fifo_index,
+        psx::state->cdrom.data_fifo_length);
 
     ImGui::Text("parameter fifo [%d]\n",
-        psx::state.cdrom.parameter_fifo_index);
+        psx::state->cdrom.parameter_fifo_index);
     for (unsigned i = 0; i < 16; i+=4) {
         ImGui::Text("   %02x  %02x  %02x  %02x\n",
-            psx::state.cdrom.parameter_fifo[i + 0],
-            psx::state.cdrom.parameter_fifo[i + 1],
-            psx::state.cdrom.parameter_fifo[i + 2],
-            psx::state.cdrom.parameter_fifo[i + 3]);
+            psx::state->cdrom.parameter_fifo[i + 0],
+            psx::state->cdrom.parameter_fifo[i + 1],
+            psx::state->cdrom.parameter_fifo[i + 2],
+            psx::state->cdrom.parameter_fifo[i + 3]);
     }
 
     ImGui::Text("response fifo [%d]\n",
-        psx::state.cdrom.response_fifo_index);
+        psx::state->cdrom.response_fifo_index);
     for (unsigned i = 0; i < 16; i+=4) {
         ImGui::Text("   %02x  %02x  %02x  %02x\n",
-            psx::state.cdrom.response_fifo[i + 0],
-            psx::state.cdrom.response_fifo[i + 1],
-            psx::state.cdrom.response_fifo[i + 2],
-            psx::state.cdrom.response_fifo[i + 3]);
+            psx::state->cdrom.response_fifo[i + 0],
+            psx::state->cdrom.response_fifo[i + 1],
+            psx::state->cdrom.response_fifo[i + 2],
+            psx::state->cdrom.response_fifo[i + 3]);
     }
 }
 
 static void ShowGPURegisters(void) {
     ImGui::Text("scanline: %u, frame: %u\n",
-        psx::state.gpu.scanline, psx::state.gpu.frame);
+        psx::state->gpu.scanline, psx::state->gpu.frame);
     ImGui::Text("gpustat                    %08" PRIx32 "\n",
-        psx::state.hw.gpustat);
+        psx::state->hw.gpustat);
 
-    uint32_t op_code = state.gp0.buffer[0] >> 24;
+    uint32_t op_code = state->gp0.buffer[0] >> 24;
     ImGui::Text("GP0 op_code %02" PRIx32 "\n",
-        state.gp0.count > 0 ? op_code : 0);
+        state->gp0.count > 0 ? op_code : 0);
     ImGui::Text("GP0 buffer\n");
-    for (unsigned i = 0; i < state.gp0.count; i++) {
-        ImGui::Text("    %08" PRIx32 "\n", state.gp0.buffer[i]);
+    for (unsigned i = 0; i < state->gp0.count; i++) {
+        ImGui::Text("    %08" PRIx32 "\n", state->gp0.buffer[i]);
     }
 
     ImGui::Text("horizontal_resolution          %" PRIu8 "\n",
-        psx::state.gpu.horizontal_resolution);
+        psx::state->gpu.horizontal_resolution);
     ImGui::Text("vertical_resolution            %" PRIu8 "\n",
-        psx::state.gpu.vertical_resolution);
+        psx::state->gpu.vertical_resolution);
     ImGui::Text("video_mode                     %" PRIu8 "\n",
-        psx::state.gpu.video_mode);
+        psx::state->gpu.video_mode);
     ImGui::Text("display_area_color_depth       %" PRIu8 "\n",
-        psx::state.gpu.display_area_color_depth);
+        psx::state->gpu.display_area_color_depth);
     ImGui::Text("vertical_interlace             %s\n",
-        psx::state.gpu.vertical_interlace ? "true" : "false");
+        psx::state->gpu.vertical_interlace ? "true" : "false");
     ImGui::Text("dma_direction                  %" PRIu8 "\n",
-        psx::state.gpu.dma_direction);
+        psx::state->gpu.dma_direction);
     ImGui::Text("start_of_display_area_x        %" PRIu16 "\n",
-        psx::state.gpu.start_of_display_area_x);
+        psx::state->gpu.start_of_display_area_x);
     ImGui::Text("start_of_display_area_y        %" PRIu16 "\n",
-        psx::state.gpu.start_of_display_area_y);
+        psx::state->gpu.start_of_display_area_y);
     ImGui::Text("horizontal_display_range       %" PRIu16 " - %" PRIu16 "\n",
-        psx::state.gpu.horizontal_display_range_x1,
-        psx::state.gpu.horizontal_display_range_x2);
+        psx::state->gpu.horizontal_display_range_x1,
+        psx::state->gpu.horizontal_display_range_x2);
     ImGui::Text("vertical_display_range         %" PRIu16 " - %" PRIu16 "\n",
-        psx::state.gpu.vertical_display_range_y1,
-        psx::state.gpu.vertical_display_range_y2);
+        psx::state->gpu.vertical_display_range_y1,
+        psx::state->gpu.vertical_display_range_y2);
     ImGui::Text("texture_disable                %s\n",
-        psx::state.gpu.texture_disable ? "true" : "false");
+        psx::state->gpu.texture_disable ? "true" : "false");
     ImGui::Text("dither_enable                  %s\n",
-        psx::state.gpu.dither_enable ? "true" : "false");
+        psx::state->gpu.dither_enable ? "true" : "false");
     ImGui::Text("drawing_to_display_area_enable %s\n",
-        psx::state.gpu.drawing_to_display_area_enable ? "true" : "false");
+        psx::state->gpu.drawing_to_display_area_enable ? "true" : "false");
     ImGui::Text("semi_transparency_mode         %" PRIu8 "\n",
-        psx::state.gpu.semi_transparency_mode);
+        psx::state->gpu.semi_transparency_mode);
     ImGui::Text("force_bit_mask                 %s\n",
-        psx::state.gpu.force_bit_mask ? "true" : "false");
+        psx::state->gpu.force_bit_mask ? "true" : "false");
     ImGui::Text("check_bit_mask                 %s\n",
-        psx::state.gpu.check_bit_mask ? "true" : "false");
+        psx::state->gpu.check_bit_mask ? "true" : "false");
     ImGui::Text("texture_page_x_base            %" PRIu8 "\n",
-        psx::state.gpu.texture_page_x_base);
+        psx::state->gpu.texture_page_x_base);
     ImGui::Text("texture_page_y_base            %" PRIu8 "\n",
-        psx::state.gpu.texture_page_y_base);
+        psx::state->gpu.texture_page_y_base);
     ImGui::Text("texture_page_colors            %" PRIu8 "\n",
-        psx::state.gpu.texture_page_colors);
+        psx::state->gpu.texture_page_colors);
     ImGui::Text("textured_rectangle_x_flip      %s\n",
-        psx::state.gpu.textured_rectangle_x_flip ? "true" : "false");
+        psx::state->gpu.textured_rectangle_x_flip ? "true" : "false");
     ImGui::Text("textured_rectangle_y_flip      %s\n",
-        psx::state.gpu.textured_rectangle_y_flip ? "true" : "false");
+        psx::state->gpu.textured_rectangle_y_flip ? "true" : "false");
     ImGui::Text("texture_window_mask_x          %" PRIu8 "\n",
-        psx::state.gpu.texture_window_mask_x);
+        psx::state->gpu.texture_window_mask_x);
     ImGui::Text("texture_window_mask_y          %" PRIu8 "\n",
-        psx::state.gpu.texture_window_mask_y);
+        psx::state->gpu.texture_window_mask_y);
     ImGui::Text("texture_window_offset_x        %" PRIu8 "\n",
-        psx::state.gpu.texture_window_offset_x);
+        psx::state->gpu.texture_window_offset_x);
     ImGui::Text("texture_window_offset_y        %" PRIu8 "\n",
-        psx::state.gpu.texture_window_offset_y);
+        psx::state->gpu.texture_window_offset_y);
     ImGui::Text("drawing_area_x1                %" PRId16 "\n",
-        psx::state.gpu.drawing_area_x1);
+        psx::state->gpu.drawing_area_x1);
     ImGui::Text("drawing_area_y1                %" PRId16 "\n",
-        psx::state.gpu.drawing_area_y1);
+        psx::state->gpu.drawing_area_y1);
     ImGui::Text("drawing_area_x2                %" PRId16 "\n",
-        psx::state.gpu.drawing_area_x2);
+        psx::state->gpu.drawing_area_x2);
     ImGui::Text("drawing_area_y2                %" PRId16 "\n",
-        psx::state.gpu.drawing_area_y2);
+        psx::state->gpu.drawing_area_y2);
     ImGui::Text("drawing_offset_x               %" PRId16 "\n",
-        psx::state.gpu.drawing_offset_x);
+        psx::state->gpu.drawing_offset_x);
     ImGui::Text("drawing_offset_y               %" PRId16 "\n",
-        psx::state.gpu.drawing_offset_y);
+        psx::state->gpu.drawing_offset_y);
 }
 
 struct Module {
@@ -425,8 +602,8 @@ static void ShowDisassembler(bool *show_disassembler) {
         if (ImGui::BeginTabItem("RAM")) {
             ramDisassembler.DrawContents(
                 assembly::cpu::disassemble,
-                psx::state.ram, sizeof(psx::state.ram),
-                psx::state.cpu.pc,
+                psx::state->ram, sizeof(psx::state->ram),
+                psx::state->cpu.pc,
                 0x80000000,
                 true);
             ImGui::EndTabItem();
@@ -434,16 +611,16 @@ static void ShowDisassembler(bool *show_disassembler) {
         if (ImGui::BeginTabItem("BIOS")) {
             biosDisassembler.DrawContents(
                 assembly::cpu::disassemble,
-                psx::state.bios, sizeof(psx::state.bios),
-                psx::state.cpu.pc,
+                (uint8_t *)psx::state->bios, BIOS_SIZE,
+                psx::state->cpu.pc,
                 0xBFC00000,
                 true);
             ImGui::EndTabItem();
         }
         if (ImGui::BeginTabItem("Cd-ROM")) {
             cdromMemory.DrawContents(
-                psx::state.cd_rom,
-                psx::state.cd_rom_size,
+                (uint8_t *)psx::state->cd_rom,
+                psx::state->cd_rom_size,
                 0x1f000000);
             ImGui::EndTabItem();
         }
@@ -612,7 +789,7 @@ static void ShowDebuggerWindow(void) {
         }
 
         ImGui::Text("Real time: %lums (%lu)\n",
-            psx::state.cycles / 33870lu, psx::state.cycles);
+            psx::state->cycles / 33870lu, psx::state->cycles);
 
         if (psx::halted()) {
             ImGui::Text("Machine halt reason: '%s'\n",
@@ -622,6 +799,60 @@ static void ShowDebuggerWindow(void) {
             if (ImGui::Button("Continue")) { psx::resume(); }
             ImGui::SameLine();
             if (ImGui::Button("Step")) { psx::step(); }
+            ImGui::SameLine();
+            if (ImGui::Button("Rewind")) {
+                if (psx::rewind::step_back(1) != 0) {
+                    debugger::warn(Debugger::CPU, "no earlier rewind capture");
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Step back")) {
+                if (psx::reverse::step_back() != 0) {
+                    debugger::warn(Debugger::CPU, "no earlier rewind capture");
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Reverse continue")) {
+                if (psx::reverse::reverse_continue() != 0) {
+                    debugger::warn(Debugger::CPU,
+                        "no earlier breakpoint hit in the rewind buffer");
+                }
+            }
+            ImGui::SameLine();
+            static char write_addr_input_buf[32];
+            ImGui::SetNextItemWidth(80);
+            bool reverse_to_write = ImGui::InputText("##write_addr",
+                write_addr_input_buf, 32,
+                ImGuiInputTextFlags_CharsHexadecimal |
+                ImGuiInputTextFlags_EnterReturnsTrue);
+            ImGui::SameLine();
+            reverse_to_write |= ImGui::Button("Reverse to write");
+            uint32_t write_addr;
+            if (reverse_to_write &&
+                sscanf(write_addr_input_buf, "%" PRIx32, &write_addr) == 1 &&
+                psx::reverse::reverse_to_write(write_addr) != 0) {
+                debugger::warn(Debugger::CPU,
+                    "no earlier write of {:08x} in the rewind buffer",
+                    write_addr);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Save state")) {
+                if (psx::snapshot::save("psx.state") == 0) {
+                    debugger::info(Debugger::CPU, "saved state 'psx.state'");
+                } else {
+                    debugger::warn(Debugger::CPU,
+                        "cannot save state 'psx.state'");
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Load state")) {
+                if (psx::snapshot::restore("psx.state") == 0) {
+                    debugger::info(Debugger::CPU, "loaded state 'psx.state'");
+                } else {
+                    debugger::warn(Debugger::CPU,
+                        "cannot load state 'psx.state'");
+                }
+            }
         } else {
             if (ImGui::Button("Halt")) {
                 psx::halt("Interrupted by user");
@@ -681,44 +912,37 @@ static void ShowDebuggerWindow(void) {
  */
 void joyKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-#if 0
-    unsigned keyval;
+    bool pressed;
     switch (action) {
-    case GLFW_PRESS: keyval = 1; break;
-    case GLFW_RELEASE: keyval = 0; break;
+    case GLFW_PRESS: pressed = true; break;
+    case GLFW_RELEASE: pressed = false; break;
     default: return;
     }
 
-    psx::controller *controller = psx::state.controllers[activeController];
-    if (controller == NULL) {
+    // Keys typed into the debugger windows are not game inputs.
+    if (pressed && ImGui::GetIO().WantCaptureKeyboard) {
         return;
     }
 
+    uint16_t buttons;
     switch (key) {
-    case GLFW_KEY_A:     controller->A               = keyval; break;
-    case GLFW_KEY_B:     controller->B               = keyval; break;
-    case GLFW_KEY_Z:     controller->Z               = keyval; break;
-    case GLFW_KEY_SPACE: controller->start           = keyval; break;
-    case GLFW_KEY_UP:    controller->direction_up    = keyval; break;
-    case GLFW_KEY_DOWN:  controller->direction_down  = keyval; break;
-    case GLFW_KEY_LEFT:  controller->direction_left  = keyval; break;
-    case GLFW_KEY_RIGHT: controller->direction_right = keyval; break;
-    case GLFW_KEY_L:     controller->L               = keyval; break;
-    case GLFW_KEY_R:     controller->R               = keyval; break;
-    case GLFW_KEY_U:     controller->camera_up       = keyval; break;
-    case GLFW_KEY_J:     controller->camera_down     = keyval; break;
-    case GLFW_KEY_H:     controller->camera_left     = keyval; break;
-    case GLFW_KEY_K:     controller->camera_right    = keyval; break;
-    default: break;
-    }
-
-    controller->direction_x =
-        127 * controller->direction_right -
-        127 * controller->direction_left;
-    controller->direction_y =
-        127 * controller->direction_up -
-        127 * controller->direction_down;
-#endif
+    case GLFW_KEY_UP:        buttons = PAD_UP; break;
+    case GLFW_KEY_DOWN:      buttons = PAD_DOWN; break;
+    case GLFW_KEY_LEFT:      buttons = PAD_LEFT; break;
+    case GLFW_KEY_RIGHT:     buttons = PAD_RIGHT; break;
+    case GLFW_KEY_X:         buttons = PAD_CROSS; break;
+    case GLFW_KEY_C:         buttons = PAD_CIRCLE; break;
+    case GLFW_KEY_Z:         buttons = PAD_SQUARE; break;
+    case GLFW_KEY_S:         buttons = PAD_TRIANGLE; break;
+    case GLFW_KEY_Q:         buttons = PAD_L1; break;
+    case GLFW_KEY_W:         buttons = PAD_R1; break;
+    case GLFW_KEY_A:         buttons = PAD_L2; break;
+    case GLFW_KEY_E:         buttons = PAD_R2; break;
+    case GLFW_KEY_ENTER:     buttons = PAD_START; break;
+    case GLFW_KEY_BACKSPACE: buttons = PAD_SELECT; break;
+    default: return;
+    }
+    psx::input::set_pad_buttons(buttons, pressed);
 }
 
 void addWindowRenderer(void (*renderer)()) {
@@ -728,7 +952,7 @@ void addWindowRenderer(void (*renderer)()) {
 int start_gui()
 {
     // Initialize the machine state.
-    psx::state.reset();
+    psx::state->reset();
     startTime = std::chrono::steady_clock::now();
     startCycles = 0;
 
@@ -800,6 +1024,7 @@ int start_gui()
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     // Main loop
+    psx::timeline::set_thread_name("gui");
     while (!glfwWindowShouldClose(window))
     {
         // Poll and handle events (inputs, window resize, etc.)
@@ -809,6 +1034,10 @@ int start_gui()
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         glfwPollEvents();
 
+        psx::timing::enter(psx::timing::GUI);
+        uint64_t frameStart = psx::timeline::enabled() ?
+            psx::timeline::timestamp() : 0;
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -832,6 +1061,13 @@ int start_gui()
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+        // Waiting for the buffer swap is not charged to the GUI.
+        psx::timing::leave();
+        if (frameStart != 0 && psx::timeline::enabled()) {
+            psx::timeline::complete("gui", "frame", frameStart,
+                psx::timeline::timestamp());
+        }
+
         glfwSwapBuffers(window);
     }
 
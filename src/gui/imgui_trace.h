@@ -72,7 +72,10 @@ struct Trace
         ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
         ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
 
-        const int line_total_count = TraceBuffer->length();
+        // Copy of the trace, most recent entry last; the interpreter
+        // may append entries while the window is drawn.
+        std::vector<Debugger::TraceEntry> entries = TraceBuffer->snapshot();
+        const int line_total_count = entries.size();
         ImGuiListClipper clipper;
 
         // Draw vertical separator
@@ -90,7 +93,7 @@ struct Trace
             // Display visible lines
             for (int line_i = clipper.DisplayStart; line_i < clipper.DisplayEnd; line_i++)
             {
-                Debugger::TraceEntry entry = TraceBuffer->peek_front(line_i);
+                Debugger::TraceEntry entry = entries[entries.size() - line_i - 1];
                 ImGui::Text(format_address, s.AddrDigitsCount, entry.first);
 
                 // Draw Hexadecimal
@@ -124,9 +127,9 @@ struct Trace
             std::ofstream os;
             os.open(name + "_trace_" + std::to_string(ExportCounter) + ".txt");
             ExportCounter++;
-            for (size_t i = 0; i < TraceBuffer->length(); i++)
+            for (auto it = entries.rbegin(); it != entries.rend(); it++)
             {
-                Debugger::TraceEntry entry = TraceBuffer->peek_front(i);
+                Debugger::TraceEntry entry = *it;
                 os << std::hex << std::setfill(' ') << std::right;
                 os << std::setw(16) << entry.first << "    ";
                 os << std::hex << std::setfill('0');
@@ -0,0 +1,148 @@
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/color.h>
+#include <fmt/format.h>
+
+#include <psx/debugger.h>
+#include <psx/disc.h>
+#include <psx/headless.h>
+#include <psx/profiler.h>
+#include <psx/psx.h>
+
+namespace psx {
+
+/// SIGUSR1 toggles the profiler while the machine is running.
+static void toggle_profiler(int) {
+    psx::profiler::set_enabled(!psx::profiler::enabled());
+}
+
+/**
+ * @brief Resume the machine and wait until it has emitted \p max_frames
+ *  frames, or until it halts.
+ * @return true if the frame budget was reached.
+ */
+static bool run_frames(unsigned long max_frames) {
+    psx::machine()->frame_budget = max_frames;
+    psx::machine()->frame_budget_reached = false;
+    psx::resume();
+
+    // The frame budget is enforced by the interpreter thread at the
+    // vertical blank: waiting for the halt from here is sufficient and
+    // costs nothing to the emulation.
+    while (!psx::halted()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return psx::machine()->frame_budget_reached;
+}
+
+static void print_halt_reason(std::string const &prefix) {
+    fmt::print(fmt::fg(fmt::color::orange_red),
+        "{}machine halted at frame {}, cycle {}: {}\n", prefix,
+        psx::state->gpu.frame, psx::state->cycles, psx::halted_reason());
+}
+
+static void print_disc_stats(std::string const &prefix) {
+    struct psx::disc::stats disc_stats = psx::disc::stats();
+    fmt::print("{}disc: {} sector reads, {} cache hits, {} cold misses, "
+               "{} prefetched\n", prefix,
+        disc_stats.reads, disc_stats.hits, disc_stats.cold_misses,
+        disc_stats.prefetched);
+}
+
+int start_headless(unsigned long max_frames) {
+    // Initialize the machine state.
+    psx::state->reset();
+
+    signal(SIGUSR1, toggle_profiler);
+
+    // Start interpreter thread.
+    psx::start();
+    bool budget_reached = run_frames(max_frames);
+    if (!budget_reached) {
+        print_halt_reason("");
+    }
+
+    print_disc_stats("");
+    psx::stop();
+    return budget_reached ? 0 : 1;
+}
+
+int start_headless_fork(unsigned long fork_frame, unsigned nr_children,
+                        unsigned long max_frames,
+                        std::function<void(unsigned)> setup_child) {
+    psx::state->reset();
+
+    psx::start();
+    if (!run_frames(fork_frame)) {
+        print_halt_reason("");
+        psx::stop();
+        return 1;
+    }
+
+    // Only the calling thread is duplicated by fork(): the helper
+    // threads are stopped in the parent, and restarted in each child.
+    bool logger_running = debugger::logger_running;
+    psx::stop();
+    psx::disc::stop();
+    debugger::stop_logger();
+    fflush(NULL);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (unsigned nr = 0; nr < nr_children; nr++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fmt::print(fmt::fg(fmt::color::orange_red),
+                "cannot fork child {}: {}\n", nr, strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            std::string prefix = fmt::format("[{}] ", nr);
+            if (logger_running) {
+                debugger::start_logger();
+            }
+            setup_child(nr);
+            signal(SIGUSR1, toggle_profiler);
+            psx::start();
+            bool budget_reached = run_frames(max_frames);
+            if (!budget_reached) {
+                print_halt_reason(prefix);
+            }
+            print_disc_stats(prefix);
+            psx::stop();
+            debugger::stop_logger();
+            exit(budget_reached ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+
+    fmt::print("forked {} children at frame {}, cycle {} in {:.3f} ms\n",
+        children.size(), psx::state->gpu.frame, psx::state->cycles,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+
+    unsigned failed = nr_children - children.size();
+    for (pid_t pid : children) {
+        int status;
+        if (waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    fmt::print("{} of {} children reached the frame budget\n",
+        nr_children - failed, nr_children);
+    return failed == 0 ? 0 : 1;
+}
+
+}; /* namespace psx */
@@ -23,18 +23,18 @@ void eval_MFC0(uint32_t instr) {
     uint32_t val;
 
     switch (rd) {
-    case DCIC:      val = state.cp0.dcic; break;
-    case BDA:       val = state.cp0.bda; break;
-    case BDAM:      val = state.cp0.bdam; break;
-    case BPC:       val = state.cp0.bpc; break;
-    case BPCM:      val = state.cp0.bpcm; break;
-    case JUMPDEST:  val = state.cp0.jumpdest; break;
-    case BadVAddr:  val = state.cp0.badvaddr; break;
-    case SR:        val = state.cp0.sr; break;
-    case Cause:     val = state.cp0.cause; break;
-    case EPC:       val = state.cp0.epc; break;
+    case DCIC:      val = state->cp0.dcic; break;
+    case BDA:       val = state->cp0.bda; break;
+    case BDAM:      val = state->cp0.bdam; break;
+    case BPC:       val = state->cp0.bpc; break;
+    case BPCM:      val = state->cp0.bpcm; break;
+    case JUMPDEST:  val = state->cp0.jumpdest; break;
+    case BadVAddr:  val = state->cp0.badvaddr; break;
+    case SR:        val = state->cp0.sr; break;
+    case Cause:     val = state->cp0.cause; break;
+    case EPC:       val = state->cp0.epc; break;
     case PrId:
-        val = state.cp0.prid;
+        val = state->cp0.prid;
         psx::halt("MFC0 prid");
         break;
     default:
@@ -46,7 +46,7 @@ void eval_MFC0(uint32_t instr) {
 
     debugger::info(Debugger::COP0, "{} -> {:08x}",
         assembly::cpu::Cop0RegisterNames[rd], val);
-    state.cpu.gpr[rt] = val;
+    state->cpu.gpr[rt] = val;
 }
 
 /** @brief Interpret a MTC0 instruction. */
@@ -54,30 +54,30 @@ void eval_MTC0(uint32_t instr) {
     using namespace assembly::cpu;
     uint32_t rt = assembly::getRt(instr);
     uint32_t rd = assembly::getRd(instr);
-    uint32_t val = state.cpu.gpr[rt];
+    uint32_t val = state->cpu.gpr[rt];
 
     debugger::info(Debugger::COP0, "{} <- {:08x}",
         assembly::cpu::Cop0RegisterNames[rd], val);
 
     switch (rd) {
-    case DCIC:      state.cp0.dcic = val; break;
-    case BDA:       state.cp0.bda = val; break;
-    case BDAM:      state.cp0.bdam = val; break;
-    case BPC:       state.cp0.bpc = val; break;
-    case BPCM:      state.cp0.bpcm = val; break;
-    case JUMPDEST:  state.cp0.jumpdest = val; break;
-    case BadVAddr:  state.cp0.badvaddr = val; break;
-    case EPC:       state.cp0.epc = val; break;
+    case DCIC:      state->cp0.dcic = val; break;
+    case BDA:       state->cp0.bda = val; break;
+    case BDAM:      state->cp0.bdam = val; break;
+    case BPC:       state->cp0.bpc = val; break;
+    case BPCM:      state->cp0.bpcm = val; break;
+    case JUMPDEST:  state->cp0.jumpdest = val; break;
+    case BadVAddr:  state->cp0.badvaddr = val; break;
+    case EPC:       state->cp0.epc = val; break;
 
     case SR:
         // TODO check config bits
-        state.cp0.sr = val;
+        state->cp0.sr = val;
         check_interrupt();
         break;
 
     case Cause:
-        state.cp0.cause =
-            (state.cp0.cause & ~CAUSE_IP_MASK) |
+        state->cp0.cause =
+            (state->cp0.cause & ~CAUSE_IP_MASK) |
             (val             &  CAUSE_IP_MASK);
         // Interrupts bit 0 and 1 can be used to raise
         // software interrupts.
@@ -87,7 +87,7 @@ void eval_MTC0(uint32_t instr) {
         break;
 
     case PrId:
-        state.cp0.prid = val;
+        state->cp0.prid = val;
         psx::halt("MTC0 prid");
         break;
     default:
@@ -112,9 +112,9 @@ void eval_CTC0(uint32_t instr) {
 
 /** @brief Interpret the RFE instruction. */
 void eval_RFE(uint32_t instr) {
-    uint32_t ku_ie = state.cp0.sr & UINT32_C(0x3f);
-    state.cp0.sr &= ~UINT32_C(0xf);
-    state.cp0.sr |= ku_ie >> 2;
+    uint32_t ku_ie = state->cp0.sr & UINT32_C(0x3f);
+    state->cp0.sr &= ~UINT32_C(0xf);
+    state->cp0.sr |= ku_ie >> 2;
     // Clearing the exception flag may have unmasked a
     // pending interrupt.
     check_interrupt();
@@ -1,7 +1,9 @@
 
+#include <array>
 #include <iomanip>
 #include <iostream>
 #include <cstring>
+#include <utility>
 
 #include <psx/psx.h>
 #include <psx/memory.h>
@@ -26,187 +28,953 @@ namespace interpreter::cpu {
 //  6-9    Always zero                        (ignored by hardware)
 //  0-5    Real GTE Command Number (00h..3Fh) (used by hardware)
 
-static bool get_sf(uint32_t instr) {
+static constexpr bool get_sf(uint32_t instr) {
     return (instr >> 19) & UINT32_C(1);
 }
 
-static uint32_t get_mvmva_mm(uint32_t instr) {
+static constexpr uint32_t get_mvmva_mm(uint32_t instr) {
     return (instr >> 17) & UINT32_C(0x3);
 }
 
-static uint32_t get_mvmva_mv(uint32_t instr) {
+static constexpr uint32_t get_mvmva_mv(uint32_t instr) {
     return (instr >> 15) & UINT32_C(0x3);
 }
 
-static uint32_t get_mvmva_tv(uint32_t instr) {
+static constexpr uint32_t get_mvmva_tv(uint32_t instr) {
     return (instr >> 13) & UINT32_C(0x3);
 }
 
-static bool get_lm(uint32_t instr) {
+static constexpr bool get_lm(uint32_t instr) {
     return (instr >> 10) & UINT32_C(1);
 }
 
-static uint32_t get_opc(uint32_t instr) {
-    return instr & UINT32_C(0x2f);
+static constexpr uint32_t get_opc(uint32_t instr) {
+    return instr & UINT32_C(0x3f);
+}
+
+/// Control registers; the matrices and vectors are identified by
+/// their first register.
+enum cp2_control_register {
+    RT = 0,         /**< Rotation matrix */
+    TR = 5,         /**< Translation vector */
+    LLM = 8,        /**< Light source matrix */
+    BK = 13,        /**< Background color */
+    LCM = 16,       /**< Light color matrix */
+    FC = 21,        /**< Far color */
+    OFX = 24,       /**< Screen offset */
+    OFY = 25,
+    H = 26,         /**< Projection plane distance */
+    DQA = 27,       /**< Depth queuing coefficient */
+    DQB = 28,       /**< Depth queuing offset */
+    ZSF3 = 29,      /**< Average Z scale factors */
+    ZSF4 = 30,
+    FLAG = 31,
+};
+
+//  FLAG register bits. The MAC1-3 and IR1-3 bits are indexed by the
+//  accumulator number.
+#define FLAG_ERROR              (UINT32_C(1) << 31)
+#define FLAG_MAC_POS(index)     (UINT32_C(1) << (31 - (index)))
+#define FLAG_MAC_NEG(index)     (UINT32_C(1) << (28 - (index)))
+#define FLAG_IR(index)          (UINT32_C(1) << (25 - (index)))
+#define FLAG_COLOR(index)       (UINT32_C(1) << (22 - (index)))
+#define FLAG_SZ3_OTZ            (UINT32_C(1) << 18)
+#define FLAG_DIVIDE             (UINT32_C(1) << 17)
+#define FLAG_MAC0_POS           (UINT32_C(1) << 16)
+#define FLAG_MAC0_NEG           (UINT32_C(1) << 15)
+#define FLAG_SX2                (UINT32_C(1) << 14)
+#define FLAG_SY2                (UINT32_C(1) << 13)
+#define FLAG_IR0                (UINT32_C(1) << 12)
+/// Bits summarized in the error bit: 30-23 and 18-13.
+#define FLAG_ERROR_MASK         UINT32_C(0x7f87e000)
+
+/// Reciprocal table of the perspective division (unsigned Newton-Raphson),
+/// for divisors 0x8000-0x10000 in steps of 0x80.
+struct unr_reciprocals {
+    uint8_t entries[0x101];
+    constexpr unr_reciprocals() : entries() {
+        for (int nr = 0; nr < 0x101; nr++) {
+            int val = (0x40000 / (nr + 0x100) + 1) / 2 - 0x101;
+            entries[nr] = val < 0 ? 0 : val;
+        }
+    }
+};
+
+static constexpr unr_reciprocals unr_table;
+
+/// Return the signed 16-bit lower half of \p val.
+static inline int32_t lo(uint32_t val) {
+    return (int16_t)val;
+}
+
+/// Return the signed 16-bit upper half of \p val.
+static inline int32_t hi(uint32_t val) {
+    return (int16_t)(val >> 16);
+}
+
+/// Load the 3x3 matrix of signed 16-bit elements stored from the control
+/// register \p base, in row order.
+static inline void get_matrix(cp2_registers const &gte, unsigned base,
+                              int32_t m[3][3]) {
+    for (unsigned nr = 0; nr < 9; nr++) {
+        m[nr / 3][nr % 3] = (int16_t)(gte.cr[base + nr / 2] >> (16 * (nr & 1)));
+    }
 }
 
+/// Load the vector V0, V1 or V2.
+static inline void get_vector(cp2_registers const &gte, unsigned nr,
+                              int32_t v[3]) {
+    v[0] = lo(gte.dr[2 * nr]);
+    v[1] = hi(gte.dr[2 * nr]);
+    v[2] = lo(gte.dr[2 * nr + 1]);
+}
+
+/// Load the vector [IR1,IR2,IR3].
+static inline void get_ir(cp2_registers const &gte, int32_t v[3]) {
+    v[0] = (int32_t)gte.ir1;
+    v[1] = (int32_t)gte.ir2;
+    v[2] = (int32_t)gte.ir3;
+}
+
+/// Load the 32-bit vector stored from the control register \p base.
+static inline void get_translation(cp2_registers const &gte, unsigned base,
+                                   int64_t t[3]) {
+    t[0] = (int32_t)gte.cr[base];
+    t[1] = (int32_t)gte.cr[base + 1];
+    t[2] = (int32_t)gte.cr[base + 2];
+}
+
+/// Flag the 44-bit overflow of an intermediate MAC1-3 value, and return
+/// the value truncated to 44 bits.
+template <unsigned index>
+static inline int64_t check_mac(cp2_registers &gte, int64_t value) {
+    if (value > INT64_C(0x7ffffffffff)) {
+        gte.cr[FLAG] |= FLAG_MAC_POS(index);
+    } else if (value < -INT64_C(0x80000000000)) {
+        gte.cr[FLAG] |= FLAG_MAC_NEG(index);
+    }
+    return (int64_t)((uint64_t)value << 20) >> 20;
+}
+
+/// Set MAC0, flagging the 32-bit overflow.
+static inline void set_mac0(cp2_registers &gte, int64_t value) {
+    if (value > INT32_MAX) {
+        gte.cr[FLAG] |= FLAG_MAC0_POS;
+    } else if (value < INT32_MIN) {
+        gte.cr[FLAG] |= FLAG_MAC0_NEG;
+    }
+    gte.mac0 = (uint32_t)value;
+}
+
+/// Set MAC1-3 to \p value shifted by \p shift, flagging the overflow.
+template <unsigned index, unsigned shift>
+static inline void set_mac(cp2_registers &gte, int64_t value) {
+    check_mac<index>(gte, value);
+    gte.dr[24 + index] = (uint32_t)(value >> shift);
+}
+
+/// Set IR1-3 to \p value saturated to -0x8000..0x7fff, or 0..0x7fff
+/// if \p lm is set.
+template <unsigned index, bool lm>
+static inline void set_ir(cp2_registers &gte, int32_t value) {
+    constexpr int32_t min = lm ? 0 : -0x8000;
+    if (value < min) {
+        value = min;
+        gte.cr[FLAG] |= FLAG_IR(index);
+    } else if (value > 0x7fff) {
+        value = 0x7fff;
+        gte.cr[FLAG] |= FLAG_IR(index);
+    }
+    gte.dr[8 + index] = (uint32_t)value;
+}
+
+/// Set IR0 to \p value saturated to 0..0x1000.
+static inline void set_ir0(cp2_registers &gte, int32_t value) {
+    if (value < 0) {
+        value = 0;
+        gte.cr[FLAG] |= FLAG_IR0;
+    } else if (value > 0x1000) {
+        value = 0x1000;
+        gte.cr[FLAG] |= FLAG_IR0;
+    }
+    gte.ir0 = (uint32_t)value;
+}
+
+/// Set MAC1-3 to \p value shifted by \p shift, and IR1-3 to the saturated
+/// MAC value.
+template <unsigned index, unsigned shift, bool lm>
+static inline void set_mac_ir(cp2_registers &gte, int64_t value) {
+    check_mac<index>(gte, value);
+    int32_t mac = (int32_t)(value >> shift);
+    gte.dr[24 + index] = (uint32_t)mac;
+    set_ir<index, lm>(gte, mac);
+}
+
+/// Push a value saturated to 0..0xffff to the SZ FIFO.
+static inline void push_sz(cp2_registers &gte, int64_t value) {
+    if (value < 0) {
+        value = 0;
+        gte.cr[FLAG] |= FLAG_SZ3_OTZ;
+    } else if (value > 0xffff) {
+        value = 0xffff;
+        gte.cr[FLAG] |= FLAG_SZ3_OTZ;
+    }
+    gte.sz0 = gte.sz1;
+    gte.sz1 = gte.sz2;
+    gte.sz2 = gte.sz3;
+    gte.sz3 = (uint32_t)value;
+}
+
+/// Saturate a screen coordinate to -0x400..0x3ff.
+static inline uint32_t saturate_sxy(cp2_registers &gte, int32_t value,
+                                    uint32_t flag) {
+    if (value < -0x400) {
+        value = -0x400;
+        gte.cr[FLAG] |= flag;
+    } else if (value > 0x3ff) {
+        value = 0x3ff;
+        gte.cr[FLAG] |= flag;
+    }
+    return (uint16_t)value;
+}
+
+/// Push the screen coordinates to the SXY FIFO.
+static inline void push_sxy(cp2_registers &gte, int32_t x, int32_t y) {
+    gte.sxy0 = gte.sxy1;
+    gte.sxy1 = gte.sxy2;
+    gte.sxy2 = saturate_sxy(gte, x, FLAG_SX2) |
+               (saturate_sxy(gte, y, FLAG_SY2) << 16);
+    gte.sxyp = gte.sxy2;
+}
+
+/// Saturate a color component to 0..0xff.
+template <unsigned index>
+static inline uint32_t saturate_color(cp2_registers &gte, int32_t value) {
+    if (value < 0) {
+        value = 0;
+        gte.cr[FLAG] |= FLAG_COLOR(index);
+    } else if (value > 0xff) {
+        value = 0xff;
+        gte.cr[FLAG] |= FLAG_COLOR(index);
+    }
+    return (uint32_t)value;
+}
+
+/// Push [MAC1,MAC2,MAC3] SAR 4 and the CODE byte to the color FIFO.
+static inline void push_color(cp2_registers &gte) {
+    uint32_t r = saturate_color<1>(gte, (int32_t)gte.mac1 >> 4);
+    uint32_t g = saturate_color<2>(gte, (int32_t)gte.mac2 >> 4);
+    uint32_t b = saturate_color<3>(gte, (int32_t)gte.mac3 >> 4);
+    gte.rgb0 = gte.rgb1;
+    gte.rgb1 = gte.rgb2;
+    gte.rgb2 = r | (g << 8) | (b << 16) | (gte.rgbc & UINT32_C(0xff000000));
+}
+
+/// Compute one row of [MAC1,MAC2,MAC3] = (T * 0x1000 + M * V),
+/// the overflow is checked after each addition.
+template <unsigned index>
+static inline int64_t dot(cp2_registers &gte, int64_t t,
+                          int32_t const m[3], int32_t const v[3]) {
+    int64_t sum = check_mac<index>(gte, (t << 12) + m[0] * v[0]);
+    sum = check_mac<index>(gte, sum + m[1] * v[1]);
+    return sum + m[2] * v[2];
+}
+
+/// [IR1,IR2,IR3] = [MAC1,MAC2,MAC3] = (T * 0x1000 + M * V) SAR shift.
+template <unsigned shift, bool lm>
+static inline void multiply(cp2_registers &gte, int32_t const m[3][3],
+                            int32_t const v[3], int64_t const t[3]) {
+    set_mac_ir<1, shift, lm>(gte, dot<1>(gte, t[0], m[0], v));
+    set_mac_ir<2, shift, lm>(gte, dot<2>(gte, t[1], m[1], v));
+    set_mac_ir<3, shift, lm>(gte, dot<3>(gte, t[2], m[2], v));
+}
+
+/// Hardware bug of MVMVA with the far color translation: the first
+/// column is only accounted for in the flags, the result is computed
+/// from the last two columns only.
+template <unsigned shift, bool lm>
+static inline void multiply_far_color(cp2_registers &gte,
+                                      int32_t const m[3][3],
+                                      int32_t const v[3]) {
+    int64_t t[3];
+    get_translation(gte, FC, t);
+    int64_t x = check_mac<1>(gte, (t[0] << 12) + m[0][0] * v[0]);
+    int64_t y = check_mac<2>(gte, (t[1] << 12) + m[1][0] * v[0]);
+    int64_t z = check_mac<3>(gte, (t[2] << 12) + m[2][0] * v[0]);
+    set_ir<1, false>(gte, (int32_t)(x >> shift));
+    set_ir<2, false>(gte, (int32_t)(y >> shift));
+    set_ir<3, false>(gte, (int32_t)(z >> shift));
+    x = check_mac<1>(gte, m[0][1] * v[1]) + m[0][2] * v[2];
+    y = check_mac<2>(gte, m[1][1] * v[1]) + m[1][2] * v[2];
+    z = check_mac<3>(gte, m[2][1] * v[1]) + m[2][2] * v[2];
+    set_mac_ir<1, shift, lm>(gte, x);
+    set_mac_ir<2, shift, lm>(gte, y);
+    set_mac_ir<3, shift, lm>(gte, z);
+}
+
+/// Interpolate the color \p mac with the far color:
+/// [IR1,IR2,IR3] = (FC * 0x1000 - MAC) SAR shift
+/// [IR1,IR2,IR3] = [MAC1,MAC2,MAC3] = (IR * IR0 + MAC) SAR shift.
+template <unsigned shift, bool lm>
+static inline void interpolate(cp2_registers &gte, int64_t const mac[3]) {
+    int64_t fc[3];
+    get_translation(gte, FC, fc);
+    set_mac_ir<1, shift, false>(gte, (fc[0] << 12) - mac[0]);
+    set_mac_ir<2, shift, false>(gte, (fc[1] << 12) - mac[1]);
+    set_mac_ir<3, shift, false>(gte, (fc[2] << 12) - mac[2]);
+    int32_t ir0 = (int32_t)gte.ir0;
+    set_mac_ir<1, shift, lm>(gte, (int32_t)gte.ir1 * ir0 + mac[0]);
+    set_mac_ir<2, shift, lm>(gte, (int32_t)gte.ir2 * ir0 + mac[1]);
+    set_mac_ir<3, shift, lm>(gte, (int32_t)gte.ir3 * ir0 + mac[2]);
+}
+
+/// Return [R*IR1,G*IR2,B*IR3] SHL 4, with the color of RGBC.
+static inline void color_product(cp2_registers const &gte, int64_t mac[3]) {
+    int32_t r = gte.rgbc & 0xff;
+    int32_t g = (gte.rgbc >> 8) & 0xff;
+    int32_t b = (gte.rgbc >> 16) & 0xff;
+    mac[0] = (int64_t)(r * (int32_t)gte.ir1) << 4;
+    mac[1] = (int64_t)(g * (int32_t)gte.ir2) << 4;
+    mac[2] = (int64_t)(b * (int32_t)gte.ir3) << 4;
+}
+
+/// Light the normal vector \p v:
+/// [IR1,IR2,IR3] = [MAC1,MAC2,MAC3] = (LLM * V) SAR shift
+/// [IR1,IR2,IR3] = [MAC1,MAC2,MAC3] = (BK * 0x1000 + LCM * IR) SAR shift.
+template <unsigned shift, bool lm>
+static inline void light(cp2_registers &gte, int32_t const v[3]) {
+    int32_t m[3][3], ir[3];
+    int64_t t[3] = { 0, 0, 0 };
+    get_matrix(gte, LLM, m);
+    multiply<shift, lm>(gte, m, v, t);
+    get_ir(gte, ir);
+    get_matrix(gte, LCM, m);
+    get_translation(gte, BK, t);
+    multiply<shift, lm>(gte, m, ir, t);
+}
+
+/// Perspective division H / SZ3 with the UNR reciprocal, returning
+/// a 1.16 fixed-point value saturated to 0x1ffff. The divide overflow
+/// flag is only raised for H >= SZ3 * 2, the saturation of the
+/// quotient is silent.
+static inline uint32_t divide(cp2_registers &gte) {
+    uint32_t h = gte.cr[H] & 0xffff;
+    uint32_t sz3 = gte.sz3;
+    if (h >= sz3 * 2) {
+        gte.cr[FLAG] |= FLAG_DIVIDE;
+        return 0x1ffff;
+    }
+
+    unsigned shift = __builtin_clz(sz3) - 16;
+    uint32_t n = h << shift;
+    uint32_t d = sz3 << shift;
+    uint32_t u = unr_table.entries[(d - 0x7fc0) >> 7] + 0x101;
+    d = (0x2000080 - d * u) >> 8;
+    d = (0x0000080 + d * u) >> 8;
+    uint32_t q = ((uint64_t)n * d + 0x8000) >> 16;
+    return q > 0x1ffff ? 0x1ffff : q;
+}
+
+/// Perspective transformation of the vector \p v. The depth cueing
+/// is computed for the last vector only.
+template <unsigned shift, bool lm, bool last>
+static inline void transform(cp2_registers &gte, int32_t const v[3]) {
+    int32_t m[3][3];
+    int64_t t[3];
+    get_matrix(gte, RT, m);
+    get_translation(gte, TR, t);
+
+    int64_t x = dot<1>(gte, t[0], m[0], v);
+    int64_t y = dot<2>(gte, t[1], m[1], v);
+    int64_t z = dot<3>(gte, t[2], m[2], v);
+    set_mac_ir<1, shift, lm>(gte, x);
+    set_mac_ir<2, shift, lm>(gte, y);
+    set_mac<3, shift>(gte, z);
+
+    // IR3 is saturated from MAC3, but flagged from the unshifted
+    // result when sf=0.
+    constexpr int32_t min = lm ? 0 : -0x8000;
+    int32_t mac3 = (int32_t)gte.mac3;
+    gte.ir3 = (uint32_t)(mac3 < min ? min : mac3 > 0x7fff ? 0x7fff : mac3);
+    if ((z >> 12) < -0x8000 || (z >> 12) > 0x7fff) {
+        gte.cr[FLAG] |= FLAG_IR(3);
+    }
+    push_sz(gte, z >> 12);
+
+    int64_t q = divide(gte);
+    int64_t sx = q * (int32_t)gte.ir1 + (int32_t)gte.cr[OFX];
+    int64_t sy = q * (int32_t)gte.ir2 + (int32_t)gte.cr[OFY];
+    set_mac0(gte, sx);
+    set_mac0(gte, sy);
+    push_sxy(gte, (int32_t)(sx >> 16), (int32_t)(sy >> 16));
+
+    if constexpr (last) {
+        int64_t sz = q * lo(gte.cr[DQA]) + (int32_t)gte.cr[DQB];
+        set_mac0(gte, sz);
+        set_ir0(gte, (int32_t)(sz >> 12));
+    }
+}
+
+/// Clear the FLAG register at the start of a command.
+static inline cp2_registers &begin_command(void) {
+    cp2_registers &gte = state->cp2;
+    gte.cr[FLAG] = 0;
+    return gte;
+}
+
+/// Set the error bit of the FLAG register at the end of a command.
+static inline void end_command(cp2_registers &gte) {
+    if (gte.cr[FLAG] & FLAG_ERROR_MASK) {
+        gte.cr[FLAG] |= FLAG_ERROR;
+    }
+}
+
+//  The commands are instantiated for every combination of their sf and
+//  lm bits (and of the MVMVA operands), and dispatched from tables
+//  indexed by the instruction bits: the kernels are free of runtime
+//  decoding.
+
 /// Perspective Transformation single.
+template <bool sf, bool lm>
 static void eval_RTPS(uint32_t instr) {
-    psx::halt("RTPS unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    get_vector(gte, 0, v);
+    transform<sf * 12, lm, true>(gte, v);
+    end_command(gte);
 }
 
 /// Normal clipping.
 static void eval_NCLIP(uint32_t instr) {
-    psx::halt("NCLIP unimplemented");
+    cp2_registers &gte = begin_command();
+    int64_t x0 = lo(gte.sxy0), y0 = hi(gte.sxy0);
+    int64_t x1 = lo(gte.sxy1), y1 = hi(gte.sxy1);
+    int64_t x2 = lo(gte.sxy2), y2 = hi(gte.sxy2);
+    set_mac0(gte, x0 * y1 + x1 * y2 + x2 * y0 - x0 * y2 - x1 * y0 - x2 * y1);
+    end_command(gte);
 }
 
 /// Outer product of 2 vectors.
+template <bool sf, bool lm>
 static void eval_OP(uint32_t instr) {
-    psx::halt("OP(sf) unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t d1 = lo(gte.cr[RT]);
+    int32_t d2 = lo(gte.cr[RT + 2]);
+    int32_t d3 = lo(gte.cr[RT + 4]);
+    int32_t ir[3];
+    get_ir(gte, ir);
+    set_mac_ir<1, shift, lm>(gte, (int64_t)(ir[2] * d2) - ir[1] * d3);
+    set_mac_ir<2, shift, lm>(gte, (int64_t)(ir[0] * d3) - ir[2] * d1);
+    set_mac_ir<3, shift, lm>(gte, (int64_t)(ir[1] * d1) - ir[0] * d2);
+    end_command(gte);
+}
+
+/// Depth Cueing of the color \p rgb.
+template <unsigned shift, bool lm>
+static inline void depth_cue(cp2_registers &gte, uint32_t rgb) {
+    int64_t mac[3] = {
+        (int64_t)(rgb & 0xff) << 16,
+        (int64_t)((rgb >> 8) & 0xff) << 16,
+        (int64_t)((rgb >> 16) & 0xff) << 16,
+    };
+    interpolate<shift, lm>(gte, mac);
+    push_color(gte);
 }
 
 /// Depth Cueing single.
+template <bool sf, bool lm>
 static void eval_DPCS(uint32_t instr) {
-    psx::halt("DPCS unimplemented");
+    cp2_registers &gte = begin_command();
+    depth_cue<sf * 12, lm>(gte, gte.rgbc);
+    end_command(gte);
 }
 
 /// Interpolation of a vector and far color vector.
+template <bool sf, bool lm>
 static void eval_INTPL(uint32_t instr) {
-    psx::halt("INTPL unimplemented");
+    cp2_registers &gte = begin_command();
+    int64_t mac[3] = {
+        (int64_t)(int32_t)gte.ir1 << 12,
+        (int64_t)(int32_t)gte.ir2 << 12,
+        (int64_t)(int32_t)gte.ir3 << 12,
+    };
+    interpolate<sf * 12, lm>(gte, mac);
+    push_color(gte);
+    end_command(gte);
+}
+
+/// Return the bits of the MVMVA instruction with the operands \p params.
+static constexpr uint32_t get_mvmva_instr(unsigned params) {
+    return ((params & UINT32_C(0xfe)) << 12) | ((params & UINT32_C(1)) << 10);
+}
+
+/// Return the MVMVA operands: the instruction bits 13-19 (sf, mx, v, cv)
+/// and 10 (lm).
+static constexpr unsigned get_mvmva_params(uint32_t instr) {
+    return ((instr >> 12) & UINT32_C(0xfe)) | get_lm(instr);
 }
 
 /// Multiply vector by matrix and add vector.
+template <unsigned params>
 static void eval_MVMVA(uint32_t instr) {
-    psx::halt("MVMVA unimplemented");
+    constexpr uint32_t bits = get_mvmva_instr(params);
+    constexpr unsigned shift = get_sf(bits) * 12;
+    constexpr bool lm = get_lm(bits);
+    constexpr uint32_t mm = get_mvmva_mm(bits);
+    constexpr uint32_t mv = get_mvmva_mv(bits);
+    constexpr uint32_t tv = get_mvmva_tv(bits);
+
+    cp2_registers &gte = begin_command();
+    int32_t m[3][3], v[3];
+    int64_t t[3] = { 0, 0, 0 };
+
+    if constexpr (mm == 0) {
+        get_matrix(gte, RT, m);
+    } else if constexpr (mm == 1) {
+        get_matrix(gte, LLM, m);
+    } else if constexpr (mm == 2) {
+        get_matrix(gte, LCM, m);
+    } else {
+        // Reserved: garbage matrix built from RGBC, IR0, RT13 and RT22.
+        m[0][0] = -(int32_t)((gte.rgbc & 0xff) << 4);
+        m[0][1] = (int32_t)((gte.rgbc & 0xff) << 4);
+        m[0][2] = (int32_t)gte.ir0;
+        m[1][0] = m[1][1] = m[1][2] = lo(gte.cr[RT + 1]);
+        m[2][0] = m[2][1] = m[2][2] = lo(gte.cr[RT + 2]);
+    }
+
+    if constexpr (mv == 3) {
+        get_ir(gte, v);
+    } else {
+        get_vector(gte, mv, v);
+    }
+
+    if constexpr (tv == 2) {
+        multiply_far_color<shift, lm>(gte, m, v);
+    } else {
+        if constexpr (tv == 0) {
+            get_translation(gte, TR, t);
+        } else if constexpr (tv == 1) {
+            get_translation(gte, BK, t);
+        }
+        multiply<shift, lm>(gte, m, v, t);
+    }
+    end_command(gte);
+}
+
+typedef void (*command)(uint32_t);
+
+template <size_t... params>
+static constexpr std::array<command, sizeof...(params)>
+make_mvmva_kernels(std::index_sequence<params...>) {
+    return {{ eval_MVMVA<params>... }};
+}
+
+/// MVMVA instances, indexed by the operands.
+static constexpr std::array<command, 256> MVMVA_kernels =
+    make_mvmva_kernels(std::make_index_sequence<256>());
+
+static void dispatch_MVMVA(uint32_t instr) {
+    MVMVA_kernels[get_mvmva_params(instr)](instr);
+}
+
+/// Normal color depth cue of the vector \p v.
+template <unsigned shift, bool lm>
+static inline void normal_color_depth(cp2_registers &gte,
+                                      int32_t const v[3]) {
+    int64_t mac[3];
+    light<shift, lm>(gte, v);
+    color_product(gte, mac);
+    interpolate<shift, lm>(gte, mac);
+    push_color(gte);
 }
 
 /// Normal color depth cue single vector.
+template <bool sf, bool lm>
 static void eval_NCDS(uint32_t instr) {
-    psx::halt("NCDS unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    get_vector(gte, 0, v);
+    normal_color_depth<sf * 12, lm>(gte, v);
+    end_command(gte);
 }
 
 /// Color Depth Que.
+template <bool sf, bool lm>
 static void eval_CDP(uint32_t instr) {
-    psx::halt("CDP unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t m[3][3], ir[3];
+    int64_t t[3], mac[3];
+    get_matrix(gte, LCM, m);
+    get_translation(gte, BK, t);
+    get_ir(gte, ir);
+    multiply<shift, lm>(gte, m, ir, t);
+    color_product(gte, mac);
+    interpolate<shift, lm>(gte, mac);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// Normal color depth cue triple vectors.
+template <bool sf, bool lm>
 static void eval_NCDT(uint32_t instr) {
-    psx::halt("NCDT unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    for (unsigned nr = 0; nr < 3; nr++) {
+        get_vector(gte, nr, v);
+        normal_color_depth<sf * 12, lm>(gte, v);
+    }
+    end_command(gte);
+}
+
+/// Normal color color of the vector \p v.
+template <unsigned shift, bool lm>
+static inline void normal_color_color(cp2_registers &gte,
+                                      int32_t const v[3]) {
+    int64_t mac[3];
+    light<shift, lm>(gte, v);
+    color_product(gte, mac);
+    set_mac_ir<1, shift, lm>(gte, mac[0]);
+    set_mac_ir<2, shift, lm>(gte, mac[1]);
+    set_mac_ir<3, shift, lm>(gte, mac[2]);
+    push_color(gte);
 }
 
 /// Normal Color Color single vector.
+template <bool sf, bool lm>
 static void eval_NCCS(uint32_t instr) {
-    psx::halt("NCCS unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    get_vector(gte, 0, v);
+    normal_color_color<sf * 12, lm>(gte, v);
+    end_command(gte);
 }
 
 /// Color Color.
+template <bool sf, bool lm>
 static void eval_CC(uint32_t instr) {
-    psx::halt("CC unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t m[3][3], ir[3];
+    int64_t t[3], mac[3];
+    get_matrix(gte, LCM, m);
+    get_translation(gte, BK, t);
+    get_ir(gte, ir);
+    multiply<shift, lm>(gte, m, ir, t);
+    color_product(gte, mac);
+    set_mac_ir<1, shift, lm>(gte, mac[0]);
+    set_mac_ir<2, shift, lm>(gte, mac[1]);
+    set_mac_ir<3, shift, lm>(gte, mac[2]);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// Normal color single.
+template <bool sf, bool lm>
 static void eval_NCS(uint32_t instr) {
-    psx::halt("NCS unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    get_vector(gte, 0, v);
+    light<sf * 12, lm>(gte, v);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// Normal color triple.
+template <bool sf, bool lm>
 static void eval_NCT(uint32_t instr) {
-    psx::halt("NCT unimplemented");
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    for (unsigned nr = 0; nr < 3; nr++) {
+        get_vector(gte, nr, v);
+        light<sf * 12, lm>(gte, v);
+        push_color(gte);
+    }
+    end_command(gte);
 }
 
 /// Square of vector IR.
+template <bool sf, bool lm>
 static void eval_SQR(uint32_t instr) {
-    psx::halt("SQR(sf) unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t ir[3];
+    get_ir(gte, ir);
+    set_mac_ir<1, shift, lm>(gte, ir[0] * ir[0]);
+    set_mac_ir<2, shift, lm>(gte, ir[1] * ir[1]);
+    set_mac_ir<3, shift, lm>(gte, ir[2] * ir[2]);
+    end_command(gte);
 }
 
 /// Depth Cue Color light.
+template <bool sf, bool lm>
 static void eval_DCPL(uint32_t instr) {
-    psx::halt("DCPL unimplemented");
+    cp2_registers &gte = begin_command();
+    int64_t mac[3];
+    color_product(gte, mac);
+    interpolate<sf * 12, lm>(gte, mac);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// Depth Cueing triple.
+template <bool sf, bool lm>
 static void eval_DPCT(uint32_t instr) {
-    psx::halt("DPCT unimplemented");
+    cp2_registers &gte = begin_command();
+    // RGB0 is popped from the color FIFO by each push.
+    for (unsigned nr = 0; nr < 3; nr++) {
+        depth_cue<sf * 12, lm>(gte, gte.rgb0);
+    }
+    end_command(gte);
+}
+
+/// Set OTZ to \p value saturated to 0..0xffff.
+static inline void set_otz(cp2_registers &gte, int64_t value) {
+    if (value < 0) {
+        value = 0;
+        gte.cr[FLAG] |= FLAG_SZ3_OTZ;
+    } else if (value > 0xffff) {
+        value = 0xffff;
+        gte.cr[FLAG] |= FLAG_SZ3_OTZ;
+    }
+    gte.otz = (uint32_t)value;
 }
 
 /// Average of three Z values.
 static void eval_AVSZ3(uint32_t instr) {
-    psx::halt("AVSZ3 unimplemented");
+    cp2_registers &gte = begin_command();
+    int64_t avg = (int64_t)lo(gte.cr[ZSF3]) * (gte.sz1 + gte.sz2 + gte.sz3);
+    set_mac0(gte, avg);
+    set_otz(gte, avg >> 12);
+    end_command(gte);
 }
 
 /// Average of four Z values.
 static void eval_AVSZ4(uint32_t instr) {
-    psx::halt("AVSZ4 unimplemented");
+    cp2_registers &gte = begin_command();
+    int64_t avg = (int64_t)lo(gte.cr[ZSF4]) *
+        (gte.sz0 + gte.sz1 + gte.sz2 + gte.sz3);
+    set_mac0(gte, avg);
+    set_otz(gte, avg >> 12);
+    end_command(gte);
 }
 
 /// Perspective Transformation triple.
+template <bool sf, bool lm>
 static void eval_RTPT(uint32_t instr) {
-    psx::halt("RTPT unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    get_vector(gte, 0, v);
+    transform<shift, lm, false>(gte, v);
+    get_vector(gte, 1, v);
+    transform<shift, lm, false>(gte, v);
+    get_vector(gte, 2, v);
+    transform<shift, lm, true>(gte, v);
+    end_command(gte);
 }
 
 /// General purpose interpolation.
+template <bool sf, bool lm>
 static void eval_GPF(uint32_t instr) {
-    psx::halt("GPF(sf) unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t ir0 = (int32_t)gte.ir0;
+    set_mac_ir<1, shift, lm>(gte, (int32_t)gte.ir1 * ir0);
+    set_mac_ir<2, shift, lm>(gte, (int32_t)gte.ir2 * ir0);
+    set_mac_ir<3, shift, lm>(gte, (int32_t)gte.ir3 * ir0);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// General purpose interpolation with base.
+template <bool sf, bool lm>
 static void eval_GPL(uint32_t instr) {
-    psx::halt("GPL(sf) unimplemented");
+    constexpr unsigned shift = sf * 12;
+    cp2_registers &gte = begin_command();
+    int32_t ir0 = (int32_t)gte.ir0;
+    int64_t mac1 = (int64_t)(int32_t)gte.mac1 << shift;
+    int64_t mac2 = (int64_t)(int32_t)gte.mac2 << shift;
+    int64_t mac3 = (int64_t)(int32_t)gte.mac3 << shift;
+    set_mac_ir<1, shift, lm>(gte, (int32_t)gte.ir1 * ir0 + mac1);
+    set_mac_ir<2, shift, lm>(gte, (int32_t)gte.ir2 * ir0 + mac2);
+    set_mac_ir<3, shift, lm>(gte, (int32_t)gte.ir3 * ir0 + mac3);
+    push_color(gte);
+    end_command(gte);
 }
 
 /// Normal Color Color triple vector.
+template <bool sf, bool lm>
 static void eval_NCCT(uint32_t instr) {
-    psx::halt("NCCT unimplemented");
-}
-
-static void (*COP2_callbacks[64])(uint32_t) = {
-    eval_Reserved,  eval_RTPS,      eval_Reserved,  eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_NCLIP,     eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_OP,        eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_DPCS,      eval_INTPL,     eval_MVMVA,     eval_NCDS,
-    eval_CDP,       eval_Reserved,  eval_NCDT,      eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_Reserved,  eval_NCCS,
-    eval_CC,        eval_Reserved,  eval_NCS,       eval_Reserved,
-    eval_NCT,       eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_SQR,       eval_DCPL,      eval_DPCT,      eval_Reserved,
-    eval_Reserved,  eval_AVSZ3,     eval_AVSZ4,     eval_Reserved,
-    eval_RTPT,      eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_Reserved,  eval_Reserved,  eval_Reserved,  eval_Reserved,
-    eval_Reserved,  eval_GPF,       eval_GPL,       eval_NCCT,
-};
+    cp2_registers &gte = begin_command();
+    int32_t v[3];
+    for (unsigned nr = 0; nr < 3; nr++) {
+        get_vector(gte, nr, v);
+        normal_color_color<sf * 12, lm>(gte, v);
+    }
+    end_command(gte);
+}
+
+/// Return the instance of the command \p opc for the sf and lm bits.
+template <unsigned opc, bool sf, bool lm>
+static constexpr command get_command(void) {
+    switch (opc) {
+    case 0x01: return eval_RTPS<sf, lm>;
+    case 0x06: return eval_NCLIP;
+    case 0x0c: return eval_OP<sf, lm>;
+    case 0x10: return eval_DPCS<sf, lm>;
+    case 0x11: return eval_INTPL<sf, lm>;
+    case 0x12: return dispatch_MVMVA;
+    case 0x13: return eval_NCDS<sf, lm>;
+    case 0x14: return eval_CDP<sf, lm>;
+    case 0x16: return eval_NCDT<sf, lm>;
+    case 0x1b: return eval_NCCS<sf, lm>;
+    case 0x1c: return eval_CC<sf, lm>;
+    case 0x1e: return eval_NCS<sf, lm>;
+    case 0x20: return eval_NCT<sf, lm>;
+    case 0x28: return eval_SQR<sf, lm>;
+    case 0x29: return eval_DCPL<sf, lm>;
+    case 0x2a: return eval_DPCT<sf, lm>;
+    case 0x2d: return eval_AVSZ3;
+    case 0x2e: return eval_AVSZ4;
+    case 0x30: return eval_RTPT<sf, lm>;
+    case 0x3d: return eval_GPF<sf, lm>;
+    case 0x3e: return eval_GPL<sf, lm>;
+    case 0x3f: return eval_NCCT<sf, lm>;
+    default:   return eval_Reserved;
+    }
+}
+
+/// Return the index of the command in \ref COP2_callbacks.
+static constexpr unsigned get_command_index(uint32_t instr) {
+    return (get_opc(instr) << 2) | (get_sf(instr) << 1) | get_lm(instr);
+}
+
+template <size_t... index>
+static constexpr std::array<command, sizeof...(index)>
+make_commands(std::index_sequence<index...>) {
+    return {{ get_command<(index >> 2), (index & 2) != 0,
+                          (index & 1) != 0>()... }};
+}
+
+/// Command instances, indexed by the command number and the sf and lm bits.
+static constexpr std::array<command, 256> COP2_callbacks =
+    make_commands(std::make_index_sequence<256>());
+
+/// Saturate IR1-3 SAR 7 to 0..0x1f, for ORGB.
+static inline uint32_t saturate_orgb(uint32_t ir) {
+    int32_t value = (int32_t)ir >> 7;
+    return value < 0 ? 0 : value > 0x1f ? 0x1f : value;
+}
+
+uint32_t read_cp2_data(unsigned reg) {
+    cp2_registers const &gte = state->cp2;
+    switch (reg) {
+    case 15:
+        // SXYP mirrors SXY2 on reads.
+        return gte.sxy2;
+    case 28:
+    case 29:
+        // IRGB and ORGB both read the IR1-3 colors.
+        return saturate_orgb(gte.ir1) |
+              (saturate_orgb(gte.ir2) << 5) |
+              (saturate_orgb(gte.ir3) << 10);
+    default:
+        return gte.dr[reg];
+    }
+}
+
+void write_cp2_data(unsigned reg, uint32_t val) {
+    cp2_registers &gte = state->cp2;
+    switch (reg) {
+    case 1: case 3: case 5: case 8: case 9: case 10: case 11:
+        // VZ0-2 and IR0-3 are read sign-extended.
+        gte.dr[reg] = (uint32_t)lo(val);
+        break;
+    case 7: case 16: case 17: case 18: case 19:
+        // OTZ and SZ0-3 are read zero-extended.
+        gte.dr[reg] = val & 0xffff;
+        break;
+    case 15:
+        // Writing SXYP pushes the value to the SXY FIFO.
+        gte.sxy0 = gte.sxy1;
+        gte.sxy1 = gte.sxy2;
+        gte.sxy2 = val;
+        gte.sxyp = val;
+        break;
+    case 28:
+        // IRGB expands the 5-bit colors to IR1-3.
+        gte.irgb = val & 0x7fff;
+        gte.ir1 = (val & 0x1f) << 7;
+        gte.ir2 = ((val >> 5) & 0x1f) << 7;
+        gte.ir3 = ((val >> 10) & 0x1f) << 7;
+        break;
+    case 29:
+    case 31:
+        // ORGB and LZCR are read-only.
+        break;
+    case 30: {
+        // LZCR counts the leading bits of LZCS equal to the sign bit.
+        uint32_t bits = (int32_t)val < 0 ? ~val : val;
+        gte.lzcs = val;
+        gte.lzcr = bits == 0 ? 32 : __builtin_clz(bits);
+        break;
+    }
+    default:
+        gte.dr[reg] = val;
+        break;
+    }
+}
 
 /** @brief Interpret a MFC2 instruction. */
 void eval_MFC2(uint32_t instr) {
-    psx::halt("MFC2");
+    uint32_t rt = assembly::getRt(instr);
+    uint32_t rd = assembly::getRd(instr);
+    state->cpu.gpr[rt] = read_cp2_data(rd);
 }
 
 /** @brief Interpret a MTC2 instruction. */
 void eval_MTC2(uint32_t instr) {
-    psx::halt("MTC2");
+    uint32_t rt = assembly::getRt(instr);
+    uint32_t rd = assembly::getRd(instr);
+    write_cp2_data(rd, state->cpu.gpr[rt]);
 }
 
 /** @brief Interpret a CFC2 instruction. */
 void eval_CFC2(uint32_t instr) {
     uint32_t rt = assembly::getRt(instr);
     uint32_t rd = assembly::getRd(instr);
-    state.cpu.gpr[rt] = state.cp2.cr[rd];
+    state->cpu.gpr[rt] = state->cp2.cr[rd];
 }
 
 /** @brief Interpret a CTC2 instruction. */
 void eval_CTC2(uint32_t instr) {
     uint32_t rt = assembly::getRt(instr);
     uint32_t rd = assembly::getRd(instr);
-    state.cp2.cr[rd] = state.cpu.gpr[rt];
+    uint32_t val = state->cpu.gpr[rt];
+    switch (rd) {
+    case RT + 4: case LLM + 4: case LCM + 4:
+    case H: case DQA: case ZSF3: case ZSF4:
+        // RT33, L33, LB3, DQA, ZSF3, ZSF4 are read sign-extended,
+        // H as well despite being unsigned.
+        state->cp2.cr[rd] = (uint32_t)lo(val);
+        break;
+    case FLAG:
+        val &= UINT32_C(0x7ffff000);
+        state->cp2.cr[rd] = (val & FLAG_ERROR_MASK) ? val | FLAG_ERROR : val;
+        break;
+    default:
+        state->cp2.cr[rd] = val;
+        break;
+    }
 }
 
 void eval_COP2(uint32_t instr)
 {
     if (instr & (UINT32_C(1) << 25)) {
-        COP2_callbacks[get_opc(instr)](instr);
+        COP2_callbacks[get_command_index(instr)](instr);
     } else {
         switch (assembly::getRs(instr)) {
         case assembly::MFCz: eval_MFC2(instr); break;
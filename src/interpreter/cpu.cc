@@ -5,6 +5,8 @@
 #include <assembly/disassembler.h>
 #include <psx/psx.h>
 #include <psx/debugger.h>
+#include <psx/profiler.h>
+#include <psx/trace.h>
 #include <interpreter.h>
 
 using namespace psx;
@@ -56,7 +58,7 @@ namespace interpreter::cpu {
  * raise CoprocessorUnusable otherwise.
  */
 #define checkCop1Usable()                                                      \
-    if (!state.cp0reg.CU1()) {                                                 \
+    if (!state->cp0reg.CU1()) {                                                 \
         take_exception(CoprocessorUnusable, 0, instr, false, 1u);               \
         return;                                                                \
     }
@@ -83,30 +85,30 @@ void eval_Reserved(uint32_t instr) {
 
 void eval_ADD(uint32_t instr) {
     RType(instr);
-    int32_t a = (int32_t)(uint32_t)state.cpu.gpr[rs];
-    int32_t b = (int32_t)(uint32_t)state.cpu.gpr[rt];
+    int32_t a = (int32_t)(uint32_t)state->cpu.gpr[rs];
+    int32_t b = (int32_t)(uint32_t)state->cpu.gpr[rt];
     int32_t res;
 
     if (__builtin_add_overflow(a, b, &res)) {
         psx::halt("ADD IntegerOverflow");
         take_exception(IntegerOverflow, 0, 0, 0);
     } else {
-        state.cpu.gpr[rd] = (uint32_t)res;
+        state->cpu.gpr[rd] = (uint32_t)res;
     }
 }
 
 void eval_ADDU(uint32_t instr) {
     RType(instr);
-    uint32_t a = (uint32_t)state.cpu.gpr[rs];
-    uint32_t b = (uint32_t)state.cpu.gpr[rt];
+    uint32_t a = (uint32_t)state->cpu.gpr[rs];
+    uint32_t b = (uint32_t)state->cpu.gpr[rt];
     uint32_t res = a + b;
 
-    state.cpu.gpr[rd] = res;
+    state->cpu.gpr[rd] = res;
 }
 
 void eval_AND(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rs] & state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = state->cpu.gpr[rs] & state->cpu.gpr[rt];
 }
 
 void eval_BREAK(uint32_t instr) {
@@ -117,63 +119,65 @@ void eval_BREAK(uint32_t instr) {
 void eval_DIV(uint32_t instr) {
     RType(instr);
     // Must use 64bit integers here to prevent signed overflow.
-    int64_t num   = (int32_t)state.cpu.gpr[rs];
-    int64_t denum = (int32_t)state.cpu.gpr[rt];
+    int64_t num   = (int32_t)state->cpu.gpr[rs];
+    int64_t denum = (int32_t)state->cpu.gpr[rt];
     if (denum != 0) {
-        state.cpu.mult_lo = (uint32_t)(uint64_t)(num / denum);
-        state.cpu.mult_hi = (uint32_t)(uint64_t)(num % denum);
+        state->cpu.mult_lo = (uint32_t)(uint64_t)(num / denum);
+        state->cpu.mult_hi = (uint32_t)(uint64_t)(num % denum);
     } else {
         debugger::undefined("Divide by 0 (DIV)");
         // Undefined behaviour here according to the reference
         // manual. The machine behaviour is as implemented.
-        state.cpu.mult_lo = num < 0 ? 1 : UINT32_C(-1);
-        state.cpu.mult_hi = (uint32_t)(uint64_t)num;
+        state->cpu.mult_lo = num < 0 ? 1 : UINT32_C(-1);
+        state->cpu.mult_hi = (uint32_t)(uint64_t)num;
     }
 }
 
 void eval_DIVU(uint32_t instr) {
     RType(instr);
-    uint32_t num = state.cpu.gpr[rs];
-    uint32_t denum = state.cpu.gpr[rt];
+    uint32_t num = state->cpu.gpr[rs];
+    uint32_t denum = state->cpu.gpr[rt];
     if (denum != 0) {
-        state.cpu.mult_lo = (uint32_t)(num / denum);
-        state.cpu.mult_hi = (uint32_t)(num % denum);
+        state->cpu.mult_lo = (uint32_t)(num / denum);
+        state->cpu.mult_hi = (uint32_t)(num % denum);
     } else {
         debugger::undefined("Divide by 0 (DIVU)");
         // Undefined behaviour here according to the reference
         // manual. The machine behaviour is as implemented.
-        state.cpu.mult_lo = UINT32_C(-1);
-        state.cpu.mult_hi = num;
+        state->cpu.mult_lo = UINT32_C(-1);
+        state->cpu.mult_hi = num;
     }
 }
 
 void eval_JALR(uint32_t instr) {
     RType(instr);
-    uint32_t tg = state.cpu.gpr[rs];
-    state.cpu.gpr[rd] = state.cpu.pc + 8;
-    state.cpu_state = cpu_state::Delay;
-    state.jump_address = tg;
+    uint32_t tg = state->cpu.gpr[rs];
+    state->cpu.gpr[rd] = state->cpu.pc + 8;
+    state->cpu_state = cpu_state::Delay;
+    state->jump_address = tg;
+    if (profiler::enabled()) profiler::call(tg, state->cpu.pc + 8);
 }
 
 void eval_JR(uint32_t instr) {
     RType(instr);
-    uint32_t tg = state.cpu.gpr[rs];
-    state.cpu_state = cpu_state::Delay;
-    state.jump_address = tg;
+    uint32_t tg = state->cpu.gpr[rs];
+    state->cpu_state = cpu_state::Delay;
+    state->jump_address = tg;
+    if (rs == 31 && profiler::enabled()) profiler::ret(tg);
 }
 
 void eval_MFHI(uint32_t instr) {
     RType(instr);
     // undefined if an instruction that follows modify
     // the special registers LO / HI
-    state.cpu.gpr[rd] = state.cpu.mult_hi;
+    state->cpu.gpr[rd] = state->cpu.mult_hi;
 }
 
 void eval_MFLO(uint32_t instr) {
     RType(instr);
     // undefined if an instruction that follows modify
     // the special registers LO / HI
-    state.cpu.gpr[rd] = state.cpu.mult_lo;
+    state->cpu.gpr[rd] = state->cpu.mult_lo;
 }
 
 void eval_MOVN(uint32_t instr) {
@@ -188,113 +192,113 @@ void eval_MOVZ(uint32_t instr) {
 
 void eval_MTHI(uint32_t instr) {
     RType(instr);
-    state.cpu.mult_hi = state.cpu.gpr[rs];
+    state->cpu.mult_hi = state->cpu.gpr[rs];
 }
 
 void eval_MTLO(uint32_t instr) {
     RType(instr);
-    state.cpu.mult_lo = state.cpu.gpr[rs];
+    state->cpu.mult_lo = state->cpu.gpr[rs];
 }
 
 void eval_MULT(uint32_t instr) {
     RType(instr);
-    int32_t a = (int32_t)(uint32_t)state.cpu.gpr[rs];
-    int32_t b = (int32_t)(uint32_t)state.cpu.gpr[rt];
+    int32_t a = (int32_t)(uint32_t)state->cpu.gpr[rs];
+    int32_t b = (int32_t)(uint32_t)state->cpu.gpr[rt];
     int64_t m = (int64_t)a * (int64_t)b;
-    state.cpu.mult_lo = (uint32_t)((uint64_t)m >>  0);
-    state.cpu.mult_hi = (uint32_t)((uint64_t)m >> 32);
+    state->cpu.mult_lo = (uint32_t)((uint64_t)m >>  0);
+    state->cpu.mult_hi = (uint32_t)((uint64_t)m >> 32);
 }
 
 void eval_MULTU(uint32_t instr) {
     RType(instr);
-    uint32_t a = (uint32_t)state.cpu.gpr[rs];
-    uint32_t b = (uint32_t)state.cpu.gpr[rt];
+    uint32_t a = (uint32_t)state->cpu.gpr[rs];
+    uint32_t b = (uint32_t)state->cpu.gpr[rt];
     uint64_t m = (uint64_t)a * (uint64_t)b;
-    state.cpu.mult_lo = m;
-    state.cpu.mult_hi = m >> 32;
+    state->cpu.mult_lo = m;
+    state->cpu.mult_hi = m >> 32;
 }
 
 void eval_NOR(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = ~(state.cpu.gpr[rs] | state.cpu.gpr[rt]);
+    state->cpu.gpr[rd] = ~(state->cpu.gpr[rs] | state->cpu.gpr[rt]);
 }
 
 void eval_OR(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rs] | state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = state->cpu.gpr[rs] | state->cpu.gpr[rt];
 }
 
 void eval_SLL(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] << shamnt;
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] << shamnt;
 }
 
 void eval_SLLV(uint32_t instr) {
     RType(instr);
-    shamnt = state.cpu.gpr[rs] & UINT32_C(0x1f);
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] << shamnt;
+    shamnt = state->cpu.gpr[rs] & UINT32_C(0x1f);
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] << shamnt;
 }
 
 void eval_SLT(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = (int32_t)state.cpu.gpr[rs] < (int32_t)state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = (int32_t)state->cpu.gpr[rs] < (int32_t)state->cpu.gpr[rt];
 }
 
 void eval_SLTU(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rs] < state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = state->cpu.gpr[rs] < state->cpu.gpr[rt];
 }
 
 void eval_SRA(uint32_t instr) {
     RType(instr);
-    bool sign = (state.cpu.gpr[rt] & (UINT32_C(1) << 31)) != 0;
+    bool sign = (state->cpu.gpr[rt] & (UINT32_C(1) << 31)) != 0;
     // Right shift is logical for unsigned c types,
     // we need to add the type manually.
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] >> shamnt;
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] >> shamnt;
     if (sign) {
         uint32_t mask = (UINT32_C(1) << shamnt) - 1u;
-        state.cpu.gpr[rd] |= mask << (32 - shamnt);
+        state->cpu.gpr[rd] |= mask << (32 - shamnt);
     }
 }
 
 void eval_SRAV(uint32_t instr) {
     RType(instr);
-    bool sign = (state.cpu.gpr[rt] & (UINT32_C(1) << 31)) != 0;
-    shamnt = state.cpu.gpr[rs] & UINT32_C(0x1f);
+    bool sign = (state->cpu.gpr[rt] & (UINT32_C(1) << 31)) != 0;
+    shamnt = state->cpu.gpr[rs] & UINT32_C(0x1f);
     // Right shift is logical for unsigned c types,
     // we need to add the type manually.
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] >> shamnt;
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] >> shamnt;
     if (sign) {
         uint32_t mask = (UINT32_C(1) << shamnt) - 1u;
-        state.cpu.gpr[rd] |= mask << (32 - shamnt);
+        state->cpu.gpr[rd] |= mask << (32 - shamnt);
     }
 }
 
 void eval_SRL(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] >> shamnt;
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] >> shamnt;
 }
 
 void eval_SRLV(uint32_t instr) {
     RType(instr);
-    shamnt = state.cpu.gpr[rs] & UINT32_C(0x1f);
-    state.cpu.gpr[rd] = state.cpu.gpr[rt] >> shamnt;
+    shamnt = state->cpu.gpr[rs] & UINT32_C(0x1f);
+    state->cpu.gpr[rd] = state->cpu.gpr[rt] >> shamnt;
 }
 
 void eval_SUB(uint32_t instr) {
     RType(instr);
     int32_t res;
-    int32_t a = (int32_t)(uint32_t)state.cpu.gpr[rs];
-    int32_t b = (int32_t)(uint32_t)state.cpu.gpr[rt];
+    int32_t a = (int32_t)(uint32_t)state->cpu.gpr[rs];
+    int32_t b = (int32_t)(uint32_t)state->cpu.gpr[rt];
     if (__builtin_sub_overflow(a, b, &res)) {
         psx::halt("SUB IntegerOverflow");
     }
-    state.cpu.gpr[rd] = (uint32_t)res;
+    state->cpu.gpr[rd] = (uint32_t)res;
 }
 
 void eval_SUBU(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rs] - state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = state->cpu.gpr[rs] - state->cpu.gpr[rt];
 }
 
 void eval_SYNC(uint32_t instr) {
@@ -338,73 +342,73 @@ void eval_TNE(uint32_t instr) {
 
 void eval_XOR(uint32_t instr) {
     RType(instr);
-    state.cpu.gpr[rd] = state.cpu.gpr[rs] ^ state.cpu.gpr[rt];
+    state->cpu.gpr[rd] = state->cpu.gpr[rs] ^ state->cpu.gpr[rt];
 }
 
 /* REGIMM opcodes */
 
 void eval_BGEZ(uint32_t instr) {
     IType(instr, sign_extend);
-    branch((int32_t)state.cpu.gpr[rs] >= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch((int32_t)state->cpu.gpr[rs] >= 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BGEZL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely((int32_t)state.cpu.gpr[rs] >= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely((int32_t)state->cpu.gpr[rs] >= 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLTZ(uint32_t instr) {
     IType(instr, sign_extend);
-    branch((int32_t)state.cpu.gpr[rs] < 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch((int32_t)state->cpu.gpr[rs] < 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLTZL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely((int32_t)state.cpu.gpr[rs] < 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely((int32_t)state->cpu.gpr[rs] < 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BGEZAL(uint32_t instr) {
     IType(instr, sign_extend);
-    int32_t r = state.cpu.gpr[rs];
-    state.cpu.gpr[31] = state.cpu.pc + 8;
+    int32_t r = state->cpu.gpr[rs];
+    state->cpu.gpr[31] = state->cpu.pc + 8;
     branch(r >= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BGEZALL(uint32_t instr) {
     IType(instr, sign_extend);
-    int32_t r = state.cpu.gpr[rs];
-    state.cpu.gpr[31] = state.cpu.pc + 8;
+    int32_t r = state->cpu.gpr[rs];
+    state->cpu.gpr[31] = state->cpu.pc + 8;
     branch_likely(r >= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLTZAL(uint32_t instr) {
     IType(instr, sign_extend);
-    int32_t r = state.cpu.gpr[rs];
-    state.cpu.gpr[31] = state.cpu.pc + 8;
+    int32_t r = state->cpu.gpr[rs];
+    state->cpu.gpr[31] = state->cpu.pc + 8;
     branch(r < 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLTZALL(uint32_t instr) {
     IType(instr, sign_extend);
-    int32_t r = state.cpu.gpr[rs];
-    state.cpu.gpr[31] = state.cpu.pc + 8;
+    int32_t r = state->cpu.gpr[rs];
+    state->cpu.gpr[31] = state->cpu.pc + 8;
     branch_likely(r < 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_TEQI(uint32_t instr) {
@@ -441,7 +445,7 @@ void eval_TNEI(uint32_t instr) {
 
 void eval_ADDI(uint32_t instr) {
     IType(instr, sign_extend);
-    int32_t a = (int32_t)(uint32_t)state.cpu.gpr[rs];
+    int32_t a = (int32_t)(uint32_t)state->cpu.gpr[rs];
     int32_t b = (int32_t)(uint32_t)imm;
     int32_t res;
 
@@ -449,78 +453,78 @@ void eval_ADDI(uint32_t instr) {
         psx::halt("ADDI IntegerOverflow");
         take_exception(IntegerOverflow, 0, 0, 0);
     } else {
-        state.cpu.gpr[rt] = (uint32_t)res;
+        state->cpu.gpr[rt] = (uint32_t)res;
     }
 }
 
 void eval_ADDIU(uint32_t instr) {
     IType(instr, sign_extend);
-    uint32_t a = (uint32_t)state.cpu.gpr[rs];
+    uint32_t a = (uint32_t)state->cpu.gpr[rs];
     uint32_t b = (uint32_t)imm;
     uint32_t res = a + b;
 
-    state.cpu.gpr[rt] = res;
+    state->cpu.gpr[rt] = res;
 }
 
 void eval_ANDI(uint32_t instr) {
     IType(instr, zero_extend);
-    state.cpu.gpr[rt] = state.cpu.gpr[rs] & imm;
+    state->cpu.gpr[rt] = state->cpu.gpr[rs] & imm;
 }
 
 void eval_BEQ(uint32_t instr) {
     IType(instr, sign_extend);
-    branch(state.cpu.gpr[rt] == state.cpu.gpr[rs],
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch(state->cpu.gpr[rt] == state->cpu.gpr[rs],
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BEQL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely(state.cpu.gpr[rt] == state.cpu.gpr[rs],
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely(state->cpu.gpr[rt] == state->cpu.gpr[rs],
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BGTZ(uint32_t instr) {
     IType(instr, sign_extend);
-    branch((int32_t)state.cpu.gpr[rs] > 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch((int32_t)state->cpu.gpr[rs] > 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BGTZL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely((int32_t)state.cpu.gpr[rs] > 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely((int32_t)state->cpu.gpr[rs] > 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLEZ(uint32_t instr) {
     IType(instr, sign_extend);
-    branch((int32_t)state.cpu.gpr[rs] <= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch((int32_t)state->cpu.gpr[rs] <= 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BLEZL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely((int32_t)state.cpu.gpr[rs] <= 0,
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely((int32_t)state->cpu.gpr[rs] <= 0,
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BNE(uint32_t instr) {
     IType(instr, sign_extend);
-    branch(state.cpu.gpr[rt] != state.cpu.gpr[rs],
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch(state->cpu.gpr[rt] != state->cpu.gpr[rs],
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_BNEL(uint32_t instr) {
     IType(instr, sign_extend);
-    branch_likely(state.cpu.gpr[rt] != state.cpu.gpr[rs],
-        state.cpu.pc + 4 + (int32_t)(imm << 2),
-        state.cpu.pc + 8);
+    branch_likely(state->cpu.gpr[rt] != state->cpu.gpr[rs],
+        state->cpu.pc + 4 + (int32_t)(imm << 2),
+        state->cpu.pc + 8);
 }
 
 void eval_CACHE(uint32_t instr) {
@@ -537,23 +541,24 @@ void eval_COP3(uint32_t instr) {
 
 void eval_J(uint32_t instr) {
     uint32_t tg = assembly::getTarget(instr);
-    tg = (state.cpu.pc & UINT32_C(0xf0000000)) | (tg << 2);
-    state.cpu_state = cpu_state::Delay;
-    state.jump_address = tg;
+    tg = (state->cpu.pc & UINT32_C(0xf0000000)) | (tg << 2);
+    state->cpu_state = cpu_state::Delay;
+    state->jump_address = tg;
 }
 
 void eval_JAL(uint32_t instr) {
     uint32_t tg = assembly::getTarget(instr);
-    tg = (state.cpu.pc & UINT32_C(0xf0000000)) | (tg << 2);
-    state.cpu.gpr[31] = state.cpu.pc + 8;
-    state.cpu_state = cpu_state::Delay;
-    state.jump_address = tg;
+    tg = (state->cpu.pc & UINT32_C(0xf0000000)) | (tg << 2);
+    state->cpu.gpr[31] = state->cpu.pc + 8;
+    state->cpu_state = cpu_state::Delay;
+    state->jump_address = tg;
+    if (profiler::enabled()) profiler::call(tg, state->cpu.pc + 8);
 }
 
 void eval_LB(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint8_t val;
 
@@ -561,16 +566,16 @@ void eval_LB(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u8(pAddr, &val) ? None : BusError,
+        state->bus->load_u8(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = sign_extend<uint32_t, uint8_t>(val);
+    state->cpu.gpr[rt] = sign_extend<uint32_t, uint8_t>(val);
 }
 
 void eval_LBU(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint8_t val;
 
@@ -578,16 +583,16 @@ void eval_LBU(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u8(pAddr, &val) ? None : BusError,
+        state->bus->load_u8(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = zero_extend<uint32_t, uint8_t>(val);
+    state->cpu.gpr[rt] = zero_extend<uint32_t, uint8_t>(val);
 }
 
 void eval_LH(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint16_t val;
 
@@ -596,16 +601,16 @@ void eval_LH(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u16(pAddr, &val) ? None : BusError,
+        state->bus->load_u16(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = sign_extend<uint32_t, uint16_t>(val);
+    state->cpu.gpr[rt] = sign_extend<uint32_t, uint16_t>(val);
 }
 
 void eval_LHU(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint16_t val;
 
@@ -614,10 +619,10 @@ void eval_LHU(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u16(pAddr, &val) ? None : BusError,
+        state->bus->load_u16(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = zero_extend<uint32_t, uint16_t>(val);
+    state->cpu.gpr[rt] = zero_extend<uint32_t, uint16_t>(val);
 }
 
 void eval_LL(uint32_t instr) {
@@ -632,13 +637,13 @@ void eval_LLD(uint32_t instr) {
 
 void eval_LUI(uint32_t instr) {
     IType(instr, sign_extend);
-    state.cpu.gpr[rt] = imm << 16;
+    state->cpu.gpr[rt] = imm << 16;
 }
 
 void eval_LW(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint32_t val;
 
@@ -647,10 +652,10 @@ void eval_LW(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u32(pAddr, &val) ? None : BusError,
+        state->bus->load_u32(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = val;
+    state->cpu.gpr[rt] = val;
 }
 
 void eval_LWC1(uint32_t instr) {
@@ -659,8 +664,21 @@ void eval_LWC1(uint32_t instr) {
 }
 
 void eval_LWC2(uint32_t instr) {
-    take_exception(CoprocessorUnusable, 0, false, true, 2);
-    psx::halt("LWC2");
+    IType(instr, sign_extend);
+
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
+    uint32_t pAddr;
+    uint32_t val;
+
+    checkAddressAlignment(vAddr, 4, false, true);
+    checkException(
+        translate_address(vAddr, &pAddr, false),
+        vAddr, false, true, 0);
+    checkException(
+        state->bus->load_u32(pAddr, &val) ? None : BusError,
+        vAddr, false, true, 0);
+
+    write_cp2_data(rt, val);
 }
 
 void eval_LWC3(uint32_t instr) {
@@ -672,7 +690,7 @@ void eval_LWL(uint32_t instr) {
     IType(instr, sign_extend);
 
     // @todo only BigEndianMem & !ReverseEndian for now
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     // Not calling checkAddressAlignment:
@@ -688,22 +706,22 @@ void eval_LWL(uint32_t instr) {
 
     for (size_t nr = 0; nr < count; nr++, shift -= 8) {
         uint8_t byte = 0;
-        if (!state.bus->load_u8(pAddr + nr, &byte)) {
+        if (!state->bus->load_u8(pAddr + nr, &byte)) {
             take_exception(BusError, vAddr, false, false, 0);
             return;
         }
         val |= ((uint32_t)byte << shift);
     }
 
-    val = val | (state.cpu.gpr[rt] & mask);
-    state.cpu.gpr[rt] = val;
+    val = val | (state->cpu.gpr[rt] & mask);
+    state->cpu.gpr[rt] = val;
 }
 
 void eval_LWR(uint32_t instr) {
     IType(instr, sign_extend);
 
     // @todo only BigEndianMem & !ReverseEndian for now
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     // Not calling checkAddressAlignment:
@@ -720,21 +738,21 @@ void eval_LWR(uint32_t instr) {
 
     for (size_t nr = 0; nr < count; nr++, shift += 8) {
         uint8_t byte = 0;
-        if (!state.bus->load_u8(pAddr - nr, &byte)) {
+        if (!state->bus->load_u8(pAddr - nr, &byte)) {
             take_exception(BusError, vAddr, false, false);
             return;
         }
         val |= ((uint32_t)byte << shift);
     }
 
-    val = val | (state.cpu.gpr[rt] & mask);
-    state.cpu.gpr[rt] = val;
+    val = val | (state->cpu.gpr[rt] & mask);
+    state->cpu.gpr[rt] = val;
 }
 
 void eval_LWU(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
     uint32_t val;
 
@@ -743,28 +761,28 @@ void eval_LWU(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, true, 0);
     checkException(
-        state.bus->load_u32(pAddr, &val) ? None : BusError,
+        state->bus->load_u32(pAddr, &val) ? None : BusError,
         vAddr, false, true, 0);
 
-    state.cpu.gpr[rt] = val;
+    state->cpu.gpr[rt] = val;
 }
 
 void eval_ORI(uint32_t instr) {
     IType(instr, zero_extend);
-    state.cpu.gpr[rt] = state.cpu.gpr[rs] | imm;
+    state->cpu.gpr[rt] = state->cpu.gpr[rs] | imm;
 }
 
 void eval_SB(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     checkException(
         translate_address(vAddr, &pAddr, false),
         vAddr, false, false, 0);
     checkException(
-        state.bus->store_u8(pAddr, state.cpu.gpr[rt]) ? None : BusError,
+        state->bus->store_u8(pAddr, state->cpu.gpr[rt]) ? None : BusError,
         vAddr, false, false, 0);
 }
 
@@ -776,7 +794,7 @@ void eval_SC(uint32_t instr) {
 void eval_SH(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     checkAddressAlignment(vAddr, 2, false, false);
@@ -784,24 +802,24 @@ void eval_SH(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, false, 0);
     checkException(
-        state.bus->store_u16(pAddr, state.cpu.gpr[rt]) ? None : BusError,
+        state->bus->store_u16(pAddr, state->cpu.gpr[rt]) ? None : BusError,
         vAddr, false, false, 0);
 }
 
 void eval_SLTI(uint32_t instr) {
     IType(instr, sign_extend);
-    state.cpu.gpr[rt] = (int32_t)state.cpu.gpr[rs] < (int32_t)imm;
+    state->cpu.gpr[rt] = (int32_t)state->cpu.gpr[rs] < (int32_t)imm;
 }
 
 void eval_SLTIU(uint32_t instr) {
     IType(instr, sign_extend);
-    state.cpu.gpr[rt] = state.cpu.gpr[rs] < imm;
+    state->cpu.gpr[rt] = state->cpu.gpr[rs] < imm;
 }
 
 void eval_SW(uint32_t instr) {
     IType(instr, sign_extend);
 
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     checkAddressAlignment(vAddr, 4, false, false);
@@ -809,7 +827,7 @@ void eval_SW(uint32_t instr) {
         translate_address(vAddr, &pAddr, false),
         vAddr, false, false, 0);
     checkException(
-        state.bus->store_u32(pAddr, state.cpu.gpr[rt]) ? None : BusError,
+        state->bus->store_u32(pAddr, state->cpu.gpr[rt]) ? None : BusError,
         vAddr, false, false, 0);
 }
 
@@ -819,8 +837,18 @@ void eval_SWC1(uint32_t instr) {
 }
 
 void eval_SWC2(uint32_t instr) {
-    take_exception(CoprocessorUnusable, 0, false, false, 2);
-    psx::halt("SWC2");
+    IType(instr, sign_extend);
+
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
+    uint32_t pAddr;
+
+    checkAddressAlignment(vAddr, 4, false, false);
+    checkException(
+        translate_address(vAddr, &pAddr, false),
+        vAddr, false, false, 0);
+    checkException(
+        state->bus->store_u32(pAddr, read_cp2_data(rt)) ? None : BusError,
+        vAddr, false, false, 0);
 }
 
 void eval_SWC3(uint32_t instr) {
@@ -832,7 +860,7 @@ void eval_SWL(uint32_t instr) {
     IType(instr, sign_extend);
     // psx::halt("SWL instruction");
     // @todo only BigEndianMem & !ReverseEndian for now
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     // Not calling checkAddressAlignment:
@@ -842,11 +870,11 @@ void eval_SWL(uint32_t instr) {
         vAddr, false, false, 0);
 
     size_t count = 4 - (pAddr % 4);
-    uint32_t val = state.cpu.gpr[rt];
+    uint32_t val = state->cpu.gpr[rt];
     unsigned int shift = 24;
     for (size_t nr = 0; nr < count; nr++, shift -= 8) {
         uint8_t byte = val >> shift;
-        if (!state.bus->store_u8(pAddr + nr, byte)) {
+        if (!state->bus->store_u8(pAddr + nr, byte)) {
             take_exception(BusError, vAddr, false, false, 0);
             return;
         }
@@ -857,7 +885,7 @@ void eval_SWR(uint32_t instr) {
     IType(instr, sign_extend);
     // psx::halt("SWR instruction");
     // @todo only BigEndianMem & !ReverseEndian for now
-    uint32_t vAddr = state.cpu.gpr[rs] + imm;
+    uint32_t vAddr = state->cpu.gpr[rs] + imm;
     uint32_t pAddr;
 
     // Not calling checkAddressAlignment:
@@ -867,11 +895,11 @@ void eval_SWR(uint32_t instr) {
         vAddr, false, false, 0);
 
     size_t count = 1 + (pAddr % 4);
-    uint32_t val = state.cpu.gpr[rt];
+    uint32_t val = state->cpu.gpr[rt];
     unsigned int shift = 0;
     for (size_t nr = 0; nr < count; nr++, shift += 8) {
         uint8_t byte = val >> shift;
-        if (!state.bus->store_u8(pAddr - nr, byte)) {
+        if (!state->bus->store_u8(pAddr - nr, byte)) {
             take_exception(BusError, vAddr, false, false);
             return;
         }
@@ -880,7 +908,7 @@ void eval_SWR(uint32_t instr) {
 
 void eval_XORI(uint32_t instr) {
     IType(instr, zero_extend);
-    state.cpu.gpr[rt] = state.cpu.gpr[rs] ^ imm;
+    state->cpu.gpr[rt] = state->cpu.gpr[rs] ^ imm;
 }
 
 
@@ -949,33 +977,47 @@ void eval_Instr(uint32_t instr) {
 
     // BIOS code writes to zero register to discard the value.
     // Force reset it.
-    state.cpu.gpr[0] = 0;
+    state->cpu.gpr[0] = 0;
 }
 
 void eval(void) {
-    uint32_t vaddr = state.cpu.pc;
+    uint32_t vaddr = state->cpu.pc;
     uint32_t paddr;
     uint32_t instr;
 
-    state.cycles++;
+    state->cycles++;
 
     checkException(
         translate_address(vaddr, &paddr, false),
         vaddr, true, true, 0);
     checkException(
-        state.bus->load_u32(paddr, &instr) ? None : BusError,
+        state->bus->load_u32(paddr, &instr) ? None : BusError,
         vaddr, true, true, 0);
 
+#if ENABLE_TRACE || ENABLE_BREAKPOINTS
+    // The debugger is shared by all the machines of the process,
+    // and only observes the machine it is attached to.
+    psx::Machine *machine = psx::machine();
+    bool debugger_attached = machine->debugger_attached;
+#endif
+
 #if ENABLE_TRACE
-    debugger::debugger.cpu_trace.put(Debugger::TraceEntry(vaddr, instr));
+    if (debugger_attached)
+        debugger::debugger.cpu_trace.put(Debugger::TraceEntry(vaddr, instr));
 #endif /* ENABLE_TRACE */
 
 #if ENABLE_BREAKPOINTS
-    if (debugger::debugger.check_breakpoint(vaddr))
+    if (debugger_attached && debugger::debugger.check_breakpoint(vaddr))
         psx::halt("Breakpoint");
 #endif /* ENABLE_BREAKPOINTS */
 
     eval_Instr(instr);
+
+#if ENABLE_TRACE
+    // Recorded after execution, with the written register value.
+    if (machine->tracing)
+        psx::trace::record(vaddr, instr);
+#endif /* ENABLE_TRACE */
 }
 
 }; /* namespace interpreter::cpu */
@@ -155,18 +155,23 @@ void eval_CFC2(uint32_t instr);
 void eval_CTC2(uint32_t instr);
 void eval_COP2(uint32_t instr);
 
+/** Read the GTE data register \p reg, as loaded by MFC2 and SWC2. */
+uint32_t read_cp2_data(unsigned reg);
+/** Write the GTE data register \p reg, as stored by MTC2 and LWC2. */
+void write_cp2_data(unsigned reg, uint32_t val);
+
 /** Helper for branch instructions: update the state to branch to \p btrue
  * or \p bfalse depending on the tested condition \p cond. */
 static inline void branch(bool cond, uint32_t btrue, uint32_t bfalse) {
-    psx::state.cpu_state = psx::Delay;
-    psx::state.jump_address = cond ? btrue : bfalse;
+    psx::state->cpu_state = psx::Delay;
+    psx::state->jump_address = cond ? btrue : bfalse;
 }
 
 /** Helper for branch likely instructions: update the state to branch to
  * \p btrue or \p bfalse depending on the tested condition \p cond. */
 static inline void branch_likely(bool cond, uint32_t btrue, uint32_t bfalse) {
-    psx::state.cpu_state = cond ? psx::Delay : psx::Jump;
-    psx::state.jump_address = cond ? btrue : bfalse;
+    psx::state->cpu_state = cond ? psx::Delay : psx::Jump;
+    psx::state->jump_address = cond ? btrue : bfalse;
 }
 
 }; /* namespace interpreter::cpu */
@@ -1,25 +1,108 @@
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 
 #include <cxxopts.hpp>
 #include <fmt/format.h>
+#include <toml++/toml.h>
 
+#include <psx/boot.h>
+#include <psx/hle.h>
+#include <psx/profiler.h>
+#include <psx/input.h>
+#include <psx/mmio.h>
+#include <psx/rewind.h>
+#include <psx/snapshot.h>
+#include <psx/timeline.h>
+#include <psx/timing.h>
+#include <psx/trace.h>
 #include <psx/debugger.h>
+#include <psx/disc.h>
+#include <psx/framehash.h>
 #include <psx/psx.h>
 #include <psx/memory.h>
 #include <psx/gui.h>
+#include <psx/headless.h>
+#include <psx/hw.h>
+
+/**
+ * @brief Parse a CD-ROM speed setting: "1x", "2x", "4x", "8x"
+ *  or "instant".
+ * @return true if the setting is valid.
+ */
+static bool parse_cd_speed(std::string const &value, unsigned *speed) {
+    if (value == "1x")           *speed = 1;
+    else if (value == "2x")      *speed = 2;
+    else if (value == "4x")      *speed = 4;
+    else if (value == "8x")      *speed = 8;
+    else if (value == "instant") *speed = CDROM_SPEED_INSTANT;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Look up the CD-ROM speed override for the disc \p volume_id
+ *  in the override list \p overrides_file. The list is a TOML table
+ *  mapping ISO9660 volume identifiers to speed settings, used to pin
+ *  titles that break with accelerated loading to accurate timings:
+ *
+ *      "SLUS_00594" = "1x"
+ */
+static void load_cd_speed_override(std::string const &overrides_file,
+                                   std::string const &volume_id,
+                                   unsigned *speed) {
+    try {
+        toml::table overrides = toml::parse_file(overrides_file);
+        auto value = overrides[volume_id].value<std::string>();
+        if (value && !parse_cd_speed(*value, speed)) {
+            fmt::print("Invalid CD-ROM speed '{}' for '{}' in '{}'\n",
+                *value, volume_id, overrides_file);
+        }
+    } catch (const toml::parse_error &err) {
+        fmt::print("Cannot parse CD-ROM speed overrides '{}': {}\n",
+            overrides_file, err.description());
+    }
+}
 
 int main(int argc, char *argv[])
 {
     cxxopts::Options options("ps1", "PS1 console emulator");
     options.add_options()
-        ("record",      "Record execution trace", cxxopts::value<std::string>())
-        ("replay",      "Replay execution trace", cxxopts::value<std::string>())
+        ("record",      "Record the pad input to a file", cxxopts::value<std::string>())
+        ("replay",      "Replay the pad input from a recording, and check the final display hash", cxxopts::value<std::string>())
+        ("trace",       "Stream the execution trace to file", cxxopts::value<std::string>())
+        ("trace-registers", "Include the written register values in the execution trace")
         ("recompiler",  "Enable recompiler", cxxopts::value<bool>()->default_value("false"))
         ("b,bios",      "Select BIOS rom", cxxopts::value<std::string>())
         ("c,cd-rom",    "CD-ROM file", cxxopts::value<std::string>())
+        ("fast-boot",   "Skip the BIOS shell and boot the disc executable directly")
+        ("exe",         "Side-load a PS-X EXE executable", cxxopts::value<std::string>())
+        ("hle-bios",    "Execute hot BIOS kernel calls natively")
+        ("hle-lle",     "BIOS kernel calls which must run the BIOS code, e.g. A0:2A,B0:3D", cxxopts::value<std::string>())
+        ("snapshot-cache", "Directory of the post-init BIOS snapshots", cxxopts::value<std::string>())
+        ("headless",    "Run without user interface")
+        ("sync-log",    "Print the logs from the emulation thread, in program order")
+        ("cd-speed",    "CD-ROM speed: 1x, 2x, 4x, 8x or instant", cxxopts::value<std::string>()->default_value("1x"))
+        ("cd-speed-overrides", "Per-title CD-ROM speed overrides", cxxopts::value<std::string>())
+        ("cd-prefetch", "Number of disc sectors read ahead of the drive", cxxopts::value<unsigned>()->default_value("64"))
+        ("compress-cd", "Write the CD-ROM image as a compressed container and exit", cxxopts::value<std::string>())
+        ("compress-hunk", "Number of sectors per compressed hunk", cxxopts::value<unsigned>()->default_value("16"))
+        ("frames",      "Frame budget for headless runs", cxxopts::value<unsigned long>()->default_value("0"))
+        ("fork",        "Fork the headless machine into N child processes", cxxopts::value<unsigned>())
+        ("fork-frame",  "Frame at which the headless machine is forked", cxxopts::value<unsigned long>()->default_value("60"))
+        ("frame-hash",  "Log per-frame display hashes to file", cxxopts::value<std::string>())
+        ("frame-hash-vram", "Include full VRAM hashes in the frame hash log")
+        ("frame-hash-ram", "Include full RAM hashes in the frame hash log")
+        ("profile",     "Profile guest code and write folded stacks to file", cxxopts::value<std::string>())
+        ("profile-interval", "Profiler sampling interval in cycles", cxxopts::value<unsigned long>()->default_value("1000"))
+        ("profile-top", "Number of functions in the profile report", cxxopts::value<size_t>()->default_value("20"))
+        ("mmio-top",    "Print the I/O registers with the most accesses per frame", cxxopts::value<size_t>()->default_value("0"))
+        ("timing",      "Log per-frame host time per subsystem to file (CSV, or JSON if *.json)", cxxopts::value<std::string>())
+        ("timeline",    "Record a Chrome trace timeline of the emulator activity to file", cxxopts::value<std::string>())
+        ("rewind",      "Capture the machine every N frames for rewinding (default 1 with the GUI)", cxxopts::value<unsigned>())
+        ("rewind-budget", "Memory budget of the rewind buffer in MiB", cxxopts::value<size_t>()->default_value("256"))
         ("h,help",      "Print usage");
     options.parse_positional("rom");
     options.positional_help("FILE");
@@ -31,22 +114,58 @@ int main(int argc, char *argv[])
         exit(0);
     }
 
-    if (result.count("cd-rom") == 0) {
+    if (result.count("cd-rom") == 0 && result.count("exe") == 0) {
         std::cout << "CD-ROM file unspecified" << std::endl;
         std::cout << options.help() << std::endl;
         exit(1);
     }
 
-    if (result.count("bios") == 0) {
-        std::cout << "BIOS file unspecified" << std::endl;
-        std::cout << options.help() << std::endl;
+    // The main and GUI threads operate on a single machine,
+    // inspected from the debugger.
+    psx::Machine machine;
+    machine.bind();
+    machine.debugger_attached = true;
+
+    if (result.count("cd-rom")) {
+        std::string rom_file = result["cd-rom"].as<std::string>();
+        if (psx::state->load_cd_rom(rom_file) != 0) {
+            fmt::print("CD-ROM file '{}' not found\n", rom_file);
+            std::cout << options.help() << std::endl;
+            exit(1);
+        }
+    }
+
+    if (result.count("exe")) {
+        std::string exe_file = result["exe"].as<std::string>();
+        if (psx::boot::set_exe(exe_file) != 0) {
+            fmt::print("'{}' is not a PS-X EXE executable\n", exe_file);
+            exit(1);
+        }
+    }
+    psx::boot::set_fast_boot(result.count("fast-boot") > 0);
+    psx::hle::set_enabled(result.count("hle-bios") > 0);
+    if (result.count("hle-lle") &&
+        psx::hle::set_lle(result["hle-lle"].as<std::string>()) != 0) {
+        fmt::print("Invalid BIOS call list '{}'\n",
+            result["hle-lle"].as<std::string>());
         exit(1);
     }
+    if (result.count("snapshot-cache")) {
+        psx::boot::set_snapshot_cache(result["snapshot-cache"].as<std::string>());
+    }
+
+    if (result.count("compress-cd")) {
+        std::string compressed_file = result["compress-cd"].as<std::string>();
+        if (psx::disc::compress(compressed_file,
+                result["compress-hunk"].as<unsigned>()) != 0) {
+            fmt::print("Cannot write compressed CD-ROM '{}'\n", compressed_file);
+            exit(1);
+        }
+        exit(0);
+    }
 
-    std::string rom_file = result["cd-rom"].as<std::string>();
-    std::ifstream cd_rom_contents(rom_file);
-    if (!cd_rom_contents.good()) {
-        fmt::print("CD-ROM file '{}' not found\n", rom_file);
+    if (result.count("bios") == 0) {
+        std::cout << "BIOS file unspecified" << std::endl;
         std::cout << options.help() << std::endl;
         exit(1);
     }
@@ -59,11 +178,181 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    unsigned cd_speed;
+    std::string cd_speed_name = result["cd-speed"].as<std::string>();
+    if (!parse_cd_speed(cd_speed_name, &cd_speed)) {
+        fmt::print("Invalid CD-ROM speed '{}'\n", cd_speed_name);
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+    if (result.count("cd-speed-overrides")) {
+        load_cd_speed_override(
+            result["cd-speed-overrides"].as<std::string>(),
+            psx::hw::read_cdrom_volume_id(), &cd_speed);
+    }
+    psx::hw::set_cdrom_speed(cd_speed);
+
+    if (result.count("frame-hash")) {
+        std::string frame_hash_file = result["frame-hash"].as<std::string>();
+        if (psx::framehash::open(frame_hash_file,
+                result.count("frame-hash-vram") > 0,
+                result.count("frame-hash-ram") > 0) != 0) {
+            fmt::print("Cannot create frame hash log '{}'\n", frame_hash_file);
+            exit(1);
+        }
+    }
+
     debugger::debugger.load_settings();
-    psx::state.load_bios(bios_contents);
-    psx::state.load_cd_rom(cd_rom_contents);
-    cd_rom_contents.close();
+    if (!result.count("sync-log")) {
+        debugger::start_logger();
+    }
+    psx::state->load_bios(bios_contents);
     bios_contents.close();
-    psx::start_gui();
-    return 0;
+
+    psx::disc::start(result["cd-prefetch"].as<unsigned>());
+
+    if (result.count("timing")) {
+        std::string timing_file = result["timing"].as<std::string>();
+        if (psx::timing::open_log(timing_file) != 0) {
+            fmt::print("Cannot create timing log '{}'\n", timing_file);
+            exit(1);
+        }
+        psx::timing::set_enabled(true);
+    }
+
+    if (result.count("timeline") && result.count("fork")) {
+        fmt::print("The timeline cannot be recorded from forked children\n");
+        exit(1);
+    }
+    if (result.count("timeline")) {
+        std::string timeline_file = result["timeline"].as<std::string>();
+        if (psx::timeline::open(timeline_file) != 0) {
+            fmt::print("Cannot create timeline '{}'\n", timeline_file);
+            exit(1);
+        }
+    }
+
+    if (result.count("rewind") && result.count("fork")) {
+        fmt::print("The rewind buffer cannot be used from forked children\n");
+        exit(1);
+    }
+    if (result.count("rewind")) {
+        psx::rewind::start(std::max(result["rewind"].as<unsigned>(), 1u),
+            result["rewind-budget"].as<size_t>() << 20);
+    } else if (!result.count("headless")) {
+        // The debugger reverse commands re-execute from the nearest
+        // capture, at most one frame away.
+        psx::rewind::start(1, result["rewind-budget"].as<size_t>() << 20);
+    }
+
+    if ((result.count("record") || result.count("replay")) &&
+        result.count("fork")) {
+        fmt::print("The pad input cannot be recorded or replayed "
+                   "from forked children\n");
+        exit(1);
+    }
+    if (result.count("record") && result.count("replay")) {
+        fmt::print("The options --record and --replay are exclusive\n");
+        exit(1);
+    }
+    if (result.count("record")) {
+        std::string record_file = result["record"].as<std::string>();
+        if (psx::input::record(record_file) != 0) {
+            fmt::print("Cannot create input log '{}'\n", record_file);
+            exit(1);
+        }
+    }
+    if (result.count("replay")) {
+        std::string replay_file = result["replay"].as<std::string>();
+        if (psx::input::replay(replay_file) != 0) {
+            fmt::print("Cannot load input log '{}'\n", replay_file);
+            exit(1);
+        }
+    }
+
+    if (result.count("trace") && result.count("fork")) {
+        fmt::print("The execution trace cannot be streamed "
+                   "from forked children\n");
+        exit(1);
+    }
+    if (result.count("trace") && !ENABLE_TRACE) {
+        fmt::print("The execution trace is disabled in this build\n");
+        exit(1);
+    }
+    if (result.count("trace")) {
+        std::string trace_file = result["trace"].as<std::string>();
+        if (psx::trace::open(trace_file,
+                result.count("trace-registers") > 0) != 0) {
+            fmt::print("Cannot create execution trace '{}'\n", trace_file);
+            exit(1);
+        }
+    }
+
+    psx::profiler::set_interval(result["profile-interval"].as<unsigned long>());
+    psx::profiler::set_enabled(result.count("profile") > 0);
+
+    int ret;
+    if (result.count("headless") && result.count("fork")) {
+        // Each child restarts the disc prefetch thread, and writes its
+        // frame hashes to its own log.
+        ret = psx::start_headless_fork(
+            result["fork-frame"].as<unsigned long>(),
+            result["fork"].as<unsigned>(),
+            result["frames"].as<unsigned long>(),
+            [&result](unsigned child) {
+                psx::disc::start(result["cd-prefetch"].as<unsigned>());
+                if (result.count("frame-hash") &&
+                    psx::framehash::open(fmt::format("{}.{}",
+                            result["frame-hash"].as<std::string>(), child),
+                        result.count("frame-hash-vram") > 0,
+                        result.count("frame-hash-ram") > 0) != 0) {
+                    fmt::print("Cannot create frame hash log for child {}\n",
+                        child);
+                }
+            });
+    } else if (result.count("headless")) {
+        ret = psx::start_headless(result["frames"].as<unsigned long>());
+    } else {
+        ret = psx::start_gui();
+    }
+
+    debugger::stop_logger();
+
+    if (result.count("profile")) {
+        std::string profile_file = result["profile"].as<std::string>();
+        if (psx::profiler::write_folded(profile_file) != 0) {
+            fmt::print("Cannot write profile '{}'\n", profile_file);
+        }
+    }
+    psx::profiler::print_report(result["profile-top"].as<size_t>());
+    psx::timing::print_report();
+    psx::mmio::print_report(result["mmio-top"].as<size_t>());
+    psx::timing::close_log();
+
+    if (result.count("rewind")) {
+        struct psx::rewind::stats rewind_stats = psx::rewind::stats();
+        fmt::print("rewind: {} captures of frames {}-{}, {:.1f} MiB, "
+                   "{} delayed\n", rewind_stats.captures,
+            rewind_stats.oldest_frame, rewind_stats.newest_frame,
+            rewind_stats.bytes / 1048576.0, rewind_stats.skipped);
+    }
+    psx::rewind::stop();
+
+    if (result.count("replay")) {
+        struct psx::input::replay_stats replay_stats =
+            psx::input::replay_stats();
+        fmt::print("replay: {}, {} polls, {} divergences\n",
+            !replay_stats.complete ? "incomplete" :
+            replay_stats.matched ? "matched" : "diverged",
+            replay_stats.polls, replay_stats.divergences);
+        ret = replay_stats.matched ? 0 : 1;
+    }
+    psx::input::close();
+    psx::trace::close();
+
+    psx::snapshot::flush();
+    psx::disc::stop();
+    psx::timeline::close();
+    psx::framehash::close();
+    return ret;
 }
@@ -0,0 +1,333 @@
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+#include <lib/sha256.h>
+#include <psx/boot.h>
+#include <psx/debugger.h>
+#include <psx/disc.h>
+#include <psx/hle.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+#include <psx/snapshot.h>
+
+using namespace psx;
+
+namespace psx::boot {
+
+/// Boot configuration of a machine.
+struct context {
+    bool fast_boot;
+    /// Cleared once the hook has run, so that jumps to the shell entry
+    /// address from the loaded executable are not intercepted.
+    bool armed;
+    std::string exe_path;
+    std::vector<uint8_t> exe_contents;
+    std::string snapshot_cache;
+
+    context() : fast_boot(false), armed(true) {}
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+//  PS-X EXE header, 0x800 bytes, followed by the text section.
+//  000h-007h ASCII ID "PS-X EXE"
+//  010h      Initial PC
+//  014h      Initial GP/R28
+//  018h      Destination Address in RAM
+//  01Ch      Filesize (must be N*800h)
+//  020h-027h Data section start address and size (usually 0)
+//  028h      BSS section start address, cleared at load
+//  02Ch      BSS section size
+//  030h      Initial SP/R29 and FP/R30 base, ignored if 0
+//  034h      Initial SP/R29 and FP/R30 offset, added to base
+
+#define EXE_HEADER_SIZE     0x800
+
+/// Offset of the user data in a raw Mode2 Form1 sector.
+#define SECTOR_DATA         24
+
+static bool is_exe(std::vector<uint8_t> const &exe) {
+    return exe.size() >= EXE_HEADER_SIZE &&
+        memcmp(exe.data(), "PS-X EXE", 8) == 0;
+}
+
+/**
+ * @brief Load the executable \p exe into RAM and set up the registers.
+ * @param stack  Stack top read from SYSTEM.CNF, used when the executable
+ *  does not define its own.
+ */
+static bool load_exe(std::vector<uint8_t> const &exe, uint32_t stack) {
+    if (!is_exe(exe)) {
+        return false;
+    }
+
+    uint8_t const *header = exe.data();
+    uint32_t pc = memory::load_u32_le(header + 0x10);
+    uint32_t gp = memory::load_u32_le(header + 0x14);
+    uint32_t t_addr = memory::load_u32_le(header + 0x18) & UINT32_C(0x1fffff);
+    uint32_t t_size = memory::load_u32_le(header + 0x1c);
+    uint32_t b_addr = memory::load_u32_le(header + 0x28) & UINT32_C(0x1fffff);
+    uint32_t b_size = memory::load_u32_le(header + 0x2c);
+    uint32_t s_addr = memory::load_u32_le(header + 0x30);
+    uint32_t s_size = memory::load_u32_le(header + 0x34);
+
+    t_size = std::min<size_t>(t_size, exe.size() - EXE_HEADER_SIZE);
+    if ((uint64_t)t_addr + t_size > sizeof(state->ram) ||
+        (uint64_t)b_addr + b_size > sizeof(state->ram)) {
+        return false;
+    }
+
+    memcpy(state->ram + t_addr, header + EXE_HEADER_SIZE, t_size);
+    memset(state->ram + b_addr, 0, b_size);
+    state->mark_ram_dirty(t_addr, t_size);
+    state->mark_ram_dirty(b_addr, b_size);
+
+    if (s_addr != 0) {
+        stack = s_addr + s_size;
+    }
+
+    state->cpu.pc = pc;
+    state->cpu.gpr[28] = gp;
+    state->cpu.gpr[29] = stack;
+    state->cpu.gpr[30] = stack;
+    return true;
+}
+
+/// Compare ISO9660 file identifiers, ignoring case and the version
+/// suffix (";1").
+static bool match_name(std::string name, std::string expected) {
+    name = name.substr(0, name.find(';'));
+    expected = expected.substr(0, expected.find(';'));
+    return name.size() == expected.size() &&
+        std::equal(name.begin(), name.end(), expected.begin(),
+            [](char a, char b) { return toupper(a) == toupper(b); });
+}
+
+/**
+ * @brief Look up the entry \p name in the directory starting at sector
+ *  \p extent of \p size bytes.
+ * @return true if found, with the location of the entry in \p extent
+ *  and \p size.
+ */
+static bool find_entry(std::string const &name, uint32_t *extent,
+                       uint32_t *size) {
+    uint8_t sector[RAW_SECTOR_SIZE];
+    uint32_t nr_sectors = (*size + DATA_SECTOR_SIZE - 1) / DATA_SECTOR_SIZE;
+
+    for (uint32_t nr = 0; nr < nr_sectors; nr++) {
+        if (!disc::read_sector(*extent + nr, sector)) {
+            return false;
+        }
+
+        // Directory records do not cross sector boundaries;
+        // a null record length pads the end of a sector.
+        uint8_t const *data = sector + SECTOR_DATA;
+        for (unsigned offset = 0; offset + 33 < DATA_SECTOR_SIZE; ) {
+            uint8_t const *record = data + offset;
+            unsigned record_len = record[0];
+            unsigned name_len = record[32];
+            if (record_len == 0 || offset + record_len > DATA_SECTOR_SIZE) {
+                break;
+            }
+            if (match_name(std::string((char const *)record + 33, name_len),
+                           name)) {
+                *extent = memory::load_u32_le(record + 2);
+                *size = memory::load_u32_le(record + 10);
+                return true;
+            }
+            offset += record_len;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read the file \p path from the ISO9660 file system of the disc.
+ *  Path components are separated by backslashes.
+ */
+static bool read_file(std::string path, std::vector<uint8_t> *contents) {
+    uint8_t sector[RAW_SECTOR_SIZE];
+    if (!disc::read_sector(16, sector) ||
+        memcmp(sector + SECTOR_DATA + 1, "CD001", 5) != 0) {
+        return false;
+    }
+
+    // Root directory record, at offset 156 of the primary
+    // volume descriptor.
+    uint8_t const *root = sector + SECTOR_DATA + 156;
+    uint32_t extent = memory::load_u32_le(root + 2);
+    uint32_t size = memory::load_u32_le(root + 10);
+
+    while (!path.empty()) {
+        size_t separator = path.find('\\');
+        std::string name = path.substr(0, separator);
+        path = separator == std::string::npos ? "" : path.substr(separator + 1);
+        if (!name.empty() && !find_entry(name, &extent, &size)) {
+            return false;
+        }
+    }
+
+    contents->resize(size);
+    for (uint32_t offset = 0; offset < size; offset += DATA_SECTOR_SIZE) {
+        if (!disc::read_sector(extent + offset / DATA_SECTOR_SIZE, sector)) {
+            return false;
+        }
+        memcpy(contents->data() + offset, sector + SECTOR_DATA,
+            std::min<uint32_t>(DATA_SECTOR_SIZE, size - offset));
+    }
+    return true;
+}
+
+/**
+ * @brief Parse SYSTEM.CNF for the boot executable path and the stack top.
+ *  Discs without SYSTEM.CNF boot PSX.EXE.
+ */
+static void read_system_cnf(std::string *boot, uint32_t *stack) {
+    std::vector<uint8_t> contents;
+    *boot = "PSX.EXE;1";
+    if (!read_file("SYSTEM.CNF;1", &contents)) {
+        return;
+    }
+
+    std::string cnf(contents.begin(), contents.end());
+    size_t pos = 0;
+    while (pos < cnf.size()) {
+        size_t end = cnf.find_first_of("\r\n", pos);
+        std::string line = cnf.substr(pos, end - pos);
+        pos = end == std::string::npos ? cnf.size() : end + 1;
+
+        size_t equal = line.find('=');
+        if (equal == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, equal);
+        std::string value = line.substr(equal + 1);
+        key.erase(std::remove_if(key.begin(), key.end(), isspace), key.end());
+        value.erase(std::remove_if(value.begin(), value.end(), isspace),
+            value.end());
+
+        if (key == "BOOT") {
+            // cdrom:\DIR\FILE.EXE;1
+            if (value.compare(0, 6, "cdrom:") == 0) {
+                value = value.substr(6);
+            }
+            *boot = value;
+        } else if (key == "STACK") {
+            *stack = strtoul(value.c_str(), NULL, 16);
+        }
+    }
+}
+
+void set_fast_boot(bool enable) {
+    context *ctx = machine()->boot.get();
+    ctx->fast_boot = enable;
+}
+
+int set_exe(std::string const &path) {
+    context *ctx = machine()->boot.get();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.good()) {
+        return -1;
+    }
+
+    ctx->exe_contents.assign(std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>());
+    if (!is_exe(ctx->exe_contents)) {
+        ctx->exe_contents.clear();
+        return -1;
+    }
+    ctx->exe_path = path;
+    return 0;
+}
+
+void set_snapshot_cache(std::string const &dir) {
+    context *ctx = machine()->boot.get();
+    ctx->snapshot_cache = dir;
+}
+
+bool enabled(void) {
+    context *ctx = machine()->boot.get();
+    return ctx->armed && (ctx->fast_boot || !ctx->exe_contents.empty() ||
+                          !ctx->snapshot_cache.empty());
+}
+
+/// Path of the cached snapshot for the loaded BIOS image. The snapshot
+/// version is part of the name, snapshots of older versions are
+/// otherwise never replaced. The CD-ROM speed and the HLE BIOS setting
+/// change the state reached at the shell entry, and are part of the
+/// name as well.
+static std::string snapshot_path(void) {
+    context *ctx = machine()->boot.get();
+    return fmt::format("{}/{}.v{}.cd{}x{}.snap", ctx->snapshot_cache,
+        sha256::hex_digest(state->bios, BIOS_SIZE), SNAPSHOT_VERSION,
+        machine()->cdrom_speed, hle::enabled() ? ".hle" : "");
+}
+
+void reset(void) {
+    context *ctx = machine()->boot.get();
+    ctx->armed = true;
+    if (ctx->snapshot_cache.empty()) {
+        return;
+    }
+
+    // The snapshot is taken on the jump to the shell entry point,
+    // the hook runs again on the first instruction after restore.
+    std::string path = snapshot_path();
+    if (snapshot::restore(path) == 0) {
+        debugger::info(Debugger::CPU, "restored BIOS snapshot '{}'", path);
+    }
+}
+
+void shell_entry(void) {
+    context *ctx = machine()->boot.get();
+    ctx->armed = false;
+    uint32_t stack = UINT32_C(0x801fff00);
+
+    if (!ctx->snapshot_cache.empty()) {
+        std::string path = snapshot_path();
+        if (access(path.c_str(), F_OK) != 0) {
+            if (snapshot::save(path) == 0) {
+                debugger::info(Debugger::CPU,
+                    "saved BIOS snapshot '{}'", path);
+            } else {
+                debugger::warn(Debugger::CPU,
+                    "cannot save BIOS snapshot '{}'", path);
+            }
+        }
+    }
+
+    if (!ctx->fast_boot && ctx->exe_contents.empty()) {
+        return;
+    }
+
+    if (!ctx->exe_contents.empty()) {
+        if (!load_exe(ctx->exe_contents, stack)) {
+            psx::halt(fmt::format("cannot load executable '{}'",
+                ctx->exe_path));
+        }
+        return;
+    }
+
+    std::string boot;
+    std::vector<uint8_t> exe;
+    read_system_cnf(&boot, &stack);
+    if (!read_file(boot, &exe) || !load_exe(exe, stack)) {
+        debugger::warn(Debugger::CDROM,
+            "fast boot: cannot load '{}', continuing with the BIOS shell",
+            boot);
+        return;
+    }
+    debugger::info(Debugger::CDROM, "fast boot: loaded '{}'", boot);
+}
+
+}; /* namespace psx::boot */
@@ -1,8 +1,14 @@
 
+#include <algorithm>
+#include <cstring>
+#include <string>
+
 #include <psx/psx.h>
+#include <psx/disc.h>
 #include <psx/hw.h>
 #include <psx/debugger.h>
 #include <psx/memory.h>
+#include <psx/timeline.h>
 
 using namespace psx;
 
@@ -36,24 +42,296 @@ namespace psx::hw {
 #define STAT_SHELL_OPEN     (UINT8_C(1) << 4)
 #define STAT_ID_ERROR       (UINT8_C(1) << 3)
 #define STAT_SEEK_ERROR     (UINT8_C(1) << 2)
-#define STAT_SPINDLE_ERROR  (UINT8_C(1) << 1)
+#define STAT_SPINDLE_MOTOR  (UINT8_C(1) << 1)
 #define STAT_ERROR          (UINT8_C(1) << 0)
 
+//  7   Speed       (0=Normal speed, 1=Double speed)
+//  6   XA-ADPCM    (0=Off, 1=Send XA-ADPCM sectors to SPU Audio Input)
+//  5   Sector Size (0=800h=DataOnly, 1=924h=WholeSectorExceptSyncBytes)
+//  4   Ignore Bit  (0=Normal, 1=Ignore Sector Size and Setloc position)
+//  3   XA-Filter   (0=Off, 1=Process only XA-ADPCM sectors that match Setfilter)
+//  2   Report      (0=Off, 1=Enable Report-Interrupts for Audio Play)
+//  1   AutoPause   (0=Off, 1=Auto Pause upon End of Track) ;for Audio Play
+//  0   CDDA        (0=Off, 1=Allow to Read CD-DA Sectors; ignore missing EDC)
+
+#define MODE_DOUBLE_SPEED   (UINT8_C(1) << 7)
+#define MODE_SECTOR_SIZE    (UINT8_C(1) << 5)
+
+//  0-4 0    Not used (should be zero)
+//  5   SMEN Want Command Start Interrupt on Next Command (0=No change, 1=Yes)
+//  6   BFWR Want Data Write  (0=No, 1=Yes)
+//  7   BFRD Want Data         (0=No/Reset Data Fifo, 1=Yes/Load Data Fifo)
+
+#define REQUEST_BFRD        (UINT8_C(1) << 7)
+
+//  Error codes, sent as second response byte with INT5.
+
+#define ERROR_INVALID_PARAMETER     UINT8_C(0x10)
+#define ERROR_WRONG_PARAMETER_COUNT UINT8_C(0x20)
+#define ERROR_NOT_READY             UINT8_C(0x80)
+
+/// The first two seconds of the disc (150 sectors) are the track 1
+/// pregap; Setloc positions are absolute and include the pregap.
+#define PREGAP_SECTORS      150
+
+// Drive timings, in CPU clock cycles. The drive reads 75 sectors per
+// second at single speed.
+static const unsigned long cpu_clock_rate = 33868800;
+static const unsigned long sector_delay_1x = cpu_clock_rate / 75;
+static const unsigned long sector_delay_2x = cpu_clock_rate / 150;
+static const unsigned long second_response_delay = 0x4a00;
+static const unsigned long init_delay = 0x13cce;
+static const unsigned long read_toc_delay = cpu_clock_rate / 2;
+static const unsigned long queued_interrupt_delay = 0x800;
+/// Shortest delay used by accelerated timings: leaves the CPU enough
+/// time to acknowledge the interrupt and run the DMA transfer.
+static const unsigned long instant_delay = 0x2000;
+
+static uint8_t to_bcd(unsigned val) {
+    return ((val / 10) << 4) | (val % 10);
+}
+
+static unsigned from_bcd(uint8_t val) {
+    return (val >> 4) * 10 + (val & UINT8_C(0xf));
+}
+
+static void lba_to_msf(uint32_t lba, uint8_t *msf) {
+    lba += PREGAP_SECTORS;
+    msf[0] = to_bcd(lba / (60 * 75));
+    msf[1] = to_bcd((lba / 75) % 60);
+    msf[2] = to_bcd(lba % 75);
+}
+
+static unsigned long accelerated_delay(unsigned long delay) {
+    unsigned speed = machine()->cdrom_speed;
+    if (speed == CDROM_SPEED_INSTANT) {
+        return instant_delay;
+    }
+    return std::max(delay / speed, instant_delay);
+}
+
+static unsigned long sector_delay(void) {
+    return accelerated_delay((state->cdrom.mode & MODE_DOUBLE_SPEED) ?
+        sector_delay_2x : sector_delay_1x);
+}
+
+/// Approximate seek time: a fixed settle delay plus a term
+/// proportional to the distance travelled by the head.
+static unsigned long seek_delay(uint32_t from, uint32_t to) {
+    uint32_t distance = from > to ? from - to : to - from;
+    return accelerated_delay(sector_delay_1x + (unsigned long)distance * 16);
+}
+
+/// Raise the interrupt \p irq for the response currently held in the
+/// response fifo.
+static void raise_interrupt(uint8_t irq) {
+    state->cdrom.interrupt_flag &= ~UINT8_C(0x7);
+    state->cdrom.interrupt_flag |= irq;
+    state->cdrom.response_fifo_index = 0;
+
+    if (state->cdrom.response_fifo_length > 0) {
+        state->cdrom.index |= RSLRRDY;
+    } else {
+        state->cdrom.index &= ~RSLRRDY;
+    }
+
+    if (state->cdrom.interrupt_flag & state->cdrom.interrupt_enable) {
+        hw::set_i_stat(I_STAT_CDROM);
+    }
+}
+
+/// Deliver an asynchronous response (INT1, INT2 or INT5).
+/// If the host has not yet acknowledged the pending interrupt, the
+/// response is held back and delivered after acknowledgement. A held
+/// sector interrupt is replaced by the next one, which loses the
+/// sector, as on hardware.
+static void async_response(uint8_t irq, uint8_t const *response,
+                           unsigned length) {
+    if ((state->cdrom.interrupt_flag & UINT8_C(0x7)) != 0) {
+        debugger::debug(Debugger::CDROM, "INT{} queued", irq);
+        state->cdrom.queued_interrupt = irq;
+        memcpy(state->cdrom.queued_response, response, length);
+        state->cdrom.queued_response_length = length;
+        return;
+    }
+
+    debugger::debug(Debugger::CDROM, "INT{}", irq);
+    memcpy(state->cdrom.response_fifo, response, length);
+    state->cdrom.response_fifo_length = length;
+    raise_interrupt(irq);
+}
+
+void cdrom_queued_interrupt_event(void) {
+    if (state->cdrom.queued_interrupt == 0 ||
+        (state->cdrom.interrupt_flag & UINT8_C(0x7)) != 0) {
+        return;
+    }
+
+    uint8_t irq = state->cdrom.queued_interrupt;
+    state->cdrom.queued_interrupt = 0;
+    async_response(irq, state->cdrom.queued_response,
+        state->cdrom.queued_response_length);
+}
+
+static uint8_t error_response(uint8_t error) {
+    state->cdrom.response_fifo[0] = state->cdrom.stat | STAT_ERROR;
+    state->cdrom.response_fifo[1] = error;
+    state->cdrom.response_fifo_length = 2;
+    return INT5;
+}
+
+static uint8_t stat_response(void) {
+    state->cdrom.response_fifo[0] = state->cdrom.stat;
+    state->cdrom.response_fifo_length = 1;
+    return INT3;
+}
+
+static bool check_parameter_count(unsigned count) {
+    return state->cdrom.parameter_fifo_index == count;
+}
+
+void cdrom_sector_event(void) {
+    // With accelerated timings the drive waits for the host to
+    // acknowledge the previous sector instead of overrunning it:
+    // the faster delivery must not cause lost sectors.
+    if (machine()->cdrom_speed != 1 &&
+        (state->cdrom.interrupt_flag & UINT8_C(0x7)) != 0) {
+        state->schedule_event(state->cycles + instant_delay, cdrom_sector_event);
+        return;
+    }
+
+    state->cdrom.stat &= ~STAT_SEEK;
+    state->cdrom.stat |= STAT_READ;
+
+    timeline::span span("cdrom", "sector", "lba", state->cdrom.lba);
+    if (!disc::read_sector(state->cdrom.lba, state->cdrom.sector)) {
+        debugger::warn(Debugger::CDROM,
+            "read past the end of the disc (lba {})", state->cdrom.lba);
+        state->cdrom.stat &= ~STAT_READ;
+        uint8_t response[2] = {
+            (uint8_t)(state->cdrom.stat | STAT_SEEK_ERROR), 0x04 };
+        async_response(INT5, response, 2);
+        return;
+    }
+
+    debugger::debug(Debugger::CDROM, "sector {} ready", state->cdrom.lba);
+    state->cdrom.sector_valid = true;
+    state->cdrom.lba++;
+
+    uint8_t response = state->cdrom.stat;
+    async_response(INT1, &response, 1);
+    state->schedule_event(state->cycles + sector_delay(), cdrom_sector_event);
+}
+
+void cdrom_second_response_event(void) {
+    uint8_t response[8];
+    unsigned length = 1;
+
+    switch (state->cdrom.second_response_command) {
+    case 0x15: // SeekL
+    case 0x16: // SeekP
+        state->cdrom.stat &= ~STAT_SEEK;
+        break;
+
+    case 0x1a: { // GetID
+        if (disc::sector_count() == 0) {
+            uint8_t no_disc[8] = { 0x08, 0x40, 0, 0, 0, 0, 0, 0 };
+            async_response(INT5, no_disc, 8);
+            return;
+        }
+
+        // The region is detected from the license string recorded
+        // in sector 4 of licensed discs.
+        char region = 'I';
+        uint8_t sector[RAW_SECTOR_SIZE];
+        if (disc::read_sector(4, sector)) {
+            std::string license((char const *)sector + 24, DATA_SECTOR_SIZE);
+            if (license.find("Europe") != std::string::npos) {
+                region = 'E';
+            } else if (license.find("Amer") != std::string::npos) {
+                region = 'A';
+            }
+        }
+
+        response[1] = 0x00;
+        response[2] = 0x20; // Mode2
+        response[3] = 0x00;
+        response[4] = 'S';
+        response[5] = 'C';
+        response[6] = 'E';
+        response[7] = region;
+        length = 8;
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    response[0] = state->cdrom.stat;
+    async_response(INT2, response, length);
+}
+
+static void schedule_second_response(uint8_t cmd, unsigned long delay) {
+    state->cdrom.second_response_command = cmd;
+    state->cancel_event(cdrom_second_response_event);
+    state->schedule_event(state->cycles + delay, cdrom_second_response_event);
+}
+
+static void stop_reading(void) {
+    state->cancel_event(cdrom_sector_event);
+    state->cdrom.stat &= ~(STAT_READ | STAT_SEEK | STAT_PLAY);
+}
+
+void set_cdrom_speed(unsigned speed) {
+    machine()->cdrom_speed = speed;
+}
+
+std::string read_cdrom_volume_id(void) {
+    // The volume identifier is stored at offset 40 of the ISO9660
+    // primary volume descriptor, in sector 16, padded with spaces.
+    uint8_t sector[RAW_SECTOR_SIZE];
+    if (!disc::read_sector(16, sector) ||
+        memcmp(sector + 24 + 1, "CD001", 5) != 0) {
+        return "";
+    }
+
+    std::string volume_id((char const *)sector + 24 + 40, 32);
+    size_t end = volume_id.find_last_not_of(' ');
+    return end == std::string::npos ? "" : volume_id.substr(0, end + 1);
+}
+
 static uint8_t sync(uint8_t cmd) {
     psx::halt("sync not implemented");
     return INT5;
 }
 
 static uint8_t get_stat(uint8_t cmd) {
-    state.cdrom.response_fifo[0] = state.cdrom.stat;
-    state.cdrom.response_fifo_length = 1;
-    state.cdrom.stat &= ~STAT_SHELL_OPEN;
+    state->cdrom.response_fifo[0] = state->cdrom.stat;
+    state->cdrom.response_fifo_length = 1;
+    state->cdrom.stat &= ~STAT_SHELL_OPEN;
     return INT3;
 }
 
 static uint8_t set_loc(uint8_t cmd) {
-    psx::halt("set_loc not implemented");
-    return INT5;
+    if (!check_parameter_count(3)) {
+        return error_response(ERROR_WRONG_PARAMETER_COUNT);
+    }
+
+    unsigned mm = from_bcd(state->cdrom.parameter_fifo[0]);
+    unsigned ss = from_bcd(state->cdrom.parameter_fifo[1]);
+    unsigned ff = from_bcd(state->cdrom.parameter_fifo[2]);
+    if (ss >= 60 || ff >= 75) {
+        return error_response(ERROR_INVALID_PARAMETER);
+    }
+
+    uint32_t lba = (mm * 60 + ss) * 75 + ff;
+    state->cdrom.setloc_lba = lba < PREGAP_SECTORS ? 0 : lba - PREGAP_SECTORS;
+    state->cdrom.setloc_pending = true;
+    disc::prefetch(state->cdrom.setloc_lba);
+    debugger::info(Debugger::CDROM, "  setloc {:02}:{:02}:{:02} (lba {})",
+        mm, ss, ff, state->cdrom.setloc_lba);
+    return stat_response();
 }
 
 static uint8_t play(uint8_t cmd) {
@@ -71,64 +349,132 @@ static uint8_t backward(uint8_t cmd) {
     return INT5;
 }
 
+/// Start reading sectors at the Setloc position, or continue from the
+/// current position when no Setloc is pending. The first sector is
+/// delivered after the seek completes, then one INT1 per sector.
 static uint8_t read_N(uint8_t cmd) {
-    psx::halt("read_N not implemented");
-    return INT5;
+    if (disc::sector_count() == 0) {
+        return error_response(ERROR_NOT_READY);
+    }
+
+    uint8_t sig = stat_response();
+    unsigned long delay = sector_delay();
+
+    state->cancel_event(cdrom_sector_event);
+    state->cdrom.stat &= ~(STAT_READ | STAT_PLAY);
+    state->cdrom.stat |= STAT_SPINDLE_MOTOR;
+    if (state->cdrom.setloc_pending) {
+        delay += seek_delay(state->cdrom.lba, state->cdrom.setloc_lba);
+        state->cdrom.lba = state->cdrom.setloc_lba;
+        state->cdrom.setloc_pending = false;
+        state->cdrom.stat |= STAT_SEEK;
+    } else {
+        state->cdrom.stat |= STAT_READ;
+    }
+
+    disc::prefetch(state->cdrom.lba);
+    state->schedule_event(state->cycles + delay, cdrom_sector_event);
+    return sig;
 }
 
 static uint8_t motor_on(uint8_t cmd) {
-    psx::halt("motor_on not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    state->cdrom.stat |= STAT_SPINDLE_MOTOR;
+    schedule_second_response(cmd, second_response_delay);
+    return sig;
 }
 
 static uint8_t stop(uint8_t cmd) {
-    psx::halt("stop not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    stop_reading();
+    state->cdrom.stat &= ~STAT_SPINDLE_MOTOR;
+    schedule_second_response(cmd, second_response_delay);
+    return sig;
 }
 
 static uint8_t pause(uint8_t cmd) {
-    psx::halt("pause not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    bool reading = (state->cdrom.stat & (STAT_READ | STAT_SEEK)) != 0;
+    stop_reading();
+    schedule_second_response(cmd,
+        reading ? sector_delay() : second_response_delay);
+    return sig;
 }
 
 static uint8_t init(uint8_t cmd) {
-    psx::halt("init not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    stop_reading();
+    state->cdrom.mode = UINT8_C(0x20);
+    state->cdrom.stat = STAT_SPINDLE_MOTOR;
+    state->cdrom.setloc_pending = false;
+    schedule_second_response(cmd, init_delay);
+    return sig;
 }
 
+// Audio playback is not emulated, the mute state is ignored.
 static uint8_t mute(uint8_t cmd) {
-    psx::halt("mute not implemented");
-    return INT5;
+    return stat_response();
 }
 
 static uint8_t demute(uint8_t cmd) {
-    psx::halt("demute not implemented");
-    return INT5;
+    return stat_response();
 }
 
 static uint8_t set_filter(uint8_t cmd) {
-    psx::halt("set_filter not implemented");
-    return INT5;
+    if (!check_parameter_count(2)) {
+        return error_response(ERROR_WRONG_PARAMETER_COUNT);
+    }
+    state->cdrom.filter_file = state->cdrom.parameter_fifo[0];
+    state->cdrom.filter_channel = state->cdrom.parameter_fifo[1];
+    return stat_response();
 }
 
 static uint8_t set_mode(uint8_t cmd) {
-    psx::halt("set_mode not implemented");
-    return INT5;
+    if (!check_parameter_count(1)) {
+        return error_response(ERROR_WRONG_PARAMETER_COUNT);
+    }
+    state->cdrom.mode = state->cdrom.parameter_fifo[0];
+    debugger::info(Debugger::CDROM, "  mode {:02x}", state->cdrom.mode);
+    return stat_response();
 }
 
 static uint8_t get_param(uint8_t cmd) {
-    psx::halt("get_param not implemented");
-    return INT5;
+    state->cdrom.response_fifo[0] = state->cdrom.stat;
+    state->cdrom.response_fifo[1] = state->cdrom.mode;
+    state->cdrom.response_fifo[2] = 0;
+    state->cdrom.response_fifo[3] = state->cdrom.filter_file;
+    state->cdrom.response_fifo[4] = state->cdrom.filter_channel;
+    state->cdrom.response_fifo_length = 5;
+    return INT3;
 }
 
 static uint8_t get_loc_L(uint8_t cmd) {
-    psx::halt("get_loc_L not implemented");
-    return INT5;
+    if (!state->cdrom.sector_valid) {
+        return error_response(ERROR_NOT_READY);
+    }
+    // Header (amm, ass, asect, mode) and subheader (file, channel,
+    // submode, codinginfo) of the last read sector.
+    memcpy(state->cdrom.response_fifo, state->cdrom.sector + 12, 8);
+    state->cdrom.response_fifo_length = 8;
+    return INT3;
 }
 
 static uint8_t get_loc_P(uint8_t cmd) {
-    psx::halt("get_loc_P not implemented");
-    return INT5;
+    uint32_t lba = state->cdrom.lba > 0 ? state->cdrom.lba - 1 : 0;
+    disc::track_info track = { 1, false, 0, 0, 0 };
+    disc::find_track(lba, &track);
+
+    // The relative position counts down to index 01 in the pregap.
+    bool pregap = lba < track.start;
+    uint32_t relative = pregap ? track.start - lba : lba - track.start;
+    state->cdrom.response_fifo[0] = to_bcd(track.number);
+    state->cdrom.response_fifo[1] = pregap ? 0x00 : 0x01;
+    state->cdrom.response_fifo[2] = to_bcd(relative / (60 * 75));
+    state->cdrom.response_fifo[3] = to_bcd((relative / 75) % 60);
+    state->cdrom.response_fifo[4] = to_bcd(relative % 75);
+    lba_to_msf(lba, state->cdrom.response_fifo + 5);
+    state->cdrom.response_fifo_length = 8;
+    return INT3;
 }
 
 static uint8_t set_session(uint8_t cmd) {
@@ -137,23 +483,51 @@ static uint8_t set_session(uint8_t cmd) {
 }
 
 static uint8_t get_TN(uint8_t cmd) {
-    psx::halt("get_TN not implemented");
-    return INT5;
+    state->cdrom.response_fifo[0] = state->cdrom.stat;
+    state->cdrom.response_fifo[1] = 0x01; // First track
+    state->cdrom.response_fifo[2] = to_bcd(disc::track_count());
+    state->cdrom.response_fifo_length = 3;
+    return INT3;
 }
 
 static uint8_t get_TD(uint8_t cmd) {
-    psx::halt("get_TD not implemented");
-    return INT5;
+    if (!check_parameter_count(1)) {
+        return error_response(ERROR_WRONG_PARAMETER_COUNT);
+    }
+
+    // Track 0 designates the lead-out area.
+    uint8_t msf[3];
+    unsigned number = from_bcd(state->cdrom.parameter_fifo[0]);
+    disc::track_info track;
+    if (number == 0) {
+        lba_to_msf(disc::sector_count(), msf);
+    } else if (disc::get_track(number, &track)) {
+        lba_to_msf(track.start, msf);
+    } else {
+        return error_response(ERROR_INVALID_PARAMETER);
+    }
+
+    state->cdrom.response_fifo[0] = state->cdrom.stat;
+    state->cdrom.response_fifo[1] = msf[0];
+    state->cdrom.response_fifo[2] = msf[1];
+    state->cdrom.response_fifo_length = 3;
+    return INT3;
 }
 
 static uint8_t seek_L(uint8_t cmd) {
-    psx::halt("seek_L not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    unsigned long delay = seek_delay(state->cdrom.lba, state->cdrom.setloc_lba);
+    stop_reading();
+    state->cdrom.stat |= STAT_SEEK | STAT_SPINDLE_MOTOR;
+    state->cdrom.lba = state->cdrom.setloc_lba;
+    state->cdrom.setloc_pending = false;
+    disc::prefetch(state->cdrom.lba);
+    schedule_second_response(cmd, delay);
+    return sig;
 }
 
 static uint8_t seek_P(uint8_t cmd) {
-    psx::halt("seek_P not implemented");
-    return INT5;
+    return seek_L(cmd);
 }
 
 static uint8_t set_clock(uint8_t cmd) {
@@ -181,19 +555,19 @@ static uint8_t get_clock(uint8_t cmd) {
 #define CTRVER_vC3_c    UINT32_C(0xA10306C3)  // PSone/late (PM-41(2))    06 Jun 2001, version vC3 (c)
 
 static uint8_t test(uint8_t cmd) {
-    if (state.cdrom.parameter_fifo_index != 1) {
+    if (state->cdrom.parameter_fifo_index != 1) {
         psx::halt("missing test parameters");
     }
 
-    uint8_t sub_function = state.cdrom.parameter_fifo[0];
+    uint8_t sub_function = state->cdrom.parameter_fifo[0];
     switch (sub_function) {
     case UINT8_C(0x20): {
         uint32_t version = CTRVER_vC3_a;
-        state.cdrom.response_fifo[0] = version >> 24; // yy
-        state.cdrom.response_fifo[1] = version >> 16; // mm
-        state.cdrom.response_fifo[2] = version >> 8;  // dd
-        state.cdrom.response_fifo[3] = version >> 0;  // version
-        state.cdrom.response_fifo_length = 4;
+        state->cdrom.response_fifo[0] = version >> 24; // yy
+        state->cdrom.response_fifo[1] = version >> 16; // mm
+        state->cdrom.response_fifo[2] = version >> 8;  // dd
+        state->cdrom.response_fifo[3] = version >> 0;  // version
+        state->cdrom.response_fifo_length = 4;
         return INT3;
     }
 
@@ -205,13 +579,13 @@ static uint8_t test(uint8_t cmd) {
 }
 
 static uint8_t get_ID(uint8_t cmd) {
-    psx::halt("get_ID not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    schedule_second_response(cmd, second_response_delay);
+    return sig;
 }
 
 static uint8_t read_S(uint8_t cmd) {
-    psx::halt("read_S not implemented");
-    return INT5;
+    return read_N(cmd);
 }
 
 static uint8_t reset(uint8_t cmd) {
@@ -225,8 +599,9 @@ static uint8_t get_Q(uint8_t cmd) {
 }
 
 static uint8_t read_TOC(uint8_t cmd) {
-    psx::halt("read_TOC not implemented");
-    return INT5;
+    uint8_t sig = stat_response();
+    schedule_second_response(cmd, accelerated_delay(read_toc_delay));
+    return sig;
 }
 
 static uint8_t video_CD(uint8_t cmd) {
@@ -282,17 +657,17 @@ static void cdrom_command(uint8_t cmd) {
         sig = INT5;
     }
 
-    state.cdrom.response_fifo_index = 0;
-    state.cdrom.parameter_fifo_index = 0;
-    state.cdrom.interrupt_flag |= sig;
+    state->cdrom.response_fifo_index = 0;
+    state->cdrom.parameter_fifo_index = 0;
+    state->cdrom.interrupt_flag |= sig;
 
-    if (state.cdrom.response_fifo_length > 0) {
-        state.cdrom.index |= RSLRRDY;
+    if (state->cdrom.response_fifo_length > 0) {
+        state->cdrom.index |= RSLRRDY;
     } else {
-        state.cdrom.index &= ~RSLRRDY;
+        state->cdrom.index &= ~RSLRRDY;
     }
 
-    if (state.cdrom.interrupt_flag & state.cdrom.interrupt_enable) {
+    if (state->cdrom.interrupt_flag & state->cdrom.interrupt_enable) {
         hw::set_i_stat(I_STAT_CDROM);
     }
 }
@@ -306,35 +681,35 @@ static void cdrom_command(uint8_t cmd) {
 //  7   BUSYSTS Command/parameter transmission busy  (1=Busy)
 
 void read_cdrom_index(uint32_t *val) {
-    debugger::info(Debugger::CDROM, "cdrom_index -> {:02x}", state.cdrom.index);
-    *val = state.cdrom.index;
+    debugger::info(Debugger::CDROM, "cdrom_index -> {:02x}", state->cdrom.index);
+    *val = state->cdrom.index;
 }
 
 void write_cdrom_index(uint8_t val) {
     debugger::info(Debugger::CDROM, "cdrom_index <- {:02x}", val);
-    state.cdrom.index &= ~UINT8_C(0x3);
-    state.cdrom.index |= val & UINT8_C(0x3);
+    state->cdrom.index &= ~UINT8_C(0x3);
+    state->cdrom.index |= val & UINT8_C(0x3);
 }
 
 void read_cdrom_reg01(uint32_t *val) {
-    *val = state.cdrom.response_fifo[state.cdrom.response_fifo_index];
+    *val = state->cdrom.response_fifo[state->cdrom.response_fifo_index];
     debugger::info(Debugger::CDROM, "cdrom_response -> {:02x}", *val);
 
-    state.cdrom.response_fifo_index++;
-    if (state.cdrom.response_fifo_index >= state.cdrom.response_fifo_length) {
-        state.cdrom.index &= ~RSLRRDY;
+    state->cdrom.response_fifo_index++;
+    if (state->cdrom.response_fifo_index >= state->cdrom.response_fifo_length) {
+        state->cdrom.index &= ~RSLRRDY;
     }
-    if (state.cdrom.response_fifo_index > sizeof(state.cdrom.response_fifo)) {
-        state.cdrom.response_fifo_index = 0;
+    if (state->cdrom.response_fifo_index > sizeof(state->cdrom.response_fifo)) {
+        state->cdrom.response_fifo_index = 0;
     }
 }
 
 void write_cdrom_reg01(uint8_t val) {
-    unsigned index = state.cdrom.index & UINT8_C(0x3);
+    unsigned index = state->cdrom.index & UINT8_C(0x3);
     switch (index) {
     case 0x0:
         debugger::info(Debugger::CDROM, "cdrom_command <- {:02x}", val);
-        state.cdrom.command = val;
+        state->cdrom.command = val;
         cdrom_command(val);
         break;
 
@@ -345,29 +720,83 @@ void write_cdrom_reg01(uint8_t val) {
     }
 }
 
+/// Load the data fifo with the last read sector: the 0x800 bytes of
+/// user data, or 0x924 bytes (whole sector except sync pattern) when
+/// the Setmode sector size bit is set.
+static void load_data_fifo(void) {
+    state->cdrom.data_fifo_index = 0;
+    if (!state->cdrom.sector_valid) {
+        state->cdrom.data_fifo_length = 0;
+        state->cdrom.index &= ~DRQSTS;
+        return;
+    }
+
+    if (state->cdrom.mode & MODE_SECTOR_SIZE) {
+        memcpy(state->cdrom.data_fifo, state->cdrom.sector + 12, 0x924);
+        state->cdrom.data_fifo_length = 0x924;
+    } else {
+        memcpy(state->cdrom.data_fifo, state->cdrom.sector + 24, 0x800);
+        state->cdrom.data_fifo_length = 0x800;
+    }
+    state->cdrom.index |= DRQSTS;
+}
+
+size_t read_cdrom_data(uint8_t *buffer, size_t len) {
+    size_t available = state->cdrom.data_fifo_length -
+                       state->cdrom.data_fifo_index;
+    size_t copied = std::min(len, available);
+
+    memcpy(buffer, state->cdrom.data_fifo + state->cdrom.data_fifo_index,
+        copied);
+    memset(buffer + copied, 0, len - copied);
+    state->cdrom.data_fifo_index += copied;
+    if (state->cdrom.data_fifo_index >= state->cdrom.data_fifo_length) {
+        state->cdrom.index &= ~DRQSTS;
+    }
+    if (copied < len) {
+        debugger::warn(Debugger::CDROM,
+            "data fifo underrun ({} bytes missing)", len - copied);
+    }
+    return copied;
+}
+
+void read_cdrom_reg02(uint32_t *val) {
+    uint8_t data;
+    read_cdrom_data(&data, 1);
+    *val = data;
+    debugger::debug(Debugger::CDROM, "cdrom_data_fifo -> {:02x}", *val);
+}
+
+void read_cdrom_reg02_u16(uint32_t *val) {
+    uint8_t data[2];
+    read_cdrom_data(data, 2);
+    *val = memory::load_u16_le(data);
+    debugger::debug(Debugger::CDROM, "cdrom_data_fifo -> {:04x}", *val);
+}
+
 void write_cdrom_reg02(uint8_t val) {
-    unsigned index = state.cdrom.index & UINT8_C(0x3);
+    unsigned index = state->cdrom.index & UINT8_C(0x3);
     unsigned fifo_index;
 
     switch (index) {
     case 0x0:
         debugger::info(Debugger::CDROM, "cdrom_parameter_fifo <- {:02x}", val);
-        fifo_index = state.cdrom.parameter_fifo_index;
+        fifo_index = state->cdrom.parameter_fifo_index;
         if (fifo_index >= 15) {
             psx::halt("CDROM parameter fifo overflow");
             return;
         }
-        state.cdrom.parameter_fifo[fifo_index] = val;
-        state.cdrom.parameter_fifo_index = fifo_index + 1;
-        state.cdrom.index &= ~PRMEMPT;
+        state->cdrom.parameter_fifo[fifo_index] = val;
+        state->cdrom.parameter_fifo_index = fifo_index + 1;
+        state->cdrom.index &= ~PRMEMPT;
         if (fifo_index + 1 >= 15) {
-            state.cdrom.index &= ~PRMWRDY;
+            state->cdrom.index &= ~PRMWRDY;
         }
         break;
 
     case 0x1:
         debugger::info(Debugger::CDROM, "cdrom_interrupt_enable <- {:02x}", val);
-        state.cdrom.interrupt_enable = val & UINT8_C(0x1f);
+        state->cdrom.interrupt_enable = val & UINT8_C(0x1f);
         break;
 
     default:
@@ -378,17 +807,17 @@ void write_cdrom_reg02(uint8_t val) {
 }
 
 void read_cdrom_reg03(uint32_t *val) {
-    unsigned index = state.cdrom.index & UINT8_C(0x3);
+    unsigned index = state->cdrom.index & UINT8_C(0x3);
     switch (index) {
     case 0x0:
     case 0x2:
-        *val = state.cdrom.interrupt_enable;
+        *val = state->cdrom.interrupt_enable;
         debugger::info(Debugger::CDROM, "cdrom_interrupt_enable -> {:02x}", *val);
         break;
 
     case 0x1:
     case 0x3:
-        *val = state.cdrom.interrupt_flag | UINT8_C(0xe0);
+        *val = state->cdrom.interrupt_flag | UINT8_C(0xe0);
         debugger::info(Debugger::CDROM, "cdrom_interrupt_flag -> {:02x}", *val);
         break;
 
@@ -401,17 +830,36 @@ void read_cdrom_reg03(uint32_t *val) {
 }
 
 void write_cdrom_reg03(uint8_t val) {
-    unsigned index = state.cdrom.index & UINT8_C(0x3);
+    unsigned index = state->cdrom.index & UINT8_C(0x3);
     switch (index) {
     case 0x0:
         debugger::info(Debugger::CDROM, "cdrom_request <- {:02x}", val);
-        state.cdrom.request = val;
+        state->cdrom.request = val;
+        if (val & REQUEST_BFRD) {
+            load_data_fifo();
+        } else {
+            state->cdrom.data_fifo_length = 0;
+            state->cdrom.data_fifo_index = 0;
+            state->cdrom.index &= ~DRQSTS;
+        }
         break;
 
     case 0x1:
     case 0x3:
         debugger::info(Debugger::CDROM, "cdrom_interrupt_flag <- {:02x}", val);
-        state.cdrom.interrupt_flag &= ~(val & UINT8_C(0x1f));
+        state->cdrom.interrupt_flag &= ~(val & UINT8_C(0x1f));
+        if (val & UINT8_C(0x40)) {
+            state->cdrom.parameter_fifo_index = 0;
+            state->cdrom.index |= PRMEMPT | PRMWRDY;
+        }
+        // Deliver the response held back while the previous
+        // interrupt was pending.
+        if ((state->cdrom.interrupt_flag & UINT8_C(0x7)) == 0 &&
+            state->cdrom.queued_interrupt != 0) {
+            state->cancel_event(cdrom_queued_interrupt_event);
+            state->schedule_event(state->cycles + queued_interrupt_delay,
+                cdrom_queued_interrupt_event);
+        }
         break;
 
     default:
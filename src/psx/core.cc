@@ -8,17 +8,24 @@
 #include <fmt/format.h>
 
 #include <interpreter.h>
+#include <psx/boot.h>
+#include <psx/disc.h>
+#include <psx/framehash.h>
+#include <psx/hle.h>
+#include <psx/input.h>
+#include <psx/mmio.h>
+#include <psx/profiler.h>
+#include <psx/rewind.h>
+#include <psx/timeline.h>
+#include <psx/timing.h>
+#include <psx/trace.h>
 #include <psx/psx.h>
 #include <psx/debugger.h>
 
 namespace psx {
 
-static std::thread            *interpreter_thread;
-static std::mutex              interpreter_mutex;
-static std::condition_variable interpreter_semaphore;
-static std::atomic_bool        interpreter_halted;
-static std::atomic_bool        interpreter_stopped;
-static std::string             interpreter_halted_reason;
+thread_local Machine *current_machine;
+thread_local struct state *state;
 
 /**
  * Handle scheduled events (counter timeout, VI interrupt).
@@ -26,40 +33,56 @@ static std::string             interpreter_halted_reason;
  */
 static
 void check_cpu_events(void) {
-    if (state.cycles >= state.next_event) {
-        state.handle_event();
+    if (state->cycles >= state->next_event) {
+        timing::scope scope(timing::Events);
+        timeline::span span("sched", "events");
+        state->handle_event();
     }
 }
 
 /**
- * Run the interpreter until the n-th branching instruction.
+ * Run the interpreter until the n-th branching instruction,
+ * or until the cycle counter reaches \p max_cycles.
  * The loop is also brokn by setting the halted flag.
  * The state is left with action Jump.
  * @return true exiting because of a branch instruction, false if because
  *  of a breakpoint.
  */
 static
-bool exec_cpu_interpreter(int nr_jumps) {
-    while (!interpreter_halted.load(std::memory_order_acquire)) {
-        switch (state.cpu_state) {
+bool exec_cpu_interpreter(std::atomic_bool const &halted, int nr_jumps,
+                          uint64_t max_cycles = UINT64_MAX) {
+    while (!halted.load(std::memory_order_acquire) &&
+           state->cycles < max_cycles) {
+        switch (state->cpu_state) {
         case psx::Continue:
-            state.cpu.pc += 4;
-            state.delay_slot = false;
+            state->cpu.pc += 4;
+            state->delay_slot = false;
             interpreter::cpu::eval();
             break;
 
         case psx::Delay:
-            state.cpu.pc += 4;
-            state.cpu_state = psx::Jump;
-            state.delay_slot = true;
+            state->cpu.pc += 4;
+            state->cpu_state = psx::Jump;
+            state->delay_slot = true;
             interpreter::cpu::eval();
             break;
 
         case psx::Jump:
             if (nr_jumps-- <= 0) return true;
-            state.cpu.pc = state.jump_address;
-            state.cpu_state = psx::Continue;
-            state.delay_slot = false;
+            state->cpu.pc = state->jump_address;
+            if (profiler::enabled()) {
+                profiler::tick();
+            }
+            if (state->cpu.pc == SHELL_ENTRY && boot::enabled()) {
+                boot::shell_entry();
+            }
+            if ((state->cpu.pc & UINT32_C(0x1fffffff)) <= UINT32_C(0xc0) &&
+                hle::enabled() &&
+                hle::call(state->cpu.pc)) {
+                break;
+            }
+            state->cpu_state = psx::Continue;
+            state->delay_slot = false;
             interpreter::cpu::eval();
         }
     }
@@ -78,18 +101,19 @@ bool exec_cpu_interpreter(int nr_jumps) {
  *  3. step-by-step execution from the GUI. The interpreter is stopped
  *     during this time, and instructions are executed from the main thread.
  */
-static
-void interpreter_routine(void) {
+void Machine::interpreter_routine(void) {
     fmt::print(fmt::fg(fmt::color::dark_orange),
         "interpreter thread starting\n");
+    bind();
+    timeline::set_thread_name("cpu");
 
     for (;;) {
-        std::unique_lock<std::mutex> lock(interpreter_mutex);
-        interpreter_semaphore.wait(lock, [] {
-            return !interpreter_halted.load(std::memory_order_acquire) ||
-                interpreter_stopped.load(std::memory_order_acquire); });
+        std::unique_lock<std::mutex> lock(_interpreter_mutex);
+        _interpreter_semaphore.wait(lock, [this] {
+            return !_interpreter_halted.load(std::memory_order_acquire) ||
+                _interpreter_stopped.load(std::memory_order_acquire); });
 
-        if (interpreter_stopped.load(std::memory_order_acquire)) {
+        if (_interpreter_stopped.load(std::memory_order_acquire)) {
             fmt::print(fmt::fg(fmt::color::dark_orange),
                 "interpreter thread exiting\n");
             return;
@@ -99,72 +123,222 @@ void interpreter_routine(void) {
             "interpreter thread resuming\n");
 
         lock.unlock();
-        exec_cpu_interpreter(0);
+        timing::enter(timing::CPU);
+        exec_cpu_interpreter(_interpreter_halted, 0);
 
-        while (!interpreter_halted.load(std::memory_order_relaxed)) {
+        while (!_interpreter_halted.load(std::memory_order_relaxed)) {
             // Ensure that the interpreter is at a jump
             // at the start of the loop contents.
             check_cpu_events();
-            exec_cpu_interpreter(1);
+            exec_cpu_interpreter(_interpreter_halted, 1);
         }
+        timing::leave();
 
         fmt::print(fmt::fg(fmt::color::dark_orange),
             "interpreter thread halting\n");
     }
 }
 
-void start(void) {
-    if (interpreter_thread == NULL) {
-        interpreter_halted = true;
-        interpreter_halted_reason = "reset";
-        interpreter_thread = new std::thread(interpreter_routine);
+Machine::Machine()
+    : state(new struct state()),
+      disc(disc::create_context()),
+      boot(boot::create_context()),
+      hle(hle::create_context()),
+      framehash(framehash::create_context()),
+      rewind(rewind::create_context()),
+      input(input::create_context()),
+      trace(trace::create_context()),
+      mmio(mmio::create_context()),
+      cdrom_speed(1),
+      frame_budget(0),
+      frame_budget_reached(false),
+      debugger_attached(false),
+      tracing(false),
+      _interpreter_thread(NULL),
+      _interpreter_halted(true),
+      _interpreter_stopped(false),
+      _reexec_halted(NULL) {
+}
+
+Machine::~Machine() {
+    stop();
+    if (current_machine == this) {
+        current_machine = NULL;
+        psx::state = NULL;
     }
 }
 
-void stop(void) {
-    if (interpreter_thread != NULL) {
-        interpreter_halted.store(true, std::memory_order_release);
-        interpreter_stopped.store(true, std::memory_order_release);
-        interpreter_semaphore.notify_one();
-        interpreter_thread->join();
-        delete interpreter_thread;
-        interpreter_thread = NULL;
+void Machine::bind(void) {
+    current_machine = this;
+    psx::state = state.get();
+}
+
+void Machine::start(void) {
+    if (_interpreter_thread == NULL) {
+        _interpreter_halted = true;
+        _interpreter_halted_reason = "reset";
+        _interpreter_thread =
+            new std::thread(&Machine::interpreter_routine, this);
+    }
+}
+
+void Machine::stop(void) {
+    if (_interpreter_thread != NULL) {
+        _interpreter_halted.store(true, std::memory_order_release);
+        {
+            // Hold the mutex so that the notification cannot be
+            // lost between the predicate check and the wait.
+            std::lock_guard<std::mutex> lock(_interpreter_mutex);
+            _interpreter_stopped.store(true, std::memory_order_release);
+        }
+        _interpreter_semaphore.notify_one();
+        _interpreter_thread->join();
+        delete _interpreter_thread;
+        _interpreter_thread = NULL;
+        _interpreter_stopped = false;
+    }
+}
+
+void Machine::halt(std::string reason) {
+    // The machine is already halted during re-execution,
+    // stop the re-execution instead.
+    if (_reexec_halted != NULL) {
+        if (!_reexec_halted->load(std::memory_order_relaxed)) {
+            _interpreter_halted_reason = reason;
+            _reexec_halted->store(true, std::memory_order_release);
+        }
+        return;
+    }
+    if (!_interpreter_halted) {
+        _interpreter_halted_reason = reason;
+        _interpreter_halted.store(true, std::memory_order_release);
+    }
+}
+
+bool Machine::halted(void) {
+    return _interpreter_halted;
+}
+
+std::string Machine::halted_reason(void) {
+    return _interpreter_halted_reason;
+}
+
+void Machine::step(void) {
+    if (_interpreter_thread != NULL &&
+        _interpreter_halted.load(std::memory_order_acquire)) {
+        check_cpu_events();
+        exec_cpu_interpreter(_interpreter_halted, 1);
+    }
+}
+
+void Machine::resume(void) {
+    if (_interpreter_thread != NULL &&
+        _interpreter_halted.load(std::memory_order_acquire)) {
+        {
+            std::lock_guard<std::mutex> lock(_interpreter_mutex);
+            _interpreter_halted.store(false, std::memory_order_release);
+        }
+        _interpreter_semaphore.notify_one();
     }
 }
 
+bool Machine::run(uint64_t cycles) {
+    bind();
+    _interpreter_halted.store(false, std::memory_order_relaxed);
+    exec_cpu_interpreter(_interpreter_halted, 0);
+
+    while (!_interpreter_halted.load(std::memory_order_relaxed) &&
+           state->cycles < cycles) {
+        check_cpu_events();
+        exec_cpu_interpreter(_interpreter_halted, 1);
+    }
+
+    if (_interpreter_halted.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    _interpreter_halted.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool Machine::fast_forward(uint64_t cycles) {
+    std::atomic_bool halted(false);
+    bool attached = debugger_attached;
+    bool traced = tracing;
+    bind();
+    debugger_attached = false;
+    tracing = false;
+    _reexec_halted = &halted;
+    exec_cpu_interpreter(halted, 0, cycles);
+    while (!halted.load(std::memory_order_relaxed) &&
+           state->cycles < cycles) {
+        check_cpu_events();
+        exec_cpu_interpreter(halted, 1, cycles);
+    }
+    _reexec_halted = NULL;
+    debugger_attached = attached;
+    tracing = traced;
+    trace::resync();
+    return !reexec_halted(halted);
+}
+
+bool Machine::step_instruction(void) {
+    std::atomic_bool halted(false);
+    bool attached = debugger_attached;
+    bool traced = tracing;
+    bind();
+    debugger_attached = false;
+    tracing = false;
+    _reexec_halted = &halted;
+    if (state->cpu_state == psx::Jump) {
+        check_cpu_events();
+    }
+    exec_cpu_interpreter(halted, 1, state->cycles + 1);
+    _reexec_halted = NULL;
+    debugger_attached = attached;
+    tracing = traced;
+    trace::resync();
+    return !reexec_halted(halted);
+}
+
+bool Machine::reexec_halted(std::atomic_bool const &halted) {
+    if (!halted.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    debugger::warn(Debugger::CPU, "re-execution halted at cycle {}: {}",
+        state->cycles, _interpreter_halted_reason);
+    return true;
+}
+
+void start(void) {
+    machine()->start();
+}
+
+void stop(void) {
+    machine()->stop();
+}
+
 void reset(void) {
-    state.reset();
+    state->reset();
 }
 
 void halt(std::string reason) {
-    if (!interpreter_halted) {
-        interpreter_halted_reason = reason;
-        interpreter_halted.store(true, std::memory_order_release);
-    }
+    machine()->halt(reason);
 }
 
 bool halted(void) {
-    return interpreter_halted;
+    return machine()->halted();
 }
 
 std::string halted_reason(void) {
-    return interpreter_halted_reason;
+    return machine()->halted_reason();
 }
 
 void step(void) {
-    if (interpreter_thread != NULL &&
-        interpreter_halted.load(std::memory_order_acquire)) {
-        check_cpu_events();
-        exec_cpu_interpreter(1);
-    }
+    machine()->step();
 }
 
 void resume(void) {
-    if (interpreter_thread != NULL &&
-        interpreter_halted.load(std::memory_order_acquire)) {
-        interpreter_halted.store(false, std::memory_order_release);
-        interpreter_semaphore.notify_one();
-    }
+    machine()->resume();
 }
 
 }; /* namespace psx */
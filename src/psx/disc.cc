@@ -0,0 +1,753 @@
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <psx/debugger.h>
+#include <psx/disc.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+#include <psx/timeline.h>
+
+using namespace psx;
+
+namespace psx::disc {
+
+struct cache_entry {
+    uint32_t lba;
+    uint8_t data[RAW_SECTOR_SIZE];
+};
+
+struct mapped_file {
+    uint8_t *data;
+    size_t size;
+};
+
+struct track {
+    struct track_info info;
+    /// Index of the file containing the track sectors.
+    unsigned file;
+    /// Size of the sectors stored in the file: 2352 (raw),
+    /// 2336 (raw without sync pattern and header) or 2048 (cooked).
+    unsigned sector_size;
+    /// First sector stored in the file; sectors of the pregap
+    /// before it are not part of the image.
+    uint32_t data_first;
+    /// Offset of the sector data_first in the file.
+    uint64_t file_offset;
+};
+
+struct hunk {
+    uint32_t index;
+    std::vector<uint8_t> data;
+};
+
+static const size_t hunk_cache_capacity = 4;
+
+/// Disc state of a machine.
+struct context {
+    std::vector<mapped_file> files;
+    std::vector<track> tracks;
+    uint32_t disc_sectors;
+
+    /// Compressed container state.
+    bool compressed;
+    uint32_t hunk_sectors;
+    std::vector<uint64_t> hunk_offsets;
+    std::mutex hunk_mutex;
+    /// Decompressed hunks, most recently used first.
+    std::list<hunk> hunk_cache;
+
+    std::mutex mutex;
+    std::condition_variable prefetch_cond;
+    std::thread prefetch_thread;
+    bool prefetch_running;
+
+    /// Cached sectors, most recently used first.
+    std::list<cache_entry> cache;
+    std::unordered_map<uint32_t, std::list<cache_entry>::iterator> cache_index;
+    size_t cache_capacity;
+
+    /// First sector of the read-ahead window.
+    uint32_t window_lba;
+    uint32_t window_size;
+
+    struct stats cache_stats;
+
+    context()
+        : disc_sectors(0), compressed(false), hunk_sectors(0),
+          prefetch_running(false), cache_capacity(256),
+          window_lba(0), window_size(64), cache_stats{} {}
+    ~context();
+};
+
+context::~context() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        prefetch_running = false;
+        prefetch_cond.notify_one();
+    }
+    if (prefetch_thread.joinable()) {
+        prefetch_thread.join();
+    }
+    for (struct mapped_file &file : files) {
+        munmap(file.data, file.size);
+    }
+}
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+static uint8_t to_bcd(unsigned val) {
+    return ((val / 10) << 4) | (val % 10);
+}
+
+/// Map the file \p path read-only. Discs are mostly read sequentially:
+/// aggressive read-ahead is requested from the kernel.
+static int map_file(std::string const &path, struct mapped_file *file) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file.
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    file->data = (uint8_t *)addr;
+    file->size = st.st_size;
+    return 0;
+}
+
+/// Write the sync pattern and the Mode2 header of the sector \p lba.
+static void write_sector_header(uint32_t lba, uint8_t *sector) {
+    // Addresses in the header are absolute, and include
+    // the 150 sectors of the track 1 pregap.
+    uint32_t msf = lba + 150;
+    memset(sector, 0, 16);
+    memset(sector + 1, 0xff, 10);
+    sector[12] = to_bcd(msf / (60 * 75));
+    sector[13] = to_bcd((msf / 75) % 60);
+    sector[14] = to_bcd(msf % 75);
+    sector[15] = 2;     // Mode2
+}
+
+static bool load_compressed_sector(uint32_t lba, uint8_t *sector) {
+    context *ctx = machine()->disc.get();
+    uint32_t index = lba / ctx->hunk_sectors;
+    size_t offset = (size_t)(lba % ctx->hunk_sectors) * RAW_SECTOR_SIZE;
+    std::lock_guard<std::mutex> lock(ctx->hunk_mutex);
+
+    for (auto it = ctx->hunk_cache.begin(); it != ctx->hunk_cache.end(); it++) {
+        if (it->index == index) {
+            ctx->hunk_cache.splice(ctx->hunk_cache.begin(),
+                ctx->hunk_cache, it);
+            memcpy(sector, it->data.data() + offset, RAW_SECTOR_SIZE);
+            return true;
+        }
+    }
+
+    if (ctx->hunk_cache.size() >= hunk_cache_capacity) {
+        ctx->hunk_cache.splice(ctx->hunk_cache.begin(), ctx->hunk_cache,
+            std::prev(ctx->hunk_cache.end()));
+    } else {
+        ctx->hunk_cache.emplace_front();
+    }
+
+    struct hunk &hunk = ctx->hunk_cache.front();
+    hunk.index = index;
+    hunk.data.resize((size_t)ctx->hunk_sectors * RAW_SECTOR_SIZE);
+
+    uLongf len = hunk.data.size();
+    uint64_t start = ctx->hunk_offsets[index];
+    uint64_t end = ctx->hunk_offsets[index + 1];
+    // Hunks are always written full size, a short hunk is corrupt
+    // and would serve the stale contents of the recycled buffer.
+    if (uncompress(hunk.data.data(), &len, ctx->files[0].data + start,
+                   end - start) != Z_OK || len != hunk.data.size()) {
+        ctx->hunk_cache.pop_front();
+        return false;
+    }
+
+    memcpy(sector, hunk.data.data() + offset, RAW_SECTOR_SIZE);
+    return true;
+}
+
+/// Read the sector at \p lba from the image. This is where the page
+/// faults on the mapped image and hunk decompression happen.
+static void load_sector(uint32_t lba, uint8_t *sector) {
+    context *ctx = machine()->disc.get();
+    if (ctx->compressed) {
+        if (!load_compressed_sector(lba, sector)) {
+            debugger::warn(Debugger::CDROM,
+                "corrupted hunk in compressed disc (lba {})", lba);
+            memset(sector, 0, RAW_SECTOR_SIZE);
+        }
+        return;
+    }
+
+    struct track const *track = NULL;
+    for (struct track const &t : ctx->tracks) {
+        if (lba >= t.info.first && lba < t.info.end) {
+            track = &t;
+            break;
+        }
+    }
+
+    memset(sector, 0, RAW_SECTOR_SIZE);
+    if (track == NULL) {
+        return;
+    }
+    if (!track->info.audio) {
+        write_sector_header(lba, sector);
+    }
+
+    // Pregap sectors missing from the image are left empty.
+    uint64_t offset = track->file_offset +
+        (uint64_t)(lba - track->data_first) * track->sector_size;
+    struct mapped_file const &file = ctx->files[track->file];
+    if (lba < track->data_first ||
+        offset + track->sector_size > file.size) {
+        return;
+    }
+
+    switch (track->sector_size) {
+    case RAW_SECTOR_SIZE:
+        memcpy(sector, file.data + offset, RAW_SECTOR_SIZE);
+        break;
+    case 2336:
+        memcpy(sector + 16, file.data + offset, 2336);
+        break;
+    default:
+        sector[18] = 0x08;  // Submode: Data
+        sector[22] = 0x08;
+        memcpy(sector + 24, file.data + offset, DATA_SECTOR_SIZE);
+        break;
+    }
+}
+
+/// Parse a CUE sheet time (mm:ss:ff) into a sector count.
+static bool parse_msf(std::string const &msf, int64_t *sectors) {
+    unsigned mm, ss, ff;
+    if (sscanf(msf.c_str(), "%u:%u:%u", &mm, &ss, &ff) != 3 ||
+        ss >= 60 || ff >= 75) {
+        return false;
+    }
+    *sectors = ((int64_t)mm * 60 + ss) * 75 + ff;
+    return true;
+}
+
+static int open_flat(std::string const &path) {
+    context *ctx = machine()->disc.get();
+    struct mapped_file file;
+    if (map_file(path, &file) < 0) {
+        return -1;
+    }
+
+    struct track track = {};
+    track.info.number = 1;
+    track.sector_size = (file.size % RAW_SECTOR_SIZE) == 0 ?
+        RAW_SECTOR_SIZE : DATA_SECTOR_SIZE;
+    track.info.end = file.size / track.sector_size;
+
+    ctx->files.push_back(file);
+    ctx->tracks.push_back(track);
+    ctx->disc_sectors = track.info.end;
+    return 0;
+}
+
+/**
+ * @brief Parse the CUE sheet \p path into the track table.
+ * @details
+ * Sector addresses are first computed relative to the start of the
+ * first file, then shifted so that index 01 of track 1 is LBA 0.
+ * INDEX times are relative to the start of the current file; PREGAP
+ * commands insert sectors that are not stored in any file.
+ */
+static int open_cue(std::string const &path) {
+    context *ctx = machine()->disc.get();
+    std::ifstream cue(path);
+    if (!cue.good()) {
+        return -1;
+    }
+
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::vector<int64_t> firsts, starts, data_firsts;
+    int64_t file_base = 0;
+    int64_t gap_total = 0;
+    int64_t pregap = 0;
+    int64_t index0 = -1;
+    std::string line;
+
+    while (std::getline(cue, line)) {
+        std::istringstream in(line);
+        std::string keyword;
+        in >> keyword;
+
+        if (keyword == "FILE") {
+            size_t open_quote = line.find('"');
+            size_t close_quote = line.find('"', open_quote + 1);
+            std::string name;
+            if (open_quote != std::string::npos &&
+                close_quote != std::string::npos) {
+                name = line.substr(open_quote + 1, close_quote - open_quote - 1);
+            } else {
+                in >> name;
+            }
+
+            if (!ctx->files.empty() && !ctx->tracks.empty()) {
+                file_base += ctx->files.back().size /
+                    ctx->tracks.back().sector_size;
+            }
+
+            struct mapped_file file;
+            if (map_file(name[0] == '/' ? name : dir + name, &file) < 0) {
+                debugger::warn(Debugger::CDROM,
+                    "cannot open '{}' referenced from '{}'", name, path);
+                return -1;
+            }
+            ctx->files.push_back(file);
+        }
+        else if (keyword == "TRACK") {
+            unsigned number;
+            std::string type;
+            in >> number >> type;
+            if (ctx->files.empty()) {
+                return -1;
+            }
+
+            struct track track = {};
+            track.info.number = number;
+            track.info.audio = type == "AUDIO";
+            track.file = ctx->files.size() - 1;
+            if (type == "AUDIO" || type == "MODE1/2352" || type == "MODE2/2352") {
+                track.sector_size = RAW_SECTOR_SIZE;
+            } else if (type == "MODE2/2336") {
+                track.sector_size = 2336;
+            } else if (type == "MODE1/2048" || type == "MODE2/2048") {
+                track.sector_size = DATA_SECTOR_SIZE;
+            } else {
+                debugger::warn(Debugger::CDROM,
+                    "unsupported track type '{}' in '{}'", type, path);
+                return -1;
+            }
+
+            ctx->tracks.push_back(track);
+            firsts.push_back(-1);
+            starts.push_back(-1);
+            data_firsts.push_back(-1);
+            pregap = 0;
+            index0 = -1;
+        }
+        else if (keyword == "PREGAP") {
+            std::string msf;
+            in >> msf;
+            if (ctx->tracks.empty() || !parse_msf(msf, &pregap)) {
+                return -1;
+            }
+            gap_total += pregap;
+        }
+        else if (keyword == "INDEX") {
+            unsigned index;
+            std::string msf;
+            int64_t frames;
+            in >> index >> msf;
+            if (ctx->tracks.empty() || !parse_msf(msf, &frames)) {
+                return -1;
+            }
+
+            int64_t lba = file_base + gap_total + frames;
+            if (index == 0) {
+                index0 = lba;
+            } else if (index == 1) {
+                struct track &track = ctx->tracks.back();
+                int64_t data_first = index0 >= 0 ? index0 : lba;
+                starts.back() = lba;
+                data_firsts.back() = data_first;
+                firsts.back() = data_first - pregap;
+                track.file_offset = (uint64_t)(data_first - file_base - gap_total) *
+                    track.sector_size;
+            }
+        }
+    }
+
+    if (ctx->tracks.empty() || ctx->files.empty()) {
+        return -1;
+    }
+
+    // Track 1 index 01 is the absolute position 00:02:00, LBA 0.
+    int64_t shift = starts[0];
+    int64_t end = file_base + gap_total +
+        ctx->files.back().size / ctx->tracks.back().sector_size;
+    for (size_t i = 0; i < ctx->tracks.size(); i++) {
+        if (starts[i] < 0) {
+            return -1;
+        }
+        struct track &track = ctx->tracks[i];
+        track.info.first = std::max<int64_t>(firsts[i] - shift, 0);
+        track.info.start = starts[i] - shift;
+        track.data_first = std::max<int64_t>(data_firsts[i] - shift, 0);
+        track.file_offset += (track.data_first - (data_firsts[i] - shift)) *
+            track.sector_size;
+        track.info.end =
+            (i + 1 < ctx->tracks.size() ? firsts[i + 1] : end) - shift;
+    }
+
+    ctx->disc_sectors = ctx->tracks.back().info.end;
+    return 0;
+}
+
+static int open_compressed(void) {
+    context *ctx = machine()->disc.get();
+    struct mapped_file const &file = ctx->files[0];
+    if (file.size < 20) {
+        return -1;
+    }
+
+    uint32_t version = memory::load_u32_le(file.data + 4);
+    ctx->hunk_sectors = memory::load_u32_le(file.data + 8);
+    ctx->disc_sectors = memory::load_u32_le(file.data + 12);
+    uint32_t nr_tracks = memory::load_u32_le(file.data + 16);
+    if (version != DISC_VERSION || ctx->hunk_sectors == 0) {
+        return -1;
+    }
+
+    uint32_t nr_hunks = (ctx->disc_sectors + ctx->hunk_sectors - 1) /
+        ctx->hunk_sectors;
+    size_t index_offset = 20 + (size_t)nr_tracks * 16;
+    if (index_offset + (nr_hunks + 1) * 8 > file.size) {
+        return -1;
+    }
+
+    for (uint32_t nr = 0; nr < nr_tracks; nr++) {
+        uint8_t const *entry = file.data + 20 + nr * 16;
+        struct track track = {};
+        track.info.number = entry[0];
+        track.info.audio = entry[1] != 0;
+        track.info.first = memory::load_u32_le(entry + 4);
+        track.info.start = memory::load_u32_le(entry + 8);
+        track.info.end = memory::load_u32_le(entry + 12);
+        ctx->tracks.push_back(track);
+    }
+
+    for (uint32_t nr = 0; nr <= nr_hunks; nr++) {
+        uint8_t const *entry = file.data + index_offset + nr * 8;
+        uint64_t offset = memory::load_u32_le(entry) |
+            ((uint64_t)memory::load_u32_le(entry + 4) << 32);
+        if (offset > file.size ||
+            (nr > 0 && offset < ctx->hunk_offsets.back())) {
+            return -1;
+        }
+        ctx->hunk_offsets.push_back(offset);
+    }
+
+    ctx->compressed = true;
+    return 0;
+}
+
+int open(std::string const &path) {
+    context *ctx = machine()->disc.get();
+    close();
+
+    int ret;
+    if (path.size() >= 4 &&
+        strcasecmp(path.c_str() + path.size() - 4, ".cue") == 0) {
+        ret = open_cue(path);
+    } else {
+        ret = open_flat(path);
+        if (ret == 0 && ctx->files[0].size >= 4 &&
+            memory::load_u32_le(ctx->files[0].data) == DISC_MAGIC) {
+            ctx->tracks.clear();
+            ret = open_compressed();
+        }
+    }
+
+    if (ret < 0) {
+        close();
+    }
+    return ret;
+}
+
+void close(void) {
+    context *ctx = machine()->disc.get();
+    // The prefetch thread reads the mapped files without the lock,
+    // and must be stopped first. The sector cache is released as well.
+    stop();
+    for (struct mapped_file &file : ctx->files) {
+        munmap(file.data, file.size);
+    }
+    ctx->files.clear();
+    ctx->tracks.clear();
+    ctx->disc_sectors = 0;
+    ctx->compressed = false;
+    ctx->hunk_offsets.clear();
+    ctx->hunk_cache.clear();
+}
+
+int compress(std::string const &path, unsigned hunk_size) {
+    context *ctx = machine()->disc.get();
+    if (hunk_size == 0) {
+        return -1;
+    }
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out == NULL) {
+        return -1;
+    }
+
+    uint32_t nr_hunks = (ctx->disc_sectors + hunk_size - 1) / hunk_size;
+    std::vector<uint8_t> header(
+        20 + ctx->tracks.size() * 16 + (nr_hunks + 1) * 8);
+    memory::store_u32_le(header.data() + 0, DISC_MAGIC);
+    memory::store_u32_le(header.data() + 4, DISC_VERSION);
+    memory::store_u32_le(header.data() + 8, hunk_size);
+    memory::store_u32_le(header.data() + 12, ctx->disc_sectors);
+    memory::store_u32_le(header.data() + 16, ctx->tracks.size());
+    for (size_t nr = 0; nr < ctx->tracks.size(); nr++) {
+        uint8_t *entry = header.data() + 20 + nr * 16;
+        entry[0] = ctx->tracks[nr].info.number;
+        entry[1] = ctx->tracks[nr].info.audio;
+        memory::store_u32_le(entry + 4, ctx->tracks[nr].info.first);
+        memory::store_u32_le(entry + 8, ctx->tracks[nr].info.start);
+        memory::store_u32_le(entry + 12, ctx->tracks[nr].info.end);
+    }
+
+    // The hunk index is written once all hunk offsets are known.
+    bool failed = fwrite(header.data(), header.size(), 1, out) != 1;
+
+    std::vector<uint8_t> hunk((size_t)hunk_size * RAW_SECTOR_SIZE);
+    std::vector<uint8_t> packed(compressBound(hunk.size()));
+    uint64_t offset = header.size();
+    uint8_t *index = header.data() + 20 + ctx->tracks.size() * 16;
+
+    for (uint32_t nr = 0; nr < nr_hunks && !failed; nr++) {
+        memset(hunk.data(), 0, hunk.size());
+        for (uint32_t sector = 0; sector < hunk_size; sector++) {
+            uint32_t lba = nr * hunk_size + sector;
+            if (lba < ctx->disc_sectors) {
+                load_sector(lba, hunk.data() + sector * RAW_SECTOR_SIZE);
+            }
+        }
+
+        uLongf len = packed.size();
+        if (compress2(packed.data(), &len, hunk.data(), hunk.size(),
+                      Z_BEST_COMPRESSION) != Z_OK) {
+            failed = true;
+            break;
+        }
+
+        memory::store_u32_le(index + nr * 8, offset);
+        memory::store_u32_le(index + nr * 8 + 4, offset >> 32);
+        failed = fwrite(packed.data(), len, 1, out) != 1;
+        offset += len;
+    }
+
+    memory::store_u32_le(index + nr_hunks * 8, offset);
+    memory::store_u32_le(index + nr_hunks * 8 + 4, offset >> 32);
+    failed = failed || fseek(out, 0, SEEK_SET) != 0 ||
+        fwrite(header.data(), header.size(), 1, out) != 1;
+    failed = fclose(out) != 0 || failed;
+    if (failed) {
+        // Do not leave a truncated image behind.
+        remove(path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t sector_count(void) {
+    context *ctx = machine()->disc.get();
+    return ctx->disc_sectors;
+}
+
+bool raw_image(uint8_t const **data, size_t *size) {
+    context *ctx = machine()->disc.get();
+    if (ctx->files.size() != 1 || ctx->compressed) {
+        return false;
+    }
+    *data = ctx->files[0].data;
+    *size = ctx->files[0].size;
+    return true;
+}
+
+unsigned track_count(void) {
+    context *ctx = machine()->disc.get();
+    return ctx->tracks.size();
+}
+
+bool get_track(unsigned number, struct track_info *info) {
+    context *ctx = machine()->disc.get();
+    for (struct track const &track : ctx->tracks) {
+        if (track.info.number == number) {
+            *info = track.info;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool find_track(uint32_t lba, struct track_info *info) {
+    context *ctx = machine()->disc.get();
+    for (struct track const &track : ctx->tracks) {
+        if (lba >= track.info.first && lba < track.info.end) {
+            *info = track.info;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Insert a sector in the cache, evicting the least recently used
+/// entry when full. The mutex must be held.
+static void cache_insert(uint32_t lba, uint8_t const *sector) {
+    context *ctx = machine()->disc.get();
+    if (ctx->cache_index.count(lba) != 0) {
+        return;
+    }
+
+    if (ctx->cache.size() >= ctx->cache_capacity) {
+        ctx->cache_index.erase(ctx->cache.back().lba);
+        ctx->cache.splice(ctx->cache.begin(), ctx->cache,
+            std::prev(ctx->cache.end()));
+    } else {
+        ctx->cache.emplace_front();
+    }
+
+    ctx->cache.front().lba = lba;
+    memcpy(ctx->cache.front().data, sector, RAW_SECTOR_SIZE);
+    ctx->cache_index[lba] = ctx->cache.begin();
+}
+
+/// Prefetch thread body: fill the first missing sector of the
+/// read-ahead window, or sleep until the window moves.
+static void prefetch_loop(Machine *owner) {
+    owner->bind();
+    context *ctx = owner->disc.get();
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    uint8_t sector[RAW_SECTOR_SIZE];
+    timeline::set_thread_name("disc prefetch");
+
+    while (ctx->prefetch_running) {
+        uint32_t end = std::min(ctx->window_lba + ctx->window_size,
+                                sector_count());
+        uint32_t lba = ctx->window_lba;
+        while (lba < end && ctx->cache_index.count(lba) != 0) {
+            lba++;
+        }
+
+        if (lba >= end) {
+            ctx->prefetch_cond.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        {
+            timeline::span span("io", "prefetch", "lba", lba);
+            load_sector(lba, sector);
+        }
+        lock.lock();
+
+        cache_insert(lba, sector);
+        ctx->cache_stats.prefetched++;
+    }
+}
+
+void start(unsigned window) {
+    context *ctx = machine()->disc.get();
+    stop();
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->window_size = window;
+    ctx->cache_capacity = std::max<size_t>(4 * window, 256);
+    ctx->window_lba = 0;
+    ctx->cache_stats = (struct stats){};
+    ctx->prefetch_running = true;
+    ctx->prefetch_thread = std::thread(prefetch_loop, machine());
+}
+
+void stop(void) {
+    context *ctx = machine()->disc.get();
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->prefetch_running = false;
+        ctx->prefetch_cond.notify_one();
+    }
+    if (ctx->prefetch_thread.joinable()) {
+        ctx->prefetch_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->cache_index.clear();
+    ctx->cache.clear();
+}
+
+bool read_sector(uint32_t lba, uint8_t *sector) {
+    context *ctx = machine()->disc.get();
+    if (lba >= sector_count()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->cache_stats.reads++;
+        ctx->window_lba = lba + 1;
+        ctx->prefetch_cond.notify_one();
+
+        auto it = ctx->cache_index.find(lba);
+        if (it != ctx->cache_index.end()) {
+            ctx->cache.splice(ctx->cache.begin(), ctx->cache, it->second);
+            memcpy(sector, it->second->data, RAW_SECTOR_SIZE);
+            ctx->cache_stats.hits++;
+            return true;
+        }
+        ctx->cache_stats.cold_misses++;
+    }
+
+    load_sector(lba, sector);
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    cache_insert(lba, sector);
+    return true;
+}
+
+void prefetch(uint32_t lba) {
+    context *ctx = machine()->disc.get();
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->window_lba = lba;
+    ctx->prefetch_cond.notify_one();
+}
+
+struct stats stats(void) {
+    context *ctx = machine()->disc.get();
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    return ctx->cache_stats;
+}
+
+}; /* namespace psx::disc */
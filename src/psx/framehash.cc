@@ -0,0 +1,147 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+#include <lib/xxhash.h>
+#include <psx/framehash.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+
+using namespace psx;
+
+namespace psx::framehash {
+
+/// Frame hash log of a machine.
+struct context {
+    FILE *log_file;
+    uint32_t log_flags;
+    unsigned frames_since_flush;
+
+    context() : log_file(NULL), log_flags(0), frames_since_flush(0) {}
+    ~context() {
+        if (log_file != NULL) {
+            fclose(log_file);
+        }
+    }
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+/// Number of frames buffered before the log is flushed to disk,
+/// in case the emulator is killed mid run.
+static const unsigned flush_interval = 60;
+
+int open(std::string const &path, bool hash_vram, bool hash_ram) {
+    context *ctx = machine()->framehash.get();
+    close();
+    ctx->log_file = fopen(path.c_str(), "wb");
+    if (ctx->log_file == NULL) {
+        return -1;
+    }
+
+    ctx->log_flags = (hash_vram ? FRAMEHASH_VRAM : 0) |
+                     (hash_ram  ? FRAMEHASH_RAM : 0);
+    ctx->frames_since_flush = 0;
+
+    uint8_t header[12];
+    memory::store_u32_le(header + 0, FRAMEHASH_MAGIC);
+    memory::store_u32_le(header + 4, FRAMEHASH_VERSION);
+    memory::store_u32_le(header + 8, ctx->log_flags);
+    fwrite(header, sizeof(header), 1, ctx->log_file);
+    return 0;
+}
+
+void close(void) {
+    context *ctx = machine()->framehash.get();
+    if (ctx->log_file != NULL) {
+        fclose(ctx->log_file);
+        ctx->log_file = NULL;
+    }
+}
+
+uint64_t display_hash(void) {
+    if (!state->gpu.display_enable) {
+        return 0;
+    }
+
+    unsigned width;
+    switch (state->gpu.horizontal_resolution) {
+    case 0x0: width = 256; break;
+    case 0x1: width = 320; break;
+    case 0x2: width = 512; break;
+    case 0x3: width = 640; break;
+    default:  width = 368; break;
+    }
+
+    unsigned height = state->gpu.vertical_resolution ? 480 : 240;
+    unsigned bytes_per_pixel = state->gpu.display_area_color_depth ? 3 : 2;
+    unsigned x0 = state->gpu.start_of_display_area_x & 0x3ff;
+    unsigned y0 = state->gpu.start_of_display_area_y & 0x1ff;
+    size_t row_offset = 2 * x0;
+    size_t row_len = std::min<size_t>(width * bytes_per_pixel, 2048);
+
+    // The display configuration is hashed before the pixel data so that
+    // identical VRAM contents displayed differently hash differently.
+    uint8_t config[8];
+    memory::store_u16_le(config + 0, x0);
+    memory::store_u16_le(config + 2, y0);
+    memory::store_u16_le(config + 4, width);
+    memory::store_u16_le(config + 6, height | (bytes_per_pixel << 12));
+
+    xxh64 hash;
+    hash.update(config, sizeof(config));
+
+    for (unsigned y = 0; y < height; y++) {
+        uint8_t const *row = state->vram + ((y0 + y) & 0x1ff) * 2048;
+        if (row_offset + row_len <= 2048) {
+            hash.update(row + row_offset, row_len);
+        } else {
+            // The display area wraps around the VRAM horizontally.
+            hash.update(row + row_offset, 2048 - row_offset);
+            hash.update(row, row_offset + row_len - 2048);
+        }
+    }
+
+    return hash.digest();
+}
+
+void vblank_event(void) {
+    context *ctx = machine()->framehash.get();
+    // Frames re-executed by the reverse debugger are already logged.
+    if (ctx->log_file == NULL || machine()->reexecuting()) {
+        return;
+    }
+
+    uint8_t record[36];
+    size_t len = 20;
+    memory::store_u32_le(record + 0, state->gpu.frame);
+    memory::store_u32_le(record + 4, state->cycles);
+    memory::store_u32_le(record + 8, state->cycles >> 32);
+    uint64_t display = display_hash();
+    memory::store_u32_le(record + 12, display);
+    memory::store_u32_le(record + 16, display >> 32);
+
+    if (ctx->log_flags & FRAMEHASH_VRAM) {
+        uint64_t vram = xxh64::hash(state->vram, sizeof(state->vram));
+        memory::store_u32_le(record + len, vram);
+        memory::store_u32_le(record + len + 4, vram >> 32);
+        len += 8;
+    }
+    if (ctx->log_flags & FRAMEHASH_RAM) {
+        uint64_t ram = xxh64::hash(state->ram, sizeof(state->ram));
+        memory::store_u32_le(record + len, ram);
+        memory::store_u32_le(record + len + 4, ram >> 32);
+        len += 8;
+    }
+
+    fwrite(record, len, 1, ctx->log_file);
+    if (++ctx->frames_since_flush >= flush_interval) {
+        fflush(ctx->log_file);
+        ctx->frames_since_flush = 0;
+    }
+}
+
+}; /* namespace psx::framehash */
@@ -4,6 +4,11 @@
 #include <psx/psx.h>
 #include <psx/hw.h>
 #include <psx/debugger.h>
+#include <psx/framehash.h>
+#include <psx/mmio.h>
+#include <psx/rewind.h>
+#include <psx/timeline.h>
+#include <psx/timing.h>
 #include <gui/graphics.h>
 
 using namespace psx;
@@ -59,25 +64,26 @@ namespace psx::hw {
 /// the current video configuration.
 void *generate_display(size_t *out_buffer_width, size_t *out_buffer_height,
                        size_t *out_display_width, size_t *out_display_height) {
-    if (!state.gpu.display_enable) {
+    timing::scope scope(timing::Display);
+    if (!state->gpu.display_enable) {
         return NULL;
     }
-    if ((state.gpu.vertical_display_range_y2 <
-         state.gpu.vertical_display_range_y1) ||
-        (state.gpu.horizontal_display_range_x2 <
-         state.gpu.horizontal_display_range_x1)) {
+    if ((state->gpu.vertical_display_range_y2 <
+         state->gpu.vertical_display_range_y1) ||
+        (state->gpu.horizontal_display_range_x2 <
+         state->gpu.horizontal_display_range_x1)) {
         return NULL;
     }
 
-    uint8_t const *framebuffer_address = state.vram +
-        state.gpu.start_of_display_area_y * 2048 +
-        state.gpu.start_of_display_area_x * 2;
+    uint8_t const *framebuffer_address = state->vram +
+        state->gpu.start_of_display_area_y * 2048 +
+        state->gpu.start_of_display_area_x * 2;
 
-    size_t color_depth = state.gpu.display_area_color_depth ? 24 : 16;
-    size_t framebuffer_height = state.gpu.vertical_resolution ? 480 : 240;
+    size_t color_depth = state->gpu.display_area_color_depth ? 24 : 16;
+    size_t framebuffer_height = state->gpu.vertical_resolution ? 480 : 240;
     size_t width;
 
-    switch (state.gpu.horizontal_resolution) {
+    switch (state->gpu.horizontal_resolution) {
     case 0x0: width = 256; break;
     case 0x1: width = 320; break;
     case 0x2: width = 512; break;
@@ -86,9 +92,9 @@ void *generate_display(size_t *out_buffer_width, size_t *out_buffer_height,
     }
 
     size_t display_height =
-        state.gpu.vertical_display_range_y2 -
-        state.gpu.vertical_display_range_y1;
-    if (state.gpu.vertical_interlace) {
+        state->gpu.vertical_display_range_y2 -
+        state->gpu.vertical_display_range_y1;
+    if (state->gpu.vertical_interlace) {
         framebuffer_height /= 2;
     }
 
@@ -97,7 +103,7 @@ void *generate_display(size_t *out_buffer_width, size_t *out_buffer_height,
     unsigned char *src_data = (unsigned char *)framebuffer_address;
     unsigned char *dst_data = framebuffer;
 
-    if (color_depth == 24 && state.gpu.vertical_interlace) {
+    if (color_depth == 24 && state->gpu.vertical_interlace) {
         for (unsigned y = 0; y < height; y++, src_data += 4096) {
             for (unsigned x = 0; x < width; x++, dst_data += 3) {
                 unsigned char r0 = src_data[3 * x + 0];
@@ -117,7 +123,7 @@ void *generate_display(size_t *out_buffer_width, size_t *out_buffer_height,
             dst_data += width * 3;
 
         }
-    } else if (state.gpu.vertical_interlace) {
+    } else if (state->gpu.vertical_interlace) {
         for (unsigned y = 0; y < height; y++, src_data += 4096) {
             for (unsigned x = 0; x < width; x++, dst_data += 3) {
                 uint16_t rgb0 =
@@ -162,10 +168,11 @@ void *generate_display_vram_16bit(size_t *out_buffer_width,
                                   size_t *out_buffer_height,
                                   size_t *out_display_width,
                                   size_t *out_display_height) {
+    timing::scope scope(timing::Display);
     unsigned width = 1024;
     unsigned height = 512;
     unsigned char *framebuffer = (unsigned char *)calloc(width * height, 3);
-    unsigned char *src_data = (unsigned char *)state.vram;
+    unsigned char *src_data = (unsigned char *)state->vram;
     unsigned char *dst_data = framebuffer;
 
     for (unsigned y = 0; y < height; y++, src_data += 2048) {
@@ -183,8 +190,8 @@ void *generate_display_vram_16bit(size_t *out_buffer_width,
     // The window is estimated as 320x240 pixels, but the size
     // may change depending on the displa
     unsigned char *display_area = framebuffer +
-        3 * state.gpu.start_of_display_area_x +
-        3 * 1024 * state.gpu.start_of_display_area_y;
+        3 * state->gpu.start_of_display_area_x +
+        3 * 1024 * state->gpu.start_of_display_area_y;
     for (unsigned y = 0; y < 240; y++) {
         display_area[y * 3 * 1024 + 0] = 0x00;
         display_area[y * 3 * 1024 + 1] = 0x00;
@@ -206,12 +213,12 @@ void *generate_display_vram_16bit(size_t *out_buffer_width,
     // The window is estimated as 320x240 pixels, but the size
     // may change depending on the displa
     unsigned char *drawing_area = framebuffer +
-        3 * state.gpu.drawing_area_x1 +
-        3 * 1024 * state.gpu.drawing_area_y1;
+        3 * state->gpu.drawing_area_x1 +
+        3 * 1024 * state->gpu.drawing_area_y1;
     uint16_t drawing_area_width =
-        state.gpu.drawing_area_x2 - state.gpu.drawing_area_x1;
+        state->gpu.drawing_area_x2 - state->gpu.drawing_area_x1;
     uint16_t drawing_area_height =
-        state.gpu.drawing_area_y2 - state.gpu.drawing_area_y1;
+        state->gpu.drawing_area_y2 - state->gpu.drawing_area_y1;
     for (unsigned y = 0; y < drawing_area_height; y++) {
         drawing_area[y * 3 * 1024 + 0] = 0xff;
         drawing_area[y * 3 * 1024 + 1] = 0x00;
@@ -239,47 +246,47 @@ void *generate_display_vram_16bit(size_t *out_buffer_width,
 void read_gpuread(uint32_t *val) {
     debugger::debug(Debugger::GPU, "gpuread -> {:08x}", *val);
 
-    if (state.gp0.state != GP0_COPY_VRAM_TO_CPU) {
+    if (state->gp0.state != GP0_COPY_VRAM_TO_CPU) {
         *val = 0;
         return;
     }
 
-    uint32_t x = (state.gp0.transfer.x0 + state.gp0.transfer.x) & UINT16_C(0x3ff);
-    uint32_t y = (state.gp0.transfer.y0 + state.gp0.transfer.y) & UINT16_C(0x1ff);
+    uint32_t x = (state->gp0.transfer.x0 + state->gp0.transfer.x) & UINT16_C(0x3ff);
+    uint32_t y = (state->gp0.transfer.y0 + state->gp0.transfer.y) & UINT16_C(0x1ff);
     uint16_t lo;
     uint16_t hi;
 
-    lo = memory::load_u16_le(state.vram + y * 2048 + 2 * x);
-    state.gp0.transfer.x++;
+    lo = memory::load_u16_le(state->vram + y * 2048 + 2 * x);
+    state->gp0.transfer.x++;
     x++;
-    if (state.gp0.transfer.x >= state.gp0.transfer.width) {
-        state.gp0.transfer.x = 0;
-        state.gp0.transfer.y++;
-        x = state.gp0.transfer.x0;
+    if (state->gp0.transfer.x >= state->gp0.transfer.width) {
+        state->gp0.transfer.x = 0;
+        state->gp0.transfer.y++;
+        x = state->gp0.transfer.x0;
         y++;
     }
 
-    hi = memory::load_u16_le(state.vram + y * 2048 + 2 * x);
-    state.gp0.transfer.x++;
-    if (state.gp0.transfer.x >= state.gp0.transfer.width) {
-        state.gp0.transfer.x = 0;
-        state.gp0.transfer.y++;
+    hi = memory::load_u16_le(state->vram + y * 2048 + 2 * x);
+    state->gp0.transfer.x++;
+    if (state->gp0.transfer.x >= state->gp0.transfer.width) {
+        state->gp0.transfer.x = 0;
+        state->gp0.transfer.y++;
     }
 
-    if (state.gp0.transfer.y >= state.gp0.transfer.height) {
+    if (state->gp0.transfer.y >= state->gp0.transfer.height) {
         debugger::info(Debugger::GPU, "VRAM to CPU transfer complete");
-        state.gp0.state = GP0_COMMAND;
-        state.gp0.count = 0;
-        state.hw.gpustat |= GPUSTAT_CMD_READY;
-        state.hw.gpustat |= GPUSTAT_DMA_READY;
-        state.hw.gpustat &= ~GPUSTAT_COPY_READY;
+        state->gp0.state = GP0_COMMAND;
+        state->gp0.count = 0;
+        state->hw.gpustat |= GPUSTAT_CMD_READY;
+        state->hw.gpustat |= GPUSTAT_DMA_READY;
+        state->hw.gpustat &= ~GPUSTAT_COPY_READY;
     }
 
     *val = (uint32_t)lo | ((uint32_t)hi << 16);
 }
 
 void read_gpustat(uint32_t *val) {
-    *val = state.hw.gpustat;
+    *val = state->hw.gpustat;
     debugger::debug(Debugger::GPU, "gpustat -> {:08x}", *val);
 }
 
@@ -313,10 +320,10 @@ struct vertex_attributes {
 /// Apply texture window mapping to a texture coordinate.
 /// Texcoord = (Texcoord AND (NOT (Mask*8))) OR ((Offset AND Mask)*8)
 static void texture_mapping(uint16_t *s, uint16_t *t) {
-    *s = (*s & ~(state.gpu.texture_window_mask_x << 3)) |
-         ((state.gpu.texture_window_offset_x & state.gpu.texture_window_mask_x) << 3);
-    *t = (*t & ~(state.gpu.texture_window_mask_y << 3)) |
-         ((state.gpu.texture_window_offset_y & state.gpu.texture_window_mask_y) << 3);
+    *s = (*s & ~(state->gpu.texture_window_mask_x << 3)) |
+         ((state->gpu.texture_window_offset_x & state->gpu.texture_window_mask_x) << 3);
+    *t = (*t & ~(state->gpu.texture_window_mask_y << 3)) |
+         ((state->gpu.texture_window_offset_y & state->gpu.texture_window_mask_y) << 3);
 }
 
 /// Render a single pixel.
@@ -324,7 +331,7 @@ static void texture_mapping(uint16_t *s, uint16_t *t) {
 static void render_pixel(vertex_attributes pixel, render_attributes attributes)
 {
     size_t pixel_width = 2;
-    uint8_t *framebuffer_address = state.vram;
+    uint8_t *framebuffer_address = state->vram;
     uint8_t *pixel_address = framebuffer_address +
         pixel.y * 2048 +
         pixel.x * pixel_width;
@@ -337,17 +344,17 @@ static void render_pixel(vertex_attributes pixel, render_attributes attributes)
     uint8_t back_b = ((back_color >> 10) & UINT16_C(0x1f)) << 3;
     uint8_t bit_mask = (back_color >> 15) & UINT16_C(0x1);
 
-    if (state.gpu.check_bit_mask && bit_mask) {
+    if (state->gpu.check_bit_mask && bit_mask) {
         return;
     }
 
     bit_mask = 0;
-    if (state.gpu.force_bit_mask) {
+    if (state->gpu.force_bit_mask) {
         bit_mask = 1;
     }
 
     if (attributes.semi_transparency) {
-        switch (state.gpu.semi_transparency_mode) {
+        switch (state->gpu.semi_transparency_mode) {
         case 0x0:
             pixel.r = (back_r / 2) + (pixel.r / 2);
             pixel.g = (back_g / 2) + (pixel.g / 2);
@@ -372,7 +379,7 @@ static void render_pixel(vertex_attributes pixel, render_attributes attributes)
         }
     }
 
-    if (state.gpu.dither_enable) {
+    if (state->gpu.dither_enable) {
         // TODO dither.
         pixel.r >>= 3;
         pixel.g >>= 3;
@@ -389,6 +396,7 @@ static void render_pixel(vertex_attributes pixel, render_attributes attributes)
         ((uint16_t)pixel.b << 10) |
         ((uint16_t)bit_mask << 15);
     memory::store_u16_le(pixel_address, color);
+    state->mark_vram_dirty(pixel_address - framebuffer_address);
 }
 
 
@@ -405,18 +413,19 @@ static void render_triangle(vertex_attributes a,
                             vertex_attributes b,
                             vertex_attributes c,
                             render_attributes attributes) {
+    timing::scope scope(timing::Rasterizer);
 
-    a.x += state.gpu.drawing_offset_x;
-    b.x += state.gpu.drawing_offset_x;
-    c.x += state.gpu.drawing_offset_x;
-    a.y += state.gpu.drawing_offset_y;
-    b.y += state.gpu.drawing_offset_y;
-    c.y += state.gpu.drawing_offset_y;
+    a.x += state->gpu.drawing_offset_x;
+    b.x += state->gpu.drawing_offset_x;
+    c.x += state->gpu.drawing_offset_x;
+    a.y += state->gpu.drawing_offset_y;
+    b.y += state->gpu.drawing_offset_y;
+    c.y += state->gpu.drawing_offset_y;
 
-    int16_t x0 = std::max<int16_t>(0,    std::min({a.x, b.x, c.x, state.gpu.drawing_area_x1}));
-    int16_t x1 = std::min<int16_t>(1024, std::max({a.x, b.x, c.x, state.gpu.drawing_area_x2}));
-    int16_t y0 = std::max<int16_t>(0,    std::min({a.y, b.y, c.y, state.gpu.drawing_area_y1}));
-    int16_t y1 = std::min<int16_t>(512,  std::max({a.y, b.y, c.y, state.gpu.drawing_area_y2}));
+    int16_t x0 = std::max<int16_t>(0,    std::min({a.x, b.x, c.x, state->gpu.drawing_area_x1}));
+    int16_t x1 = std::min<int16_t>(1024, std::max({a.x, b.x, c.x, state->gpu.drawing_area_x2}));
+    int16_t y0 = std::max<int16_t>(0,    std::min({a.y, b.y, c.y, state->gpu.drawing_area_y1}));
+    int16_t y1 = std::min<int16_t>(512,  std::max({a.y, b.y, c.y, state->gpu.drawing_area_y2}));
 
     // Compute edge function for Vc for Va, Vb.
     // - if == 0 the triangle is flat and not rendered.
@@ -454,11 +463,12 @@ static void render_triangle(vertex_attributes a,
 static void render_line(vertex_attributes a,
                         vertex_attributes b,
                         render_attributes attributes) {
+    timing::scope scope(timing::Rasterizer);
 
-    a.x += state.gpu.drawing_offset_x;
-    b.x += state.gpu.drawing_offset_x;
-    a.y += state.gpu.drawing_offset_y;
-    b.y += state.gpu.drawing_offset_y;
+    a.x += state->gpu.drawing_offset_x;
+    b.x += state->gpu.drawing_offset_x;
+    a.y += state->gpu.drawing_offset_y;
+    b.y += state->gpu.drawing_offset_y;
 
     if (std::abs(b.y - a.y) < std::abs(b.x - a.x)) {
         if (a.x > b.x) {
@@ -533,13 +543,14 @@ static void nop(void) {
 }
 
 static void fill_rectangle(void) {
-    uint8_t r = state.gp0.buffer[0];
-    uint8_t g = state.gp0.buffer[0] >> 8;
-    uint8_t b = state.gp0.buffer[0] >> 16;
-    uint16_t x0 = state.gp0.buffer[1];
-    uint16_t y0 = state.gp0.buffer[1] >> 16;
-    uint16_t width  = state.gp0.buffer[2];
-    uint16_t height = state.gp0.buffer[2] >> 16;
+    timing::scope scope(timing::Rasterizer);
+    uint8_t r = state->gp0.buffer[0];
+    uint8_t g = state->gp0.buffer[0] >> 8;
+    uint8_t b = state->gp0.buffer[0] >> 16;
+    uint16_t x0 = state->gp0.buffer[1];
+    uint16_t y0 = state->gp0.buffer[1] >> 16;
+    uint16_t width  = state->gp0.buffer[2];
+    uint16_t height = state->gp0.buffer[2] >> 16;
 
     x0 = x0 & UINT16_C(0x3f0);
     y0 = y0 & UINT16_C(0x1ff);
@@ -577,18 +588,18 @@ static void monochrome_4p_polygon_opaque(void) {
     vertex_attributes vc = { 0 };
     vertex_attributes vd = { 0 };
 
-    uint8_t r = state.gp0.buffer[0];
-    uint8_t g = state.gp0.buffer[0] >> 8;
-    uint8_t b = state.gp0.buffer[0] >> 16;
+    uint8_t r = state->gp0.buffer[0];
+    uint8_t g = state->gp0.buffer[0] >> 8;
+    uint8_t b = state->gp0.buffer[0] >> 16;
 
-    va.x = sext_i11_i16(state.gp0.buffer[1]);
-    va.y = sext_i11_i16(state.gp0.buffer[1] >> 16);
-    vb.x = sext_i11_i16(state.gp0.buffer[2]);
-    vb.y = sext_i11_i16(state.gp0.buffer[2] >> 16);
-    vc.x = sext_i11_i16(state.gp0.buffer[3]);
-    vc.y = sext_i11_i16(state.gp0.buffer[3] >> 16);
-    vd.x = sext_i11_i16(state.gp0.buffer[4]);
-    vd.y = sext_i11_i16(state.gp0.buffer[4] >> 16);
+    va.x = sext_i11_i16(state->gp0.buffer[1]);
+    va.y = sext_i11_i16(state->gp0.buffer[1] >> 16);
+    vb.x = sext_i11_i16(state->gp0.buffer[2]);
+    vb.y = sext_i11_i16(state->gp0.buffer[2] >> 16);
+    vc.x = sext_i11_i16(state->gp0.buffer[3]);
+    vc.y = sext_i11_i16(state->gp0.buffer[3] >> 16);
+    vd.x = sext_i11_i16(state->gp0.buffer[4]);
+    vd.y = sext_i11_i16(state->gp0.buffer[4] >> 16);
 
     va.r = vb.r = vc.r = vd.r = r;
     va.g = vb.g = vc.g = vd.g = g;
@@ -610,23 +621,23 @@ static void shaded_3p_polygon_opaque(void) {
     vertex_attributes vb = { 0 };
     vertex_attributes vc = { 0 };
 
-    va.r = state.gp0.buffer[0];
-    va.g = state.gp0.buffer[0] >> 8;
-    va.b = state.gp0.buffer[0] >> 16;
-    va.x = sext_i11_i16(state.gp0.buffer[1]);
-    va.y = sext_i11_i16(state.gp0.buffer[1] >> 16);
+    va.r = state->gp0.buffer[0];
+    va.g = state->gp0.buffer[0] >> 8;
+    va.b = state->gp0.buffer[0] >> 16;
+    va.x = sext_i11_i16(state->gp0.buffer[1]);
+    va.y = sext_i11_i16(state->gp0.buffer[1] >> 16);
 
-    vb.r = state.gp0.buffer[2];
-    vb.g = state.gp0.buffer[2] >> 8;
-    vb.b = state.gp0.buffer[2] >> 16;
-    vb.x = sext_i11_i16(state.gp0.buffer[3]);
-    vb.y = sext_i11_i16(state.gp0.buffer[3] >> 16);
+    vb.r = state->gp0.buffer[2];
+    vb.g = state->gp0.buffer[2] >> 8;
+    vb.b = state->gp0.buffer[2] >> 16;
+    vb.x = sext_i11_i16(state->gp0.buffer[3]);
+    vb.y = sext_i11_i16(state->gp0.buffer[3] >> 16);
 
-    vc.r = state.gp0.buffer[4];
-    vc.g = state.gp0.buffer[4] >> 8;
-    vc.b = state.gp0.buffer[4] >> 16;
-    vc.x = sext_i11_i16(state.gp0.buffer[5]);
-    vc.y = sext_i11_i16(state.gp0.buffer[5] >> 16);
+    vc.r = state->gp0.buffer[4];
+    vc.g = state->gp0.buffer[4] >> 8;
+    vc.b = state->gp0.buffer[4] >> 16;
+    vc.x = sext_i11_i16(state->gp0.buffer[5]);
+    vc.y = sext_i11_i16(state->gp0.buffer[5] >> 16);
 
     render_attributes attributes = {
         .blended = false,
@@ -644,29 +655,29 @@ static void shaded_4p_polygon_opaque(void) {
     vertex_attributes vc = { 0 };
     vertex_attributes vd = { 0 };
 
-    va.r = state.gp0.buffer[0];
-    va.g = state.gp0.buffer[0] >> 8;
-    va.b = state.gp0.buffer[0] >> 16;
-    va.x = sext_i11_i16(state.gp0.buffer[1]);
-    va.y = sext_i11_i16(state.gp0.buffer[1] >> 16);
-
-    vb.r = state.gp0.buffer[2];
-    vb.g = state.gp0.buffer[2] >> 8;
-    vb.b = state.gp0.buffer[2] >> 16;
-    vb.x = sext_i11_i16(state.gp0.buffer[3]);
-    vb.y = sext_i11_i16(state.gp0.buffer[3] >> 16);
-
-    vc.r = state.gp0.buffer[4];
-    vc.g = state.gp0.buffer[4] >> 8;
-    vc.b = state.gp0.buffer[4] >> 16;
-    vc.x = sext_i11_i16(state.gp0.buffer[5]);
-    vc.y = sext_i11_i16(state.gp0.buffer[5] >> 16);
-
-    vd.r = state.gp0.buffer[6];
-    vd.g = state.gp0.buffer[6] >> 8;
-    vd.b = state.gp0.buffer[6] >> 16;
-    vd.x = sext_i11_i16(state.gp0.buffer[7]);
-    vd.y = sext_i11_i16(state.gp0.buffer[7] >> 16);
+    va.r = state->gp0.buffer[0];
+    va.g = state->gp0.buffer[0] >> 8;
+    va.b = state->gp0.buffer[0] >> 16;
+    va.x = sext_i11_i16(state->gp0.buffer[1]);
+    va.y = sext_i11_i16(state->gp0.buffer[1] >> 16);
+
+    vb.r = state->gp0.buffer[2];
+    vb.g = state->gp0.buffer[2] >> 8;
+    vb.b = state->gp0.buffer[2] >> 16;
+    vb.x = sext_i11_i16(state->gp0.buffer[3]);
+    vb.y = sext_i11_i16(state->gp0.buffer[3] >> 16);
+
+    vc.r = state->gp0.buffer[4];
+    vc.g = state->gp0.buffer[4] >> 8;
+    vc.b = state->gp0.buffer[4] >> 16;
+    vc.x = sext_i11_i16(state->gp0.buffer[5]);
+    vc.y = sext_i11_i16(state->gp0.buffer[5] >> 16);
+
+    vd.r = state->gp0.buffer[6];
+    vd.g = state->gp0.buffer[6] >> 8;
+    vd.b = state->gp0.buffer[6] >> 16;
+    vd.x = sext_i11_i16(state->gp0.buffer[7]);
+    vd.y = sext_i11_i16(state->gp0.buffer[7] >> 16);
 
     render_attributes attributes = {
         .blended = false,
@@ -683,14 +694,14 @@ static void monochrome_line_opaque(void) {
     vertex_attributes va = { 0 };
     vertex_attributes vb = { 0 };
 
-    uint8_t r = state.gp0.buffer[0];
-    uint8_t g = state.gp0.buffer[0] >> 8;
-    uint8_t b = state.gp0.buffer[0] >> 16;
+    uint8_t r = state->gp0.buffer[0];
+    uint8_t g = state->gp0.buffer[0] >> 8;
+    uint8_t b = state->gp0.buffer[0] >> 16;
 
-    va.x = sext_i11_i16(state.gp0.buffer[1]);
-    va.y = sext_i11_i16(state.gp0.buffer[1] >> 16);
-    vb.x = sext_i11_i16(state.gp0.buffer[2]);
-    vb.y = sext_i11_i16(state.gp0.buffer[2] >> 16);
+    va.x = sext_i11_i16(state->gp0.buffer[1]);
+    va.y = sext_i11_i16(state->gp0.buffer[1] >> 16);
+    vb.x = sext_i11_i16(state->gp0.buffer[2]);
+    vb.y = sext_i11_i16(state->gp0.buffer[2] >> 16);
 
     va.r = vb.r = r;
     va.g = vb.g = g;
@@ -707,123 +718,123 @@ static void monochrome_line_opaque(void) {
 }
 
 static void copy_rectangle_cpu_to_vram(void) {
-    uint16_t x = (state.gp0.buffer[1] >> 0) & UINT32_C(0xffff);
-    uint16_t y = (state.gp0.buffer[1] >> 16) & UINT32_C(0xffff);
-    uint16_t width = (state.gp0.buffer[2] >> 0) & UINT32_C(0xffff);;
-    uint16_t height = (state.gp0.buffer[2] >> 16) & UINT32_C(0xffff);;
-
-    state.gp0.state = GP0_COPY_CPU_TO_VRAM;
-    state.gp0.transfer.x0 = x & UINT16_C(0x3ff);
-    state.gp0.transfer.y0 = y & UINT16_C(0x1ff);
-    state.gp0.transfer.width = ((width - 1) & UINT16_C(0x3ff)) + 1;
-    state.gp0.transfer.height = ((height - 1) & UINT16_C(0x1ff)) + 1;
-    state.gp0.transfer.x = 0;
-    state.gp0.transfer.y = 0;
+    uint16_t x = (state->gp0.buffer[1] >> 0) & UINT32_C(0xffff);
+    uint16_t y = (state->gp0.buffer[1] >> 16) & UINT32_C(0xffff);
+    uint16_t width = (state->gp0.buffer[2] >> 0) & UINT32_C(0xffff);;
+    uint16_t height = (state->gp0.buffer[2] >> 16) & UINT32_C(0xffff);;
+
+    state->gp0.state = GP0_COPY_CPU_TO_VRAM;
+    state->gp0.transfer.x0 = x & UINT16_C(0x3ff);
+    state->gp0.transfer.y0 = y & UINT16_C(0x1ff);
+    state->gp0.transfer.width = ((width - 1) & UINT16_C(0x3ff)) + 1;
+    state->gp0.transfer.height = ((height - 1) & UINT16_C(0x1ff)) + 1;
+    state->gp0.transfer.x = 0;
+    state->gp0.transfer.y = 0;
 
     debugger::info(Debugger::GPU, "  x: {}", x);
     debugger::info(Debugger::GPU, "  y: {}", y);
-    debugger::info(Debugger::GPU, "  width: {}", state.gp0.transfer.width);
-    debugger::info(Debugger::GPU, "  height: {}", state.gp0.transfer.height);
+    debugger::info(Debugger::GPU, "  width: {}", state->gp0.transfer.width);
+    debugger::info(Debugger::GPU, "  height: {}", state->gp0.transfer.height);
 }
 
 static void copy_rectangle_vram_to_cpu(void) {
-    uint16_t x = (state.gp0.buffer[1] >> 0) & UINT32_C(0xffff);
-    uint16_t y = (state.gp0.buffer[1] >> 16) & UINT32_C(0xffff);
-    uint16_t width = (state.gp0.buffer[2] >> 0) & UINT32_C(0xffff);;
-    uint16_t height = (state.gp0.buffer[2] >> 16) & UINT32_C(0xffff);;
-
-    state.hw.gpustat |= GPUSTAT_COPY_READY;
-    state.gp0.state = GP0_COPY_VRAM_TO_CPU;
-    state.gp0.transfer.x0 = x & UINT16_C(0x3ff);
-    state.gp0.transfer.y0 = y & UINT16_C(0x1ff);
-    state.gp0.transfer.width = ((width - 1) & UINT16_C(0x3ff)) + 1;
-    state.gp0.transfer.height = ((height - 1) & UINT16_C(0x1ff)) + 1;
-    state.gp0.transfer.x = 0;
-    state.gp0.transfer.y = 0;
+    uint16_t x = (state->gp0.buffer[1] >> 0) & UINT32_C(0xffff);
+    uint16_t y = (state->gp0.buffer[1] >> 16) & UINT32_C(0xffff);
+    uint16_t width = (state->gp0.buffer[2] >> 0) & UINT32_C(0xffff);;
+    uint16_t height = (state->gp0.buffer[2] >> 16) & UINT32_C(0xffff);;
+
+    state->hw.gpustat |= GPUSTAT_COPY_READY;
+    state->gp0.state = GP0_COPY_VRAM_TO_CPU;
+    state->gp0.transfer.x0 = x & UINT16_C(0x3ff);
+    state->gp0.transfer.y0 = y & UINT16_C(0x1ff);
+    state->gp0.transfer.width = ((width - 1) & UINT16_C(0x3ff)) + 1;
+    state->gp0.transfer.height = ((height - 1) & UINT16_C(0x1ff)) + 1;
+    state->gp0.transfer.x = 0;
+    state->gp0.transfer.y = 0;
 
     debugger::info(Debugger::GPU, "  x: {}", x);
     debugger::info(Debugger::GPU, "  y: {}", y);
-    debugger::info(Debugger::GPU, "  width: {}", state.gp0.transfer.width);
-    debugger::info(Debugger::GPU, "  height: {}", state.gp0.transfer.height);
+    debugger::info(Debugger::GPU, "  width: {}", state->gp0.transfer.width);
+    debugger::info(Debugger::GPU, "  height: {}", state->gp0.transfer.height);
 }
 
 static void draw_mode_setting(void) {
-    state.gpu.texture_page_x_base = (state.gp0.buffer[0] >> 0) & UINT32_C(0xf);
-    state.gpu.texture_page_y_base = (state.gp0.buffer[0] >> 4) & UINT32_C(0x1);
-    state.gpu.semi_transparency_mode = (state.gp0.buffer[0] >> 5) & UINT32_C(0x3);
-    state.gpu.texture_page_colors = (state.gp0.buffer[0] >> 7) & UINT32_C(0x3);
-    state.gpu.dither_enable = (state.gp0.buffer[0] >> 9) & UINT32_C(0x1);
-    state.gpu.drawing_to_display_area_enable = (state.gp0.buffer[0] >> 10) & UINT32_C(0x1);
-    state.gpu.texture_disable = (state.gp0.buffer[0] >> 11) & UINT32_C(0x1);
-    state.gpu.textured_rectangle_x_flip = (state.gp0.buffer[0] >> 12) & UINT32_C(0x1);
-    state.gpu.textured_rectangle_y_flip = (state.gp0.buffer[0] >> 13) & UINT32_C(0x1);
-
-    state.hw.gpustat &= ~UINT32_C(0x87ff);
-    state.hw.gpustat |= state.gp0.buffer[0] & UINT32_C(0x7ff);
-    state.hw.gpustat |= (state.gp0.buffer[0] << 4) & UINT32_C(0x8000);
-
-    debugger::info(Debugger::GPU, "  texture_page_x_base: {}", state.gpu.texture_page_x_base);
-    debugger::info(Debugger::GPU, "  texture_page_y_base: {}", state.gpu.texture_page_y_base);
-    debugger::info(Debugger::GPU, "  semi_transparency_mode: {}", state.gpu.semi_transparency_mode);
-    debugger::info(Debugger::GPU, "  texture_page_colors: {}", state.gpu.texture_page_colors);
-    debugger::info(Debugger::GPU, "  dither_enable: {}", state.gpu.dither_enable);
-    debugger::info(Debugger::GPU, "  drawing_to_display_area_enable: {}", state.gpu.drawing_to_display_area_enable);
-    debugger::info(Debugger::GPU, "  texture_disable: {}", state.gpu.texture_disable);
-    debugger::info(Debugger::GPU, "  textured_rectangle_x_flip: {}", state.gpu.textured_rectangle_x_flip);
-    debugger::info(Debugger::GPU, "  textured_rectangle_y_flip: {}", state.gpu.textured_rectangle_y_flip);
+    state->gpu.texture_page_x_base = (state->gp0.buffer[0] >> 0) & UINT32_C(0xf);
+    state->gpu.texture_page_y_base = (state->gp0.buffer[0] >> 4) & UINT32_C(0x1);
+    state->gpu.semi_transparency_mode = (state->gp0.buffer[0] >> 5) & UINT32_C(0x3);
+    state->gpu.texture_page_colors = (state->gp0.buffer[0] >> 7) & UINT32_C(0x3);
+    state->gpu.dither_enable = (state->gp0.buffer[0] >> 9) & UINT32_C(0x1);
+    state->gpu.drawing_to_display_area_enable = (state->gp0.buffer[0] >> 10) & UINT32_C(0x1);
+    state->gpu.texture_disable = (state->gp0.buffer[0] >> 11) & UINT32_C(0x1);
+    state->gpu.textured_rectangle_x_flip = (state->gp0.buffer[0] >> 12) & UINT32_C(0x1);
+    state->gpu.textured_rectangle_y_flip = (state->gp0.buffer[0] >> 13) & UINT32_C(0x1);
+
+    state->hw.gpustat &= ~UINT32_C(0x87ff);
+    state->hw.gpustat |= state->gp0.buffer[0] & UINT32_C(0x7ff);
+    state->hw.gpustat |= (state->gp0.buffer[0] << 4) & UINT32_C(0x8000);
+
+    debugger::info(Debugger::GPU, "  texture_page_x_base: {}", state->gpu.texture_page_x_base);
+    debugger::info(Debugger::GPU, "  texture_page_y_base: {}", state->gpu.texture_page_y_base);
+    debugger::info(Debugger::GPU, "  semi_transparency_mode: {}", state->gpu.semi_transparency_mode);
+    debugger::info(Debugger::GPU, "  texture_page_colors: {}", state->gpu.texture_page_colors);
+    debugger::info(Debugger::GPU, "  dither_enable: {}", state->gpu.dither_enable);
+    debugger::info(Debugger::GPU, "  drawing_to_display_area_enable: {}", state->gpu.drawing_to_display_area_enable);
+    debugger::info(Debugger::GPU, "  texture_disable: {}", state->gpu.texture_disable);
+    debugger::info(Debugger::GPU, "  textured_rectangle_x_flip: {}", state->gpu.textured_rectangle_x_flip);
+    debugger::info(Debugger::GPU, "  textured_rectangle_y_flip: {}", state->gpu.textured_rectangle_y_flip);
 }
 
 static void texture_window_setting(void) {
-    uint32_t cmd = state.gp0.buffer[0];
-    state.gpu.texture_window_mask_x = (cmd >> 0) & UINT32_C(0x1f);
-    state.gpu.texture_window_mask_y = (cmd >> 5) & UINT32_C(0x1f);
-    state.gpu.texture_window_offset_x = (cmd >> 10) & UINT32_C(0x1f);
-    state.gpu.texture_window_offset_y = (cmd >> 15) & UINT32_C(0x1f);
-
-    debugger::info(Debugger::GPU, "  texture_window_mask_x: {}", state.gpu.texture_window_mask_x);
-    debugger::info(Debugger::GPU, "  texture_window_mask_y: {}", state.gpu.texture_window_mask_y);
-    debugger::info(Debugger::GPU, "  texture_window_offset_x: {}", state.gpu.texture_window_offset_x);
-    debugger::info(Debugger::GPU, "  texture_window_offset_y: {}", state.gpu.texture_window_offset_y);
+    uint32_t cmd = state->gp0.buffer[0];
+    state->gpu.texture_window_mask_x = (cmd >> 0) & UINT32_C(0x1f);
+    state->gpu.texture_window_mask_y = (cmd >> 5) & UINT32_C(0x1f);
+    state->gpu.texture_window_offset_x = (cmd >> 10) & UINT32_C(0x1f);
+    state->gpu.texture_window_offset_y = (cmd >> 15) & UINT32_C(0x1f);
+
+    debugger::info(Debugger::GPU, "  texture_window_mask_x: {}", state->gpu.texture_window_mask_x);
+    debugger::info(Debugger::GPU, "  texture_window_mask_y: {}", state->gpu.texture_window_mask_y);
+    debugger::info(Debugger::GPU, "  texture_window_offset_x: {}", state->gpu.texture_window_offset_x);
+    debugger::info(Debugger::GPU, "  texture_window_offset_y: {}", state->gpu.texture_window_offset_y);
 }
 
 static void set_drawing_area_top_left(void) {
-    uint32_t cmd = state.gp0.buffer[0];
-    state.gpu.drawing_area_x1 = (cmd >> 0) & UINT32_C(0x3ff);
-    state.gpu.drawing_area_y1 = (cmd >> 10) & UINT32_C(0x3ff);
+    uint32_t cmd = state->gp0.buffer[0];
+    state->gpu.drawing_area_x1 = (cmd >> 0) & UINT32_C(0x3ff);
+    state->gpu.drawing_area_y1 = (cmd >> 10) & UINT32_C(0x3ff);
 
-    debugger::info(Debugger::GPU, "  drawing_area_x1: {}", state.gpu.drawing_area_x1);
-    debugger::info(Debugger::GPU, "  drawing_area_y1: {}", state.gpu.drawing_area_y1);
+    debugger::info(Debugger::GPU, "  drawing_area_x1: {}", state->gpu.drawing_area_x1);
+    debugger::info(Debugger::GPU, "  drawing_area_y1: {}", state->gpu.drawing_area_y1);
 }
 
 static void set_drawing_area_bottom_right(void) {
-    uint32_t cmd = state.gp0.buffer[0];
-    state.gpu.drawing_area_x2 = (cmd >> 0) & UINT32_C(0x3ff);
-    state.gpu.drawing_area_y2 = (cmd >> 10) & UINT32_C(0x3ff);
+    uint32_t cmd = state->gp0.buffer[0];
+    state->gpu.drawing_area_x2 = (cmd >> 0) & UINT32_C(0x3ff);
+    state->gpu.drawing_area_y2 = (cmd >> 10) & UINT32_C(0x3ff);
 
-    debugger::info(Debugger::GPU, "  drawing_area_x2: {}", state.gpu.drawing_area_x2);
-    debugger::info(Debugger::GPU, "  drawing_area_y2: {}", state.gpu.drawing_area_y2);
+    debugger::info(Debugger::GPU, "  drawing_area_x2: {}", state->gpu.drawing_area_x2);
+    debugger::info(Debugger::GPU, "  drawing_area_y2: {}", state->gpu.drawing_area_y2);
 }
 
 static void set_drawing_offset(void) {
-    uint32_t cmd = state.gp0.buffer[0];
+    uint32_t cmd = state->gp0.buffer[0];
     uint16_t offset_x = (cmd >>  0) & UINT32_C(0x7ff);
     uint16_t offset_y = (cmd >> 10) & UINT32_C(0x7ff);
-    state.gpu.drawing_offset_x = sext_i11_i16(offset_x);
-    state.gpu.drawing_offset_y = sext_i11_i16(offset_y);
+    state->gpu.drawing_offset_x = sext_i11_i16(offset_x);
+    state->gpu.drawing_offset_y = sext_i11_i16(offset_y);
 
-    debugger::info(Debugger::GPU, "  drawing_offset_x: {}", state.gpu.drawing_offset_x);
-    debugger::info(Debugger::GPU, "  drawing_offset_y: {}", state.gpu.drawing_offset_y);
+    debugger::info(Debugger::GPU, "  drawing_offset_x: {}", state->gpu.drawing_offset_x);
+    debugger::info(Debugger::GPU, "  drawing_offset_y: {}", state->gpu.drawing_offset_y);
 }
 
 static void mask_bit_setting(void) {
-    uint32_t cmd = state.gp0.buffer[0];
-    state.gpu.force_bit_mask = (cmd & UINT32_C(0x1)) != 0;
-    state.gpu.check_bit_mask = (cmd & UINT32_C(0x2)) != 0;
-    state.hw.gpustat &= ~UINT32_C(0x1800);
-    state.hw.gpustat |= (cmd & UINT32_C(0x3)) << 11;
-
-    debugger::info(Debugger::GPU, "  force_bit_mask: {}", state.gpu.force_bit_mask);
-    debugger::info(Debugger::GPU, "  check_bit_mask: {}", state.gpu.check_bit_mask);
+    uint32_t cmd = state->gp0.buffer[0];
+    state->gpu.force_bit_mask = (cmd & UINT32_C(0x1)) != 0;
+    state->gpu.check_bit_mask = (cmd & UINT32_C(0x2)) != 0;
+    state->hw.gpustat &= ~UINT32_C(0x1800);
+    state->hw.gpustat |= (cmd & UINT32_C(0x3)) << 11;
+
+    debugger::info(Debugger::GPU, "  force_bit_mask: {}", state->gpu.force_bit_mask);
+    debugger::info(Debugger::GPU, "  check_bit_mask: {}", state->gpu.check_bit_mask);
 }
 
 static struct {
@@ -1090,12 +1101,12 @@ static struct {
 };
 
 static void reset_gpu(uint32_t cmd) {
-    state.hw.gpustat = UINT32_C(0x14802000);
-    state.gp0.count = 0;
-    state.gpu = gpu_registers();
+    state->hw.gpustat = UINT32_C(0x14802000);
+    state->gp0.count = 0;
+    state->gpu = gpu_registers();
 
-    state.gpu.vertical_interlace = true;
-    state.gpu.display_enable = false;
+    state->gpu.vertical_interlace = true;
+    state->gpu.display_enable = false;
 }
 
 static void display_mode(uint32_t cmd) {
@@ -1108,75 +1119,75 @@ static void display_mode(uint32_t cmd) {
     //  7     "Reverseflag"               (0=Normal, 1=Distorted)      ;GPUSTAT.14
     //  8-23  Not used (zero)
 
-    state.gpu.horizontal_resolution =
+    state->gpu.horizontal_resolution =
         ((cmd >> 0) & UINT8_C(0x3)) |
         ((cmd >> 4) & UINT8_C(0x1));
-    state.gpu.vertical_resolution = (cmd >> 2) & UINT8_C(0x1);
-    state.gpu.video_mode = (cmd >> 3) & UINT8_C(0x1);
-    state.gpu.display_area_color_depth = (cmd >> 4) & UINT8_C(0x1);
-    state.gpu.vertical_interlace = (cmd >> 5) & UINT32_C(0x1);
-
-    state.hw.gpustat &= ~UINT32_C(0x007f4000);
-    state.hw.gpustat |= (cmd & UINT32_C(0x3f)) << 17;
-    state.hw.gpustat |= ((cmd >> 6) & UINT32_C(0x1)) << 16;
-    state.hw.gpustat |= ((cmd >> 7) & UINT32_C(0x1)) << 14;
+    state->gpu.vertical_resolution = (cmd >> 2) & UINT8_C(0x1);
+    state->gpu.video_mode = (cmd >> 3) & UINT8_C(0x1);
+    state->gpu.display_area_color_depth = (cmd >> 4) & UINT8_C(0x1);
+    state->gpu.vertical_interlace = (cmd >> 5) & UINT32_C(0x1);
+
+    state->hw.gpustat &= ~UINT32_C(0x007f4000);
+    state->hw.gpustat |= (cmd & UINT32_C(0x3f)) << 17;
+    state->hw.gpustat |= ((cmd >> 6) & UINT32_C(0x1)) << 16;
+    state->hw.gpustat |= ((cmd >> 7) & UINT32_C(0x1)) << 14;
 }
 
 static void reset_command_buffer(uint32_t cmd) {
-    state.gp0.count = 0;
-    state.hw.gpustat |= GPUSTAT_CMD_READY;
-    state.hw.gpustat |= GPUSTAT_DMA_READY;
-    state.hw.gpustat &= GPUSTAT_COPY_READY;
+    state->gp0.count = 0;
+    state->hw.gpustat |= GPUSTAT_CMD_READY;
+    state->hw.gpustat |= GPUSTAT_DMA_READY;
+    state->hw.gpustat &= GPUSTAT_COPY_READY;
 }
 
 static void ack_gpu_interrupt(uint32_t cmd) {
-    state.hw.gpustat &= ~GPUSTAT_INT;
+    state->hw.gpustat &= ~GPUSTAT_INT;
 }
 
 static void display_enable(uint32_t cmd) {
-    state.gpu.display_enable = (cmd & UINT32_C(0x1)) == 0;
+    state->gpu.display_enable = (cmd & UINT32_C(0x1)) == 0;
 
-    state.hw.gpustat &= ~GPUSTAT_DISPLAY_DISABLE;
-    state.hw.gpustat |= (cmd << 23) & GPUSTAT_DISPLAY_DISABLE;
+    state->hw.gpustat &= ~GPUSTAT_DISPLAY_DISABLE;
+    state->hw.gpustat |= (cmd << 23) & GPUSTAT_DISPLAY_DISABLE;
 }
 
 static void dma_direction(uint32_t cmd) {
-    state.gpu.dma_direction = cmd & UINT32_C(0x3);
-    state.hw.gpustat &= ~UINT32_C(0x60000000);
-    state.hw.gpustat |= (cmd & UINT32_C(0x3)) << 29;
+    state->gpu.dma_direction = cmd & UINT32_C(0x3);
+    state->hw.gpustat &= ~UINT32_C(0x60000000);
+    state->hw.gpustat |= (cmd & UINT32_C(0x3)) << 29;
 
     debugger::info(Debugger::GPU, "  dma_direction: {}",
-                   state.gpu.dma_direction);
+                   state->gpu.dma_direction);
 }
 
 static void start_of_display_area(uint32_t cmd) {
-    state.gpu.start_of_display_area_x = (cmd >> 0) & UINT32_C(0x3ff);
-    state.gpu.start_of_display_area_y = (cmd >> 10) & UINT32_C(0x1ff);
+    state->gpu.start_of_display_area_x = (cmd >> 0) & UINT32_C(0x3ff);
+    state->gpu.start_of_display_area_y = (cmd >> 10) & UINT32_C(0x1ff);
 
     debugger::info(Debugger::GPU, "  start_of_display_area_x: {}",
-                   state.gpu.start_of_display_area_x);
+                   state->gpu.start_of_display_area_x);
     debugger::info(Debugger::GPU, "  start_of_display_area_y: {}",
-                   state.gpu.start_of_display_area_y);
+                   state->gpu.start_of_display_area_y);
 }
 
 static void horizontal_display_range(uint32_t cmd) {
-    state.gpu.horizontal_display_range_x1 = (cmd >> 0) & UINT32_C(0xfff);
-    state.gpu.horizontal_display_range_x2 = (cmd >> 12) & UINT32_C(0xfff);
+    state->gpu.horizontal_display_range_x1 = (cmd >> 0) & UINT32_C(0xfff);
+    state->gpu.horizontal_display_range_x2 = (cmd >> 12) & UINT32_C(0xfff);
 
     debugger::info(Debugger::GPU, "  horizontal_display_range_x1: {}",
-                   state.gpu.horizontal_display_range_x1);
+                   state->gpu.horizontal_display_range_x1);
     debugger::info(Debugger::GPU, "  horizontal_display_range_x2: {}",
-                   state.gpu.horizontal_display_range_x2);
+                   state->gpu.horizontal_display_range_x2);
 }
 
 static void vertical_display_range(uint32_t cmd) {
-    state.gpu.vertical_display_range_y1 = (cmd >> 0) & UINT32_C(0x3ff);
-    state.gpu.vertical_display_range_y2 = (cmd >> 10) & UINT32_C(0x3ff);
+    state->gpu.vertical_display_range_y1 = (cmd >> 0) & UINT32_C(0x3ff);
+    state->gpu.vertical_display_range_y2 = (cmd >> 10) & UINT32_C(0x3ff);
 
     debugger::info(Debugger::GPU, "  vertical_display_range_y1: {}",
-                   state.gpu.vertical_display_range_y1);
+                   state->gpu.vertical_display_range_y1);
     debugger::info(Debugger::GPU, "  vertical_display_range_y2: {}",
-                   state.gpu.vertical_display_range_y2);
+                   state->gpu.vertical_display_range_y2);
 }
 
 static struct {
@@ -1250,81 +1261,84 @@ static struct {
 };
 
 static void gp0_command(uint32_t val) {
-    unsigned index = state.gp0.count;
-    state.gp0.buffer[index] = val;
-    state.gp0.count++;
+    unsigned index = state->gp0.count;
+    state->gp0.buffer[index] = val;
+    state->gp0.count++;
 
-    uint8_t op_code = state.gp0.buffer[0] >> 24;
+    uint8_t op_code = state->gp0.buffer[0] >> 24;
     unsigned cmd_length = gp0_commands[op_code].length;
 
-    if (state.gp0.count == cmd_length) {
+    if (state->gp0.count == cmd_length) {
         debugger::info(Debugger::GPU, "{}", gp0_commands[op_code].name);
-        state.gp0.count = 0;
-        state.hw.gpustat |= GPUSTAT_CMD_READY;
-        state.hw.gpustat |= GPUSTAT_DMA_READY;
+        state->gp0.count = 0;
+        state->hw.gpustat |= GPUSTAT_CMD_READY;
+        state->hw.gpustat |= GPUSTAT_DMA_READY;
         if (gp0_commands[op_code].handler == NULL) {
             psx::halt("unhandled GP0 command");
         } else {
+            timeline::span span("gpu", gp0_commands[op_code].name);
             gp0_commands[op_code].handler();
         }
     } else {
-        state.hw.gpustat &= ~GPUSTAT_CMD_READY;
-        state.hw.gpustat &= ~GPUSTAT_DMA_READY;
+        state->hw.gpustat &= ~GPUSTAT_CMD_READY;
+        state->hw.gpustat &= ~GPUSTAT_DMA_READY;
     }
 }
 
 static void gp0_polyline(uint32_t val) {
     if (val == UINT32_C(0x55555555) ||
         val == UINT32_C(0x50005000)) {
-        state.gp0.state = GP0_COMMAND;
-        state.gp0.count = 0;
-        state.hw.gpustat |= GPUSTAT_CMD_READY;
-        state.hw.gpustat |= GPUSTAT_DMA_READY;
-        state.hw.gpustat &= ~GPUSTAT_COPY_READY;
+        state->gp0.state = GP0_COMMAND;
+        state->gp0.count = 0;
+        state->hw.gpustat |= GPUSTAT_CMD_READY;
+        state->hw.gpustat |= GPUSTAT_DMA_READY;
+        state->hw.gpustat &= ~GPUSTAT_COPY_READY;
         return;
     }
 
     psx::halt("unhandled polyline command");
 
     // TODO
-/*    unsigned index = state.gp0.count;
-    state.gp0.buffer[index] = val;
-    state.gp0.count++;*/
+/*    unsigned index = state->gp0.count;
+    state->gp0.buffer[index] = val;
+    state->gp0.count++;*/
 }
 
 static void gp0_copy_cpu_to_vram(uint32_t val) {
-    uint32_t x = (state.gp0.transfer.x0 + state.gp0.transfer.x) & UINT16_C(0x3ff);
-    uint32_t y = (state.gp0.transfer.y0 + state.gp0.transfer.y) & UINT16_C(0x1ff);
+    uint32_t x = (state->gp0.transfer.x0 + state->gp0.transfer.x) & UINT16_C(0x3ff);
+    uint32_t y = (state->gp0.transfer.y0 + state->gp0.transfer.y) & UINT16_C(0x1ff);
     uint16_t lo = val >> 0;
     uint16_t hi = val >> 16;
 
     // TODO: the transfer is affected by the Mask setting.
 
-    memory::store_u16_le(state.vram + y * 2048 + 2 * x, lo);
-    state.gp0.transfer.x++;
+    memory::store_u16_le(state->vram + y * 2048 + 2 * x, lo);
+    state->mark_vram_dirty(y * 2048 + 2 * x);
+    state->gp0.transfer.x++;
     x++;
-    if (state.gp0.transfer.x >= state.gp0.transfer.width) {
-        state.gp0.transfer.x = 0;
-        state.gp0.transfer.y++;
-        x = state.gp0.transfer.x0;
+    if (state->gp0.transfer.x >= state->gp0.transfer.width) {
+        state->gp0.transfer.x = 0;
+        state->gp0.transfer.y++;
+        x = state->gp0.transfer.x0;
         y++;
     }
 
-    memory::store_u16_le(state.vram + y * 2048 + 2 * x, hi);
-    state.gp0.transfer.x++;
-    if (state.gp0.transfer.x >= state.gp0.transfer.width) {
-        state.gp0.transfer.x = 0;
-        state.gp0.transfer.y++;
+    memory::store_u16_le(state->vram + y * 2048 + 2 * x, hi);
+    state->mark_vram_dirty(y * 2048 + 2 * x);
+    state->gp0.transfer.x++;
+    if (state->gp0.transfer.x >= state->gp0.transfer.width) {
+        state->gp0.transfer.x = 0;
+        state->gp0.transfer.y++;
     }
 
-    if (state.gp0.transfer.y >= state.gp0.transfer.height) {
+    if (state->gp0.transfer.y >= state->gp0.transfer.height) {
         debugger::info(Debugger::GPU, "CPU to VRAM transfer complete");
         refreshVideoImage();
-        state.gp0.state = GP0_COMMAND;
-        state.gp0.count = 0;
-        state.hw.gpustat |= GPUSTAT_CMD_READY;
-        state.hw.gpustat |= GPUSTAT_DMA_READY;
-        state.hw.gpustat &= ~GPUSTAT_COPY_READY;
+        state->gp0.state = GP0_COMMAND;
+        state->gp0.count = 0;
+        state->hw.gpustat |= GPUSTAT_CMD_READY;
+        state->hw.gpustat |= GPUSTAT_DMA_READY;
+        state->hw.gpustat &= ~GPUSTAT_COPY_READY;
     }
 }
 
@@ -1334,8 +1348,9 @@ static void gp0_copy_vram_to_cpu(uint32_t val) {
 
 void write_gpu0(uint32_t val) {
     debugger::debug(Debugger::GPU, "gpu0 <- {:08x}", val);
+    timing::scope scope(timing::GP0);
 
-    switch (state.gp0.state) {
+    switch (state->gp0.state) {
     case GP0_COMMAND:           gp0_command(val); break;
     case GP0_POLYLINE:          gp0_polyline(val); break;
     case GP0_COPY_CPU_TO_VRAM:  gp0_copy_cpu_to_vram(val); break;
@@ -1345,6 +1360,7 @@ void write_gpu0(uint32_t val) {
 
 void write_gpu1(uint32_t val) {
     debugger::debug(Debugger::GPU, "gpu1 <- {:08x}", val);
+    timing::scope scope(timing::GP0);
 
     uint8_t op_code = (val >> 24) & UINT8_C(0x3f);
     debugger::info(Debugger::GPU, "{}", gp1_commands[op_code].name);
@@ -1369,39 +1385,53 @@ void hblank_event() {
     // - PAL:  3406 video cycles per scanline (or 3406.1 or so?)
     // - NTSC: 3413 video cycles per scanline (or 3413.6 or so?)
 
-    bool pal = state.gpu.video_mode != 0;
-    bool interlace = state.gpu.vertical_interlace;
-    bool resolution = state.gpu.vertical_resolution != 0;
+    bool pal = state->gpu.video_mode != 0;
+    bool interlace = state->gpu.vertical_interlace;
+    bool resolution = state->gpu.vertical_resolution != 0;
     unsigned scanline_vblank = 240; // TODO computed from vertical resolution
     unsigned scanline_endframe = pal ? 314 : 263;
 
-    unsigned long cpu_clock = state.cycles;
+    unsigned long cpu_clock = state->cycles;
     unsigned long delay = (pal ? 3406 : 3413) * 7 / 11;
 
-    state.gpu.scanline++;
-    state.hw.gpustat &= ~GPUSTAT_VBLANK;
+    state->gpu.scanline++;
+    state->hw.gpustat &= ~GPUSTAT_VBLANK;
 
-    if (state.gpu.scanline >= scanline_endframe) {
-        state.gpu.scanline = 0;
-        state.gpu.frame++;
+    if (state->gpu.scanline >= scanline_endframe) {
+        state->gpu.scanline = 0;
+        state->gpu.frame++;
     }
 
-    if (state.gpu.scanline < scanline_vblank) {
+    if (state->gpu.scanline < scanline_vblank) {
         bool bit31_set = (resolution && interlace) ?
-            state.gpu.frame % 2 :
-            state.gpu.scanline % 2;
+            state->gpu.frame % 2 :
+            state->gpu.scanline % 2;
 
         if (bit31_set) {
-            state.hw.gpustat |= GPUSTAT_VBLANK;
+            state->hw.gpustat |= GPUSTAT_VBLANK;
         }
     }
 
-    if (state.gpu.scanline == scanline_vblank) {
+    if (state->gpu.scanline == scanline_vblank) {
+        timing::end_frame(state->gpu.frame);
+        mmio::end_frame();
+        timeline::instant("gpu", "vblank", "frame", state->gpu.frame);
         hw::set_i_stat(I_STAT_VBLANK);
         refreshVideoImage();
+        framehash::vblank_event();
+        if (machine()->frame_budget != 0 && !machine()->reexecuting() &&
+            state->gpu.frame >= machine()->frame_budget) {
+            machine()->frame_budget_reached = true;
+            psx::halt("Frame budget reached");
+        }
     }
 
-    state.schedule_event(cpu_clock + delay, hblank_event);
+    state->schedule_event(cpu_clock + delay, hblank_event);
+
+    // The rewind capture must include the next horizontal blank event.
+    if (state->gpu.scanline == scanline_vblank) {
+        rewind::vblank_event();
+    }
 }
 
 };  // psx::hw
@@ -0,0 +1,576 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <psx/debugger.h>
+#include <psx/hle.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+
+using namespace psx;
+
+namespace psx::hle {
+
+/// HLE configuration and kernel state of a machine.
+struct context {
+    bool hle_enabled;
+    std::set<uint32_t> lle_calls;
+    /// TTY output, flushed on new lines.
+    std::string tty_line;
+
+    context() : hle_enabled(false) {}
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+/// Location and size of the kernel tables in RAM. Calls whose table
+/// entry was patched to point outside of the kernel are executed by the
+/// game code.
+static const struct {
+    uint32_t address;
+    uint32_t size;
+} kernel_table_location[3] = {
+    { UINT32_C(0x200), 0xc0 },
+    { UINT32_C(0x874), 0x5e },
+    { UINT32_C(0x674), 0x20 },
+};
+
+/// Location of the seed of the BIOS rand() function in the kernel RAM.
+/// The seed is kept in RAM as by the BIOS, so that it is saved with the
+/// machine state and shared with the BIOS implementation.
+#define RAND_SEED_ADDRESS   UINT32_C(0x9010)
+
+/// Approximate number of instructions executed by the kernel dispatch
+/// stub and the function prologue and epilogue.
+#define CALL_CYCLES         16
+
+static uint32_t call_id(unsigned vector, unsigned function) {
+    return (vector << 8) | function;
+}
+
+/**
+ * @brief Translate the virtual address \p addr to a RAM pointer.
+ * @return NULL if the range [addr, addr+len) is not contained in RAM.
+ */
+static uint8_t *ram_ptr(uint32_t addr, uint32_t len) {
+    uint32_t phys = addr & UINT32_C(0x1fffffff);
+    if (phys >= sizeof(state->ram) || len > sizeof(state->ram) - phys) {
+        return NULL;
+    }
+    // The pointer may be used for writing.
+    state->mark_ram_dirty(phys, len);
+    return state->ram + phys;
+}
+
+/**
+ * @brief Return the length of the null terminated string at \p addr.
+ * @return -1 if the string is not contained in RAM.
+ */
+static int32_t ram_strlen(uint32_t addr) {
+    uint8_t *ptr = ram_ptr(addr, 1);
+    if (ptr == NULL) {
+        return -1;
+    }
+    size_t max_len = state->ram + sizeof(state->ram) - ptr;
+    uint8_t *end = (uint8_t *)memchr(ptr, 0, max_len);
+    return end == NULL ? -1 : end - ptr;
+}
+
+static void tty_putchar(char c) {
+    context *ctx = machine()->hle.get();
+    // The output of re-executed calls was already printed.
+    if (machine()->reexecuting()) {
+        return;
+    }
+    if (c == '\n') {
+        debugger::info(Debugger::CPU, "tty: {}", ctx->tty_line);
+        ctx->tty_line.clear();
+    } else if (c != '\r') {
+        ctx->tty_line += c;
+    }
+}
+
+/**
+ * Implementations of the kernel calls.
+ * Each function reads its arguments from a0-a3, and returns false if
+ * the call must be executed by the BIOS instead. The result is written
+ * to \p ret, the cycle cost to \p cycles.
+ */
+typedef bool (*call_handler)(uint32_t *ret, unsigned *cycles);
+
+#define a0  state->cpu.gpr[4]
+#define a1  state->cpu.gpr[5]
+#define a2  state->cpu.gpr[6]
+#define a3  state->cpu.gpr[7]
+#define sp  state->cpu.gpr[29]
+
+// A(0Eh) abs(val), A(0Fh) labs(val)
+static bool call_abs(uint32_t *ret, unsigned *cycles) {
+    *ret = (int32_t)a0 < 0 ? -a0 : a0;
+    *cycles = 4;
+    return true;
+}
+
+// A(17h) strcmp(str1, str2)
+static bool call_strcmp(uint32_t *ret, unsigned *cycles) {
+    if (a0 == 0 || a1 == 0) {
+        *ret = a0 == a1 ? 0 : a0 == 0 ? -1 : 1;
+        *cycles = 8;
+        return true;
+    }
+    int32_t len1 = ram_strlen(a0);
+    int32_t len2 = ram_strlen(a1);
+    if (len1 < 0 || len2 < 0) {
+        return false;
+    }
+    uint8_t *str1 = ram_ptr(a0, len1 + 1);
+    uint8_t *str2 = ram_ptr(a1, len2 + 1);
+    int32_t nr = 0;
+    while (str1[nr] == str2[nr] && str1[nr] != 0) {
+        nr++;
+    }
+    *ret = (int32_t)str1[nr] - (int32_t)str2[nr];
+    *cycles = 8 + 8 * nr;
+    return true;
+}
+
+// A(18h) strncmp(str1, str2, maxlen)
+static bool call_strncmp(uint32_t *ret, unsigned *cycles) {
+    if (a0 == 0 || a1 == 0) {
+        *ret = a0 == a1 ? 0 : a0 == 0 ? -1 : 1;
+        *cycles = 8;
+        return true;
+    }
+    int32_t len1 = ram_strlen(a0);
+    int32_t len2 = ram_strlen(a1);
+    if (len1 < 0 || len2 < 0) {
+        return false;
+    }
+    uint8_t *str1 = ram_ptr(a0, len1 + 1);
+    uint8_t *str2 = ram_ptr(a1, len2 + 1);
+    int32_t maxlen = a2;
+    int32_t nr = 0;
+    while (nr < maxlen && str1[nr] == str2[nr] && str1[nr] != 0) {
+        nr++;
+    }
+    *ret = nr == maxlen ? 0 : (int32_t)str1[nr] - (int32_t)str2[nr];
+    *cycles = 8 + 9 * nr;
+    return true;
+}
+
+// A(19h) strcpy(dst, src)
+static bool call_strcpy(uint32_t *ret, unsigned *cycles) {
+    if (a0 == 0 || a1 == 0) {
+        *ret = 0;
+        *cycles = 8;
+        return true;
+    }
+    int32_t len = ram_strlen(a1);
+    uint8_t *dst = len < 0 ? NULL : ram_ptr(a0, len + 1);
+    if (dst == NULL) {
+        return false;
+    }
+    memmove(dst, ram_ptr(a1, len + 1), len + 1);
+    *ret = a0;
+    *cycles = 8 + 6 * len;
+    return true;
+}
+
+// A(1Bh) strlen(src)
+static bool call_strlen(uint32_t *ret, unsigned *cycles) {
+    if (a0 == 0) {
+        *ret = 0;
+        *cycles = 4;
+        return true;
+    }
+    int32_t len = ram_strlen(a0);
+    if (len < 0) {
+        return false;
+    }
+    *ret = len;
+    *cycles = 6 + 5 * len;
+    return true;
+}
+
+// A(25h) toupper(char)
+static bool call_toupper(uint32_t *ret, unsigned *cycles) {
+    uint8_t c = a0;
+    *ret = (c >= 'a' && c <= 'z') ? c - 0x20 : c;
+    *cycles = 6;
+    return true;
+}
+
+// A(26h) tolower(char)
+static bool call_tolower(uint32_t *ret, unsigned *cycles) {
+    uint8_t c = a0;
+    *ret = (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+    *cycles = 6;
+    return true;
+}
+
+// A(2Ah) memcpy(dst, src, len)
+static bool call_memcpy(uint32_t *ret, unsigned *cycles) {
+    int32_t len = a2;
+    *cycles = 8;
+    if (a0 == 0 || a1 == 0) {
+        *ret = 0;
+        return true;
+    }
+    if (len <= 0) {
+        *ret = a0;
+        return true;
+    }
+    uint8_t *dst = ram_ptr(a0, len);
+    uint8_t *src = ram_ptr(a1, len);
+    if (dst == NULL || src == NULL) {
+        return false;
+    }
+    // The BIOS copies byte by byte in increasing address order.
+    for (int32_t nr = 0; nr < len; nr++) {
+        dst[nr] = src[nr];
+    }
+    *ret = a0;
+    *cycles += 6 * len;
+    return true;
+}
+
+// A(2Bh) memset(dst, fillbyte, len)
+static bool call_memset(uint32_t *ret, unsigned *cycles) {
+    int32_t len = a2;
+    *cycles = 8;
+    if (a0 == 0) {
+        *ret = 0;
+        return true;
+    }
+    if (len <= 0) {
+        *ret = a0;
+        return true;
+    }
+    uint8_t *dst = ram_ptr(a0, len);
+    if (dst == NULL) {
+        return false;
+    }
+    memset(dst, (uint8_t)a1, len);
+    *ret = a0;
+    *cycles += 5 * len;
+    return true;
+}
+
+// A(2Ch) memmove(dst, src, len)
+static bool call_memmove(uint32_t *ret, unsigned *cycles) {
+    int32_t len = a2;
+    *cycles = 8;
+    if (a0 == 0 || a1 == 0) {
+        *ret = 0;
+        return true;
+    }
+    if (len <= 0) {
+        *ret = a0;
+        return true;
+    }
+    uint8_t *dst = ram_ptr(a0, len);
+    uint8_t *src = ram_ptr(a1, len);
+    if (dst == NULL || src == NULL) {
+        return false;
+    }
+    memmove(dst, src, len);
+    *ret = a0;
+    *cycles += 6 * len;
+    return true;
+}
+
+// A(2Eh) memchr(src, scanbyte, len)
+static bool call_memchr(uint32_t *ret, unsigned *cycles) {
+    int32_t len = a2;
+    *cycles = 8;
+    if (a0 == 0 || len <= 0) {
+        *ret = 0;
+        return true;
+    }
+    uint8_t *src = ram_ptr(a0, len);
+    if (src == NULL) {
+        return false;
+    }
+    uint8_t *pos = (uint8_t *)memchr(src, (uint8_t)a1, len);
+    *ret = pos == NULL ? 0 : a0 + (pos - src);
+    *cycles += 6 * (pos == NULL ? len : pos - src);
+    return true;
+}
+
+// A(2Fh) rand()
+static bool call_rand(uint32_t *ret, unsigned *cycles) {
+    uint8_t *ptr = ram_ptr(RAND_SEED_ADDRESS, 4);
+    uint32_t seed = memory::load_u32_le(ptr) * UINT32_C(0x41c64e6d) +
+        UINT32_C(0x3039);
+    memory::store_u32_le(ptr, seed);
+    *ret = (seed >> 16) & UINT32_C(0x7fff);
+    *cycles = 12;
+    return true;
+}
+
+// A(30h) srand(seed)
+static bool call_srand(uint32_t *ret, unsigned *cycles) {
+    memory::store_u32_le(ram_ptr(RAND_SEED_ADDRESS, 4), a0);
+    *ret = 0;
+    *cycles = 4;
+    return true;
+}
+
+/**
+ * @brief Return the n-th argument of a variadic call. The first four
+ *  arguments are passed in a0-a3, the following on the stack with
+ *  space reserved for the register arguments.
+ */
+static bool read_arg(unsigned nr, uint32_t *val) {
+    static uint32_t const *const regs[4] = {
+        &a0, &a1, &a2, &a3,
+    };
+    if (nr < 4) {
+        *val = *regs[nr];
+        return true;
+    }
+    uint8_t *ptr = ram_ptr(sp + 4 * nr, 4);
+    if (ptr == NULL) {
+        return false;
+    }
+    *val = memory::load_u32_le(ptr);
+    return true;
+}
+
+// A(3Fh) printf(txt, param1, param2, etc.)
+static bool call_printf(uint32_t *ret, unsigned *cycles) {
+    int32_t len = ram_strlen(a0);
+    if (len < 0) {
+        return false;
+    }
+
+    std::string fmt((char const *)ram_ptr(a0, len), len);
+    std::string out;
+    unsigned arg = 1;
+
+    for (size_t pos = 0; pos < fmt.size(); pos++) {
+        if (fmt[pos] != '%') {
+            out += fmt[pos];
+            continue;
+        }
+
+        // Flags, width and precision are forwarded to the host printf.
+        size_t end = fmt.find_first_not_of("-+ #0123456789.l", pos + 1);
+        if (end == std::string::npos) {
+            break;
+        }
+        std::string spec = fmt.substr(pos, end - pos);
+        spec.erase(std::remove(spec.begin(), spec.end(), 'l'), spec.end());
+        char conv = fmt[end];
+        char buf[64];
+        uint32_t val = 0;
+        pos = end;
+
+        if (conv == '%') {
+            out += '%';
+            continue;
+        }
+        if (!read_arg(arg++, &val)) {
+            return false;
+        }
+
+        switch (conv) {
+        case 'd': case 'i':
+            snprintf(buf, sizeof(buf), (spec + "d").c_str(), (int32_t)val);
+            out += buf;
+            break;
+        case 'u': case 'x': case 'X': case 'o': case 'c':
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), val);
+            out += buf;
+            break;
+        case 'p':
+            snprintf(buf, sizeof(buf), "%08x", val);
+            out += buf;
+            break;
+        case 's': {
+            int32_t str_len = ram_strlen(val);
+            if (str_len < 0) {
+                return false;
+            }
+            std::string str((char const *)ram_ptr(val, str_len), str_len);
+            std::vector<char> str_buf(str.size() + 64);
+            snprintf(str_buf.data(), str_buf.size(), (spec + "s").c_str(),
+                str.c_str());
+            out += str_buf.data();
+            break;
+        }
+        default:
+            // Unsupported conversion, let the BIOS handle it.
+            return false;
+        }
+    }
+
+    for (char c : out) {
+        tty_putchar(c);
+    }
+    *ret = out.size();
+    *cycles = 64 + 40 * out.size();
+    return true;
+}
+
+// B(3Dh) std_out_putchar(char)
+static bool call_putchar(uint32_t *ret, unsigned *cycles) {
+    tty_putchar(a0);
+    *ret = a0 & 0xff;
+    *cycles = 40;
+    return true;
+}
+
+// B(3Fh) std_out_puts(src)
+static bool call_puts(uint32_t *ret, unsigned *cycles) {
+    int32_t len = a0 == 0 ? 0 : ram_strlen(a0);
+    if (len < 0) {
+        return false;
+    }
+    uint8_t *str = ram_ptr(a0, len);
+    for (int32_t nr = 0; nr < len; nr++) {
+        tty_putchar(str[nr]);
+    }
+    *ret = 0;
+    *cycles = 16 + 40 * len;
+    return true;
+}
+
+#undef a0
+#undef a1
+#undef a2
+#undef a3
+#undef sp
+
+static const struct {
+    unsigned vector;
+    unsigned function;
+    call_handler handler;
+} call_handlers[] = {
+    { 0, 0x0e, call_abs },
+    { 0, 0x0f, call_abs },
+    { 0, 0x17, call_strcmp },
+    { 0, 0x18, call_strncmp },
+    { 0, 0x19, call_strcpy },
+    { 0, 0x1b, call_strlen },
+    { 0, 0x25, call_toupper },
+    { 0, 0x26, call_tolower },
+    { 0, 0x2a, call_memcpy },
+    { 0, 0x2b, call_memset },
+    { 0, 0x2c, call_memmove },
+    { 0, 0x2e, call_memchr },
+    { 0, 0x2f, call_rand },
+    { 0, 0x30, call_srand },
+    { 0, 0x3f, call_printf },
+    { 1, 0x3d, call_putchar },
+    { 1, 0x3f, call_puts },
+};
+
+static call_handler find_handler(unsigned vector, unsigned function) {
+    for (auto const &entry : call_handlers) {
+        if (entry.vector == vector && entry.function == function) {
+            return entry.handler;
+        }
+    }
+    return NULL;
+}
+
+/// Return true if the kernel table entry for the call points to the
+/// BIOS ROM, or to the kernel area (first 64K of RAM).
+static bool check_kernel_table(unsigned vector, unsigned function) {
+    if (function >= kernel_table_location[vector].size) {
+        return false;
+    }
+    uint32_t entry = memory::load_u32_le(state->ram +
+        kernel_table_location[vector].address + 4 * function);
+    uint32_t phys = entry & UINT32_C(0x1fffffff);
+    return phys < UINT32_C(0x10000) ||
+        (phys >= UINT32_C(0x1fc00000) && phys < UINT32_C(0x1fc80000));
+}
+
+void set_enabled(bool enable) {
+    context *ctx = machine()->hle.get();
+    ctx->hle_enabled = enable;
+}
+
+int set_lle(std::string const &list) {
+    context *ctx = machine()->hle.get();
+    std::stringstream ss(list);
+    std::string item;
+    std::set<uint32_t> calls;
+
+    while (std::getline(ss, item, ',')) {
+        unsigned vector, function;
+        char c;
+        if (sscanf(item.c_str(), " %c0:%x", &c, &function) != 2 ||
+            function > 0xff) {
+            return -1;
+        }
+        switch (toupper(c)) {
+        case 'A': vector = 0; break;
+        case 'B': vector = 1; break;
+        case 'C': vector = 2; break;
+        default:  return -1;
+        }
+        calls.insert(call_id(vector, function));
+    }
+
+    ctx->lle_calls = calls;
+    return 0;
+}
+
+bool enabled(void) {
+    context *ctx = machine()->hle.get();
+    return ctx->hle_enabled;
+}
+
+void reset(void) {
+    context *ctx = machine()->hle.get();
+    ctx->tty_line.clear();
+}
+
+void restore(void) {
+    context *ctx = machine()->hle.get();
+    ctx->tty_line.clear();
+}
+
+bool call(uint32_t vector) {
+    context *ctx = machine()->hle.get();
+    switch (vector & UINT32_C(0x1fffffff)) {
+    case UINT32_C(0xa0): vector = 0; break;
+    case UINT32_C(0xb0): vector = 1; break;
+    case UINT32_C(0xc0): vector = 2; break;
+    default: return false;
+    }
+
+    unsigned function = state->cpu.gpr[9] & 0xff;
+    if (state->cpu.gpr[9] > 0xff ||
+        ctx->lle_calls.count(call_id(vector, function)) > 0) {
+        return false;
+    }
+
+    call_handler handler = find_handler(vector, function);
+    if (handler == NULL || !check_kernel_table(vector, function)) {
+        return false;
+    }
+
+    uint32_t ret;
+    unsigned cycles;
+    if (!handler(&ret, &cycles)) {
+        return false;
+    }
+
+    state->cpu.gpr[2] = ret;
+    state->cycles += CALL_CYCLES + cycles;
+    state->jump_address = state->cpu.gpr[31];
+    return true;
+}
+
+}; /* namespace psx::hle */
@@ -2,7 +2,10 @@
 #include <psx/psx.h>
 #include <psx/hw.h>
 #include <psx/debugger.h>
+#include <psx/input.h>
 #include <psx/memory.h>
+#include <psx/timeline.h>
+#include <psx/timing.h>
 
 using namespace psx;
 
@@ -30,24 +33,6 @@ namespace psx::hw {
 #define JOY_STAT_RX_FIFO_NOT_EMPTY  (UINT32_C(1) << 1)
 #define JOY_STAT_TX_READY_1         (UINT32_C(1) << 0)
 
-void read_joy_stat(uint32_t *val) {
-    *val = state.hw.joy_stat;
-    debugger::info(Debugger::JC, "joy_stat -> {:08x}", *val);
-}
-
-void read_joy_data(uint32_t *val) {
-    // TODO
-    *val = 0;
-    debugger::debug(Debugger::JC, "joy_data -> {:02x}", *val);
-    state.hw.joy_stat &= ~JOY_STAT_RX_FIFO_NOT_EMPTY;
-}
-
-void write_joy_data(uint32_t val) {
-    // TODO
-    debugger::debug(Debugger::JC, "joy_data <- {:02x}", val);
-    state.hw.joy_stat |= JOY_STAT_RX_FIFO_NOT_EMPTY;
-}
-
 //  0     TX Enable (TXEN)  (0=Disable, 1=Enable)
 //  1     /JOYn Output      (0=High, 1=Low/Select) (/JOYn as defined in Bit13)
 //  2     RX Enable (RXEN)  (0=Normal, when /JOYn=Low, 1=Force Enable Once)
@@ -75,70 +60,152 @@ void write_joy_data(uint32_t val) {
 #define JOY_CTRL_JOYN_OUTPUT        (UINT32_C(1) << 1)
 #define JOY_CTRL_TXEN               (UINT32_C(1) << 0)
 
+void read_joy_stat(uint32_t *val) {
+    *val = state->hw.joy_stat;
+    debugger::info(Debugger::JC, "joy_stat -> {:08x}", *val);
+}
+
+void read_joy_data(uint32_t *val) {
+    *val = state->hw.joy_rx_data;
+    debugger::debug(Debugger::JC, "joy_data -> {:02x}", *val);
+    state->hw.joy_stat &= ~JOY_STAT_RX_FIFO_NOT_EMPTY;
+}
+
+/// Delay between the reception of a byte and the /ACK pulse of the pad.
+#define JOY_ACK_DELAY               338
+
+/// Transfer sequence of the digital pad.
+#define JOY_PAD_STEP_ADDRESS        0
+#define JOY_PAD_STEP_COMMAND        1
+#define JOY_PAD_STEP_ID             2
+#define JOY_PAD_STEP_BUTTONS_LO     3
+#define JOY_PAD_STEP_BUTTONS_HI     4
+#define JOY_PAD_STEP_DONE           5
+
+void joy_ack_event() {
+    state->hw.joy_stat |= JOY_STAT_ACK_INPUT_LEVEL;
+    if (state->hw.joy_ctrl & JOY_CTRL_ACK_INT_EN) {
+        state->hw.joy_stat |= JOY_STAT_INT;
+        set_i_stat(I_STAT_CTRL);
+    }
+}
+
+void write_joy_data(uint32_t val) {
+    debugger::debug(Debugger::JC, "joy_data <- {:02x}", val);
+    state->hw.joy_stat |= JOY_STAT_RX_FIFO_NOT_EMPTY;
+    state->hw.joy_stat &= ~JOY_STAT_ACK_INPUT_LEVEL;
+    state->hw.joy_rx_data = 0xff;
+
+    // Only the digital pad in port 1 is connected.
+    if (!(state->hw.joy_ctrl & JOY_CTRL_JOYN_OUTPUT) ||
+        (state->hw.joy_ctrl & JOY_CTRL_JOYN)) {
+        return;
+    }
+
+    bool ack = true;
+    switch (state->hw.joy_pad_step) {
+    case JOY_PAD_STEP_ADDRESS:
+        ack = (val & 0xff) == 0x01;
+        break;
+    case JOY_PAD_STEP_COMMAND:
+        state->hw.joy_rx_data = 0x41;
+        ack = (val & 0xff) == 0x42;
+        break;
+    case JOY_PAD_STEP_ID:
+        state->hw.joy_rx_data = 0x5a;
+        break;
+    case JOY_PAD_STEP_BUTTONS_LO:
+        // Buttons are active low.
+        state->hw.joy_pad_buttons = input::poll_pad();
+        state->hw.joy_rx_data = ~state->hw.joy_pad_buttons;
+        break;
+    case JOY_PAD_STEP_BUTTONS_HI:
+        state->hw.joy_rx_data = ~state->hw.joy_pad_buttons >> 8;
+        ack = false;
+        break;
+    default:
+        ack = false;
+        break;
+    }
+
+    state->hw.joy_pad_step = ack ?
+        state->hw.joy_pad_step + 1 : JOY_PAD_STEP_DONE;
+    if (ack) {
+        state->schedule_event(state->cycles + JOY_ACK_DELAY, joy_ack_event);
+    }
+}
+
 void read_joy_ctrl(uint32_t *val) {
-    *val = state.hw.joy_ctrl;
+    *val = state->hw.joy_ctrl;
     debugger::info(Debugger::JC, "joy_ctrl -> {:02x}", *val);
 }
 
 void write_joy_ctrl(uint16_t val) {
     debugger::info(Debugger::JC, "joy_ctrl <- {:04x}", val);
-    state.hw.joy_ctrl = val;
+    if (val & JOY_CTRL_ACK) {
+        state->hw.joy_stat &= ~(JOY_STAT_INT | JOY_STAT_RX_PARITY_ERROR);
+    }
+    // Deselecting the pad terminates the transfer.
+    if (!(val & JOY_CTRL_JOYN_OUTPUT)) {
+        state->hw.joy_pad_step = JOY_PAD_STEP_ADDRESS;
+    }
+    state->hw.joy_ctrl = val & ~(JOY_CTRL_ACK | JOY_CTRL_RST);
 }
 
 void read_joy_mode(uint32_t *val) {
-    *val = state.hw.joy_mode;
+    *val = state->hw.joy_mode;
     debugger::info(Debugger::JC, "joy_mode -> {:02x}", *val);
 }
 
 void write_joy_mode(uint16_t val) {
     debugger::info(Debugger::JC, "joy_mode <- {:04x}", val);
-    state.hw.joy_mode = val;
+    state->hw.joy_mode = val;
 }
 
 void read_joy_baud(uint32_t *val) {
-    *val = state.hw.joy_baud;
+    *val = state->hw.joy_baud;
     debugger::info(Debugger::JC, "joy_baud -> {:02x}", *val);
 }
 
 void write_joy_baud(uint16_t val) {
     debugger::info(Debugger::JC, "joy_baud <- {:04x}", val);
-    state.hw.joy_baud = val;
+    state->hw.joy_baud = val;
 }
 
 static void check_ip2(void) {
-    bool any_set = (state.hw.i_stat & state.hw.i_mask) != 0;
+    bool any_set = (state->hw.i_stat & state->hw.i_mask) != 0;
     if (any_set) {
-        state.cp0.cause |= CAUSE_IP2;
+        state->cp0.cause |= CAUSE_IP2;
     } else {
-        state.cp0.cause &= ~CAUSE_IP2;
+        state->cp0.cause &= ~CAUSE_IP2;
     }
     check_interrupt();
 }
 
 void set_i_stat(uint32_t irq) {
-    state.hw.i_stat |= irq;
+    state->hw.i_stat |= irq;
     check_ip2();
 }
 
 void read_i_stat(uint32_t *val) {
-    *val = state.hw.i_stat;
+    *val = state->hw.i_stat;
     debugger::debug(Debugger::IC, "i_stat -> {:04x}", *val);
 }
 
 void read_i_mask(uint32_t *val) {
-    *val = state.hw.i_mask;
+    *val = state->hw.i_mask;
     debugger::debug(Debugger::IC, "i_mask -> {:04x}", *val);
 }
 
 void write_i_stat(uint32_t val) {
     debugger::debug(Debugger::IC, "i_stat <- {:04x}", val);
-    state.hw.i_stat &= val;
+    state->hw.i_stat &= val;
     check_ip2();
 }
 
 void write_i_mask(uint32_t val) {
     debugger::debug(Debugger::IC, "i_mask <- {:04x}", val);
-    state.hw.i_mask = val;
+    state->hw.i_mask = val;
     check_ip2();
 }
 
@@ -177,10 +244,6 @@ void write_i_mask(uint32_t val) {
 //  11    Reached Target Value    (0=No, 1=Yes) (Reset after Reading)        (R)
 //  12    Reached FFFFh Value     (0=No, 1=Yes) (Reset after Reading)        (R)
 
-static void timer0_event();
-static void timer1_event();
-static void timer2_event();
-
 static void (*timer_event[3])() = {
     timer0_event,
     timer1_event,
@@ -264,7 +327,7 @@ static void schedule_timer2_event(
             trigger_timer_irq(timer, irq_mode, I_STAT_TMR2);
         }
         if (reset_mode == 1) {
-            timer->counter.clear(state.cycles);
+            timer->counter.clear(state->cycles);
         }
         break;
 
@@ -274,7 +337,7 @@ static void schedule_timer2_event(
             trigger_timer_irq(timer, irq_mode, I_STAT_TMR2);
         }
         if (reset_mode == 0) {
-            timer->counter.clear(state.cycles);
+            timer->counter.clear(state->cycles);
         }
         break;
     }
@@ -283,15 +346,15 @@ static void schedule_timer2_event(
     bool ffff_trigger = reset_mode == 0 || irq_ffff;
 
     uint64_t target_timeout = target_trigger ?
-        timer->counter.timeout(state.cycles, timer->target) : UINT64_MAX;
+        timer->counter.timeout(state->cycles, timer->target) : UINT64_MAX;
     uint64_t ffff_timeout = ffff_trigger ?
-        timer->counter.timeout(state.cycles, 0xffff) : UINT64_MAX;
+        timer->counter.timeout(state->cycles, 0xffff) : UINT64_MAX;
 
     if (target_timeout != UINT64_MAX) {
-        state.schedule_event(target_timeout, timer2_event);
+        state->schedule_event(target_timeout, timer2_event);
         timer->trigger = timer::trigger::TARGET;
     } else if (ffff_timeout != UINT64_MAX) {
-        state.schedule_event(ffff_timeout, timer2_event);
+        state->schedule_event(ffff_timeout, timer2_event);
         timer->trigger = timer::trigger::FFFF;
     } else {
         timer->trigger = timer::trigger::NONE;
@@ -299,40 +362,40 @@ static void schedule_timer2_event(
 }
 
 static void schedule_timer_event(int timer) {
-    bool sync_enable   = state.hw.timer[timer].mode & TIMER_MODE_SYNC_ENABLE;
-    uint8_t sync_mode  = (state.hw.timer[timer].mode >> 1) & 0x3;
-    uint8_t reset_mode = state.hw.timer[timer].mode & TIMER_MODE_RST_TARGET;
+    bool sync_enable   = state->hw.timer[timer].mode & TIMER_MODE_SYNC_ENABLE;
+    uint8_t sync_mode  = (state->hw.timer[timer].mode >> 1) & 0x3;
+    uint8_t reset_mode = state->hw.timer[timer].mode & TIMER_MODE_RST_TARGET;
 
     // Interrupt mode.
     // 6  IRQ Once/Repeat Mode    (0=One-shot, 1=Repeatedly)
     // 7  IRQ Pulse/Toggle Mode   (0=Short Bit10=0 Pulse, 1=Toggle Bit10 on/off)
     timer::irq_mode irq_mode =
-        (state.hw.timer[timer].mode & TIMER_MODE_INT_REPEAT) == 0 ? timer::irq_mode::ONE_SHOT :
-        (state.hw.timer[timer].mode & TIMER_MODE_INT_TOGGLE) == 0 ? timer::irq_mode::PULSE :
+        (state->hw.timer[timer].mode & TIMER_MODE_INT_REPEAT) == 0 ? timer::irq_mode::ONE_SHOT :
+        (state->hw.timer[timer].mode & TIMER_MODE_INT_TOGGLE) == 0 ? timer::irq_mode::PULSE :
                                                                     timer::irq_mode::TOGGLE;
 
     switch (timer) {
-    case 0: schedule_timer0_event(state.hw.timer + 0, sync_enable, sync_mode, reset_mode, irq_mode); break;
-    case 1: schedule_timer1_event(state.hw.timer + 1, sync_enable, sync_mode, reset_mode, irq_mode); break;
-    case 2: schedule_timer2_event(state.hw.timer + 2, sync_enable, sync_mode, reset_mode, irq_mode); break;
+    case 0: schedule_timer0_event(state->hw.timer + 0, sync_enable, sync_mode, reset_mode, irq_mode); break;
+    case 1: schedule_timer1_event(state->hw.timer + 1, sync_enable, sync_mode, reset_mode, irq_mode); break;
+    case 2: schedule_timer2_event(state->hw.timer + 2, sync_enable, sync_mode, reset_mode, irq_mode); break;
     }
 }
 
-static void timer0_event() {
+void timer0_event() {
     schedule_timer_event(0);
 }
 
-static void timer1_event() {
+void timer1_event() {
     schedule_timer_event(1);
 }
 
-static void timer2_event() {
+void timer2_event() {
     debugger::warn(Debugger::Timer, "timer 2 event");
     schedule_timer_event(2);
 }
 
 void read_timer_value(int timer, uint32_t *val) {
-    *val = state.cycles & UINT64_C(0xffff);
+    *val = state->cycles & UINT64_C(0xffff);
     debugger::info(Debugger::Timer, "tim{}_value -> {:04x}",
         timer, *val);
 }
@@ -340,17 +403,17 @@ void read_timer_value(int timer, uint32_t *val) {
 void write_timer_value(int timer, uint16_t val) {
     debugger::info(Debugger::Timer, "tim{}_value <- {:04x}", timer, val);
 
-    switch (state.hw.timer[timer].trigger) {
+    switch (state->hw.timer[timer].trigger) {
     case timer::trigger::HBLANK_START:
     case timer::trigger::VBLANK_START:
     case timer::trigger::TARGET:
     case timer::trigger::FFFF:
-        state.cancel_event(timer_event[timer]);
-        state.hw.timer[timer].trigger = timer::trigger::NONE;
+        state->cancel_event(timer_event[timer]);
+        state->hw.timer[timer].trigger = timer::trigger::NONE;
         [[fallthrough]];
 
     case timer::trigger::NONE:
-        state.hw.timer[timer].counter.write(state.cycles, val);
+        state->hw.timer[timer].counter.write(state->cycles, val);
         schedule_timer_event(timer);
         break;
 
@@ -358,16 +421,16 @@ void write_timer_value(int timer, uint16_t val) {
     // In this case just update the counter value and let the trigger occur.
     case timer::trigger::HBLANK_END:
     case timer::trigger::VBLANK_END:
-        state.hw.timer[timer].counter.write(state.cycles, val);
+        state->hw.timer[timer].counter.write(state->cycles, val);
         break;
     }
 }
 
 void write_timer_mode(int timer, uint16_t val) {
     debugger::info(Debugger::Timer, "tim{}_mode <- {:04x}", timer, val);
-    state.hw.timer[timer].mode &= ~UINT32_C(0x3ff);
-    state.hw.timer[timer].mode |= val & UINT32_C(0x3ff);
-    state.hw.timer[timer].mode |= TIMER_MODE_INT_ENABLE;
+    state->hw.timer[timer].mode &= ~UINT32_C(0x3ff);
+    state->hw.timer[timer].mode |= val & UINT32_C(0x3ff);
+    state->hw.timer[timer].mode |= TIMER_MODE_INT_ENABLE;
 
     // Clock Source (0-3, see list below)
     //   Counter 0:  0 or 2 = System Clock,  1 or 3 = Dotclock
@@ -396,26 +459,26 @@ void write_timer_mode(int timer, uint16_t val) {
         break;
     }
 
-    state.cancel_event(timer_event[timer]);
-    state.hw.timer[timer].trigger = timer::trigger::NONE;
-    state.hw.timer[timer].counter.configure(cpu_clock, multiplier);
+    state->cancel_event(timer_event[timer]);
+    state->hw.timer[timer].trigger = timer::trigger::NONE;
+    state->hw.timer[timer].counter.configure(cpu_clock, multiplier);
     schedule_timer_event(timer);
 }
 
 void write_timer_target(int timer, uint16_t val) {
     debugger::info(Debugger::Timer, "tim{}_target <- {:04x}", timer, val);
 
-    switch (state.hw.timer[timer].trigger) {
+    switch (state->hw.timer[timer].trigger) {
     case timer::trigger::HBLANK_START:
     case timer::trigger::VBLANK_START:
     case timer::trigger::TARGET:
     case timer::trigger::FFFF:
-        state.cancel_event(timer_event[timer]);
-        state.hw.timer[timer].trigger = timer::trigger::NONE;
+        state->cancel_event(timer_event[timer]);
+        state->hw.timer[timer].trigger = timer::trigger::NONE;
         [[fallthrough]];
 
     case timer::trigger::NONE:
-        state.hw.timer[timer].target = val;
+        state->hw.timer[timer].target = val;
         schedule_timer_event(timer);
         break;
 
@@ -423,7 +486,7 @@ void write_timer_target(int timer, uint16_t val) {
     // In this case just update the target and let the trigger occur.
     case timer::trigger::HBLANK_END:
     case timer::trigger::VBLANK_END:
-        state.hw.timer[timer].target = val;
+        state->hw.timer[timer].target = val;
         break;
     }
 }
@@ -458,17 +521,17 @@ void write_timer_target(int timer, uint16_t val) {
 #define DICR_IRQ_MASTER_FLAG    (UINT32_C(1) << 31)
 
 static void check_dicr_irq_master_flag() {
-    uint32_t irq_enable = (state.hw.dicr >> 16) & UINT32_C(0x7f);
-    uint32_t irq_flag = (state.hw.dicr >> 24) & UINT32_C(0x7f);
-    bool set_before = (state.hw.dicr & DICR_IRQ_MASTER_FLAG) != 0;
+    uint32_t irq_enable = (state->hw.dicr >> 16) & UINT32_C(0x7f);
+    uint32_t irq_flag = (state->hw.dicr >> 24) & UINT32_C(0x7f);
+    bool set_before = (state->hw.dicr & DICR_IRQ_MASTER_FLAG) != 0;
     bool set =
-        (state.hw.dicr & DICR_FORCE_IRQ) != 0 ||
-       ((state.hw.dicr & DICR_IRQ_MASTER_ENABLE) != 0 &&
+        (state->hw.dicr & DICR_FORCE_IRQ) != 0 ||
+       ((state->hw.dicr & DICR_IRQ_MASTER_ENABLE) != 0 &&
         (irq_enable & irq_flag) != 0);
     if (set) {
-        state.hw.dicr |= DICR_IRQ_MASTER_FLAG;
+        state->hw.dicr |= DICR_IRQ_MASTER_FLAG;
     } else {
-        state.hw.dicr &= ~DICR_IRQ_MASTER_FLAG;
+        state->hw.dicr &= ~DICR_IRQ_MASTER_FLAG;
     }
 
     if (set && !set_before) {
@@ -477,25 +540,25 @@ static void check_dicr_irq_master_flag() {
 }
 
 void read_dpcr(uint32_t *val) {
-    *val = state.hw.dpcr;
+    *val = state->hw.dpcr;
     debugger::debug(Debugger::DMA, "dpcr -> {:08x}", *val);
 }
 
 void write_dpcr(uint32_t val) {
     debugger::debug(Debugger::DMA, "dpcr <- {:08x}", val);
-    state.hw.dpcr = val;
+    state->hw.dpcr = val;
 }
 
 void read_dicr(uint32_t *val) {
-    *val = state.hw.dicr;
+    *val = state->hw.dicr;
     debugger::debug(Debugger::DMA, "dicr -> {:08x}", *val);
 }
 
 void write_dicr(uint32_t val) {
     debugger::debug(Debugger::DMA, "dicr <- {:08x}", val);
-    state.hw.dicr &= ~UINT32_C(0xff0000);
-    state.hw.dicr |=   val & UINT32_C(0x00ff0000);
-    state.hw.dicr &= ~(val & UINT32_C(0x7f000000));
+    state->hw.dicr &= ~UINT32_C(0xff0000);
+    state->hw.dicr |=   val & UINT32_C(0x00ff0000);
+    state->hw.dicr &= ~(val & UINT32_C(0x7f000000));
     check_dicr_irq_master_flag();
 }
 
@@ -527,39 +590,41 @@ void write_dicr(uint32_t val) {
 #define DX_CHCR_DIRECTION               (UINT32_C(1) << 0)
 
 void read_dx_madr(int channel, uint32_t *val) {
-    *val = state.hw.dma[channel].madr;
+    *val = state->hw.dma[channel].madr;
     debugger::debug(Debugger::DMA, "d{}_madr -> {:08x}", channel, *val);
 }
 
 void write_dx_madr(int channel, uint32_t val) {
     debugger::debug(Debugger::DMA, "d{}_madr <- {:08x}", channel, val);
-    state.hw.dma[channel].madr = val & UINT32_C(0x00ffffff);
+    state->hw.dma[channel].madr = val & UINT32_C(0x00ffffff);
 }
 
 void write_dx_bcr(int channel, uint32_t val) {
     debugger::debug(Debugger::DMA, "d{}_bcr <- {:08x}", channel, val);
-    state.hw.dma[channel].bcr = val;
+    state->hw.dma[channel].bcr = val;
 }
 
 void read_dx_chcr(int channel, uint32_t *val) {
-    *val = state.hw.dma[channel].chcr;
+    *val = state->hw.dma[channel].chcr;
     debugger::debug(Debugger::DMA, "d{}_chcr -> {:08x}", channel, *val);
 }
 
 void write_d2_chcr(uint32_t val) {
     debugger::debug(Debugger::DMA, "d2_chcr <- {:08x}", val);
-    state.hw.dma[2].chcr = val;
+    timing::scope scope(timing::DMA);
+    timeline::span span("dma", "dma2");
+    state->hw.dma[2].chcr = val;
 
     bool started = (val & DX_CHCR_BUSY) != 0;
-    bool master_enabled = (state.hw.dpcr >> 11) & UINT32_C(1);
+    bool master_enabled = (state->hw.dpcr >> 11) & UINT32_C(1);
 
     if (!(started && master_enabled)) {
         return;
     }
 
-    uint32_t bcr = state.hw.dma[2].bcr;
-    uint32_t chcr = state.hw.dma[2].chcr;
-    uint32_t addr = state.hw.dma[2].madr & UINT32_C(0xfffffc);
+    uint32_t bcr = state->hw.dma[2].bcr;
+    uint32_t chcr = state->hw.dma[2].chcr;
+    uint32_t addr = state->hw.dma[2].madr & UINT32_C(0xfffffc);
     bool from_ram = (chcr & DX_CHCR_DIRECTION) != 0;
     uint32_t sync_mode = (chcr >> 9) & UINT32_C(0x3);
 
@@ -594,17 +659,18 @@ void write_d2_chcr(uint32_t val) {
         for (uint32_t offset = 0; offset < total_len; offset += 4) {
             if (from_ram) {
                 hw::write_gpu0(psx::memory::load_u32_le(
-                    state.ram + addr + offset));
+                    state->ram + addr + offset));
             }
             else {
                 uint32_t val;
                 hw::read_gpuread(&val);
-                memory::store_u32_le(state.ram + addr + offset, val);
+                memory::store_u32_le(state->ram + addr + offset, val);
+                state->mark_ram_dirty(addr + offset);
             }
         }
 
         // Address is updated after block transfer.
-        state.hw.dma[2].madr = addr + total_len;
+        state->hw.dma[2].madr = addr + total_len;
     }
     else if (sync_mode == 2) {
         // Linked-List mode.
@@ -615,7 +681,7 @@ void write_d2_chcr(uint32_t val) {
         // Expected for transfer of Ordering Tables from CPU to GPU0.
         // DMA direction should be from RAM to GPU0.
 
-        if (!from_ram || state.gpu.dma_direction != UINT8_C(2)) {
+        if (!from_ram || state->gpu.dma_direction != UINT8_C(2)) {
             psx::halt("unsupported GPU DMA direction in sync mode 0");
             return;
         }
@@ -626,12 +692,12 @@ void write_d2_chcr(uint32_t val) {
                 return;
             }
 
-            uint32_t entry = memory::load_u32_le(state.ram + addr);
+            uint32_t entry = memory::load_u32_le(state->ram + addr);
             uint32_t nr_words = (entry >> 24) & UINT32_C(0xff);
 
             for (unsigned nr = 0; nr < nr_words; nr++) {
                 uint32_t val = psx::memory::load_u32_le(
-                    state.ram + addr + 4 + nr * 4);
+                    state->ram + addr + 4 + nr * 4);
                 hw::write_gpu0(val);
             }
 
@@ -643,19 +709,85 @@ void write_d2_chcr(uint32_t val) {
     }
 
     // Clear busy and start bits in CHCR register, set DMA flag.
-    state.hw.dma[2].chcr &= ~(DX_CHCR_START | DX_CHCR_BUSY);
-    if ((state.hw.dicr & DICR_IRQ_ENABLE(2)) != 0) {
-        state.hw.dicr |= DICR_IRQ_FLAG(2);
+    state->hw.dma[2].chcr &= ~(DX_CHCR_START | DX_CHCR_BUSY);
+    if ((state->hw.dicr & DICR_IRQ_ENABLE(2)) != 0) {
+        state->hw.dicr |= DICR_IRQ_FLAG(2);
+        check_dicr_irq_master_flag();
+    }
+}
+
+void write_d3_chcr(uint32_t val) {
+    debugger::debug(Debugger::DMA, "d3_chcr <- {:08x}", val);
+    timing::scope scope(timing::DMA);
+    timeline::span span("dma", "dma3");
+    state->hw.dma[3].chcr = val;
+
+    bool started = (val & DX_CHCR_BUSY) != 0;
+    bool master_enabled = (state->hw.dpcr >> 15) & UINT32_C(1);
+
+    if (!(started && master_enabled)) {
+        return;
+    }
+
+    uint32_t bcr = state->hw.dma[3].bcr;
+    uint32_t chcr = state->hw.dma[3].chcr;
+    uint32_t addr = state->hw.dma[3].madr & UINT32_C(0xfffffc);
+    bool from_ram = (chcr & DX_CHCR_DIRECTION) != 0;
+    uint32_t sync_mode = (chcr >> 9) & UINT32_C(0x3);
+    uint32_t nr_words;
+
+    debugger::info(Debugger::DMA, "CDROM DMA");
+    debugger::info(Debugger::DMA, "  address: {:08x}", addr);
+    debugger::info(Debugger::DMA, "  sync_mode: {}", sync_mode);
+
+    if (from_ram) {
+        psx::halt("unsupported CDROM DMA direction");
+        return;
+    }
+
+    if (sync_mode == 0) {
+        // The BCR register holds the number of words, 0 means 0x10000.
+        nr_words = bcr & UINT32_C(0xffff);
+        nr_words = nr_words ? nr_words : UINT32_C(0x10000);
+    } else if (sync_mode == 1) {
+        nr_words = (bcr & UINT32_C(0xffff)) * (bcr >> 16);
+    } else {
+        psx::halt("unsupported CDROM DMA sync mode");
+        return;
+    }
+
+    debugger::info(Debugger::DMA, "  nr_words: {}", nr_words);
+
+    if ((uint64_t)addr + (uint64_t)nr_words * 4 > UINT64_C(0x200000)) {
+        psx::halt("invalid CDROM DMA address");
+        return;
+    }
+
+    // The sector is already resident in the data fifo,
+    // the transfer is a single bulk copy.
+    hw::read_cdrom_data(state->ram + addr, nr_words * 4);
+    state->mark_ram_dirty(addr, nr_words * 4);
+
+    if (sync_mode == 1) {
+        state->hw.dma[3].madr = addr + nr_words * 4;
+    }
+
+    // Clear busy and start bits in CHCR register, set DMA flag.
+    state->hw.dma[3].chcr &= ~(DX_CHCR_START | DX_CHCR_BUSY);
+    if ((state->hw.dicr & DICR_IRQ_ENABLE(3)) != 0) {
+        state->hw.dicr |= DICR_IRQ_FLAG(3);
         check_dicr_irq_master_flag();
     }
 }
 
 void write_d6_chcr(uint32_t val) {
     debugger::debug(Debugger::DMA, "d6_chcr <- {:08x}", val);
-    state.hw.dma[6].chcr = (val & UINT32_C(0x51000000)) | UINT32_C(0x2);
+    timing::scope scope(timing::DMA);
+    timeline::span span("dma", "dma6");
+    state->hw.dma[6].chcr = (val & UINT32_C(0x51000000)) | UINT32_C(0x2);
 
     bool started = (val & DX_CHCR_START) != 0;
-    bool master_enabled = (state.hw.dpcr >> 27) & UINT32_C(1);
+    bool master_enabled = (state->hw.dpcr >> 27) & UINT32_C(1);
 
     if (!(started && master_enabled)) {
         return;
@@ -664,9 +796,9 @@ void write_d6_chcr(uint32_t val) {
     // Direction is always from GPU to RAM;
     // step is always backward,
     // sync mode is always 0.
-    uint32_t bcr = state.hw.dma[6].bcr;
+    uint32_t bcr = state->hw.dma[6].bcr;
     uint32_t nr_words = bcr & UINT32_C(0xffff);
-    uint32_t start_addr = state.hw.dma[6].madr;
+    uint32_t start_addr = state->hw.dma[6].madr;
     uint32_t end_addr = start_addr - (nr_words * 4);
 
     debugger::info(Debugger::DMA, "OTC DMA");
@@ -684,36 +816,43 @@ void write_d6_chcr(uint32_t val) {
 
     // Build the linked list.
     if (nr_words > 0) {
-        memory::store_u32_le(state.ram + start_addr, UINT32_C(0x00ffffff));
+        state->mark_ram_dirty(end_addr + 4, nr_words * 4);
+        memory::store_u32_le(state->ram + start_addr, UINT32_C(0x00ffffff));
         start_addr -= 4;
         for (unsigned nr = 1; nr < nr_words; nr++, start_addr -= 4) {
             memory::store_u32_le(
-                state.ram + start_addr,
+                state->ram + start_addr,
                 (start_addr + 4) & UINT32_C(0x00ffffff));
         }
     }
 
     // Clear busy and start bits in CHCR register, set DMA flag.
-    state.hw.dma[6].chcr &= ~(DX_CHCR_START | DX_CHCR_BUSY);
-    if ((state.hw.dicr & DICR_IRQ_ENABLE(6)) != 0) {
-        state.hw.dicr |= DICR_IRQ_FLAG(6);
+    state->hw.dma[6].chcr &= ~(DX_CHCR_START | DX_CHCR_BUSY);
+    if ((state->hw.dicr & DICR_IRQ_ENABLE(6)) != 0) {
+        state->hw.dicr |= DICR_IRQ_FLAG(6);
         check_dicr_irq_master_flag();
     }
 }
 
+static char const *dma_channel_names[7] = {
+    "dma0", "dma1", "dma2", "dma3", "dma4", "dma5", "dma6",
+};
+
 void write_dx_chcr(int channel, uint32_t val) {
     debugger::debug(Debugger::DMA, "d{}_chcr <- {:08x}", channel, val);
-    state.hw.dma[channel].chcr = val;
+    timing::scope scope(timing::DMA);
+    timeline::span span("dma", dma_channel_names[channel]);
+    state->hw.dma[channel].chcr = val;
 
     bool started = (val & DX_CHCR_BUSY) != 0;
-    bool master_enabled = (state.hw.dpcr >> (channel * 4 + 3)) & UINT32_C(1);
+    bool master_enabled = (state->hw.dpcr >> (channel * 4 + 3)) & UINT32_C(1);
 
     if (!(started && master_enabled)) {
         return;
     }
 
-    uint32_t madr = state.hw.dma[channel].madr;
-    uint32_t chcr = state.hw.dma[channel].chcr;
+    uint32_t madr = state->hw.dma[channel].madr;
+    uint32_t chcr = state->hw.dma[channel].chcr;
     bool from_ram = (chcr & DX_CHCR_DIRECTION) != 0;
     uint32_t sync_mode = (chcr >> 9) & UINT32_C(0x3);
 
@@ -0,0 +1,317 @@
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include <unistd.h>
+
+#include <lib/xxhash.h>
+#include <psx/debugger.h>
+#include <psx/framehash.h>
+#include <psx/input.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+
+using namespace psx;
+
+namespace psx::input {
+
+#define HEADER_SIZE             16
+
+#define RECORD_POLL             0
+#define RECORD_POLL_BUTTONS     1
+#define RECORD_END              2
+
+/// Input state of a machine.
+struct context {
+    /// Live button state, written from the frontend threads.
+    std::atomic<uint16_t> buttons;
+    /// Buttons latched at the previous poll.
+    uint16_t last_buttons;
+    /// Cycle of the previous record.
+    uint64_t last_cycles;
+    /// Cycle of the most recent live poll; polls up to this cycle are
+    /// re-executed after a rewind, and read the history.
+    uint64_t live_cycles;
+    /// Button changes of the live polls, as (cycle, buttons).
+    std::vector<std::pair<uint64_t, uint16_t>> history;
+
+    FILE *record_file;
+
+    /// Replayed log, empty when not replaying.
+    std::vector<uint8_t> replay_log;
+    size_t replay_offset;
+    size_t replay_end_offset;
+    uint64_t replay_end_cycles;
+    uint32_t replay_end_frame;
+    uint64_t replay_end_hash;
+    struct replay_stats stats;
+
+    context()
+        : buttons(0), last_buttons(0), last_cycles(0), live_cycles(0),
+          record_file(NULL),
+          replay_offset(0), replay_end_offset(0), replay_end_cycles(0),
+          replay_end_frame(0), replay_end_hash(0), stats() {}
+    ~context() {
+        if (record_file != NULL) {
+            fclose(record_file);
+        }
+    }
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+static void put_varint(FILE *file, uint64_t val) {
+    uint8_t buffer[10];
+    size_t len = 0;
+    do {
+        buffer[len] = val & 0x7f;
+        val >>= 7;
+        buffer[len++] |= val != 0 ? 0x80 : 0;
+    } while (val != 0);
+    fwrite(buffer, len, 1, file);
+}
+
+static bool get_varint(std::vector<uint8_t> const &log, size_t *offset,
+                       uint64_t *val) {
+    *val = 0;
+    for (unsigned shift = 0; shift < 64 && *offset < log.size(); shift += 7) {
+        uint8_t byte = log[(*offset)++];
+        *val |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t bios_hash(void) {
+    return xxh64::hash(state->bios, BIOS_SIZE);
+}
+
+void set_pad_buttons(uint16_t buttons, bool pressed) {
+    context *ctx = machine()->input.get();
+    if (pressed) {
+        ctx->buttons.fetch_or(buttons, std::memory_order_relaxed);
+    } else {
+        ctx->buttons.fetch_and(~buttons, std::memory_order_relaxed);
+    }
+}
+
+static void divergence(context *ctx, uint64_t expected_cycles) {
+    if (ctx->stats.divergences++ == 0) {
+        debugger::warn(Debugger::JC,
+            "replay: pad poll at cycle {} diverges from the recording "
+            "(cycle {})", state->cycles, expected_cycles);
+    }
+}
+
+static uint16_t replay_poll(context *ctx) {
+    size_t offset = ctx->replay_offset;
+    uint16_t buttons = ctx->last_buttons;
+    uint64_t val;
+
+    ctx->stats.polls++;
+    get_varint(ctx->replay_log, &offset, &val);
+    if ((val & 3) == RECORD_END) {
+        // Extra poll past the recorded ones.
+        divergence(ctx, ctx->replay_end_cycles);
+        return buttons;
+    }
+
+    ctx->last_cycles += val >> 2;
+    if (ctx->last_cycles != state->cycles) {
+        divergence(ctx, ctx->last_cycles);
+    }
+    if ((val & 3) == RECORD_POLL_BUTTONS) {
+        buttons = memory::load_u16_le(ctx->replay_log.data() + offset);
+        offset += 2;
+    }
+    ctx->replay_offset = offset;
+    return buttons;
+}
+
+static uint16_t history_poll(context *ctx) {
+    auto it = std::upper_bound(ctx->history.begin(), ctx->history.end(),
+        std::pair<uint64_t, uint16_t>(state->cycles, UINT16_MAX));
+    return it == ctx->history.begin() ? 0 : std::prev(it)->second;
+}
+
+uint16_t poll_pad(void) {
+    context *ctx = machine()->input.get();
+    if (state->cycles <= ctx->live_cycles) {
+        return history_poll(ctx);
+    }
+
+    // Replayed polls are kept in the history as well, the replay
+    // cursor only moves forward.
+    uint16_t buttons = ctx->replay_log.empty() ?
+        ctx->buttons.load(std::memory_order_relaxed) : replay_poll(ctx);
+    bool changed = buttons != ctx->last_buttons;
+    if (changed) {
+        ctx->history.push_back({ state->cycles, buttons });
+    }
+    if (ctx->record_file != NULL) {
+        put_varint(ctx->record_file,
+            ((state->cycles - ctx->last_cycles) << 2) |
+            (changed ? RECORD_POLL_BUTTONS : RECORD_POLL));
+        if (changed) {
+            uint8_t buffer[2];
+            memory::store_u16_le(buffer, buttons);
+            fwrite(buffer, sizeof(buffer), 1, ctx->record_file);
+        }
+        ctx->last_cycles = state->cycles;
+    }
+    ctx->live_cycles = state->cycles;
+    ctx->last_buttons = buttons;
+    return buttons;
+}
+
+int record(std::string const &path) {
+    context *ctx = machine()->input.get();
+    close();
+    ctx->record_file = fopen(path.c_str(), "wb");
+    if (ctx->record_file == NULL) {
+        return -1;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    uint64_t bios = bios_hash();
+    memory::store_u32_le(header + 0, INPUT_MAGIC);
+    memory::store_u32_le(header + 4, INPUT_VERSION);
+    memory::store_u32_le(header + 8, bios);
+    memory::store_u32_le(header + 12, bios >> 32);
+    fwrite(header, sizeof(header), 1, ctx->record_file);
+    return 0;
+}
+
+int replay(std::string const &path) {
+    context *ctx = machine()->input.get();
+    close();
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    std::vector<uint8_t> log;
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        log.insert(log.end(), buffer, buffer + len);
+    }
+    fclose(file);
+
+    if (log.size() < HEADER_SIZE ||
+        memory::load_u32_le(log.data() + 0) != INPUT_MAGIC ||
+        memory::load_u32_le(log.data() + 4) != INPUT_VERSION) {
+        return -1;
+    }
+
+    // Locate the end record; the log is rejected if truncated.
+    size_t offset = HEADER_SIZE;
+    uint64_t cycles = 0;
+    for (;;) {
+        size_t record_offset = offset;
+        uint64_t val;
+        if (!get_varint(log, &offset, &val)) {
+            return -1;
+        }
+        cycles += val >> 2;
+        if ((val & 3) == RECORD_POLL_BUTTONS) {
+            offset += 2;
+        } else if ((val & 3) == RECORD_END) {
+            if (offset + 12 > log.size()) {
+                return -1;
+            }
+            ctx->replay_end_offset = record_offset;
+            ctx->replay_end_cycles = cycles;
+            ctx->replay_end_frame = memory::load_u32_le(log.data() + offset);
+            ctx->replay_end_hash =
+                memory::load_u32_le(log.data() + offset + 4) |
+                ((uint64_t)memory::load_u32_le(log.data() + offset + 8) << 32);
+            break;
+        } else if ((val & 3) != RECORD_POLL) {
+            return -1;
+        }
+        if (offset > log.size()) {
+            return -1;
+        }
+    }
+
+    uint64_t bios = memory::load_u32_le(log.data() + 8) |
+        ((uint64_t)memory::load_u32_le(log.data() + 12) << 32);
+    if (bios != bios_hash()) {
+        debugger::warn(Debugger::JC,
+            "replay: '{}' was recorded with a different BIOS", path);
+    }
+
+    ctx->replay_log = std::move(log);
+    return 0;
+}
+
+void close(void) {
+    context *ctx = machine()->input.get();
+    if (ctx->record_file != NULL) {
+        uint8_t buffer[12];
+        uint64_t display = framehash::display_hash();
+        put_varint(ctx->record_file,
+            ((state->cycles - ctx->last_cycles) << 2) | RECORD_END);
+        memory::store_u32_le(buffer + 0, state->gpu.frame);
+        memory::store_u32_le(buffer + 4, display);
+        memory::store_u32_le(buffer + 8, display >> 32);
+        fwrite(buffer, sizeof(buffer), 1, ctx->record_file);
+        fclose(ctx->record_file);
+        ctx->record_file = NULL;
+    }
+    ctx->replay_log.clear();
+}
+
+void reset(void) {
+    context *ctx = machine()->input.get();
+    ctx->last_buttons = 0;
+    ctx->last_cycles = 0;
+    ctx->live_cycles = 0;
+    ctx->history.clear();
+
+    // The recording restarts from the reset.
+    if (ctx->record_file != NULL) {
+        fflush(ctx->record_file);
+        if (ftruncate(fileno(ctx->record_file), HEADER_SIZE) != 0) {
+            debugger::warn(Debugger::JC, "cannot restart the recording");
+        }
+        fseek(ctx->record_file, HEADER_SIZE, SEEK_SET);
+    }
+    if (!ctx->replay_log.empty()) {
+        ctx->replay_offset = HEADER_SIZE;
+        ctx->stats = {};
+        state->cancel_event(replay_end_event);
+        state->schedule_event(ctx->replay_end_cycles, replay_end_event);
+    }
+}
+
+void replay_end_event(void) {
+    context *ctx = machine()->input.get();
+    // The event is restored with the rewind captures taken before it,
+    // the end is only reported once.
+    if (ctx->stats.complete) {
+        return;
+    }
+    ctx->stats.complete = true;
+    // Recorded polls that were not replayed are divergences as well.
+    if (ctx->replay_offset != ctx->replay_end_offset) {
+        divergence(ctx, ctx->replay_end_cycles);
+    }
+    ctx->stats.matched = ctx->stats.divergences == 0 &&
+        state->gpu.frame == ctx->replay_end_frame &&
+        framehash::display_hash() == ctx->replay_end_hash;
+    psx::halt(ctx->stats.matched ? "Replay complete" : "Replay diverged");
+}
+
+struct replay_stats replay_stats(void) {
+    return machine()->input.get()->stats;
+}
+
+}; /* namespace psx::input */
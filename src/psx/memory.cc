@@ -3,6 +3,7 @@
 
 #include <psx/debugger.h>
 #include <psx/memory.h>
+#include <psx/mmio.h>
 #include <psx/psx.h>
 #include <psx/hw.h>
 
@@ -35,6 +36,7 @@ static bool load_u8_(uint32_t addr, uint32_t *val) {
     // CDROM Controller I/O Ports
     case UINT32_C(0x1f801800): hw::read_cdrom_index(val); break;
     case UINT32_C(0x1f801801): hw::read_cdrom_reg01(val); break;
+    case UINT32_C(0x1f801802): hw::read_cdrom_reg02(val); break;
     case UINT32_C(0x1f801803): hw::read_cdrom_reg03(val); break;
 
     // Controller and Memory Card I/O Ports
@@ -51,6 +53,9 @@ static bool load_u8_(uint32_t addr, uint32_t *val) {
 
 static bool load_u16_(uint32_t addr, uint32_t *val) {
     switch (addr) {
+    // CDROM Controller I/O Ports
+    case UINT32_C(0x1f801802):  hw::read_cdrom_reg02_u16(val); break;
+
     // Controller and Memory Card I/O Ports
     case UINT32_C(0x1f801044):  hw::read_joy_stat(val); break;
     case UINT32_C(0x1f801048):  hw::read_joy_mode(val); break;
@@ -65,30 +70,30 @@ static bool load_u16_(uint32_t addr, uint32_t *val) {
     case UINT32_C(0x1f801120):  hw::read_timer_value(2, val); break;
 
     // SPU Control
-    case UINT32_C(0x1f801d80):  *val = state.hw.main_volume_left; break;
-    case UINT32_C(0x1f801d82):  *val = state.hw.main_volume_right; break;
-    case UINT32_C(0x1f801d84):  *val = state.hw.main_volume_left; break;
-    case UINT32_C(0x1f801d86):  *val = state.hw.main_volume_right; break;
-    case UINT32_C(0x1f801d88):  *val = state.hw.voice_key_on; break; // TODO lo
-    case UINT32_C(0x1f801d8a):  *val = state.hw.voice_key_on; break; // TODO hi
-    case UINT32_C(0x1f801d8c):  *val = state.hw.voice_key_off; break; // TODO lo
-    case UINT32_C(0x1f801d8e):  *val = state.hw.voice_key_off; break; // TODO hi
-    case UINT32_C(0x1f801d90):  *val = state.hw.voice_channel_fm; break; // TODO lo
-    case UINT32_C(0x1f801d92):  *val = state.hw.voice_channel_fm; break; // TODO hi
-    case UINT32_C(0x1f801d94):  *val = state.hw.voice_channel_noise_mode; break; // TODO lo
-    case UINT32_C(0x1f801d96):  *val = state.hw.voice_channel_noise_mode; break; // TODO hi
-    case UINT32_C(0x1f801d98):  *val = state.hw.voice_channel_reverb_mode; break; // TODO lo
-    case UINT32_C(0x1f801d9a):  *val = state.hw.voice_channel_reverb_mode; break; // TODO hi
-    case UINT32_C(0x1f801da2):  *val = state.hw.sound_ram_reverb_start_addr; break;
-    case UINT32_C(0x1f801da6):  *val = state.hw.sound_ram_data_transfer_addr; break;
-    case UINT32_C(0x1f801da8):  *val = state.hw.sound_ram_data_transfer_fifo; break;
-    case UINT32_C(0x1f801daa):  *val = state.hw.spu_control; break;
-    case UINT32_C(0x1f801dac):  *val = state.hw.sound_ram_data_transfer_control; break;
-    case UINT32_C(0x1f801dae):  *val = state.hw.spu_status; break;
-    case UINT32_C(0x1f801db0):  *val = state.hw.cd_volume_left; break;
-    case UINT32_C(0x1f801db2):  *val = state.hw.cd_volume_right; break;
-    case UINT32_C(0x1f801db4):  *val = state.hw.extern_volume_left; break;
-    case UINT32_C(0x1f801db6):  *val = state.hw.extern_volume_right; break;
+    case UINT32_C(0x1f801d80):  *val = state->hw.main_volume_left; break;
+    case UINT32_C(0x1f801d82):  *val = state->hw.main_volume_right; break;
+    case UINT32_C(0x1f801d84):  *val = state->hw.main_volume_left; break;
+    case UINT32_C(0x1f801d86):  *val = state->hw.main_volume_right; break;
+    case UINT32_C(0x1f801d88):  *val = state->hw.voice_key_on; break; // TODO lo
+    case UINT32_C(0x1f801d8a):  *val = state->hw.voice_key_on; break; // TODO hi
+    case UINT32_C(0x1f801d8c):  *val = state->hw.voice_key_off; break; // TODO lo
+    case UINT32_C(0x1f801d8e):  *val = state->hw.voice_key_off; break; // TODO hi
+    case UINT32_C(0x1f801d90):  *val = state->hw.voice_channel_fm; break; // TODO lo
+    case UINT32_C(0x1f801d92):  *val = state->hw.voice_channel_fm; break; // TODO hi
+    case UINT32_C(0x1f801d94):  *val = state->hw.voice_channel_noise_mode; break; // TODO lo
+    case UINT32_C(0x1f801d96):  *val = state->hw.voice_channel_noise_mode; break; // TODO hi
+    case UINT32_C(0x1f801d98):  *val = state->hw.voice_channel_reverb_mode; break; // TODO lo
+    case UINT32_C(0x1f801d9a):  *val = state->hw.voice_channel_reverb_mode; break; // TODO hi
+    case UINT32_C(0x1f801da2):  *val = state->hw.sound_ram_reverb_start_addr; break;
+    case UINT32_C(0x1f801da6):  *val = state->hw.sound_ram_data_transfer_addr; break;
+    case UINT32_C(0x1f801da8):  *val = state->hw.sound_ram_data_transfer_fifo; break;
+    case UINT32_C(0x1f801daa):  *val = state->hw.spu_control; break;
+    case UINT32_C(0x1f801dac):  *val = state->hw.sound_ram_data_transfer_control; break;
+    case UINT32_C(0x1f801dae):  *val = state->hw.spu_status; break;
+    case UINT32_C(0x1f801db0):  *val = state->hw.cd_volume_left; break;
+    case UINT32_C(0x1f801db2):  *val = state->hw.cd_volume_right; break;
+    case UINT32_C(0x1f801db4):  *val = state->hw.extern_volume_left; break;
+    case UINT32_C(0x1f801db6):  *val = state->hw.extern_volume_right; break;
 
     default:
         std::string reason = fmt::format("load_u16 at 0x{:08x}", addr);
@@ -111,6 +116,8 @@ static bool load_u32_(uint32_t addr, uint32_t *val) {
     // DMA Control
     case UINT32_C(0x1f8010a0):  hw::read_dx_madr(2, val); break;
     case UINT32_C(0x1f8010a8):  hw::read_dx_chcr(2, val); break;
+    case UINT32_C(0x1f8010b0):  hw::read_dx_madr(3, val); break;
+    case UINT32_C(0x1f8010b8):  hw::read_dx_chcr(3, val); break;
     case UINT32_C(0x1f8010e8):  hw::read_dx_chcr(6, val); break;
     case UINT32_C(0x1f8010f0):  hw::read_dpcr(val); break;
     case UINT32_C(0x1f8010f4):  hw::read_dicr(val); break;
@@ -130,28 +137,35 @@ static bool load_u32_(uint32_t addr, uint32_t *val) {
 
 bool DefaultBus::load(unsigned bytes, uint32_t addr, uint32_t *val) {
     if (addr < UINT32_C(0x200000)) {
-        *val = load_le(state.ram + addr, bytes);
+        *val = load_le(state->ram + addr, bytes);
         return true;
     }
 
     if (addr >= UINT32_C(0x1F800000) &&
         addr <  UINT32_C(0x1F800400)) {
-        *val = load_le(state.dram + (addr - UINT32_C(0x1F800000)), bytes);
+        *val = load_le(state->dram + (addr - UINT32_C(0x1F800000)), bytes);
         return true;
     }
 
     if (addr >= UINT32_C(0x1FC00000) &&
         addr <  UINT32_C(0x1FC80000)) {
-        *val = load_le(state.bios + (addr - UINT32_C(0x1FC00000)), bytes);
+        *val = load_le(state->bios + (addr - UINT32_C(0x1FC00000)), bytes);
         return true;
     }
 
     if (addr >= UINT32_C(0x1F000000) &&
         addr <  UINT32_C(0x1F000100)) {
-        *val = load_le(state.cd_rom + (addr - UINT32_C(0x1F000000)), bytes);
+        // No image is loaded when side-loading an executable.
+        uint32_t offset = addr - UINT32_C(0x1F000000);
+        *val = offset + bytes <= state->cd_rom_size ?
+            load_le(state->cd_rom + offset, bytes) : 0;
         return true;
     }
 
+    if (addr >= MMIO_BASE && addr < MMIO_BASE + MMIO_SIZE) {
+        mmio::count(addr, bytes, false);
+    }
+
     if (addr >= UINT32_C(0x1f801c00) &&
         addr <  UINT32_C(0x1f801d80)) {
         // TODO SPU Voice
@@ -215,30 +229,30 @@ static bool store_u16_(uint32_t addr, uint16_t val) {
     case UINT32_C(0x1f801128):  hw::write_timer_target(2, val); break;
 
     // SPU Control
-    case UINT32_C(0x1f801d80):  state.hw.main_volume_left = val; break;
-    case UINT32_C(0x1f801d82):  state.hw.main_volume_right = val; break;
-    case UINT32_C(0x1f801d84):  state.hw.main_volume_left = val; break;
-    case UINT32_C(0x1f801d86):  state.hw.main_volume_right = val; break;
-    case UINT32_C(0x1f801d88):  state.hw.voice_key_on = val; break; // TODO lo
-    case UINT32_C(0x1f801d8a):  state.hw.voice_key_on = val; break; // TODO hi
-    case UINT32_C(0x1f801d8c):  state.hw.voice_key_off = val; break; // TODO lo
-    case UINT32_C(0x1f801d8e):  state.hw.voice_key_off = val; break; // TODO hi
-    case UINT32_C(0x1f801d90):  state.hw.voice_channel_fm = val; break; // TODO lo
-    case UINT32_C(0x1f801d92):  state.hw.voice_channel_fm = val; break; // TODO hi
-    case UINT32_C(0x1f801d94):  state.hw.voice_channel_noise_mode = val; break; // TODO lo
-    case UINT32_C(0x1f801d96):  state.hw.voice_channel_noise_mode = val; break; // TODO hi
-    case UINT32_C(0x1f801d98):  state.hw.voice_channel_reverb_mode = val; break; // TODO lo
-    case UINT32_C(0x1f801d9a):  state.hw.voice_channel_reverb_mode = val; break; // TODO hi
-    case UINT32_C(0x1f801da2):  state.hw.sound_ram_reverb_start_addr = val; break;
-    case UINT32_C(0x1f801da6):  state.hw.sound_ram_data_transfer_addr = val; break;
-    case UINT32_C(0x1f801da8):  state.hw.sound_ram_data_transfer_fifo = val; break;
-    case UINT32_C(0x1f801daa):  state.hw.spu_control = val; break;
-    case UINT32_C(0x1f801dae):  state.hw.spu_status = val; break;
-    case UINT32_C(0x1f801dac):  state.hw.sound_ram_data_transfer_control = val; break;
-    case UINT32_C(0x1f801db0):  state.hw.cd_volume_left = val; break;
-    case UINT32_C(0x1f801db2):  state.hw.cd_volume_right = val; break;
-    case UINT32_C(0x1f801db4):  state.hw.extern_volume_left = val; break;
-    case UINT32_C(0x1f801db6):  state.hw.extern_volume_right = val; break;
+    case UINT32_C(0x1f801d80):  state->hw.main_volume_left = val; break;
+    case UINT32_C(0x1f801d82):  state->hw.main_volume_right = val; break;
+    case UINT32_C(0x1f801d84):  state->hw.main_volume_left = val; break;
+    case UINT32_C(0x1f801d86):  state->hw.main_volume_right = val; break;
+    case UINT32_C(0x1f801d88):  state->hw.voice_key_on = val; break; // TODO lo
+    case UINT32_C(0x1f801d8a):  state->hw.voice_key_on = val; break; // TODO hi
+    case UINT32_C(0x1f801d8c):  state->hw.voice_key_off = val; break; // TODO lo
+    case UINT32_C(0x1f801d8e):  state->hw.voice_key_off = val; break; // TODO hi
+    case UINT32_C(0x1f801d90):  state->hw.voice_channel_fm = val; break; // TODO lo
+    case UINT32_C(0x1f801d92):  state->hw.voice_channel_fm = val; break; // TODO hi
+    case UINT32_C(0x1f801d94):  state->hw.voice_channel_noise_mode = val; break; // TODO lo
+    case UINT32_C(0x1f801d96):  state->hw.voice_channel_noise_mode = val; break; // TODO hi
+    case UINT32_C(0x1f801d98):  state->hw.voice_channel_reverb_mode = val; break; // TODO lo
+    case UINT32_C(0x1f801d9a):  state->hw.voice_channel_reverb_mode = val; break; // TODO hi
+    case UINT32_C(0x1f801da2):  state->hw.sound_ram_reverb_start_addr = val; break;
+    case UINT32_C(0x1f801da6):  state->hw.sound_ram_data_transfer_addr = val; break;
+    case UINT32_C(0x1f801da8):  state->hw.sound_ram_data_transfer_fifo = val; break;
+    case UINT32_C(0x1f801daa):  state->hw.spu_control = val; break;
+    case UINT32_C(0x1f801dae):  state->hw.spu_status = val; break;
+    case UINT32_C(0x1f801dac):  state->hw.sound_ram_data_transfer_control = val; break;
+    case UINT32_C(0x1f801db0):  state->hw.cd_volume_left = val; break;
+    case UINT32_C(0x1f801db2):  state->hw.cd_volume_right = val; break;
+    case UINT32_C(0x1f801db4):  state->hw.extern_volume_left = val; break;
+    case UINT32_C(0x1f801db6):  state->hw.extern_volume_right = val; break;
 
     default:
         std::string reason = fmt::format("store_u16 at 0x{:08x}", addr);
@@ -252,17 +266,17 @@ static bool store_u16_(uint32_t addr, uint16_t val) {
 static bool store_u32_(uint32_t addr, uint32_t val) {
     switch (addr) {
     // Memory Control
-    case UINT32_C(0x1f801000):  state.hw.expansion_1_base_addr = val; break;
-    case UINT32_C(0x1f801004):  state.hw.expansion_2_base_addr = val; break;
-    case UINT32_C(0x1f801008):  state.hw.expansion_1_delay_size = val; break;
-    case UINT32_C(0x1f80100c):  state.hw.expansion_3_delay_size = val; break;
-    case UINT32_C(0x1f801010):  state.hw.bios_rom_delay_size = val; break;
-    case UINT32_C(0x1f801014):  state.hw.spu_delay = val; break;
-    case UINT32_C(0x1f801018):  state.hw.cdrom_delay = val; break;
-    case UINT32_C(0x1f80101c):  state.hw.expansion_2_delay_size = val; break;
-    case UINT32_C(0x1f801020):  state.hw.common_delay = val; break;
-    case UINT32_C(0x1f801060):  state.hw.ram_size = val; break;
-    case UINT32_C(0xfffe0130):  state.hw.cache_control = val; break;
+    case UINT32_C(0x1f801000):  state->hw.expansion_1_base_addr = val; break;
+    case UINT32_C(0x1f801004):  state->hw.expansion_2_base_addr = val; break;
+    case UINT32_C(0x1f801008):  state->hw.expansion_1_delay_size = val; break;
+    case UINT32_C(0x1f80100c):  state->hw.expansion_3_delay_size = val; break;
+    case UINT32_C(0x1f801010):  state->hw.bios_rom_delay_size = val; break;
+    case UINT32_C(0x1f801014):  state->hw.spu_delay = val; break;
+    case UINT32_C(0x1f801018):  state->hw.cdrom_delay = val; break;
+    case UINT32_C(0x1f80101c):  state->hw.expansion_2_delay_size = val; break;
+    case UINT32_C(0x1f801020):  state->hw.common_delay = val; break;
+    case UINT32_C(0x1f801060):  state->hw.ram_size = val; break;
+    case UINT32_C(0xfffe0130):  state->hw.cache_control = val; break;
 
     // Interrupt Control
     case UINT32_C(0x1f801070):  hw::write_i_stat(val); break;
@@ -272,6 +286,9 @@ static bool store_u32_(uint32_t addr, uint32_t val) {
     case UINT32_C(0x1f8010a0):  hw::write_dx_madr(2, val); break;
     case UINT32_C(0x1f8010a4):  hw::write_dx_bcr(2, val); break;
     case UINT32_C(0x1f8010a8):  hw::write_d2_chcr(val); break;
+    case UINT32_C(0x1f8010b0):  hw::write_dx_madr(3, val); break;
+    case UINT32_C(0x1f8010b4):  hw::write_dx_bcr(3, val); break;
+    case UINT32_C(0x1f8010b8):  hw::write_d3_chcr(val); break;
     case UINT32_C(0x1f8010e0):  hw::write_dx_madr(6, val); break;
     case UINT32_C(0x1f8010e4):  hw::write_dx_bcr(6, val); break;
     case UINT32_C(0x1f8010e8):  hw::write_d6_chcr(val); break;
@@ -297,7 +314,7 @@ static bool store_u32_(uint32_t addr, uint32_t val) {
 }
 
 bool DefaultBus::store(unsigned bytes, uint32_t addr, uint32_t val) {
-    if (state.cp0.IC()) {
+    if (state->cp0.IC()) {
         // When the Isolate Cache bit is set in the Status register,
         // store operations do not propagate to the external memory system.
         // The BIOS sets this bit in order to clear the instruction
@@ -306,13 +323,14 @@ bool DefaultBus::store(unsigned bytes, uint32_t addr, uint32_t val) {
     }
 
     if (addr < UINT32_C(0x200000)) {
-        store_le(state.ram + addr, bytes, val);
+        store_le(state->ram + addr, bytes, val);
+        state->mark_ram_dirty(addr);
         return true;
     }
 
     if (addr >= UINT32_C(0x1f800000) &&
         addr <  UINT32_C(0x1f800400)) {
-        store_le(state.dram + (addr - UINT32_C(0x1f800000)), bytes, val);
+        store_le(state->dram + (addr - UINT32_C(0x1f800000)), bytes, val);
         return true;
     }
 
@@ -321,6 +339,10 @@ bool DefaultBus::store(unsigned bytes, uint32_t addr, uint32_t val) {
         return false;
     }
 
+    if (addr >= MMIO_BASE && addr < MMIO_BASE + MMIO_SIZE) {
+        mmio::count(addr, bytes, true);
+    }
+
     if (addr >= UINT32_C(0x1f801c00) &&
         addr <  UINT32_C(0x1f801d80)) {
         // TODO SPU Voice
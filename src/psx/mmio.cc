@@ -0,0 +1,216 @@
+
+#include <algorithm>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <psx/mmio.h>
+#include <psx/psx.h>
+
+using namespace psx;
+
+namespace psx::mmio {
+
+/// Counter of an I/O register, for one width and direction.
+struct counter {
+    uint32_t addr;
+    unsigned bytes;
+    bool store;
+    uint64_t total;
+    uint32_t frame;
+    /// Majority vote for the most frequent accessor: the candidate pc
+    /// and its votes, and its exact access counts since elected.
+    uint32_t pc;
+    uint32_t votes;
+    uint32_t pc_frame;
+    uint64_t pc_total;
+};
+
+/// Access counters of a machine.
+struct context {
+    /// Index of the counters in \ref counters, by address offset, width
+    /// and direction; 0 if the register was never accessed.
+    std::vector<uint16_t> index;
+    /// Counters in order of first access; entry 0 is unused.
+    std::vector<counter> counters;
+
+    /// Counters published at the last vertical blank, read from the
+    /// GUI thread.
+    std::mutex mutex;
+    std::vector<register_stats> published;
+    unsigned long frames;
+
+    context() : index(MMIO_SIZE << 3, 0), counters(1), frames(0) {}
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+void count(uint32_t addr, unsigned bytes, bool store) {
+    context *ctx = machine()->mmio.get();
+    // Accesses re-executed by the reverse debugger were already counted.
+    if (machine()->reexecuting()) {
+        return;
+    }
+    unsigned width = bytes == 1 ? 0 : bytes == 2 ? 1 : 2;
+    size_t key = ((addr - MMIO_BASE) << 3) | (store << 2) | width;
+    if (ctx->index[key] == 0) {
+        if (ctx->counters.size() > UINT16_MAX) {
+            return;
+        }
+        ctx->index[key] = ctx->counters.size();
+        ctx->counters.push_back({ addr, bytes, store });
+    }
+
+    counter &counter = ctx->counters[ctx->index[key]];
+    uint32_t pc = state->cpu.pc;
+    counter.total++;
+    counter.frame++;
+    if (counter.pc == pc) {
+        counter.votes++;
+        counter.pc_frame++;
+        counter.pc_total++;
+    } else if (counter.votes == 0) {
+        counter.pc = pc;
+        counter.votes = 1;
+        counter.pc_frame = 1;
+        counter.pc_total = 1;
+    } else {
+        counter.votes--;
+    }
+}
+
+void end_frame(void) {
+    context *ctx = machine()->mmio.get();
+    if (machine()->reexecuting()) {
+        return;
+    }
+    std::vector<register_stats> stats;
+    stats.reserve(ctx->counters.size() - 1);
+    for (size_t nr = 1; nr < ctx->counters.size(); nr++) {
+        counter &counter = ctx->counters[nr];
+        stats.push_back({ counter.addr, counter.bytes, counter.store,
+            counter.total, counter.frame, counter.pc, counter.pc_frame,
+            counter.pc_total });
+        counter.frame = 0;
+        counter.pc_frame = 0;
+    }
+    std::sort(stats.begin(), stats.end(),
+        [](register_stats const &lhs, register_stats const &rhs) {
+            return std::tie(lhs.addr, lhs.store, lhs.bytes) <
+                   std::tie(rhs.addr, rhs.store, rhs.bytes); });
+
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->published = std::move(stats);
+    ctx->frames++;
+}
+
+std::vector<register_stats> stats(void) {
+    context *ctx = machine()->mmio.get();
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    return ctx->published;
+}
+
+char const *register_name(uint32_t addr, bool store) {
+    static char const *memory_control[] = {
+        "EXP1_BASE", "EXP2_BASE", "EXP1_DELAY", "EXP3_DELAY",
+        "BIOS_DELAY", "SPU_DELAY", "CDROM_DELAY", "EXP2_DELAY",
+        "COM_DELAY",
+    };
+    static char const *dma[] = {
+        "D0_MADR", "D0_BCR", "D0_CHCR", "D1_MADR", "D1_BCR", "D1_CHCR",
+        "D2_MADR", "D2_BCR", "D2_CHCR", "D3_MADR", "D3_BCR", "D3_CHCR",
+        "D4_MADR", "D4_BCR", "D4_CHCR", "D5_MADR", "D5_BCR", "D5_CHCR",
+        "D6_MADR", "D6_BCR", "D6_CHCR",
+    };
+    static char const *timers[] = {
+        "T0_VALUE", "T0_MODE", "T0_TARGET", "T1_VALUE", "T1_MODE",
+        "T1_TARGET", "T2_VALUE", "T2_MODE", "T2_TARGET",
+    };
+
+    if (addr >= 0x1f801000 && addr < 0x1f801024 && (addr & 3) == 0) {
+        return memory_control[(addr - 0x1f801000) / 4];
+    }
+    if (addr >= 0x1f801080 && addr < 0x1f8010f0 && (addr & 0xf) < 0xc &&
+        (addr & 3) == 0) {
+        return dma[(addr - 0x1f801080) / 16 * 3 + (addr & 0xf) / 4];
+    }
+    if (addr >= 0x1f801100 && addr < 0x1f801130 && (addr & 0xf) < 0xc &&
+        (addr & 3) == 0) {
+        return timers[(addr - 0x1f801100) / 16 * 3 + (addr & 0xf) / 4];
+    }
+    if (addr >= 0x1f801c00 && addr < 0x1f801d80) {
+        return "SPU_VOICE";
+    }
+    if (addr >= 0x1f801d80 && addr < 0x1f802000) {
+        switch (addr) {
+        case 0x1f801da6: return "SPU_ADDR";
+        case 0x1f801da8: return "SPU_FIFO";
+        case 0x1f801daa: return "SPUCNT";
+        case 0x1f801dae: return "SPUSTAT";
+        default:         return "SPU";
+        }
+    }
+
+    switch (addr) {
+    case 0x1f801040: return "JOY_DATA";
+    case 0x1f801044: return "JOY_STAT";
+    case 0x1f801048: return "JOY_MODE";
+    case 0x1f80104a: return "JOY_CTRL";
+    case 0x1f80104e: return "JOY_BAUD";
+    case 0x1f801050: return "SIO_DATA";
+    case 0x1f801054: return "SIO_STAT";
+    case 0x1f801058: return "SIO_MODE";
+    case 0x1f80105a: return "SIO_CTRL";
+    case 0x1f80105e: return "SIO_BAUD";
+    case 0x1f801060: return "RAM_SIZE";
+    case 0x1f801070: return "I_STAT";
+    case 0x1f801074: return "I_MASK";
+    case 0x1f8010f0: return "DPCR";
+    case 0x1f8010f4: return "DICR";
+    case 0x1f801800: return "CDROM_INDEX";
+    case 0x1f801801: return "CDROM_REG1";
+    case 0x1f801802: return "CDROM_REG2";
+    case 0x1f801803: return "CDROM_REG3";
+    case 0x1f801810: return store ? "GP0" : "GPUREAD";
+    case 0x1f801814: return store ? "GP1" : "GPUSTAT";
+    case 0x1f801820: return store ? "MDEC_CMD" : "MDEC_DATA";
+    case 0x1f801824: return store ? "MDEC_CTRL" : "MDEC_STAT";
+    case 0x1f802041: return "POST";
+    default:         return NULL;
+    }
+}
+
+void print_report(size_t count) {
+    context *ctx = machine()->mmio.get();
+    std::vector<register_stats> stats;
+    unsigned long frames;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        stats = ctx->published;
+        frames = ctx->frames;
+    }
+    if (stats.empty() || count == 0) {
+        return;
+    }
+
+    std::sort(stats.begin(), stats.end(),
+        [](register_stats const &lhs, register_stats const &rhs) {
+            return lhs.total > rhs.total; });
+    stats.resize(std::min(stats.size(), count));
+
+    fmt::print("mmio: {} frames, accesses per frame\n", frames);
+    for (register_stats const &reg : stats) {
+        char const *name = register_name(reg.addr, reg.store);
+        fmt::print("  {:<12} {:08x} {}{:<2} {:>12.1f}   "
+                   "{:5.1f}% from pc {:08x}\n",
+            name ? name : "", reg.addr, reg.store ? "w" : "r",
+            reg.bytes * 8, (double)reg.total / frames,
+            100.0 * reg.pc_total / reg.total, reg.pc);
+    }
+}
+
+}; /* namespace psx::mmio */
@@ -0,0 +1,204 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fmt/format.h>
+
+#include <psx/profiler.h>
+#include <psx/psx.h>
+
+using namespace psx;
+
+namespace psx::profiler {
+
+std::atomic_bool active;
+
+/// Incremented when the profiler is enabled; each interpreter thread
+/// restarts its sampling state when it observes a new generation.
+static std::atomic<unsigned> generation;
+
+static unsigned long interval = 1000;
+
+/// Sampling state of the interpreter thread of each machine.
+static thread_local unsigned thread_generation;
+static thread_local unsigned long last_sample;
+static thread_local std::chrono::steady_clock::time_point last_sample_time;
+
+/// Shadow call stack, per interpreter thread.
+struct frame {
+    uint32_t function;
+    uint32_t return_address;
+};
+
+/// Calls deeper than this are folded into the deepest frame, e.g. for
+/// unbalanced calls and returns (longjmp, exceptions).
+#define MAX_STACK_DEPTH     256
+
+static thread_local std::vector<frame> call_stack;
+
+/// Aggregated samples, read from the GUI and main threads.
+struct stack_stats {
+    uint64_t cycles;
+    uint64_t host_ns;
+};
+
+static std::mutex samples_mutex;
+static std::map<std::vector<uint32_t>, stack_stats> stacks;
+static std::unordered_map<uint32_t, function_stats> functions;
+static uint64_t total_cycles;
+
+void set_enabled(bool enable) {
+    if (enable) {
+        generation.fetch_add(1, std::memory_order_relaxed);
+    }
+    active.store(enable, std::memory_order_release);
+}
+
+void set_interval(unsigned long cycles) {
+    interval = std::max(cycles, 1ul);
+}
+
+void clear(void) {
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    stacks.clear();
+    functions.clear();
+    total_cycles = 0;
+}
+
+void call(uint32_t target, uint32_t return_address) {
+    if (call_stack.size() < MAX_STACK_DEPTH) {
+        call_stack.push_back({ target, return_address });
+    }
+}
+
+void ret(uint32_t target) {
+    // Unwind to the matching frame; returns without a matching call
+    // (computed jumps through ra) leave the stack unchanged.
+    for (size_t depth = call_stack.size(); depth > 0; depth--) {
+        if (call_stack[depth - 1].return_address == target) {
+            call_stack.resize(depth - 1);
+            return;
+        }
+    }
+}
+
+static void sample(unsigned long cycles, uint64_t host_ns) {
+    std::vector<uint32_t> stack;
+    for (frame const &frame : call_stack) {
+        stack.push_back(frame.function);
+    }
+    if (stack.empty()) {
+        stack.push_back(0);
+    }
+
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    stack_stats &stack_stats = stacks[stack];
+    stack_stats.cycles += cycles;
+    stack_stats.host_ns += host_ns;
+    total_cycles += cycles;
+
+    // Recursive functions are counted once in total_cycles.
+    std::unordered_set<uint32_t> seen;
+    for (uint32_t function : stack) {
+        if (seen.insert(function).second) {
+            function_stats &stats = functions[function];
+            stats.address = function;
+            stats.total_cycles += cycles;
+        }
+    }
+    function_stats &self = functions[stack.back()];
+    self.self_cycles += cycles;
+    self.self_host_ns += host_ns;
+}
+
+void tick(void) {
+    auto now = std::chrono::steady_clock::now();
+    unsigned current = generation.load(std::memory_order_relaxed);
+    if (thread_generation != current) {
+        thread_generation = current;
+        call_stack.clear();
+        last_sample = state->cycles;
+        last_sample_time = now;
+        return;
+    }
+
+    unsigned long cycles = state->cycles - last_sample;
+    if (cycles < interval) {
+        return;
+    }
+
+    uint64_t host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - last_sample_time).count();
+    sample(cycles, host_ns);
+    last_sample = state->cycles;
+    last_sample_time = now;
+}
+
+std::vector<function_stats> top(size_t count) {
+    std::vector<function_stats> sorted;
+    {
+        std::lock_guard<std::mutex> lock(samples_mutex);
+        for (auto const &entry : functions) {
+            sorted.push_back(entry.second);
+        }
+    }
+
+    count = std::min(count, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(),
+        [](function_stats const &a, function_stats const &b) {
+            return a.self_cycles > b.self_cycles; });
+    sorted.resize(count);
+    return sorted;
+}
+
+uint64_t sampled_cycles(void) {
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    return total_cycles;
+}
+
+static std::string function_name(uint32_t address) {
+    return address == 0 ? "[unknown]" : fmt::format("fn_{:08x}", address);
+}
+
+int write_folded(std::string const &path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    for (auto const &entry : stacks) {
+        std::string line;
+        for (uint32_t function : entry.first) {
+            if (!line.empty()) line += ';';
+            line += function_name(function);
+        }
+        fmt::print(file, "{} {}\n", line, entry.second.cycles);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+void print_report(size_t count) {
+    uint64_t total = sampled_cycles();
+    if (total == 0) {
+        return;
+    }
+
+    fmt::print("profile: {} cycles sampled\n", total);
+    fmt::print("{:>7} {:>7} {:>12} {:>10}  function\n",
+        "self%", "total%", "self cycles", "host ms");
+    for (function_stats const &stats : top(count)) {
+        fmt::print("{:>6.2f}% {:>6.2f}% {:>12} {:>10.3f}  {}\n",
+            100.0 * stats.self_cycles / total,
+            100.0 * stats.total_cycles / total,
+            stats.self_cycles, stats.self_host_ns / 1e6,
+            function_name(stats.address));
+    }
+}
+
+}; /* namespace psx::profiler */
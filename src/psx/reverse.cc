@@ -0,0 +1,137 @@
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <assembly/disassembler.h>
+#include <assembly/opcodes.h>
+#include <psx/debugger.h>
+#include <psx/psx.h>
+#include <psx/reverse.h>
+#include <psx/rewind.h>
+
+using namespace psx;
+
+namespace psx::reverse {
+
+int seek(uint64_t cycles) {
+    if (rewind::restore(cycles) != 0) {
+        return -1;
+    }
+    return machine()->fast_forward(cycles) ? 0 : -1;
+}
+
+int step_back(void) {
+    uint64_t current = state->cycles;
+    if (current == 0 || seek(current - 1) != 0) {
+        return -1;
+    }
+    if (state->cycles < current) {
+        return 0;
+    }
+
+    // The previous instruction was longer than one cycle (HLE calls):
+    // single step from the capture to find where it started.
+    rewind::restore(current - 1);
+    uint64_t previous = state->cycles;
+    while (state->cycles < current) {
+        previous = state->cycles;
+        if (!machine()->step_instruction()) {
+            return -1;
+        }
+    }
+    return seek(previous);
+}
+
+/// Capture intervals searched before giving up, about two seconds of
+/// execution with a capture every frame.
+#define SEARCH_MAX_CAPTURES     120
+
+/**
+ * Search backwards for the most recent instruction for which \p match
+ * returns true, evaluated after the instruction is executed, and move
+ * the machine there. The current cycle is excluded. The captures are
+ * only discarded once a match is found.
+ */
+static int search(std::function<bool()> const &match) {
+    uint64_t current = state->cycles;
+    uint64_t end = current;
+
+    for (unsigned nr = 0; nr < SEARCH_MAX_CAPTURES && end > 0 &&
+         rewind::peek(end - 1) == 0; nr++) {
+        uint64_t start = state->cycles;
+        uint64_t hit = UINT64_MAX;
+        while (state->cycles < end) {
+            if (!machine()->step_instruction()) {
+                return -1;
+            }
+            if (state->cycles < current && match()) {
+                hit = state->cycles;
+            }
+        }
+        if (hit != UINT64_MAX) {
+            return seek(hit);
+        }
+        end = start;
+    }
+
+    // No capture newer than the current cycle was discarded,
+    // the most recent one is at most an interval away.
+    seek(current);
+    return -1;
+}
+
+int reverse_continue(void) {
+    std::vector<uint32_t> breakpoints;
+    for (auto it = debugger::debugger.breakpointsBegin();
+         it != debugger::debugger.breakpointsEnd(); it++) {
+        if (it->second.enabled) {
+            breakpoints.push_back(it->second.addr);
+        }
+    }
+    if (breakpoints.empty()) {
+        return -1;
+    }
+    std::sort(breakpoints.begin(), breakpoints.end());
+    return search([&breakpoints] {
+        return std::binary_search(breakpoints.begin(), breakpoints.end(),
+            state->cpu.pc);
+    });
+}
+
+int reverse_to_write(uint32_t addr) {
+    return search([addr] {
+        uint32_t pc = state->cpu.pc;
+        uint32_t paddr, instr;
+        if (translate_address(pc, &paddr, false) != None ||
+            !state->bus->load_u32(paddr, &instr)) {
+            return false;
+        }
+
+        uint32_t bytes;
+        switch (assembly::getOpcode(instr)) {
+        case assembly::SB:  bytes = 1; break;
+        case assembly::SH:  bytes = 2; break;
+        case assembly::SW:
+        case assembly::SWL:
+        case assembly::SWR: bytes = 4; break;
+        default: return false;
+        }
+        if (state->cp0.IC()) {
+            return false;
+        }
+
+        // Stores do not modify the base register, the address can be
+        // computed after the fact. SWL and SWR store within the
+        // aligned word.
+        uint32_t vaddr = state->cpu.gpr[assembly::getRs(instr)] +
+            (uint32_t)(int16_t)assembly::getImmediate(instr);
+        vaddr &= ~(bytes - 1);
+        if (translate_address(vaddr, &paddr, true) != None) {
+            return false;
+        }
+        return addr >= paddr && addr < paddr + bytes;
+    });
+}
+
+}; /* namespace psx::reverse */
@@ -0,0 +1,457 @@
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <psx/hle.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+#include <psx/rewind.h>
+#include <psx/timeline.h>
+#include <psx/trace.h>
+
+using namespace psx;
+
+namespace psx::rewind {
+
+#define PAGE_WORDS          (STATE_PAGE_SIZE / 4)
+#define IMAGE_SIZE          ((RAM_PAGES + VRAM_PAGES) * STATE_PAGE_SIZE)
+
+/// Captures queued to the encoder before further captures are delayed.
+/// Delayed captures keep their dirty pages, nothing is lost.
+#define MAX_PENDING         4
+
+/// Register files and scalar state, copied whole at every capture.
+struct registers {
+    struct cpu_registers cpu;
+    struct cp0_registers cp0;
+    struct cp2_registers cp2;
+    struct hw_registers hw;
+    struct cdrom_registers cdrom;
+    struct gpu_registers gpu;
+    struct gp0_registers gp0;
+    uint8_t dram[0x400];
+    uint64_t cycles;
+    enum cpu_state cpu_state;
+    uint32_t jump_address;
+    bool delay_slot;
+    std::vector<std::pair<unsigned long, void (*)()>> events;
+};
+
+/// Capture handed over from the emulation thread to the encoder.
+/// Pages are numbered from the start of RAM, VRAM pages follow
+/// the RAM pages.
+struct capture {
+    struct registers registers;
+    std::vector<uint16_t> pages;
+    std::vector<uint8_t> data;      /**< Contents of the captured pages */
+};
+
+/// Capture in the ring.
+struct entry {
+    struct registers registers;
+    std::vector<uint16_t> pages;    /**< Pages modified since the
+                                         previous capture */
+    std::vector<uint8_t> deltas;    /**< Encoded deltas of the pages */
+
+    size_t bytes(void) const {
+        return sizeof(*this) + pages.size() * sizeof(pages[0]) +
+            deltas.size();
+    }
+};
+
+/// Rewind buffer of a machine.
+struct context {
+    unsigned interval;      /**< Capture interval in frames, 0 if disabled */
+    size_t budget;
+    uint64_t skipped;
+
+    std::mutex mutex;
+    std::condition_variable semaphore;
+    std::condition_variable idle;
+    std::thread *encoder;
+    bool stopped;
+    bool busy;
+    std::deque<capture> pending;
+    /// Page buffers released by the encoder, reused by the next captures.
+    std::vector<std::vector<uint8_t>> spare;
+    std::deque<entry> entries;
+    size_t bytes;
+    /// RAM followed by VRAM, as of the most recent capture.
+    std::vector<uint8_t> image;
+    /// RAM followed by VRAM, as of the capture \ref view_entry loaded
+    /// by peek(); empty when the captures changed since.
+    std::vector<uint8_t> view;
+    size_t view_entry;
+
+    context()
+        : interval(0), budget(0), skipped(0), encoder(NULL),
+          stopped(false), busy(false), bytes(0), view_entry(0) {}
+    ~context() {
+        stop_encoder();
+    }
+
+    void stop_encoder(void) {
+        if (encoder == NULL) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        semaphore.notify_one();
+        encoder->join();
+        delete encoder;
+        encoder = NULL;
+    }
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+/**
+ * XOR deltas are mostly zero. A delta is encoded as runs of
+ * (u16 zero words, u16 literal words, literal words) over the 32-bit
+ * words of the page; the runs cover the page exactly.
+ */
+static void encode_delta(uint8_t const *prev, uint8_t const *next,
+                         std::vector<uint8_t> *out) {
+    uint32_t words[PAGE_WORDS];
+    for (unsigned nr = 0; nr < PAGE_WORDS; nr++) {
+        uint32_t a, b;
+        memcpy(&a, prev + 4 * nr, 4);
+        memcpy(&b, next + 4 * nr, 4);
+        words[nr] = a ^ b;
+    }
+
+    unsigned nr = 0;
+    while (nr < PAGE_WORDS) {
+        unsigned zeros = 0;
+        for (; nr < PAGE_WORDS && words[nr] == 0; nr++) {
+            zeros++;
+        }
+        unsigned start = nr;
+        for (; nr < PAGE_WORDS && words[nr] != 0; nr++) {
+        }
+
+        size_t offset = out->size();
+        unsigned literals = nr - start;
+        out->resize(offset + 4 + 4 * literals);
+        memory::store_u16_le(out->data() + offset, zeros);
+        memory::store_u16_le(out->data() + offset + 2, literals);
+        memcpy(out->data() + offset + 4, words + start, 4 * literals);
+    }
+}
+
+/// XOR the delta \p in into \p page.
+/// @return the end of the encoded delta.
+static uint8_t const *apply_delta(uint8_t const *in, uint8_t *page) {
+    unsigned nr = 0;
+    while (nr < PAGE_WORDS) {
+        unsigned zeros = memory::load_u16_le(in);
+        unsigned literals = memory::load_u16_le(in + 2);
+        in += 4;
+        nr += zeros;
+        for (unsigned end = nr + literals; nr < end; nr++, in += 4) {
+            uint32_t delta, word;
+            memcpy(&delta, in, 4);
+            memcpy(&word, page + 4 * nr, 4);
+            word ^= delta;
+            memcpy(page + 4 * nr, &word, 4);
+        }
+    }
+    return in;
+}
+
+static void encoder_routine(context *ctx) {
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    for (;;) {
+        ctx->semaphore.wait(lock, [ctx] {
+            return !ctx->pending.empty() || ctx->stopped; });
+        if (ctx->pending.empty()) {
+            return;
+        }
+
+        capture capture = std::move(ctx->pending.front());
+        ctx->pending.pop_front();
+        ctx->busy = true;
+        lock.unlock();
+
+        // The image is only modified by the encoder, and by step_back()
+        // which waits for the encoder to be idle.
+        entry entry;
+        entry.registers = std::move(capture.registers);
+        for (size_t nr = 0; nr < capture.pages.size(); nr++) {
+            uint8_t *prev = ctx->image.data() +
+                (size_t)capture.pages[nr] * STATE_PAGE_SIZE;
+            uint8_t const *next = capture.data.data() + nr * STATE_PAGE_SIZE;
+            if (memcmp(prev, next, STATE_PAGE_SIZE) == 0) {
+                continue;
+            }
+            entry.pages.push_back(capture.pages[nr]);
+            encode_delta(prev, next, &entry.deltas);
+            memcpy(prev, next, STATE_PAGE_SIZE);
+        }
+        entry.deltas.shrink_to_fit();
+
+        lock.lock();
+        ctx->bytes += entry.bytes();
+        ctx->entries.push_back(std::move(entry));
+        // The oldest capture is only needed to reconstruct itself.
+        while (ctx->entries.size() > 1 && ctx->bytes > ctx->budget) {
+            ctx->bytes -= ctx->entries.front().bytes();
+            ctx->entries.pop_front();
+        }
+        ctx->view.clear();
+        ctx->spare.push_back(std::move(capture.data));
+        ctx->busy = false;
+        ctx->idle.notify_all();
+    }
+}
+
+void start(unsigned interval, size_t budget) {
+    context *ctx = machine()->rewind.get();
+    stop();
+    ctx->interval = interval;
+    ctx->budget = budget;
+    ctx->stopped = false;
+    ctx->image.assign(IMAGE_SIZE, 0);
+    // The first capture holds the full memories.
+    state->mark_all_dirty();
+    ctx->encoder = new std::thread(encoder_routine, ctx);
+}
+
+void stop(void) {
+    context *ctx = machine()->rewind.get();
+    ctx->stop_encoder();
+    ctx->interval = 0;
+    ctx->pending.clear();
+    ctx->spare.clear();
+    ctx->entries.clear();
+    ctx->bytes = 0;
+    ctx->skipped = 0;
+    ctx->image.clear();
+    ctx->image.shrink_to_fit();
+    ctx->view.clear();
+    ctx->view.shrink_to_fit();
+}
+
+static void save_registers(struct registers *registers) {
+    registers->cpu = state->cpu;
+    registers->cp0 = state->cp0;
+    registers->cp2 = state->cp2;
+    registers->hw = state->hw;
+    registers->cdrom = state->cdrom;
+    registers->gpu = state->gpu;
+    registers->gp0 = state->gp0;
+    memcpy(registers->dram, state->dram, sizeof(registers->dram));
+    registers->cycles = state->cycles;
+    registers->cpu_state = state->cpu_state;
+    registers->jump_address = state->jump_address;
+    registers->delay_slot = state->delay_slot;
+    registers->events.clear();
+    for (struct event *event = state->event_queue; event != NULL;
+         event = event->next) {
+        registers->events.push_back({ event->timeout, event->callback });
+    }
+}
+
+static void load_registers(struct registers const &registers) {
+    state->cpu = registers.cpu;
+    state->cp0 = registers.cp0;
+    state->cp2 = registers.cp2;
+    state->hw = registers.hw;
+    state->cdrom = registers.cdrom;
+    state->gpu = registers.gpu;
+    state->gp0 = registers.gp0;
+    memcpy(state->dram, registers.dram, sizeof(state->dram));
+    state->cycles = registers.cycles;
+    state->cpu_state = registers.cpu_state;
+    state->jump_address = registers.jump_address;
+    state->delay_slot = registers.delay_slot;
+    state->cancel_all_events();
+    for (auto const &event : registers.events) {
+        state->schedule_event(event.first, event.second);
+    }
+}
+
+/// Append the pages of the dirty bitmap \p dirty to the capture,
+/// and clear the bitmap.
+static void capture_pages(uint64_t *dirty, size_t nr_pages,
+                          uint8_t const *memory, unsigned first_page,
+                          struct capture *capture) {
+    for (size_t nr = 0; nr < nr_pages / 64; nr++) {
+        for (uint64_t bits = dirty[nr]; bits != 0; bits &= bits - 1) {
+            unsigned page = nr * 64 + __builtin_ctzll(bits);
+            memcpy(capture->data.data() +
+                    capture->pages.size() * STATE_PAGE_SIZE,
+                memory + (size_t)page * STATE_PAGE_SIZE, STATE_PAGE_SIZE);
+            capture->pages.push_back(first_page + page);
+        }
+        dirty[nr] = 0;
+    }
+}
+
+void vblank_event(void) {
+    context *ctx = machine()->rewind.get();
+    // Re-executed frames are covered by the captures already taken.
+    if (ctx->interval == 0 || state->gpu.frame % ctx->interval != 0 ||
+        machine()->reexecuting()) {
+        return;
+    }
+
+    timeline::span span("rewind", "capture");
+    capture capture;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (ctx->pending.size() >= MAX_PENDING) {
+            ctx->skipped++;
+            return;
+        }
+        if (!ctx->spare.empty()) {
+            capture.data = std::move(ctx->spare.back());
+            ctx->spare.pop_back();
+        }
+    }
+
+    // Page buffers are sized for the full memories once,
+    // and reused afterwards.
+    if (capture.data.empty()) {
+        capture.data.resize(IMAGE_SIZE);
+    }
+    save_registers(&capture.registers);
+    capture_pages(state->ram_dirty, RAM_PAGES, state->ram, 0, &capture);
+    capture_pages(state->vram_dirty, VRAM_PAGES, state->vram, RAM_PAGES,
+        &capture);
+
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->pending.push_back(std::move(capture));
+    }
+    ctx->semaphore.notify_one();
+}
+
+/// Undo the deltas of the capture \p entry in the memory image \p image.
+static void undo_entry(entry const &entry, uint8_t *image) {
+    uint8_t const *in = entry.deltas.data();
+    for (uint16_t page : entry.pages) {
+        in = apply_delta(in, image + (size_t)page * STATE_PAGE_SIZE);
+    }
+}
+
+/// Load the registers \p registers and the memory image \p image
+/// into the machine.
+static void load_entry(struct registers const &registers,
+                       uint8_t const *image) {
+    load_registers(registers);
+    memcpy(state->ram, image, sizeof(state->ram));
+    memcpy(state->vram, image + sizeof(state->ram), sizeof(state->vram));
+    trace::resync();
+}
+
+/// Restore the capture \p target, discarding the more recent captures.
+/// Called with the context lock held, and the encoder idle.
+static void restore_entry(context *ctx, size_t target) {
+    // Undo the deltas of the captures following the target,
+    // most recent first.
+    while (ctx->entries.size() > target + 1) {
+        undo_entry(ctx->entries.back(), ctx->image.data());
+        ctx->bytes -= ctx->entries.back().bytes();
+        ctx->entries.pop_back();
+    }
+
+    ctx->view.clear();
+    ctx->view.shrink_to_fit();
+    load_entry(ctx->entries.back().registers, ctx->image.data());
+    memset(state->ram_dirty, 0, sizeof(state->ram_dirty));
+    memset(state->vram_dirty, 0, sizeof(state->vram_dirty));
+    hle::restore();
+}
+
+int step_back(unsigned count) {
+    context *ctx = machine()->rewind.get();
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->idle.wait(lock, [ctx] {
+        return ctx->pending.empty() && !ctx->busy; });
+
+    // Captures taken at or after the current cycle are skipped, so
+    // that repeated steps go further back.
+    size_t newest = ctx->entries.size();
+    while (newest > 0 &&
+           ctx->entries[newest - 1].registers.cycles >= state->cycles) {
+        newest--;
+    }
+    if (count == 0 || count > newest) {
+        return -1;
+    }
+    restore_entry(ctx, newest - count);
+    return 0;
+}
+
+int restore(uint64_t cycles) {
+    context *ctx = machine()->rewind.get();
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->idle.wait(lock, [ctx] {
+        return ctx->pending.empty() && !ctx->busy; });
+
+    size_t newest = ctx->entries.size();
+    while (newest > 0 &&
+           ctx->entries[newest - 1].registers.cycles > cycles) {
+        newest--;
+    }
+    if (newest == 0) {
+        return -1;
+    }
+    restore_entry(ctx, newest - 1);
+    return 0;
+}
+
+int peek(uint64_t cycles) {
+    context *ctx = machine()->rewind.get();
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->idle.wait(lock, [ctx] {
+        return ctx->pending.empty() && !ctx->busy; });
+
+    size_t newest = ctx->entries.size();
+    while (newest > 0 &&
+           ctx->entries[newest - 1].registers.cycles > cycles) {
+        newest--;
+    }
+    if (newest == 0) {
+        return -1;
+    }
+
+    // The view is reused when walking back, so that each capture
+    // is decoded once.
+    size_t target = newest - 1;
+    if (ctx->view.empty() || ctx->view_entry < target) {
+        ctx->view = ctx->image;
+        ctx->view_entry = ctx->entries.size() - 1;
+    }
+    for (; ctx->view_entry > target; ctx->view_entry--) {
+        undo_entry(ctx->entries[ctx->view_entry], ctx->view.data());
+    }
+    load_entry(ctx->entries[target].registers, ctx->view.data());
+    return 0;
+}
+
+struct stats stats(void) {
+    context *ctx = machine()->rewind.get();
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    struct stats stats = {};
+    stats.captures = ctx->entries.size();
+    stats.bytes = ctx->bytes;
+    stats.skipped = ctx->skipped;
+    if (!ctx->entries.empty()) {
+        stats.oldest_frame = ctx->entries.front().registers.gpu.frame;
+        stats.newest_frame = ctx->entries.back().registers.gpu.frame;
+    }
+    return stats;
+}
+
+}; /* namespace psx::rewind */
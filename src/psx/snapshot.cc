@@ -0,0 +1,448 @@
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <psx/debugger.h>
+#include <psx/hle.h>
+#include <psx/hw.h>
+#include <psx/input.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+#include <psx/snapshot.h>
+#include <psx/trace.h>
+
+using namespace psx;
+
+namespace psx::snapshot {
+
+/// Stable identifiers of the event callbacks. Identifiers are part of
+/// the snapshot format: they are never reassigned, and the identifiers
+/// of removed events are not reused.
+static struct {
+    uint32_t id;
+    void (*callback)();
+} const event_ids[] = {
+    { 1, hw::hblank_event },
+    { 2, hw::timer0_event },
+    { 3, hw::timer1_event },
+    { 4, hw::timer2_event },
+    { 5, hw::cdrom_sector_event },
+    { 6, hw::cdrom_second_response_event },
+    { 7, hw::cdrom_queued_interrupt_event },
+    { 8, hw::joy_ack_event },
+    { 9, input::replay_end_event },
+};
+
+static constexpr uint32_t chunk_id(char const id[5]) {
+    return (uint32_t)(uint8_t)id[0] |
+        ((uint32_t)(uint8_t)id[1] << 8) |
+        ((uint32_t)(uint8_t)id[2] << 16) |
+        ((uint32_t)(uint8_t)id[3] << 24);
+}
+
+#define HEADER_SIZE             16
+#define DIRECTORY_ENTRY_SIZE    24
+#define MISC_SIZE               20
+#define EVENT_SIZE              16
+
+struct chunk {
+    uint32_t id;
+    void *ptr;
+    size_t size;
+    size_t alignment;
+};
+
+/// Machine state saved as raw chunks. The memory chunks are last,
+/// so that the padding before the page aligned chunks is minimal.
+static std::vector<chunk> state_chunks(void) {
+    return {
+        { chunk_id("CPU "), &state->cpu,     sizeof(state->cpu),    8 },
+        { chunk_id("CP0 "), &state->cp0,     sizeof(state->cp0),    8 },
+        { chunk_id("CP2 "), &state->cp2,     sizeof(state->cp2),    8 },
+        { chunk_id("HW  "), &state->hw,      sizeof(state->hw),     8 },
+        { chunk_id("CDRM"), &state->cdrom,   sizeof(state->cdrom),  8 },
+        { chunk_id("GPU "), &state->gpu,     sizeof(state->gpu),    8 },
+        { chunk_id("GP0 "), &state->gp0,     sizeof(state->gp0),    8 },
+        { chunk_id("SPAD"), state->dram,     sizeof(state->dram),   8 },
+        { chunk_id("RAM "), state->ram,      sizeof(state->ram),
+                            SNAPSHOT_PAGE_SIZE },
+        { chunk_id("VRAM"), state->vram,     sizeof(state->vram),
+                            SNAPSHOT_PAGE_SIZE },
+    };
+}
+
+static uint32_t event_id(void (*callback)()) {
+    for (auto const &event : event_ids) {
+        if (event.callback == callback) {
+            return event.id;
+        }
+    }
+    return 0;
+}
+
+static void (*event_callback(uint32_t id))() {
+    for (auto const &event : event_ids) {
+        if (event.id == id) {
+            return event.callback;
+        }
+    }
+    return NULL;
+}
+
+static void store_u64_le(uint8_t *ptr, uint64_t val) {
+    memory::store_u32_le(ptr, val);
+    memory::store_u32_le(ptr + 4, val >> 32);
+}
+
+static uint64_t load_u64_le(uint8_t const *ptr) {
+    return memory::load_u32_le(ptr) |
+        ((uint64_t)memory::load_u32_le(ptr + 4) << 32);
+}
+
+/// Snapshot images waiting to be written, written by a background thread
+/// so that the machine is paused only for the capture.
+struct image {
+    std::string path;
+    std::vector<uint8_t> data;
+};
+
+static std::mutex writer_mutex;
+static std::condition_variable writer_semaphore;
+static std::condition_variable writer_idle;
+static std::thread *writer_thread;
+static std::deque<image> pending;
+/// Images already written, reused by the next captures: touching fresh
+/// pages costs more than the copy itself.
+static std::vector<std::vector<uint8_t>> spare;
+static bool writer_busy;
+static bool writer_stopped;
+static bool writer_failed;
+static std::atomic<unsigned> tmp_sequence;
+
+static bool write_file(std::string const &path,
+                       std::vector<uint8_t> const &data) {
+    // Several machines of the process may save the same path.
+    std::string tmp_path = fmt::format("{}.tmp.{}.{}", path, getpid(),
+        tmp_sequence.fetch_add(1, std::memory_order_relaxed));
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint8_t const *ptr = data.data();
+    size_t size = data.size();
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        ptr += written;
+        size -= written;
+    }
+
+    bool ok = (close(fd) == 0) && size == 0;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void writer_routine(void) {
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    for (;;) {
+        writer_semaphore.wait(lock, [] {
+            return !pending.empty() || writer_stopped; });
+        if (pending.empty()) {
+            return;
+        }
+
+        image image = std::move(pending.front());
+        pending.pop_front();
+        writer_busy = true;
+        lock.unlock();
+        bool ok = write_file(image.path, image.data);
+        if (!ok) {
+            debugger::warn(Debugger::CPU,
+                "snapshot: cannot write '{}'", image.path);
+        }
+        lock.lock();
+        writer_failed |= !ok;
+        writer_busy = false;
+        spare.push_back(std::move(image.data));
+        writer_idle.notify_all();
+    }
+}
+
+int save(std::string const &path) {
+    uint8_t misc[MISC_SIZE];
+    size_t nr_events = 0;
+
+    store_u64_le(misc, state->cycles);
+    memory::store_u32_le(misc + 8, state->cpu_state);
+    memory::store_u32_le(misc + 12, state->jump_address);
+    memory::store_u32_le(misc + 16, state->delay_slot);
+
+    for (struct event *event = state->event_queue; event != NULL;
+         event = event->next, nr_events++) {
+        if (event_id(event->callback) == 0) {
+            debugger::warn(Debugger::CPU,
+                "snapshot: unregistered event callback, not saved");
+            return -1;
+        }
+    }
+
+    // The events are encoded in place, after the chunks are copied.
+    std::vector<chunk> chunks = state_chunks();
+    chunks.insert(chunks.end() - 2, {
+        { chunk_id("MISC"), misc, MISC_SIZE, 8 },
+        { chunk_id("EVTS"), NULL, nr_events * EVENT_SIZE, 8 },
+    });
+    size_t evts_index = chunks.size() - 3;
+
+    std::vector<uint64_t> offsets;
+    uint64_t offset = HEADER_SIZE + chunks.size() * DIRECTORY_ENTRY_SIZE;
+    for (chunk const &chunk : chunks) {
+        offset = (offset + chunk.alignment - 1) & ~(chunk.alignment - 1);
+        offsets.push_back(offset);
+        offset += chunk.size;
+    }
+
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        if (!spare.empty()) {
+            data = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+
+    // The image is reused: the padding is cleared explicitly.
+    data.resize(offset);
+    memset(data.data(), 0, offsets[0]);
+    memory::store_u32_le(data.data() + 0, SNAPSHOT_MAGIC);
+    memory::store_u32_le(data.data() + 4, SNAPSHOT_VERSION);
+    memory::store_u32_le(data.data() + 8, chunks.size());
+    for (size_t nr = 0; nr < chunks.size(); nr++) {
+        uint8_t *entry = data.data() + HEADER_SIZE +
+            nr * DIRECTORY_ENTRY_SIZE;
+        memory::store_u32_le(entry + 0, chunks[nr].id);
+        store_u64_le(entry + 8, offsets[nr]);
+        store_u64_le(entry + 16, chunks[nr].size);
+
+        uint64_t end = offsets[nr] + chunks[nr].size;
+        uint64_t next = nr + 1 < chunks.size() ? offsets[nr + 1] : end;
+        memset(data.data() + end, 0, next - end);
+        if (chunks[nr].ptr != NULL) {
+            memcpy(data.data() + offsets[nr], chunks[nr].ptr,
+                chunks[nr].size);
+        }
+    }
+
+    uint8_t *events = data.data() + offsets[evts_index];
+    for (struct event *event = state->event_queue; event != NULL;
+         event = event->next, events += EVENT_SIZE) {
+        memory::store_u32_le(events, event_id(event->callback));
+        memory::store_u32_le(events + 4, 0);
+        store_u64_le(events + 8, event->timeout);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        pending.push_back({ path, std::move(data) });
+        if (writer_thread == NULL) {
+            writer_stopped = false;
+            writer_thread = new std::thread(writer_routine);
+        }
+    }
+    writer_semaphore.notify_one();
+    return 0;
+}
+
+static void wait_writes(std::unique_lock<std::mutex> &lock) {
+    writer_idle.wait(lock, [] { return pending.empty() && !writer_busy; });
+}
+
+int flush(void) {
+    std::thread *thread;
+    bool failed;
+    {
+        std::unique_lock<std::mutex> lock(writer_mutex);
+        wait_writes(lock);
+        failed = writer_failed;
+        writer_failed = false;
+        writer_stopped = true;
+        thread = writer_thread;
+        writer_thread = NULL;
+    }
+    if (thread != NULL) {
+        writer_semaphore.notify_one();
+        thread->join();
+        delete thread;
+    }
+    return failed ? -1 : 0;
+}
+
+static bool read_at(int fd, void *ptr, size_t size, uint64_t offset) {
+    uint8_t *bytes = (uint8_t *)ptr;
+    while (size > 0) {
+        ssize_t nr_read = pread(fd, bytes, size, offset);
+        if (nr_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nr_read <= 0) {
+            return false;
+        }
+        bytes += nr_read;
+        size -= nr_read;
+        offset += nr_read;
+    }
+    return true;
+}
+
+int restore(std::string const &path) {
+    // A snapshot of the same path may still be queued.
+    {
+        std::unique_lock<std::mutex> lock(writer_mutex);
+        wait_writes(lock);
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    uint8_t header[HEADER_SIZE];
+    if (fstat(fd, &st) < 0 ||
+        !read_at(fd, header, sizeof(header), 0) ||
+        memory::load_u32_le(header + 0) != SNAPSHOT_MAGIC ||
+        memory::load_u32_le(header + 4) != SNAPSHOT_VERSION) {
+        close(fd);
+        return -1;
+    }
+
+    uint64_t size = st.st_size;
+    uint32_t nr_chunks = memory::load_u32_le(header + 8);
+    std::vector<uint8_t> directory;
+    std::vector<chunk> chunks = state_chunks();
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> registers;
+    std::vector<uint8_t> evts;
+    std::vector<std::pair<unsigned long, void (*)()>> events;
+    uint8_t misc[MISC_SIZE];
+    int ret = -1;
+
+    // Locate the chunk \p id, false if the chunk is missing
+    // or does not fit in the file.
+    auto find_chunk = [&](uint32_t id, uint64_t *offset, uint64_t *length) {
+        for (uint32_t nr = 0; nr < nr_chunks; nr++) {
+            uint8_t const *entry = directory.data() +
+                nr * DIRECTORY_ENTRY_SIZE;
+            if (memory::load_u32_le(entry) != id) {
+                continue;
+            }
+            *offset = load_u64_le(entry + 8);
+            *length = load_u64_le(entry + 16);
+            return *offset <= size && *length <= size - *offset;
+        }
+        return false;
+    };
+
+    if (nr_chunks > (size - HEADER_SIZE) / DIRECTORY_ENTRY_SIZE) {
+        goto done;
+    }
+    directory.resize(nr_chunks * DIRECTORY_ENTRY_SIZE);
+    if (!read_at(fd, directory.data(), directory.size(), HEADER_SIZE)) {
+        goto done;
+    }
+
+    // Validate the complete snapshot, and read all the chunks but the
+    // page aligned memory chunks, before modifying the machine state.
+    for (chunk const &chunk : chunks) {
+        uint64_t offset, length;
+        if (!find_chunk(chunk.id, &offset, &length) || length != chunk.size) {
+            goto done;
+        }
+        offsets.push_back(offset);
+        if (chunk.alignment < SNAPSHOT_PAGE_SIZE) {
+            size_t end = registers.size();
+            registers.resize(end + length);
+            if (!read_at(fd, registers.data() + end, length, offset)) {
+                goto done;
+            }
+        }
+    }
+
+    {
+        uint64_t misc_offset, misc_size, evts_offset, evts_size;
+        if (!find_chunk(chunk_id("MISC"), &misc_offset, &misc_size) ||
+            !find_chunk(chunk_id("EVTS"), &evts_offset, &evts_size) ||
+            misc_size != MISC_SIZE || evts_size % EVENT_SIZE != 0) {
+            goto done;
+        }
+        evts.resize(evts_size);
+        if (!read_at(fd, misc, MISC_SIZE, misc_offset) ||
+            !read_at(fd, evts.data(), evts_size, evts_offset) ||
+            memory::load_u32_le(misc + 8) > Jump) {
+            goto done;
+        }
+    }
+
+    for (size_t offset = 0; offset < evts.size(); offset += EVENT_SIZE) {
+        void (*callback)() = event_callback(
+            memory::load_u32_le(evts.data() + offset));
+        if (callback == NULL) {
+            goto done;
+        }
+        events.push_back({ load_u64_le(evts.data() + offset + 8), callback });
+    }
+
+    // The memory chunks are read in place. Snapshots are replaced by
+    // rename and never rewritten, the reads can only fail on I/O errors
+    // past this point.
+    state->cancel_all_events();
+    for (size_t nr = 0, end = 0; nr < chunks.size(); nr++) {
+        if (chunks[nr].alignment < SNAPSHOT_PAGE_SIZE) {
+            memcpy(chunks[nr].ptr, registers.data() + end, chunks[nr].size);
+            end += chunks[nr].size;
+        } else if (!read_at(fd, chunks[nr].ptr, chunks[nr].size,
+                            offsets[nr])) {
+            psx::halt(fmt::format("cannot read snapshot '{}'", path));
+            goto done;
+        }
+    }
+    state->mark_all_dirty();
+    state->cycles = load_u64_le(misc);
+    state->cpu_state = (enum cpu_state)memory::load_u32_le(misc + 8);
+    state->jump_address = memory::load_u32_le(misc + 12);
+    state->delay_slot = memory::load_u32_le(misc + 16) != 0;
+    for (auto const &event : events) {
+        state->schedule_event(event.first, event.second);
+    }
+    trace::resync();
+    hle::restore();
+    ret = 0;
+
+done:
+    close(fd);
+    return ret;
+}
+
+}; /* namespace psx::snapshot */
@@ -1,7 +1,15 @@
 
+#include <cstring>
+#include <istream>
+#include <memory>
 #include <mutex>
+#include <vector>
 
+#include <psx/boot.h>
+#include <psx/hle.h>
 #include <psx/debugger.h>
+#include <psx/disc.h>
+#include <psx/input.h>
 #include <psx/psx.h>
 #include <psx/hw.h>
 
@@ -12,43 +20,107 @@ using namespace psx;
 
 namespace psx {
 
-/// State declaration.
-struct state state;
+/// Contents of the BIOS region before an image is loaded.
+static const uint8_t empty_bios[BIOS_SIZE] = {};
 
-state::state() {
+/// Loaded BIOS images, shared between the machines of the process.
+static std::mutex bios_images_mutex;
+static std::vector<std::weak_ptr<uint8_t const>> bios_images;
+
+/**
+ * @brief Return a shared copy of the BIOS image \p contents.
+ *  Machines loading the same image share a single read-only copy.
+ */
+static std::shared_ptr<uint8_t const> share_bios_image(
+    std::vector<uint8_t> const &contents) {
+    std::lock_guard<std::mutex> lock(bios_images_mutex);
+    std::shared_ptr<uint8_t const> image;
+    for (auto it = bios_images.begin(); it != bios_images.end(); ) {
+        std::shared_ptr<uint8_t const> other = it->lock();
+        if (other == NULL) {
+            it = bios_images.erase(it);
+            continue;
+        }
+        if (memcmp(other.get(), contents.data(), BIOS_SIZE) == 0) {
+            image = other;
+        }
+        it++;
+    }
+
+    if (image == NULL) {
+        uint8_t *copy = new uint8_t[BIOS_SIZE];
+        memcpy(copy, contents.data(), BIOS_SIZE);
+        image = std::shared_ptr<uint8_t const>(copy,
+            std::default_delete<uint8_t const[]>());
+        bios_images.push_back(image);
+    }
+    return image;
+}
+
+/// The registers and memories are cleared: the state of a machine
+/// starts the same as the former static state.
+state::state()
+    : cpu(), cp0(), cp2(), hw(), cdrom(), gpu(), gp0(),
+      ram(), bios(empty_bios), dram(), vram(), cd_rom(NULL), cd_rom_size(0),
+      cycles(0), cpu_state(psx::Jump), jump_address(0), next_event(-1lu),
+      event_queue(NULL), delay_slot(false), ram_dirty(), vram_dirty() {
     bus = new psx::DefaultBus();
 }
 
 state::~state() {
+    cancel_all_events();
+    unload_cd_rom();
     delete bus;
 }
 
 int state::load_bios(std::istream &bios_contents) {
-    memset(bios, 0, sizeof(bios));
-    bios_contents.read((char *)bios, sizeof(bios));
-    return bios_contents.gcount() > 0 ? 0 : -1;
+    std::vector<uint8_t> contents(BIOS_SIZE, 0);
+    bios_contents.read((char *)contents.data(), BIOS_SIZE);
+    if (bios_contents.gcount() <= 0) {
+        return -1;
+    }
+    _bios_image = share_bios_image(contents);
+    bios = _bios_image.get();
+    return 0;
 }
 
-int state::load_cd_rom(std::istream &cd_rom_contents) {
-    if (cd_rom != NULL) {
-        delete cd_rom;
+/**
+ * @brief Load the disc image \p cd_rom_path.
+ * @details The image file is opened by the disc module, which parses
+ * CUE sheets and compressed containers. The memory viewer and the
+ * 0x1F000000 region show the raw sector data when the image is stored in
+ * a single uncompressed file, through the mapping of the disc module:
+ * pages are loaded on demand, and are shared through the page cache with
+ * every other process running the same image.
+ * @return 0 on success, -1 if the image cannot be opened.
+ */
+int state::load_cd_rom(std::string const &cd_rom_path) {
+    unload_cd_rom();
+    if (disc::open(cd_rom_path) < 0) {
+        return -1;
+    }
+    if (!disc::raw_image(&cd_rom, &cd_rom_size)) {
+        cd_rom = NULL;
+        cd_rom_size = 0;
     }
-
-    cd_rom_contents.seekg(0, cd_rom_contents.end);
-    cd_rom_size = cd_rom_contents.tellg();
-    cd_rom_contents.seekg(0, cd_rom_contents.beg);
-    cd_rom = new uint8_t[cd_rom_size];
-    cd_rom_contents.read((char *)cd_rom, cd_rom_size);
     return 0;
 }
 
+void state::unload_cd_rom(void) {
+    // The image mapping is owned by the disc module.
+    cd_rom = NULL;
+    cd_rom_size = 0;
+}
+
 void state::reset() {
     // Clear the machine state.
     memset(ram, 0, sizeof(ram));
     memset(dram, 0, sizeof(dram));
+    mark_all_dirty();
     cpu = (psx::cpu_registers){};
     cp0 = (psx::cp0_registers){};
     hw = (psx::hw_registers){};
+    cdrom = (psx::cdrom_registers){};
 
     cancel_all_events();
     hw::hblank_event();
@@ -61,11 +133,17 @@ void state::reset() {
     hw.dpcr     = UINT32_C(0x07654321);
     hw.joy_stat = UINT32_C(0x00000005);
     cdrom.index = UINT8_C(0x18);
+    cdrom.stat  = UINT8_C(0x02); // Spindle motor on
+    cdrom.mode  = UINT8_C(0x20);
 
     // Setup initial action.
     cycles = 0;
     cpu_state = psx::Jump;
     jump_address = cpu.pc;
+
+    hle::reset();
+    boot::reset();
+    input::reset();
 }
 
 void state::schedule_event(unsigned long timeout, void (*callback)()) {
@@ -142,29 +220,29 @@ void handle_counter_event() {
     // the Count register value will necessary be inexact.
 
 #if 0
-    unsigned long diff = (state.cycles - state.cp0.lastCounterUpdate) / 2;
-    uint32_t untilCompare = state.cp0.compare - state.cp0.count;
+    unsigned long diff = (state->cycles - state->cp0.lastCounterUpdate) / 2;
+    uint32_t untilCompare = state->cp0.compare - state->cp0.count;
 
     debugger::debug(Debugger::COP0, "counter event");
-    debugger::debug(Debugger::COP0, "  count:{}", state.cp0.count);
-    debugger::debug(Debugger::COP0, "  compare:{}", state.cp0.compare);
-    debugger::debug(Debugger::COP0, "  cycles:{}", state.cycles);
-    debugger::debug(Debugger::COP0, "  last_counter_update:{}", state.cp0.lastCounterUpdate);
+    debugger::debug(Debugger::COP0, "  count:{}", state->cp0.count);
+    debugger::debug(Debugger::COP0, "  compare:{}", state->cp0.compare);
+    debugger::debug(Debugger::COP0, "  cycles:{}", state->cycles);
+    debugger::debug(Debugger::COP0, "  last_counter_update:{}", state->cp0.lastCounterUpdate);
 
     if (diff >= untilCompare) {
-        state.cp0.cause |= CAUSE_IP7;
+        state->cp0.cause |= CAUSE_IP7;
         check_interrupt();
     } else {
         psx::halt("Spurious counter event");
     }
 
-    state.cp0.count = (uint32_t)((unsigned long)state.cp0.count + diff);
-    state.cp0.lastCounterUpdate = state.cycles;
-    untilCompare = state.cp0.compare - state.cp0.count - 1;
+    state->cp0.count = (uint32_t)((unsigned long)state->cp0.count + diff);
+    state->cp0.lastCounterUpdate = state->cycles;
+    untilCompare = state->cp0.compare - state->cp0.count - 1;
 
-    debugger::debug(Debugger::COP0, "  now:{}", state.cycles);
-    debugger::debug(Debugger::COP0, "  trig:{}", state.cycles + 2 * (unsigned long)untilCompare);
-    state.scheduleEvent(state.cycles + 2 * (unsigned long)untilCompare, handleCounterEvent);
+    debugger::debug(Debugger::COP0, "  now:{}", state->cycles);
+    debugger::debug(Debugger::COP0, "  trig:{}", state->cycles + 2 * (unsigned long)untilCompare);
+    state->scheduleEvent(state->cycles + 2 * (unsigned long)untilCompare, handleCounterEvent);
 #endif
 }
 
@@ -174,16 +252,16 @@ void handle_counter_event() {
  */
 void schedule_counter_event() {
 #if 0
-    unsigned long diff = (state.cycles - state.cp0.lastCounterUpdate) / 2;
-    state.cp0.count = (uint32_t)((unsigned long)state.cp0.count + diff);
-    state.cp0.lastCounterUpdate = state.cycles;
-    uint32_t untilCompare = state.cp0.compare - state.cp0.count;
+    unsigned long diff = (state->cycles - state->cp0.lastCounterUpdate) / 2;
+    state->cp0.count = (uint32_t)((unsigned long)state->cp0.count + diff);
+    state->cp0.lastCounterUpdate = state->cycles;
+    uint32_t untilCompare = state->cp0.compare - state->cp0.count;
 
     debugger::debug(Debugger::COP0, "scheduling counter event");
-    debugger::debug(Debugger::COP0, "  now:{}", state.cycles);
-    debugger::debug(Debugger::COP0, "  trig:{}", state.cycles + 2 * (unsigned long)untilCompare);
-    state.cancelEvent(handleCounterEvent);
-    state.scheduleEvent(state.cycles + 2 * (unsigned long)untilCompare, handleCounterEvent);
+    debugger::debug(Debugger::COP0, "  now:{}", state->cycles);
+    debugger::debug(Debugger::COP0, "  trig:{}", state->cycles + 2 * (unsigned long)untilCompare);
+    state->cancelEvent(handleCounterEvent);
+    state->scheduleEvent(state->cycles + 2 * (unsigned long)untilCompare, handleCounterEvent);
 #endif
 }
 
@@ -194,7 +272,7 @@ void schedule_counter_event() {
 void check_interrupt(void) {
     // For the interrupt to be taken, the interrupts must globally enabled
     // (IEc = 1) and the particular interrupt must be unmasked (IM[irq] = 1).
-    if (state.cp0.IEc() && (state.cp0.IM() & state.cp0.IP()) != 0) {
+    if (state->cp0.IEc() && (state->cp0.IM() & state->cp0.IP()) != 0) {
         // Arrange for the interrupt to be taken at the following instruction :
         // The present instruction which enabled the interrupt must
         // not be repeated.
@@ -205,20 +283,20 @@ void check_interrupt(void) {
         // 2. called from event handler. The result is the same, event
         //    handlers are always called before the instruction to execute
         //    is determined.
-        switch (state.cpu_state) {
+        switch (state->cpu_state) {
         case psx::Continue:
-            state.cpu.pc += 4;
-            state.delay_slot = false;
+            state->cpu.pc += 4;
+            state->delay_slot = false;
             break;
 
         case psx::Delay:
-            state.cpu.pc += 4;
-            state.delay_slot = true;
+            state->cpu.pc += 4;
+            state->delay_slot = true;
             break;
 
         case psx::Jump:
-            state.cpu.pc = state.jump_address;
-            state.delay_slot = false;
+            state->cpu.pc = state->jump_address;
+            state->delay_slot = false;
             break;
         }
 
@@ -235,13 +313,13 @@ void check_interrupt(void) {
  */
 void set_interrupt_pending(unsigned irq) {
     // Update the pending bits in the Cause register.
-    state.cp0.cause |= CAUSE_IP(1lu << irq);
+    state->cp0.cause |= CAUSE_IP(1lu << irq);
     check_interrupt();
 }
 
 void clear_interrupt_pending(unsigned irq) {
     // Update the pending bits in the Cause register.
-    state.cp0.cause &= ~CAUSE_IP(1lu << irq);
+    state->cp0.cause &= ~CAUSE_IP(1lu << irq);
 }
 
 /**
@@ -283,7 +361,7 @@ void take_exception(enum cpu_exception exn, uint32_t vaddr, bool instr,
         //      - reference the supervisor address space from User mode
         case AddressError:
             exccode = load ? 4 : 5; // AdEL : AdES
-            state.cp0.badvaddr = vaddr;
+            state->cp0.badvaddr = vaddr;
             debugger::error(Debugger::CPU,
                 "exception AddressError({:08x},{})",
                 vaddr, load);
@@ -376,34 +454,34 @@ void take_exception(enum cpu_exception exn, uint32_t vaddr, bool instr,
     }
 
     // Set Cause Register : EXCCode, CE
-    state.cp0.cause &= ~(CAUSE_EXCCODE_MASK | CAUSE_CE_MASK);
-    state.cp0.cause |= CAUSE_EXCCODE(exccode) | CAUSE_CE(ce);
+    state->cp0.cause &= ~(CAUSE_EXCCODE_MASK | CAUSE_CE_MASK);
+    state->cp0.cause |= CAUSE_EXCCODE(exccode) | CAUSE_CE(ce);
     // Swap processor mode and interrupt enable bits.
-    uint32_t ku_ie = state.cp0.sr & UINT32_C(0x3f);
-    state.cp0.sr &= ~UINT32_C(0x3f);
-    state.cp0.sr |= ku_ie << 2;
+    uint32_t ku_ie = state->cp0.sr & UINT32_C(0x3f);
+    state->cp0.sr &= ~UINT32_C(0x3f);
+    state->cp0.sr |= ku_ie << 2;
 
     // Check if the exception was caused by a delay slot instruction.
     // Set EPC and Cause:BD accordingly.
-    if (state.delay_slot) {
-        state.cp0.epc = state.cpu.pc - 4;
-        state.cp0.cause |= CAUSE_BD;
+    if (state->delay_slot) {
+        state->cp0.epc = state->cpu.pc - 4;
+        state->cp0.cause |= CAUSE_BD;
     } else {
-        state.cp0.epc = state.cpu.pc;
-        state.cp0.cause &= ~CAUSE_BD;
+        state->cp0.epc = state->cpu.pc;
+        state->cp0.cause &= ~CAUSE_BD;
     }
 
     // Check if exceuting bootstrap code
     // and jump to the designated handler.
     uint32_t pc;
-    if (state.cp0.BEV()) {
+    if (state->cp0.BEV()) {
         pc = UINT32_C(0xbfc00100) + vector;
     } else {
         pc = UINT32_C(0x80000000) + vector;
     }
 
-    state.cpu_state = psx::Jump;
-    state.jump_address = pc;
+    state->cpu_state = psx::Jump;
+    state->jump_address = pc;
 }
 
 #define KSEG2  UINT32_C(0xc0000000)
@@ -422,7 +500,7 @@ cpu_exception translate_address(
         *phys_addr  = virt_addr;
         vstart = 0;
         vend   = KSEG0 - 1;
-    } else if (state.cp0.KUc()) {
+    } else if (state->cp0.KUc()) {
         return cpu_exception::AddressError;
     } else if (virt_addr < KSEG1) {
         *phys_addr  = virt_addr - KSEG0;
@@ -0,0 +1,202 @@
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <lib/circular_buffer.h>
+#include <psx/timeline.h>
+
+namespace psx::timeline {
+
+std::atomic_bool active;
+
+struct event {
+    uint64_t start;
+    uint64_t end;           /**< Equal to start for instant events */
+    char const *category;
+    char const *name;
+    char const *arg_name;
+    uint64_t arg;
+};
+
+/// Number of events buffered per thread between two flushes.
+#define BUFFER_CAPACITY     (1u << 16)
+
+/**
+ * Per-thread event buffer. The recording thread is the producer of the
+ * event queue, the flusher thread its consumer.
+ */
+struct buffer {
+    unsigned tid;
+    char const *name;
+    std::atomic<uint64_t> dropped;
+    circular_buffer<event> events;
+
+    buffer(unsigned tid)
+        : tid(tid), name(NULL), dropped(0), events(BUFFER_CAPACITY) {}
+};
+
+static std::mutex buffers_mutex;
+static std::vector<std::unique_ptr<buffer>> buffers;
+static thread_local buffer *thread_buffer;
+static thread_local char const *thread_name;
+
+static FILE *trace_file;
+static bool first_event;
+static std::thread *flusher_thread;
+static std::mutex flusher_mutex;
+static std::condition_variable flusher_semaphore;
+static bool flusher_stopped;
+
+/// Interval between two flushes of the event buffers.
+static const std::chrono::milliseconds flush_interval(100);
+
+static const auto epoch = std::chrono::steady_clock::now();
+
+uint64_t timestamp(void) {
+    // Offset by one so that a valid time stamp is never 0.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+static buffer *get_thread_buffer(void) {
+    if (thread_buffer == NULL) {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.emplace_back(new buffer(buffers.size() + 1));
+        thread_buffer = buffers.back().get();
+        thread_buffer->name = thread_name;
+    }
+    return thread_buffer;
+}
+
+static void push(event const &event) {
+    buffer *buffer = get_thread_buffer();
+    if (!buffer->events.push(event)) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void set_thread_name(char const *name) {
+    // The buffer is allocated on the first recorded event.
+    thread_name = name;
+    if (thread_buffer != NULL) {
+        thread_buffer->name = name;
+    }
+}
+
+void complete(char const *category, char const *name, uint64_t start,
+              uint64_t end, char const *arg_name, uint64_t arg) {
+    push({ start, end, category, name, arg_name, arg });
+}
+
+void instant(char const *category, char const *name,
+             char const *arg_name, uint64_t arg) {
+    if (enabled()) {
+        uint64_t now = timestamp();
+        push({ now, now, category, name, arg_name, arg });
+    }
+}
+
+static void write_event(unsigned tid, event const &event) {
+    // Chrome trace time stamps are in microseconds.
+    std::string args = event.arg_name == NULL ? "" :
+        fmt::format(", \"args\": {{\"{}\": {}}}", event.arg_name, event.arg);
+    if (event.end == event.start) {
+        fmt::print(trace_file,
+            "{}{{\"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": {}, "
+            "\"ts\": {:.3f}, \"cat\": \"{}\", \"name\": \"{}\"{}}}",
+            first_event ? "" : ",\n", tid, event.start / 1e3,
+            event.category, event.name, args);
+    } else {
+        fmt::print(trace_file,
+            "{}{{\"ph\": \"X\", \"pid\": 1, \"tid\": {}, "
+            "\"ts\": {:.3f}, \"dur\": {:.3f}, \"cat\": \"{}\", "
+            "\"name\": \"{}\"{}}}",
+            first_event ? "" : ",\n", tid, event.start / 1e3,
+            (event.end - event.start) / 1e3,
+            event.category, event.name, args);
+    }
+    first_event = false;
+}
+
+/// Drain the event buffers to the trace file.
+static void flush(void) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto &buffer : buffers) {
+        // Events recorded during the flush wait for the next one.
+        event event;
+        for (size_t count = buffer->events.length();
+             count > 0 && buffer->events.pop(&event); count--) {
+            write_event(buffer->tid, event);
+        }
+    }
+    fflush(trace_file);
+}
+
+static void flusher_routine(void) {
+    std::unique_lock<std::mutex> lock(flusher_mutex);
+    while (!flusher_stopped) {
+        flusher_semaphore.wait_for(lock, flush_interval);
+        flush();
+    }
+}
+
+int open(std::string const &path) {
+    close();
+    trace_file = fopen(path.c_str(), "w");
+    if (trace_file == NULL) {
+        return -1;
+    }
+
+    fmt::print(trace_file, "{{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    first_event = true;
+    flusher_stopped = false;
+    flusher_thread = new std::thread(flusher_routine);
+    active.store(true, std::memory_order_release);
+    return 0;
+}
+
+void close(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    active.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex);
+        flusher_stopped = true;
+    }
+    flusher_semaphore.notify_one();
+    flusher_thread->join();
+    delete flusher_thread;
+    flusher_thread = NULL;
+
+    // Spans closed after the flusher exited, and thread names.
+    flush();
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto &buffer : buffers) {
+        if (buffer->name != NULL) {
+            fmt::print(trace_file,
+                "{}{{\"ph\": \"M\", \"pid\": 1, \"tid\": {}, "
+                "\"name\": \"thread_name\", \"args\": {{\"name\": \"{}\"}}}}",
+                first_event ? "" : ",\n", buffer->tid, buffer->name);
+            first_event = false;
+        }
+        uint64_t dropped = buffer->dropped.exchange(0);
+        if (dropped != 0) {
+            fmt::print("timeline: {} events dropped from thread {}\n",
+                dropped, buffer->name ? buffer->name : "?");
+        }
+    }
+    fmt::print(trace_file, "\n]}}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+}; /* namespace psx::timeline */
@@ -0,0 +1,212 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+#include <fmt/format.h>
+
+#include <lib/circular_buffer.h>
+#include <psx/timing.h>
+
+namespace psx::timing {
+
+std::atomic_bool active;
+
+static char const *subsystem_names[SubsystemCount] = {
+    "cpu", "gp0", "rasterizer", "display", "dma", "events", "gui",
+};
+
+/// Ticks accumulated per subsystem since the last frame end, updated
+/// from the interpreter and GUI threads.
+static std::atomic<uint64_t> ticks[SubsystemCount];
+
+/// Stack of the open scopes of the current thread. The time between two
+/// scope transitions is charged to the innermost open scope.
+#define MAX_SCOPE_DEPTH     16
+
+static thread_local unsigned scope_stack[MAX_SCOPE_DEPTH];
+static thread_local unsigned scope_depth;
+static thread_local uint64_t scope_timestamp;
+
+/// Time stamp of the last enable. Time elapsed while the timers were
+/// disabled is not charged to open scopes.
+static std::atomic<uint64_t> enable_timestamp;
+
+/// Tick rate calibration, against the steady clock.
+static uint64_t calibration_ticks;
+static std::chrono::steady_clock::time_point calibration_time;
+static double ns_per_tick = 1.0;
+
+/// Records of the most recent frames, for the GUI.
+#define HISTORY_LENGTH      300
+
+/// Logged by the interpreter thread, read by the GUI thread.
+static circular_buffer<frame_record> frame_history(HISTORY_LENGTH);
+
+/// Guards the totals and the frame record log.
+static std::mutex report_mutex;
+
+/// Frame record log.
+static FILE *log_file;
+static bool log_json;
+static unsigned long log_records;
+
+/// Totals for the final report.
+static uint64_t total_ns[SubsystemCount];
+static unsigned long total_frames;
+
+/// Charge the time elapsed since the last transition to the innermost
+/// open scope of the current thread.
+static void charge(uint64_t now) {
+    uint64_t start = std::max(scope_timestamp,
+        enable_timestamp.load(std::memory_order_relaxed));
+    if (enabled() && scope_depth > 0 && scope_depth <= MAX_SCOPE_DEPTH &&
+        now > start) {
+        ticks[scope_stack[scope_depth - 1]].fetch_add(
+            now - start, std::memory_order_relaxed);
+    }
+    scope_timestamp = now;
+}
+
+void enter(subsystem subsystem) {
+    charge(timestamp());
+    if (scope_depth < MAX_SCOPE_DEPTH) {
+        scope_stack[scope_depth] = subsystem;
+    }
+    scope_depth++;
+}
+
+void leave(void) {
+    charge(timestamp());
+    scope_depth--;
+}
+
+void set_enabled(bool enable) {
+    if (enable && !enabled()) {
+        for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+            ticks[nr].store(0, std::memory_order_relaxed);
+        }
+        calibration_ticks = timestamp();
+        calibration_time = std::chrono::steady_clock::now();
+        enable_timestamp.store(calibration_ticks, std::memory_order_relaxed);
+    }
+    active.store(enable, std::memory_order_release);
+}
+
+char const *subsystem_name(unsigned subsystem) {
+    return subsystem < SubsystemCount ? subsystem_names[subsystem] : "";
+}
+
+static void log_record(frame_record const &record) {
+    if (log_json) {
+        fmt::print(log_file, "{}  {{\"frame\": {}", log_records ? ",\n" : "",
+            record.frame);
+        for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+            fmt::print(log_file, ", \"{}_ns\": {}", subsystem_names[nr],
+                record.ns[nr]);
+        }
+        fmt::print(log_file, "}}");
+    } else {
+        fmt::print(log_file, "{}", record.frame);
+        for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+            fmt::print(log_file, ",{}", record.ns[nr]);
+        }
+        fmt::print(log_file, "\n");
+    }
+    log_records++;
+}
+
+void end_frame(uint32_t frame) {
+    if (!enabled()) {
+        return;
+    }
+
+    // Close the open scope of the interpreter thread, and refresh the
+    // tick rate calibration.
+    uint64_t now = timestamp();
+    charge(now);
+
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - calibration_time;
+    if (now > calibration_ticks) {
+        ns_per_tick = elapsed.count() / (now - calibration_ticks);
+    }
+
+    frame_record record;
+    record.frame = frame;
+    for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+        record.ns[nr] = ticks[nr].exchange(0, std::memory_order_relaxed) *
+            ns_per_tick;
+    }
+
+    frame_history.put(record);
+
+    std::lock_guard<std::mutex> lock(report_mutex);
+    for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+        total_ns[nr] += record.ns[nr];
+    }
+    total_frames++;
+    if (log_file != NULL) {
+        log_record(record);
+    }
+}
+
+std::vector<frame_record> history(void) {
+    return frame_history.snapshot(HISTORY_LENGTH);
+}
+
+int open_log(std::string const &path) {
+    close_log();
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(report_mutex);
+    log_file = file;
+    log_records = 0;
+    log_json = path.size() >= 5 &&
+        path.compare(path.size() - 5, 5, ".json") == 0;
+    if (log_json) {
+        fmt::print(log_file, "[\n");
+    } else {
+        fmt::print(log_file, "frame");
+        for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+            fmt::print(log_file, ",{}_ns", subsystem_names[nr]);
+        }
+        fmt::print(log_file, "\n");
+    }
+    return 0;
+}
+
+void close_log(void) {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    if (log_file != NULL) {
+        if (log_json) {
+            fmt::print(log_file, "\n]\n");
+        }
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+void print_report(void) {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    if (total_frames == 0) {
+        return;
+    }
+
+    uint64_t frame_ns = 0;
+    for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+        frame_ns += total_ns[nr];
+    }
+    fmt::print("timing: {} frames, {:.3f} ms per frame\n", total_frames,
+        frame_ns / 1e6 / total_frames);
+    for (unsigned nr = 0; nr < SubsystemCount; nr++) {
+        fmt::print("  {:<12} {:>8.3f} ms {:>6.2f}%\n", subsystem_names[nr],
+            total_ns[nr] / 1e6 / total_frames,
+            frame_ns ? 100.0 * total_ns[nr] / frame_ns : 0.0);
+    }
+}
+
+}; /* namespace psx::timing */
@@ -0,0 +1,284 @@
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <assembly/disassembler.h>
+#include <assembly/opcodes.h>
+#include <lib/circular_buffer.h>
+#include <psx/debugger.h>
+#include <psx/memory.h>
+#include <psx/psx.h>
+#include <psx/trace.h>
+
+using namespace psx;
+
+namespace psx::trace {
+
+/// Size of the records of a block before it is handed over to the writer.
+#define BLOCK_SIZE          65536
+/// Largest encoded record.
+#define MAX_RECORD_SIZE     24
+/// Blocks queued to the writer before the emulation thread waits.
+#define MAX_PENDING         64
+
+/// Execution trace of a machine.
+struct context {
+    FILE *file;
+    bool registers;
+
+    /// Block being encoded, header included.
+    std::vector<uint8_t> block;
+    size_t block_size;
+    uint32_t block_count;
+    uint32_t prev_pc;
+    uint64_t prev_cycles;
+    uint32_t cache_pc[TRACE_CACHE_SIZE];
+    uint32_t cache_instr[TRACE_CACHE_SIZE];
+
+    /// Blocks queued to the writer.
+    circular_buffer<std::vector<uint8_t>> pending;
+    /// Block buffers released by the writer, reused by the next blocks.
+    circular_buffer<std::vector<uint8_t>> spare;
+
+    /// The mutex only guards the waits: for blocks in the writer, for
+    /// room in the pending queue in the emulation thread.
+    std::mutex mutex;
+    std::condition_variable semaphore;
+    std::condition_variable idle;
+    std::thread *writer;
+    bool stopped;
+    bool failed;
+
+    context()
+        : file(NULL), registers(false), block_size(0), block_count(0),
+          prev_pc(0), prev_cycles(0), pending(MAX_PENDING),
+          spare(MAX_PENDING), writer(NULL), stopped(false),
+          failed(false) {}
+    ~context() {
+        stop_writer();
+    }
+
+    void stop_writer(void) {
+        if (writer == NULL) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        semaphore.notify_one();
+        writer->join();
+        delete writer;
+        writer = NULL;
+        fclose(file);
+        file = NULL;
+    }
+};
+
+std::shared_ptr<context> create_context(void) {
+    return std::make_shared<context>();
+}
+
+static void writer_routine(context *ctx) {
+    std::vector<uint8_t> block;
+    for (;;) {
+        if (!ctx->pending.pop(&block)) {
+            std::unique_lock<std::mutex> lock(ctx->mutex);
+            ctx->semaphore.wait(lock, [ctx] {
+                return !ctx->pending.empty() || ctx->stopped; });
+            if (ctx->pending.empty()) {
+                return;
+            }
+            continue;
+        }
+
+        if (fwrite(block.data(), block.size(), 1, ctx->file) != 1) {
+            ctx->failed = true;
+        }
+        // The buffer is dropped if the emulation thread did not
+        // reclaim the previous ones.
+        ctx->spare.push(std::move(block));
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        ctx->idle.notify_all();
+    }
+}
+
+/// Write the position preceding the current block, and the block
+/// flags \p flags to its header.
+static void store_block_origin(context *ctx, uint32_t flags) {
+    memory::store_u32_le(ctx->block.data() + 16, ctx->prev_pc);
+    memory::store_u32_le(ctx->block.data() + 8, ctx->prev_cycles);
+    memory::store_u32_le(ctx->block.data() + 12, ctx->prev_cycles >> 32);
+    memory::store_u32_le(ctx->block.data() + 20, flags);
+}
+
+/// Start a new block, following the last recorded instruction.
+static void start_block(context *ctx, uint32_t flags = 0) {
+    ctx->spare.pop(&ctx->block);
+    ctx->block.resize(TRACE_BLOCK_HEADER_SIZE + BLOCK_SIZE + MAX_RECORD_SIZE);
+    ctx->block_size = TRACE_BLOCK_HEADER_SIZE;
+    ctx->block_count = 0;
+    store_block_origin(ctx, flags);
+    // Entries are invalidated by an address that cannot be fetched.
+    memset(ctx->cache_pc, 0xff, sizeof(ctx->cache_pc));
+}
+
+/// Queue the current block to the writer.
+static void flush_block(context *ctx) {
+    memory::store_u32_le(ctx->block.data() + 0,
+        ctx->block_size - TRACE_BLOCK_HEADER_SIZE);
+    memory::store_u32_le(ctx->block.data() + 4, ctx->block_count);
+    ctx->block.resize(ctx->block_size);
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->idle.wait(lock, [ctx] { return !ctx->pending.full(); });
+    ctx->pending.push(std::move(ctx->block));
+    ctx->semaphore.notify_one();
+}
+
+int open(std::string const &path, bool registers) {
+    context *ctx = machine()->trace.get();
+    close();
+    ctx->file = fopen(path.c_str(), "wb");
+    if (ctx->file == NULL) {
+        return -1;
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    memory::store_u32_le(header + 0, TRACE_MAGIC);
+    memory::store_u32_le(header + 4, TRACE_VERSION);
+    memory::store_u32_le(header + 8, registers ? TRACE_REGISTERS : 0);
+    memory::store_u32_le(header + 12, 0);
+    fwrite(header, sizeof(header), 1, ctx->file);
+
+    ctx->registers = registers;
+    ctx->prev_pc = state->cpu.pc;
+    ctx->prev_cycles = state->cycles;
+    ctx->stopped = false;
+    ctx->failed = false;
+    start_block(ctx);
+    ctx->writer = new std::thread(writer_routine, ctx);
+    machine()->tracing = true;
+    return 0;
+}
+
+void close(void) {
+    context *ctx = machine()->trace.get();
+    if (ctx->writer == NULL) {
+        return;
+    }
+    machine()->tracing = false;
+    if (ctx->block_count > 0) {
+        flush_block(ctx);
+    }
+    ctx->stop_writer();
+    if (ctx->failed) {
+        debugger::warn(Debugger::CPU, "the execution trace is incomplete");
+    }
+    // Release the block buffers.
+    while (ctx->spare.pop(&ctx->block)) {}
+    ctx->block.clear();
+    ctx->block.shrink_to_fit();
+}
+
+/// Return the general purpose register written by \p instr, 0 if none.
+static unsigned written_register(uint32_t instr) {
+    using namespace psx::assembly;
+    switch (getOpcode(instr)) {
+    case SPECIAL:
+        switch (getFunct(instr)) {
+        case JR: case SYSCALL: case BREAK: case SYNC:
+        case MTHI: case MTLO: case MULT: case MULTU:
+        case DIV: case DIVU:
+            return 0;
+        default:
+            // Traps are the remaining functions without destination.
+            return getFunct(instr) >= TGE ? 0 : getRd(instr);
+        }
+    case REGIMM:
+        return (getRt(instr) & 0x10) ? 31 : 0;
+    case JAL:
+        return 31;
+    case ADDI: case ADDIU: case SLTI: case SLTIU:
+    case ANDI: case ORI: case XORI: case LUI:
+    case LB: case LH: case LWL: case LW:
+    case LBU: case LHU: case LWR:
+        return getRt(instr);
+    case COP0: case COP2:
+        return getFmt(instr) == MFCz || getFmt(instr) == CFCz ?
+            getRt(instr) : 0;
+    default:
+        return 0;
+    }
+}
+
+static inline uint8_t *put_varint(uint8_t *ptr, uint64_t val) {
+    while (val >= 0x80) {
+        *ptr++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *ptr++ = val;
+    return ptr;
+}
+
+void record(uint32_t pc, uint32_t instr) {
+    context *ctx = machine()->trace.get();
+    uint8_t *start = ctx->block.data() + ctx->block_size;
+    uint8_t *ptr = start;
+
+    int32_t pc_delta = pc - ctx->prev_pc - 4;
+    uint64_t cycles_delta = state->cycles - ctx->prev_cycles;
+    unsigned slot = (pc >> 2) % TRACE_CACHE_SIZE;
+    bool cached = ctx->cache_pc[slot] == pc && ctx->cache_instr[slot] == instr;
+    uint32_t zigzag = ((uint32_t)pc_delta << 1) ^ (uint32_t)(pc_delta >> 31);
+
+    ptr = put_varint(ptr, ((uint64_t)zigzag << 2) |
+        (cycles_delta != 1 ? 2 : 0) | (cached ? 0 : 1));
+    if (cycles_delta != 1) {
+        ptr = put_varint(ptr, cycles_delta);
+    }
+    if (!cached) {
+        memory::store_u32_le(ptr, instr);
+        ptr += 4;
+        ctx->cache_pc[slot] = pc;
+        ctx->cache_instr[slot] = instr;
+    }
+    if (ctx->registers) {
+        unsigned reg = written_register(instr);
+        *ptr++ = reg;
+        if (reg != 0) {
+            memory::store_u32_le(ptr, state->cpu.gpr[reg]);
+            ptr += 4;
+        }
+    }
+
+    ctx->block_size += ptr - start;
+    ctx->block_count++;
+    ctx->prev_pc = pc;
+    ctx->prev_cycles = state->cycles;
+    if (ctx->block_size >= TRACE_BLOCK_HEADER_SIZE + BLOCK_SIZE) {
+        flush_block(ctx);
+        start_block(ctx);
+    }
+}
+
+void resync(void) {
+    context *ctx = machine()->trace.get();
+    if (ctx->writer == NULL) {
+        return;
+    }
+    ctx->prev_pc = state->cpu.pc;
+    ctx->prev_cycles = state->cycles;
+    // An empty block is moved in place, its cache is still clear.
+    if (ctx->block_count == 0) {
+        store_block_origin(ctx, TRACE_BLOCK_RESYNC);
+        return;
+    }
+    flush_block(ctx);
+    start_block(ctx, TRACE_BLOCK_RESYNC);
+}
+
+}; /* namespace psx::trace */
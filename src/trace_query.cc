@@ -0,0 +1,329 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cxxopts.hpp>
+#include <fmt/format.h>
+
+#include <assembly/disassembler.h>
+#include <assembly/registers.h>
+#include <psx/memory.h>
+#include <psx/trace.h>
+
+/**
+ * @file
+ * @brief Query tool for the execution traces streamed with
+ *  `ps1 --trace FILE`, see \ref psx::trace for the file layout.
+ * @details
+ * The block headers are read first to build the trace index; only the
+ * blocks covering the query are decoded. Examples:
+ *
+ *      ps1-trace --info trace.bin
+ *      ps1-trace --cycle 1000000 -n 64 trace.bin
+ *      ps1-trace --pc 80010000 trace.bin
+ */
+
+using namespace psx;
+
+namespace {
+
+struct block {
+    /// Offset of the records in the trace file.
+    long offset;
+    uint32_t size;
+    uint32_t count;
+    /// Cycle counter and address of the instruction preceding the block.
+    uint64_t cycles;
+    uint32_t pc;
+    /// The block starts a new segment, see TRACE_BLOCK_RESYNC.
+    bool resync;
+};
+
+struct record {
+    uint64_t cycles;
+    uint32_t pc;
+    uint32_t instr;
+    /// Register written by the instruction, 0 if none or not traced.
+    unsigned reg;
+    uint32_t value;
+};
+
+struct trace_file {
+    FILE *file;
+    bool registers;
+    std::vector<block> blocks;
+};
+
+}; /* namespace */
+
+/// Read the file header and the block headers.
+/// A truncated last block is ignored.
+static bool read_index(trace_file *trace) {
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    if (fread(header, TRACE_HEADER_SIZE, 1, trace->file) != 1 ||
+        memory::load_u32_le(header + 0) != TRACE_MAGIC ||
+        memory::load_u32_le(header + 4) != TRACE_VERSION) {
+        return false;
+    }
+
+    trace->registers = memory::load_u32_le(header + 8) & TRACE_REGISTERS;
+    fseek(trace->file, 0, SEEK_END);
+    long file_size = ftell(trace->file);
+    long offset = TRACE_HEADER_SIZE;
+
+    while (offset + TRACE_BLOCK_HEADER_SIZE <= file_size) {
+        fseek(trace->file, offset, SEEK_SET);
+        if (fread(header, sizeof(header), 1, trace->file) != 1) {
+            break;
+        }
+        block block;
+        block.offset = offset + TRACE_BLOCK_HEADER_SIZE;
+        block.size = memory::load_u32_le(header + 0);
+        block.count = memory::load_u32_le(header + 4);
+        block.cycles = memory::load_u32_le(header + 8) |
+            ((uint64_t)memory::load_u32_le(header + 12) << 32);
+        block.pc = memory::load_u32_le(header + 16);
+        block.resync = memory::load_u32_le(header + 20) & TRACE_BLOCK_RESYNC;
+        if (block.offset + block.size > file_size) {
+            break;
+        }
+        trace->blocks.push_back(block);
+        offset = block.offset + block.size;
+    }
+    return true;
+}
+
+static bool get_varint(uint8_t const **ptr, uint8_t const *end,
+                       uint64_t *val) {
+    *val = 0;
+    for (unsigned shift = 0; shift < 64 && *ptr < end; shift += 7) {
+        uint8_t byte = *(*ptr)++;
+        *val |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Decode the records of a block, stopping when \p visit returns false.
+/// Returns false if the block is malformed or if the visit was stopped.
+static bool decode_block(trace_file const *trace, block const &block,
+                         std::function<bool(record const &)> const &visit) {
+    std::vector<uint8_t> buffer(block.size);
+    fseek(trace->file, block.offset, SEEK_SET);
+    if (block.size > 0 &&
+        fread(buffer.data(), block.size, 1, trace->file) != 1) {
+        return false;
+    }
+
+    uint32_t cache_pc[TRACE_CACHE_SIZE];
+    uint32_t cache_instr[TRACE_CACHE_SIZE];
+    std::fill(cache_pc, cache_pc + TRACE_CACHE_SIZE, UINT32_MAX);
+
+    uint8_t const *ptr = buffer.data();
+    uint8_t const *end = ptr + block.size;
+    record record = { block.cycles, block.pc, 0, 0, 0 };
+
+    for (uint32_t nr = 0; nr < block.count; nr++) {
+        uint64_t tag, cycles_delta = 1;
+        if (!get_varint(&ptr, end, &tag) ||
+            ((tag & 2) && !get_varint(&ptr, end, &cycles_delta))) {
+            return false;
+        }
+
+        uint32_t zigzag = tag >> 2;
+        uint32_t pc_delta = (zigzag >> 1) ^ -(zigzag & 1);
+        record.pc += pc_delta + 4;
+        record.cycles += cycles_delta;
+
+        unsigned slot = (record.pc >> 2) % TRACE_CACHE_SIZE;
+        if (tag & 1) {
+            if (end - ptr < 4) {
+                return false;
+            }
+            record.instr = memory::load_u32_le(ptr);
+            ptr += 4;
+            cache_pc[slot] = record.pc;
+            cache_instr[slot] = record.instr;
+        } else if (cache_pc[slot] == record.pc) {
+            record.instr = cache_instr[slot];
+        } else {
+            return false;
+        }
+
+        record.reg = 0;
+        if (trace->registers) {
+            if (ptr >= end) {
+                return false;
+            }
+            record.reg = *ptr++;
+            if (record.reg != 0) {
+                if (end - ptr < 4) {
+                    return false;
+                }
+                record.value = memory::load_u32_le(ptr);
+                ptr += 4;
+            }
+        }
+        if (!visit(record)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_record(record const &record) {
+    fmt::print("{:>12}  {:08x}  {:08x}  {}", record.cycles, record.pc,
+        record.instr, assembly::cpu::disassemble(record.pc, record.instr));
+    if (record.reg != 0) {
+        fmt::print("  ; {} = {:08x}",
+            assembly::cpu::getRegisterName(record.reg), record.value);
+    }
+    fmt::print("\n");
+}
+
+/// Split the blocks into segments of increasing cycles, delimited by
+/// the blocks starting after a restore of the machine.
+static std::vector<std::pair<size_t, size_t>> segments(
+        trace_file const *trace) {
+    std::vector<std::pair<size_t, size_t>> segments;
+    for (size_t nr = 0; nr < trace->blocks.size(); nr++) {
+        if (nr == 0 || trace->blocks[nr].resync) {
+            segments.push_back({ nr, nr + 1 });
+        } else {
+            segments.back().second = nr + 1;
+        }
+    }
+    return segments;
+}
+
+static void print_info(trace_file const *trace) {
+    uint64_t instructions = 0, bytes = 0;
+    for (block const &block : trace->blocks) {
+        instructions += block.count;
+        bytes += block.size + TRACE_BLOCK_HEADER_SIZE;
+    }
+    fmt::print("blocks:          {}\n", trace->blocks.size());
+    fmt::print("segments:        {}\n", segments(trace).size());
+    fmt::print("instructions:    {}\n", instructions);
+    fmt::print("registers:       {}\n", trace->registers ? "yes" : "no");
+    if (!trace->blocks.empty()) {
+        // The last cycle is only found by decoding the last block.
+        uint64_t last = trace->blocks.back().cycles;
+        decode_block(trace, trace->blocks.back(), [&last](record const &record) {
+            last = record.cycles;
+            return true;
+        });
+        fmt::print("cycles:          {} - {}\n",
+            trace->blocks.front().cycles + 1, last);
+    }
+    if (instructions > 0) {
+        fmt::print("bytes per instr: {:.2f}\n",
+            (double)bytes / instructions);
+    }
+}
+
+int main(int argc, char **argv) {
+    cxxopts::Options options("ps1-trace", "Query PS1 execution traces");
+    options.add_options()
+        ("trace",       "Execution trace", cxxopts::value<std::string>())
+        ("c,cycle",     "Print the instructions executed from this cycle", cxxopts::value<uint64_t>())
+        ("p,pc",        "Print the executions of the instruction at this address (hex)", cxxopts::value<std::string>())
+        ("n,count",     "Number of instructions printed", cxxopts::value<unsigned>()->default_value("32"))
+        ("i,info",      "Print the trace summary")
+        ("h,help",      "Print usage");
+    options.parse_positional({"trace"});
+    options.positional_help("TRACE");
+
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help") || result.count("trace") == 0) {
+        std::cout << options.help() << std::endl;
+        exit(result.count("help") ? 0 : 1);
+    }
+
+    std::string trace_path = result["trace"].as<std::string>();
+    unsigned count = result["count"].as<unsigned>();
+    trace_file trace;
+    trace.file = fopen(trace_path.c_str(), "rb");
+    if (trace.file == NULL || !read_index(&trace)) {
+        fmt::print("Cannot read the execution trace '{}'\n", trace_path);
+        exit(1);
+    }
+
+    if (result.count("info")) {
+        print_info(&trace);
+    }
+
+    if (result.count("pc")) {
+        std::string pc_value = result["pc"].as<std::string>();
+        char *end;
+        uint32_t pc = strtoul(pc_value.c_str(), &end, 16);
+        if (pc_value.empty() || *end != '\0') {
+            fmt::print("Invalid address '{}'\n", pc_value);
+            exit(1);
+        }
+        // Executions are printed from the --cycle position, if any.
+        uint64_t cycles = result.count("cycle") ?
+            result["cycle"].as<uint64_t>() : 0;
+        unsigned printed = 0;
+        for (block const &block : trace.blocks) {
+            if (printed >= count) {
+                break;
+            }
+            decode_block(&trace, block, [&](record const &record) {
+                if (record.pc == pc && record.cycles >= cycles) {
+                    print_record(record);
+                    printed++;
+                }
+                return printed < count;
+            });
+        }
+    } else if (result.count("cycle")) {
+        // The cycle may be executed once in every segment: the segments
+        // are searched separately. Locate the first block including the
+        // cycle, the block headers hold the cycle counter of the last
+        // instruction of the previous block.
+        uint64_t cycles = result["cycle"].as<uint64_t>();
+        auto all = segments(&trace);
+        for (auto const &segment : all) {
+            auto begin = trace.blocks.begin() + segment.first;
+            auto end = trace.blocks.begin() + segment.second;
+            if (segment.first != 0 && begin->cycles >= cycles) {
+                continue;
+            }
+            auto it = std::upper_bound(begin, end, cycles,
+                [](uint64_t cycles, block const &block) {
+                    return cycles <= block.cycles; });
+            if (it != begin) {
+                it--;
+            }
+            unsigned printed = 0;
+            for (; it != end && printed < count; it++) {
+                decode_block(&trace, *it, [&](record const &record) {
+                    if (record.cycles < cycles) {
+                        return true;
+                    }
+                    if (printed == 0 && all.size() > 1) {
+                        fmt::print("segment from cycle {}:\n",
+                            begin->cycles + 1);
+                    }
+                    print_record(record);
+                    printed++;
+                    return printed < count;
+                });
+            }
+        }
+    } else if (!result.count("info")) {
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+
+    fclose(trace.file);
+    return 0;
+}